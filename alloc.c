@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "alloc.h"
+
+#define POOL_CHUNK_BLOCKS 1024
+#define POOL_ALIGNMENT 16
+
+/***
+ * Allocation helpers
+*/
+
+void* allocMemory(Allocator* allocator, size_t size) {
+    return allocator->allocate(allocator, size);
+}
+
+void* reallocMemory(Allocator* allocator, void* ptr, size_t oldSize, size_t newSize) {
+    if (ptr == NULL) {
+        return allocator->allocate(allocator, newSize);
+    }
+    return allocator->reallocate(allocator, ptr, oldSize, newSize);
+}
+
+void releaseMemory(Allocator* allocator, void* ptr, size_t size) {
+    if (ptr != NULL) {
+        allocator->release(allocator, ptr, size);
+    }
+}
+
+char* allocStringN(Allocator* allocator, const char* value, size_t length) {
+    if (value == NULL) {
+        return NULL;
+    }
+    char* copy = allocator->allocate(allocator, length + 1);
+    if (copy != NULL) {
+        memcpy(copy, value, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+char* allocString(Allocator* allocator, const char* value) {
+    if (value == NULL) {
+        return NULL;
+    }
+    return allocStringN(allocator, value, strlen(value));
+}
+
+void releaseString(Allocator* allocator, char* value) {
+    if (value != NULL) {
+        allocator->release(allocator, value, strlen(value) + 1);
+    }
+}
+
+void destroyAllocator(Allocator* allocator) {
+    if (allocator != NULL && allocator->destroy != NULL) {
+        allocator->destroy(allocator);
+    }
+}
+
+/***
+ * System allocator: plain malloc/realloc/free
+*/
+
+static void* systemAllocate(Allocator* self, size_t size) {
+    (void)self;
+    return malloc(size);
+}
+
+static void* systemReallocate(Allocator* self, void* ptr, size_t oldSize, size_t newSize) {
+    (void)self;
+    (void)oldSize;
+    return realloc(ptr, newSize);
+}
+
+static void systemRelease(Allocator* self, void* ptr, size_t size) {
+    (void)self;
+    (void)size;
+    free(ptr);
+}
+
+static Allocator systemAllocatorInstance = {
+    systemAllocate,
+    systemReallocate,
+    systemRelease,
+    NULL // The system allocator is never destroyed
+};
+
+Allocator* systemAllocator() {
+    return &systemAllocatorInstance;
+}
+
+/***
+ * Pool allocator: fixed-size blocks carved out of large chunks.
+ * Requests between half a block and a block (tokens, AST nodes) come from
+ * the pool; everything else is passed to the parent allocator.
+*/
+
+struct PoolChunk {
+    struct PoolChunk* next;
+};
+
+struct FreeBlock {
+    struct FreeBlock* next;
+};
+
+struct PoolAllocator {
+    Allocator base;
+    Allocator* parent;
+    size_t blockSize;
+    struct PoolChunk* chunks;
+    struct FreeBlock* freeList;
+};
+
+static int poolServes(const struct PoolAllocator* pool, size_t size) {
+    return size <= pool->blockSize && size * 2 > pool->blockSize;
+}
+
+static size_t poolChunkSize(const struct PoolAllocator* pool) {
+    return POOL_ALIGNMENT + pool->blockSize * POOL_CHUNK_BLOCKS;
+}
+
+static int growPool(struct PoolAllocator* pool) {
+    struct PoolChunk* chunk = allocMemory(pool->parent, poolChunkSize(pool));
+    if (chunk == NULL) {
+        return 0;
+    }
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    // Thread the new blocks onto the free list
+    char* blocks = (char*)chunk + POOL_ALIGNMENT;
+    for (int i = POOL_CHUNK_BLOCKS - 1; i >= 0; i--) {
+        struct FreeBlock* block = (struct FreeBlock*)(blocks + (size_t)i * pool->blockSize);
+        block->next = pool->freeList;
+        pool->freeList = block;
+    }
+    return 1;
+}
+
+static void* poolAllocate(Allocator* self, size_t size) {
+    struct PoolAllocator* pool = (struct PoolAllocator*)self;
+    if (!poolServes(pool, size)) {
+        return allocMemory(pool->parent, size);
+    }
+    if (pool->freeList == NULL && !growPool(pool)) {
+        return NULL;
+    }
+    struct FreeBlock* block = pool->freeList;
+    pool->freeList = block->next;
+    return block;
+}
+
+static void poolRelease(Allocator* self, void* ptr, size_t size) {
+    struct PoolAllocator* pool = (struct PoolAllocator*)self;
+    if (!poolServes(pool, size)) {
+        releaseMemory(pool->parent, ptr, size);
+        return;
+    }
+    struct FreeBlock* block = ptr;
+    block->next = pool->freeList;
+    pool->freeList = block;
+}
+
+static void* poolReallocate(Allocator* self, void* ptr, size_t oldSize, size_t newSize) {
+    struct PoolAllocator* pool = (struct PoolAllocator*)self;
+    if (!poolServes(pool, oldSize) && !poolServes(pool, newSize)) {
+        return reallocMemory(pool->parent, ptr, oldSize, newSize);
+    }
+    if (poolServes(pool, oldSize) && poolServes(pool, newSize)) {
+        return ptr; // Still fits in the same block
+    }
+
+    void* resized = poolAllocate(self, newSize);
+    if (resized == NULL) {
+        return NULL;
+    }
+    memcpy(resized, ptr, oldSize < newSize ? oldSize : newSize);
+    poolRelease(self, ptr, oldSize);
+    return resized;
+}
+
+static void poolDestroy(Allocator* self) {
+    struct PoolAllocator* pool = (struct PoolAllocator*)self;
+    while (pool->chunks != NULL) {
+        struct PoolChunk* next = pool->chunks->next;
+        releaseMemory(pool->parent, pool->chunks, poolChunkSize(pool));
+        pool->chunks = next;
+    }
+    free(pool);
+}
+
+Allocator* createPoolAllocator(Allocator* parent, size_t blockSize) {
+    struct PoolAllocator* pool = malloc(sizeof(struct PoolAllocator));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    if (blockSize < sizeof(struct FreeBlock)) {
+        blockSize = sizeof(struct FreeBlock);
+    }
+    pool->base.allocate = poolAllocate;
+    pool->base.reallocate = poolReallocate;
+    pool->base.release = poolRelease;
+    pool->base.destroy = poolDestroy;
+    pool->parent = (parent != NULL) ? parent : systemAllocator();
+    pool->blockSize = (blockSize + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+    pool->chunks = NULL;
+    pool->freeList = NULL;
+    return &pool->base;
+}
+
+/***
+ * Tracking allocator: forwards to its parent and keeps per-subsystem counters
+*/
+
+struct TrackingAllocator {
+    Allocator base;
+    Allocator* parent;
+    struct AllocStats stats;
+};
+
+static void trackAdd(struct TrackingAllocator* tracker, size_t size) {
+    tracker->stats.bytes += size;
+    if (tracker->stats.bytes > tracker->stats.peakBytes) {
+        tracker->stats.peakBytes = tracker->stats.bytes;
+    }
+}
+
+static void* trackingAllocate(Allocator* self, size_t size) {
+    struct TrackingAllocator* tracker = (struct TrackingAllocator*)self;
+    void* ptr = allocMemory(tracker->parent, size);
+    if (ptr != NULL) {
+        trackAdd(tracker, size);
+        tracker->stats.liveObjects++;
+        tracker->stats.totalAllocations++;
+    }
+    return ptr;
+}
+
+static void* trackingReallocate(Allocator* self, void* ptr, size_t oldSize, size_t newSize) {
+    struct TrackingAllocator* tracker = (struct TrackingAllocator*)self;
+    void* resized = reallocMemory(tracker->parent, ptr, oldSize, newSize);
+    if (resized != NULL) {
+        tracker->stats.bytes -= oldSize;
+        trackAdd(tracker, newSize);
+    }
+    return resized;
+}
+
+static void trackingRelease(Allocator* self, void* ptr, size_t size) {
+    struct TrackingAllocator* tracker = (struct TrackingAllocator*)self;
+    releaseMemory(tracker->parent, ptr, size);
+    tracker->stats.bytes -= size;
+    tracker->stats.liveObjects--;
+}
+
+static void trackingDestroy(Allocator* self) {
+    free(self);
+}
+
+Allocator* createTrackingAllocator(Allocator* parent, const char* name) {
+    struct TrackingAllocator* tracker = malloc(sizeof(struct TrackingAllocator));
+    if (tracker == NULL) {
+        return NULL;
+    }
+
+    tracker->base.allocate = trackingAllocate;
+    tracker->base.reallocate = trackingReallocate;
+    tracker->base.release = trackingRelease;
+    tracker->base.destroy = trackingDestroy;
+    tracker->parent = (parent != NULL) ? parent : systemAllocator();
+    memset(&tracker->stats, 0, sizeof(tracker->stats));
+    tracker->stats.name = name;
+    return &tracker->base;
+}
+
+const struct AllocStats* trackingAllocatorStats(const Allocator* allocator) {
+    if (allocator == NULL || allocator->allocate != trackingAllocate) {
+        return NULL;
+    }
+    return &((const struct TrackingAllocator*)allocator)->stats;
+}
+
+void printAllocatorStats(const Allocator* allocator) {
+    const struct AllocStats* stats = trackingAllocatorStats(allocator);
+    if (stats == NULL) {
+        return;
+    }
+    printf("Memory [%s]: %zu bytes live, %zu bytes peak, %ld live objects, %ld allocations\n",
+        stats->name, stats->bytes, stats->peakBytes, stats->liveObjects, stats->totalAllocations);
+}
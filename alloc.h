@@ -0,0 +1,43 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+// Allocator interface. Sizes are passed back on reallocate/release so
+// fixed-size pools and accounting wrappers need no per-block headers.
+typedef struct Allocator Allocator;
+struct Allocator {
+    void* (*allocate)(Allocator* self, size_t size);
+    void* (*reallocate)(Allocator* self, void* ptr, size_t oldSize, size_t newSize);
+    void (*release)(Allocator* self, void* ptr, size_t size);
+    void (*destroy)(Allocator* self);
+};
+
+// Counters kept by a tracking allocator
+struct AllocStats {
+    const char* name;       // Subsystem the allocator was created for
+    size_t bytes;           // Bytes currently allocated
+    size_t peakBytes;       // Highest value bytes has reached
+    long liveObjects;       // Allocations not yet released
+    long totalAllocations;  // Allocations made over the allocator's lifetime
+};
+
+// Function prototypes for allocating through an allocator
+void* allocMemory(Allocator* allocator, size_t size);
+void* reallocMemory(Allocator* allocator, void* ptr, size_t oldSize, size_t newSize);
+void releaseMemory(Allocator* allocator, void* ptr, size_t size);
+char* allocString(Allocator* allocator, const char* value);
+char* allocStringN(Allocator* allocator, const char* value, size_t length);
+void releaseString(Allocator* allocator, char* value);
+
+// Built-in allocators
+Allocator* systemAllocator();
+Allocator* createPoolAllocator(Allocator* parent, size_t blockSize);
+Allocator* createTrackingAllocator(Allocator* parent, const char* name);
+void destroyAllocator(Allocator* allocator);
+
+// Accounting for tracking allocators (NULL for other allocators)
+const struct AllocStats* trackingAllocatorStats(const Allocator* allocator);
+void printAllocatorStats(const Allocator* allocator);
+
+#endif // ALLOC_H
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <string.h>
+#include "calendar.h"
+#include "semantic.h"
+
+/***
+ * Date helpers (proleptic Gregorian calendar)
+*/
+
+// Days since 1970-01-01
+static long daysFromCivil(int year, int month, int day) {
+    year -= (month <= 2) ? 1 : 0;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yearOfEra = year - era * 400;
+    long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static CalendarDate civilFromDays(long days) {
+    days += 719468;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long dayOfEra = days - era * 146097;
+    long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    long monthIndex = (5 * dayOfYear + 2) / 153;
+
+    CalendarDate date;
+    date.day = (int)(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    date.month = (int)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    date.year = (int)(yearOfEra + era * 400 + (date.month <= 2 ? 1 : 0));
+    return date;
+}
+
+// Monday = 0 ... Sunday = 6 (1970-01-01 was a Thursday)
+static int weekdayFromDays(long days) {
+    return (int)(((days % 7) + 7 + 3) % 7);
+}
+
+// Weekday of a plan day name, or -1 for a name that is not a weekday
+int weekdayFromName(const char* name) {
+    switch (name[0]) {
+        case 'M':
+            return strcmp(name, "Monday") == 0 ? 0 : -1;
+        case 'T':
+            if (strcmp(name, "Tuesday") == 0) {
+                return 1;
+            }
+            return strcmp(name, "Thursday") == 0 ? 3 : -1;
+        case 'W':
+            return strcmp(name, "Wednesday") == 0 ? 2 : -1;
+        case 'F':
+            return strcmp(name, "Friday") == 0 ? 4 : -1;
+        case 'S':
+            if (strcmp(name, "Saturday") == 0) {
+                return 5;
+            }
+            return strcmp(name, "Sunday") == 0 ? 6 : -1;
+        default:
+            return -1;
+    }
+}
+
+// Weekdays on which any of the client's plans has exercises
+static unsigned char trainingDays(const Environment* env, const ClientRecord* client) {
+    unsigned char weekdays = 0;
+    size_t order = 0;
+    for (ASTNode* plan = clientPlanFrom(env, client, 0, &order); plan != NULL;
+         plan = clientPlanFrom(env, client, order + 1, &order)) {
+        for (int j = 0; j < plan->childrenCount; j++) {
+            int weekday = weekdayFromName(plan->children[j]->data.day.name);
+            if (weekday >= 0 && plan->children[j]->childrenCount > 0) {
+                weekdays |= 1 << weekday;
+            }
+        }
+    }
+    return weekdays;
+}
+
+/***
+ * Calendar functions
+*/
+
+// Parse YYYY-MM-DD
+bool parseCalendarDate(const char* text, CalendarDate* date) {
+    int year, month, day;
+    char extra;
+    if (sscanf(text, "%4d-%2d-%2d%c", &year, &month, &day, &extra) != 3 || month < 1 || month > 12 || day < 1) {
+        return false;
+    }
+    // Reject days past the end of the month
+    CalendarDate check = civilFromDays(daysFromCivil(year, month, day));
+    if (check.month != month || check.day != day) {
+        return false;
+    }
+    date->year = year;
+    date->month = month;
+    date->day = day;
+    return true;
+}
+
+void calendarBegin(CalendarCursor* cursor, const Environment* env, CalendarDate start, int weeks) {
+    cursor->env = env;
+    cursor->firstDay = daysFromCivil(start.year, start.month, start.day);
+    cursor->dayCount = (weeks > 0) ? (long)weeks * 7 : 0;
+    cursor->client = 0;
+    cursor->clientStarted = false;
+    cursor->weekdays = 0;
+    cursor->day = 0;
+    cursor->plan = 0;
+    cursor->planDay = 0;
+    cursor->exercise = 0;
+}
+
+// Produce the next session, ordered by client, then date, then plan order
+bool calendarNext(CalendarCursor* cursor, CalendarSession* session) {
+    const Environment* env = cursor->env;
+
+    while (cursor->client < env->clientCount) {
+        const ClientRecord* client = &env->clients[cursor->client];
+        if (!cursor->clientStarted) {
+            cursor->weekdays = trainingDays(env, client);
+            cursor->clientStarted = true;
+        }
+
+        while (cursor->day < cursor->dayCount) {
+            int weekday = weekdayFromDays(cursor->firstDay + cursor->day);
+            // Rest days are skipped without looking at the plans
+            size_t order;
+            ASTNode* plan;
+            while ((cursor->weekdays & (1 << weekday)) && (plan = clientPlanFrom(env, client, cursor->plan, &order)) != NULL) {
+                cursor->plan = order;
+                while (cursor->planDay < plan->childrenCount) {
+                    ASTNode* day = plan->children[cursor->planDay];
+                    if (cursor->exercise < day->childrenCount && weekdayFromName(day->data.day.name) == weekday) {
+                        ASTNode* exercise = day->children[cursor->exercise++];
+                        session->client = client->name;
+                        session->date = civilFromDays(cursor->firstDay + cursor->day);
+                        session->plan = plan->data.plan.name;
+                        session->exercise = exercise->data.exercise.name;
+                        session->sets = exercise->data.exercise.sets;
+                        session->rest = exercise->data.exercise.rest;
+                        return true;
+                    }
+                    cursor->planDay++;
+                    cursor->exercise = 0;
+                }
+                cursor->plan = order + 1;
+                cursor->planDay = 0;
+            }
+            cursor->day++;
+            cursor->plan = 0;
+        }
+
+        cursor->client++;
+        cursor->clientStarted = false;
+        cursor->day = 0;
+    }
+    return false;
+}
+
+int expandCalendar(const Environment* env, CalendarDate start, int weeks, OutputWriter writer, void* writerData) {
+    CalendarCursor cursor;
+    CalendarSession session;
+    calendarBegin(&cursor, env, start, weeks);
+
+    while (calendarNext(&cursor, &session)) {
+        if (writeFormatted(env->allocator, writer, writerData, "%s,%04d-%02d-%02d,%s,%d,%d\n",
+                session.client, session.date.year, session.date.month, session.date.day,
+                session.exercise, session.sets, session.rest) != 0) {
+            return RUNTIME_ERROR;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+#include <stdbool.h>
+#include "interpreter.h"
+
+// Calendar expansion: turns each client's weekly plan templates into dated
+// sessions. A cursor walks clients, dates, plans, days and exercises one
+// session at a time, so nothing is materialized and memory use does not
+// depend on the number of clients or weeks.
+
+typedef struct {
+    int year;
+    int month;  // 1-12
+    int day;    // 1-31
+} CalendarDate;
+
+// One dated session produced by the cursor; strings point into the environment
+typedef struct {
+    const char* client;
+    CalendarDate date;
+    const char* plan;
+    const char* exercise;
+    int sets;
+    int rest;
+} CalendarSession;
+
+// Cursor state; positions are resumed on the next call
+typedef struct {
+    const Environment* env;
+    long firstDay;          // Start date as days since 1970-01-01
+    long dayCount;          // Days in the horizon
+    int client;             // Position in env->clients
+    bool clientStarted;     // weekdays has been computed for the current client
+    unsigned char weekdays; // Bit per weekday (Monday = bit 0) on which the client trains
+    long day;               // Offset from firstDay
+    size_t plan;            // Least assignment order of the next plan (see clientPlanFrom)
+    int planDay;
+    int exercise;
+} CalendarCursor;
+
+// Function prototypes for calendar expansion
+bool parseCalendarDate(const char* text, CalendarDate* date);
+void calendarBegin(CalendarCursor* cursor, const Environment* env, CalendarDate start, int weeks);
+bool calendarNext(CalendarCursor* cursor, CalendarSession* session);
+
+// Weekday of a plan day name (Monday = 0 ... Sunday = 6), or -1 for a name that is not a weekday
+int weekdayFromName(const char* name);
+
+// Stream every session as "client,YYYY-MM-DD,exercise,sets,rest" lines; returns 0 on success
+int expandCalendar(const Environment* env, CalendarDate start, int weeks, OutputWriter writer, void* writerData);
+
+#endif // CALENDAR_H
@@ -0,0 +1,832 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "catalog.h"
+
+#define CATALOG_MAGIC "FLCATLG1"
+#define CATALOG_VERSION 1
+#define CATALOG_LINE_SIZE 1024
+#define FNV_OFFSET 1469598103934665603UL
+#define FNV_PRIME 1099511628211UL
+
+// File layout: the header, then the arc, word ID and name offset arrays, then
+// the canonical names. Integers are kept in host byte order: a compiled
+// catalog is local to the machine that built it.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t stateCount;     // Automaton states, for statistics
+    uint32_t arcCount;
+    uint32_t wordCount;      // Names accepted (canonical names and aliases)
+    uint32_t exerciseCount;  // Canonical names
+    uint32_t namesSize;      // Bytes of NUL-terminated canonical names
+} CatalogHeader;
+
+// There is no state table: a state is the index of its first arc, and its arcs
+// follow in label order up to one marked ARC_LAST. States are laid out depth
+// first, so following a name mostly moves forward through memory and each
+// character costs about one cache line. The start state is at 0.
+typedef struct {
+    uint32_t target;         // Target state, with ARC_FINAL and ARC_LAST in the top bits
+    uint32_t labelBefore;    // Label in the top 8 bits; below, the names that sort before
+                             // those reached through this arc, counted from its state
+} CatalogArc;
+
+#define ARC_FINAL 0x80000000u    // A name may end at the target
+#define ARC_LAST 0x40000000u     // Last arc of its state
+#define ARC_TARGET_MASK 0x3fffffffu
+#define NO_STATE ARC_TARGET_MASK // Target of arcs into the state without arcs
+#define ARC_LABEL(arc) ((arc)->labelBefore >> 24)
+#define ARC_BEFORE(arc) ((arc)->labelBefore & 0xffffffu)
+#define MAX_ARCS (NO_STATE - 1)
+#define MAX_WORDS 0x1000000
+
+struct Catalog {
+    Allocator* allocator;
+    void* mapping;
+    size_t mappingSize;
+    const CatalogHeader* header;
+    const CatalogArc* arcs;
+    const uint32_t* wordIds;     // Lexicographic name index to canonical ID
+    const uint32_t* nameOffsets; // Canonical ID to offset in names
+    const char* names;
+};
+
+/***
+ * Name helpers
+*/
+
+static bool isNameSpace(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static unsigned char foldCase(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+// Copy length bytes of name without surrounding whitespace and with inner runs
+// collapsed to one space, folding case if asked. Returns the new length, or -1
+// if the result would be longer than CATALOG_MAX_NAME_LENGTH.
+static int collapseName(const char* name, size_t length, char* out, bool fold) {
+    int used = 0;
+    bool pendingSpace = false;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (isNameSpace(c)) {
+            pendingSpace = used > 0;
+            continue;
+        }
+        if (used + (pendingSpace ? 2 : 1) > CATALOG_MAX_NAME_LENGTH) {
+            return -1;
+        }
+        if (pendingSpace) {
+            out[used++] = ' ';
+            pendingSpace = false;
+        }
+        out[used++] = (char)(fold ? foldCase(c) : c);
+    }
+    out[used] = '\0';
+    return used;
+}
+
+/***
+ * Reading a source list
+*/
+
+typedef struct {
+    char* key;       // Name as matched: whitespace collapsed, case folded
+    char* target;    // Key of the canonical name (aliases only)
+    char* display;   // Canonical name as written (canonical names only)
+    int line;
+    int id;
+} CatalogEntry;
+
+typedef struct {
+    Allocator* allocator;
+    CatalogEntry* entries;
+    int count;
+    int capacity;
+} EntryList;
+
+static void freeEntries(EntryList* list) {
+    for (int i = 0; i < list->count; i++) {
+        releaseString(list->allocator, list->entries[i].key);
+        releaseString(list->allocator, list->entries[i].target);
+        releaseString(list->allocator, list->entries[i].display);
+    }
+    releaseMemory(list->allocator, list->entries, list->capacity * sizeof(CatalogEntry));
+}
+
+static int addEntry(EntryList* list, const char* key, const char* target, const char* display, int line) {
+    if (list->count == list->capacity) {
+        int newCapacity = (list->capacity == 0) ? 256 : list->capacity * 2;
+        CatalogEntry* resized = reallocMemory(list->allocator, list->entries,
+            list->capacity * sizeof(CatalogEntry), newCapacity * sizeof(CatalogEntry));
+        if (resized == NULL) {
+            return CATALOG_ERROR_NO_MEMORY;
+        }
+        list->entries = resized;
+        list->capacity = newCapacity;
+    }
+
+    CatalogEntry* entry = &list->entries[list->count];
+    entry->key = allocString(list->allocator, key);
+    entry->target = (target != NULL) ? allocString(list->allocator, target) : NULL;
+    entry->display = (display != NULL) ? allocString(list->allocator, display) : NULL;
+    entry->line = line;
+    entry->id = -1;
+    list->count++;
+    if (entry->key == NULL || (target != NULL && entry->target == NULL) || (display != NULL && entry->display == NULL)) {
+        return CATALOG_ERROR_NO_MEMORY;
+    }
+    return CATALOG_OK;
+}
+
+// Parse one source line into the list (blank lines and comments add nothing)
+static int parseCatalogLine(EntryList* list, const char* text, int line) {
+    const char* start = text;
+    while (isNameSpace((unsigned char)*start)) {
+        start++;
+    }
+    if (*start == '\0' || *start == '#') {
+        return CATALOG_OK;
+    }
+
+    char key[CATALOG_MAX_NAME_LENGTH + 1];
+    const char* equals = strchr(start, '=');
+    if (equals == NULL) {
+        char display[CATALOG_MAX_NAME_LENGTH + 1];
+        if (collapseName(start, strlen(start), display, false) <= 0) {
+            return CATALOG_ERROR_SYNTAX;
+        }
+        collapseName(start, strlen(start), key, true);
+        return addEntry(list, key, NULL, display, line);
+    }
+
+    char target[CATALOG_MAX_NAME_LENGTH + 1];
+    if (collapseName(start, equals - start, key, true) <= 0 ||
+        collapseName(equals + 1, strlen(equals + 1), target, true) <= 0) {
+        return CATALOG_ERROR_SYNTAX;
+    }
+    return addEntry(list, key, target, NULL, line);
+}
+
+static int readCatalogList(const char* path, EntryList* list, int* errorLine) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return CATALOG_ERROR_IO;
+    }
+
+    char text[CATALOG_LINE_SIZE];
+    int line = 0;
+    int status = CATALOG_OK;
+    while (status == CATALOG_OK && fgets(text, sizeof(text), file) != NULL) {
+        line++;
+        size_t length = strlen(text);
+        if (length == sizeof(text) - 1 && text[length - 1] != '\n' && !feof(file)) {
+            status = CATALOG_ERROR_SYNTAX; // Longer than any name can be
+        } else {
+            status = parseCatalogLine(list, text, line);
+        }
+    }
+    if (status == CATALOG_OK && ferror(file)) {
+        status = CATALOG_ERROR_IO;
+    }
+    if (status == CATALOG_ERROR_SYNTAX) {
+        *errorLine = line;
+    }
+    fclose(file);
+    return status;
+}
+
+static int compareEntryKeys(const void* a, const void* b) {
+    const CatalogEntry* left = *(CatalogEntry* const*)a;
+    const CatalogEntry* right = *(CatalogEntry* const*)b;
+    int result = strcmp(left->key, right->key);
+    return (result != 0) ? result : left->line - right->line;
+}
+
+static int compareKeyToEntry(const void* key, const void* entry) {
+    return strcmp(key, (*(CatalogEntry* const*)entry)->key);
+}
+
+/***
+ * Building the automaton
+*/
+
+typedef struct {
+    unsigned char label;
+    int target;
+} BuildArc;
+
+typedef struct {
+    BuildArc* arcs;
+    int arcCount;
+    int arcCapacity;
+    bool final;
+    uint32_t words;  // Names accepted from this node (set when it is registered)
+} BuildNode;
+
+// Incremental construction of a minimal automaton from sorted names
+// (Daciuk et al.): only the nodes along the previous name can still change, and
+// each is either replaced by an equivalent registered node or registered itself.
+typedef struct {
+    Allocator* allocator;
+    BuildNode* nodes;
+    int nodeCount;
+    int nodeCapacity;
+    int* freeNodes;           // Slots of replaced nodes
+    int freeCount;
+    int freeCapacity;
+    int* registry;            // Open-addressed set of registered nodes (entries are index + 1)
+    int registryCapacity;
+    int registeredCount;
+    int path[CATALOG_MAX_NAME_LENGTH + 1]; // Nodes along the previous name
+    const char* previous;
+    size_t previousLength;
+} Builder;
+
+static int newBuildNode(Builder* builder) {
+    int index;
+    if (builder->freeCount > 0) {
+        index = builder->freeNodes[--builder->freeCount];
+    } else {
+        if (builder->nodeCount == builder->nodeCapacity) {
+            int newCapacity = (builder->nodeCapacity == 0) ? 1024 : builder->nodeCapacity * 2;
+            BuildNode* resized = reallocMemory(builder->allocator, builder->nodes,
+                builder->nodeCapacity * sizeof(BuildNode), newCapacity * sizeof(BuildNode));
+            if (resized == NULL) {
+                return -1;
+            }
+            builder->nodes = resized;
+            builder->nodeCapacity = newCapacity;
+        }
+        index = builder->nodeCount++;
+    }
+    memset(&builder->nodes[index], 0, sizeof(BuildNode));
+    return index;
+}
+
+static bool releaseBuildNode(Builder* builder, int index) {
+    BuildNode* node = &builder->nodes[index];
+    releaseMemory(builder->allocator, node->arcs, node->arcCapacity * sizeof(BuildArc));
+    memset(node, 0, sizeof(BuildNode));
+
+    if (builder->freeCount == builder->freeCapacity) {
+        int newCapacity = (builder->freeCapacity == 0) ? 256 : builder->freeCapacity * 2;
+        int* resized = reallocMemory(builder->allocator, builder->freeNodes,
+            builder->freeCapacity * sizeof(int), newCapacity * sizeof(int));
+        if (resized == NULL) {
+            return false;
+        }
+        builder->freeNodes = resized;
+        builder->freeCapacity = newCapacity;
+    }
+    builder->freeNodes[builder->freeCount++] = index;
+    return true;
+}
+
+static bool addBuildArc(Builder* builder, int from, unsigned char label, int target) {
+    BuildNode* node = &builder->nodes[from];
+    if (node->arcCount == node->arcCapacity) {
+        int newCapacity = (node->arcCapacity == 0) ? 2 : node->arcCapacity * 2;
+        BuildArc* resized = reallocMemory(builder->allocator, node->arcs,
+            node->arcCapacity * sizeof(BuildArc), newCapacity * sizeof(BuildArc));
+        if (resized == NULL) {
+            return false;
+        }
+        node->arcs = resized;
+        node->arcCapacity = newCapacity;
+    }
+    node->arcs[node->arcCount].label = label;
+    node->arcs[node->arcCount].target = target;
+    node->arcCount++;
+    return true;
+}
+
+// Registered nodes are equal when they accept the same names: same finality, same arcs
+static unsigned long hashBuildNode(const BuildNode* node) {
+    unsigned long hash = (FNV_OFFSET ^ (unsigned long)node->final) * FNV_PRIME;
+    for (int i = 0; i < node->arcCount; i++) {
+        hash = (hash ^ node->arcs[i].label) * FNV_PRIME;
+        hash = (hash ^ (unsigned long)node->arcs[i].target) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool sameBuildNode(const BuildNode* a, const BuildNode* b) {
+    if (a->final != b->final || a->arcCount != b->arcCount) {
+        return false;
+    }
+    for (int i = 0; i < a->arcCount; i++) {
+        if (a->arcs[i].label != b->arcs[i].label || a->arcs[i].target != b->arcs[i].target) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Slot holding a node equal to index, or the empty slot where it belongs
+static int findRegistrySlot(const Builder* builder, int index) {
+    const BuildNode* node = &builder->nodes[index];
+    int mask = builder->registryCapacity - 1;
+    int slot = (int)(hashBuildNode(node) & (unsigned long)mask);
+    while (builder->registry[slot] != 0 && !sameBuildNode(&builder->nodes[builder->registry[slot] - 1], node)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool growRegistry(Builder* builder) {
+    int oldCapacity = builder->registryCapacity;
+    int* old = builder->registry;
+    int newCapacity = (oldCapacity == 0) ? 1024 : oldCapacity * 2;
+    builder->registry = allocMemory(builder->allocator, newCapacity * sizeof(int));
+    if (builder->registry == NULL) {
+        builder->registry = old;
+        return false;
+    }
+    memset(builder->registry, 0, newCapacity * sizeof(int));
+    builder->registryCapacity = newCapacity;
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i] != 0) {
+            builder->registry[findRegistrySlot(builder, old[i] - 1)] = old[i];
+        }
+    }
+    releaseMemory(builder->allocator, old, oldCapacity * sizeof(int));
+    return true;
+}
+
+// Freeze the previous name's nodes below depth, deepest first
+static bool minimizePath(Builder* builder, size_t depth) {
+    for (size_t d = builder->previousLength; d > depth; d--) {
+        int child = builder->path[d];
+        BuildNode* node = &builder->nodes[child];
+        node->words = node->final ? 1 : 0;
+        for (int i = 0; i < node->arcCount; i++) {
+            node->words += builder->nodes[node->arcs[i].target].words;
+        }
+
+        if ((builder->registeredCount + 1) * 2 > builder->registryCapacity && !growRegistry(builder)) {
+            return false;
+        }
+        int slot = findRegistrySlot(builder, child);
+        if (builder->registry[slot] != 0) {
+            BuildNode* parent = &builder->nodes[builder->path[d - 1]];
+            parent->arcs[parent->arcCount - 1].target = builder->registry[slot] - 1;
+            if (!releaseBuildNode(builder, child)) {
+                return false;
+            }
+        } else {
+            builder->registry[slot] = child + 1;
+            builder->registeredCount++;
+        }
+    }
+    return true;
+}
+
+// Names must arrive in strictly increasing byte order
+static bool addName(Builder* builder, const char* key) {
+    size_t length = strlen(key);
+    size_t prefix = 0;
+    while (prefix < length && prefix < builder->previousLength && key[prefix] == builder->previous[prefix]) {
+        prefix++;
+    }
+    if (!minimizePath(builder, prefix)) {
+        return false;
+    }
+
+    for (size_t d = prefix; d < length; d++) {
+        int node = newBuildNode(builder);
+        if (node < 0 || !addBuildArc(builder, builder->path[d], (unsigned char)key[d], node)) {
+            return false;
+        }
+        builder->path[d + 1] = node;
+    }
+    builder->nodes[builder->path[length]].final = true;
+    builder->previous = key;
+    builder->previousLength = length;
+    return true;
+}
+
+static void freeBuilder(Builder* builder) {
+    for (int i = 0; i < builder->nodeCount; i++) {
+        releaseMemory(builder->allocator, builder->nodes[i].arcs, builder->nodes[i].arcCapacity * sizeof(BuildArc));
+    }
+    releaseMemory(builder->allocator, builder->nodes, builder->nodeCapacity * sizeof(BuildNode));
+    releaseMemory(builder->allocator, builder->freeNodes, builder->freeCapacity * sizeof(int));
+    releaseMemory(builder->allocator, builder->registry, builder->registryCapacity * sizeof(int));
+}
+
+/***
+ * Writing a compiled catalog
+*/
+
+// Give each node with arcs its place in the arc array, depth first
+static uint32_t placeNode(const Builder* builder, int index, uint32_t* places, uint32_t next) {
+    const BuildNode* node = &builder->nodes[index];
+    if (node->arcCount == 0 || places[index] != NO_STATE) {
+        return next;
+    }
+    places[index] = next;
+    next += node->arcCount;
+    for (int i = 0; i < node->arcCount; i++) {
+        next = placeNode(builder, node->arcs[i].target, places, next);
+    }
+    return next;
+}
+
+static int writeArcs(const Builder* builder, const uint32_t* places, int index, bool* written, FILE* file) {
+    const BuildNode* node = &builder->nodes[index];
+    if (node->arcCount == 0 || written[index]) {
+        return CATALOG_OK;
+    }
+    written[index] = true;
+
+    uint32_t before = node->final ? 1 : 0;
+    for (int i = 0; i < node->arcCount; i++) {
+        const BuildNode* target = &builder->nodes[node->arcs[i].target];
+        CatalogArc arc;
+        arc.target = (target->arcCount > 0) ? places[node->arcs[i].target] : NO_STATE;
+        arc.target |= (target->final ? ARC_FINAL : 0) | (i == node->arcCount - 1 ? ARC_LAST : 0);
+        arc.labelBefore = ((uint32_t)node->arcs[i].label << 24) | before;
+        if (fwrite(&arc, sizeof(arc), 1, file) != 1) {
+            return CATALOG_ERROR_IO;
+        }
+        before += target->words;
+    }
+    // Children were placed in this order, so their arcs follow
+    for (int i = 0; i < node->arcCount; i++) {
+        int status = writeArcs(builder, places, node->arcs[i].target, written, file);
+        if (status != CATALOG_OK) {
+            return status;
+        }
+    }
+    return CATALOG_OK;
+}
+
+static int writeAutomaton(Builder* builder, FILE* file, uint32_t* stateCount, uint32_t* arcCount) {
+    Allocator* allocator = builder->allocator;
+    uint32_t* places = allocMemory(allocator, builder->nodeCount * sizeof(uint32_t));
+    bool* written = allocMemory(allocator, builder->nodeCount * sizeof(bool));
+    if (places == NULL || written == NULL) {
+        releaseMemory(allocator, places, builder->nodeCount * sizeof(uint32_t));
+        releaseMemory(allocator, written, builder->nodeCount * sizeof(bool));
+        return CATALOG_ERROR_NO_MEMORY;
+    }
+    for (int i = 0; i < builder->nodeCount; i++) {
+        places[i] = NO_STATE;
+        written[i] = false;
+    }
+
+    *arcCount = placeNode(builder, 0, places, 0);
+    *stateCount = 1; // The state without arcs
+    for (int i = 0; i < builder->nodeCount; i++) {
+        *stateCount += (places[i] != NO_STATE) ? 1 : 0;
+    }
+    int status = (*arcCount <= MAX_ARCS) ? writeArcs(builder, places, 0, written, file) : CATALOG_ERROR_TOO_LARGE;
+
+    releaseMemory(allocator, places, builder->nodeCount * sizeof(uint32_t));
+    releaseMemory(allocator, written, builder->nodeCount * sizeof(bool));
+    return status;
+}
+
+static int writeUint32(FILE* file, uint32_t value) {
+    return fwrite(&value, sizeof(value), 1, file) == 1 ? CATALOG_OK : CATALOG_ERROR_IO;
+}
+
+// Write the header (with placeholder counts), automaton, word IDs and names
+static int writeCatalog(const char* path, Builder* builder, CatalogEntry** names, int nameCount,
+                        CatalogEntry** exercises, int exerciseCount) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return CATALOG_ERROR_IO;
+    }
+
+    CatalogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CATALOG_MAGIC, sizeof(header.magic));
+    header.version = CATALOG_VERSION;
+    header.wordCount = (uint32_t)nameCount;
+    header.exerciseCount = (uint32_t)exerciseCount;
+
+    int status = fwrite(&header, sizeof(header), 1, file) == 1 ? CATALOG_OK : CATALOG_ERROR_IO;
+    if (status == CATALOG_OK) {
+        status = writeAutomaton(builder, file, &header.stateCount, &header.arcCount);
+    }
+    for (int i = 0; i < nameCount && status == CATALOG_OK; i++) {
+        status = writeUint32(file, (uint32_t)names[i]->id);
+    }
+    uint32_t offset = 0;
+    for (int i = 0; i < exerciseCount && status == CATALOG_OK; i++) {
+        status = writeUint32(file, offset);
+        offset += (uint32_t)strlen(exercises[i]->display) + 1;
+    }
+    for (int i = 0; i < exerciseCount && status == CATALOG_OK; i++) {
+        size_t length = strlen(exercises[i]->display) + 1;
+        if (fwrite(exercises[i]->display, 1, length, file) != length) {
+            status = CATALOG_ERROR_IO;
+        }
+    }
+    header.namesSize = offset;
+
+    if (status == CATALOG_OK && (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1)) {
+        status = CATALOG_ERROR_IO;
+    }
+    if (fclose(file) != 0 && status == CATALOG_OK) {
+        status = CATALOG_ERROR_IO;
+    }
+    if (status != CATALOG_OK) {
+        remove(path);
+    }
+    return status;
+}
+
+/***
+ * Catalog functions
+*/
+
+int buildCatalog(const char* listPath, const char* outputPath, Allocator* allocator, int* errorLine) {
+    *errorLine = 0;
+    EntryList list = { allocator, NULL, 0, 0 };
+    int status = readCatalogList(listPath, &list, errorLine);
+
+    // Canonical IDs follow the sorted order of the canonical names
+    CatalogEntry** exercises = NULL;
+    CatalogEntry** names = NULL;
+    int exerciseCount = 0;
+    int nameCount = 0;
+    if (status == CATALOG_OK) {
+        exercises = allocMemory(allocator, (list.count + 1) * sizeof(CatalogEntry*));
+        names = allocMemory(allocator, (list.count + 1) * sizeof(CatalogEntry*));
+        if (exercises == NULL || names == NULL) {
+            status = CATALOG_ERROR_NO_MEMORY;
+        }
+    }
+    if (status == CATALOG_OK) {
+        for (int i = 0; i < list.count; i++) {
+            if (list.entries[i].display != NULL) {
+                exercises[exerciseCount++] = &list.entries[i];
+            }
+        }
+        qsort(exercises, exerciseCount, sizeof(CatalogEntry*), compareEntryKeys);
+        for (int i = 0; i < exerciseCount && status == CATALOG_OK; i++) {
+            if (i > 0 && strcmp(exercises[i - 1]->key, exercises[i]->key) == 0) {
+                status = CATALOG_ERROR_DUPLICATE;
+                *errorLine = exercises[i]->line;
+            }
+            exercises[i]->id = i;
+        }
+    }
+
+    // Aliases take the ID of their canonical name
+    for (int i = 0; i < list.count && status == CATALOG_OK; i++) {
+        CatalogEntry* entry = &list.entries[i];
+        if (entry->target != NULL) {
+            CatalogEntry** found = bsearch(entry->target, exercises, exerciseCount, sizeof(CatalogEntry*), compareKeyToEntry);
+            if (found == NULL) {
+                status = CATALOG_ERROR_UNKNOWN_NAME;
+                *errorLine = entry->line;
+            } else {
+                entry->id = (*found)->id;
+            }
+        }
+    }
+
+    // Every spelling, in order; repeating a name is fine as long as it means the same exercise
+    if (status == CATALOG_OK) {
+        for (int i = 0; i < list.count; i++) {
+            names[i] = &list.entries[i];
+        }
+        qsort(names, list.count, sizeof(CatalogEntry*), compareEntryKeys);
+        for (int i = 0; i < list.count && status == CATALOG_OK; i++) {
+            if (nameCount > 0 && strcmp(names[nameCount - 1]->key, names[i]->key) == 0) {
+                if (names[nameCount - 1]->id != names[i]->id) {
+                    status = CATALOG_ERROR_DUPLICATE;
+                    *errorLine = names[i]->line;
+                }
+            } else {
+                names[nameCount++] = names[i];
+            }
+        }
+    }
+
+    Builder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.allocator = allocator;
+    if (status == CATALOG_OK && newBuildNode(&builder) != 0) {
+        status = CATALOG_ERROR_NO_MEMORY;
+    }
+    builder.path[0] = 0;
+    for (int i = 0; i < nameCount && status == CATALOG_OK; i++) {
+        if (!addName(&builder, names[i]->key)) {
+            status = CATALOG_ERROR_NO_MEMORY;
+        }
+    }
+    if (status == CATALOG_OK && !minimizePath(&builder, 0)) {
+        status = CATALOG_ERROR_NO_MEMORY;
+    }
+    if (status == CATALOG_OK) {
+        status = writeCatalog(outputPath, &builder, names, nameCount, exercises, exerciseCount);
+    }
+
+    freeBuilder(&builder);
+    releaseMemory(allocator, exercises, (list.count + 1) * sizeof(CatalogEntry*));
+    releaseMemory(allocator, names, (list.count + 1) * sizeof(CatalogEntry*));
+    freeEntries(&list);
+    return status;
+}
+
+// Check every offset in the mapping once, so lookups need no bounds checks
+static bool validCatalog(const Catalog* catalog) {
+    const CatalogHeader* header = catalog->header;
+    if (memcmp(header->magic, CATALOG_MAGIC, sizeof(header->magic)) != 0 || header->version != CATALOG_VERSION) {
+        return false;
+    }
+    uint64_t expected = sizeof(CatalogHeader) + (uint64_t)header->arcCount * sizeof(CatalogArc) +
+        (uint64_t)header->wordCount * sizeof(uint32_t) + (uint64_t)header->exerciseCount * sizeof(uint32_t) +
+        header->namesSize;
+    if (expected != catalog->mappingSize || header->arcCount > MAX_ARCS || header->wordCount > MAX_WORDS) {
+        return false;
+    }
+
+    // Every scan through a state's arcs stops at an ARC_LAST at the latest
+    if (header->arcCount > 0 && !(catalog->arcs[header->arcCount - 1].target & ARC_LAST)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header->arcCount; i++) {
+        uint32_t target = catalog->arcs[i].target & ARC_TARGET_MASK;
+        if (target != NO_STATE && target >= header->arcCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->wordCount; i++) {
+        if (catalog->wordIds[i] >= header->exerciseCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->exerciseCount; i++) {
+        if (catalog->nameOffsets[i] >= header->namesSize) {
+            return false;
+        }
+    }
+    return header->exerciseCount == 0 || catalog->names[header->namesSize - 1] == '\0';
+}
+
+int openCatalog(const char* path, Allocator* allocator, Catalog** catalog) {
+    *catalog = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return CATALOG_ERROR_IO;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return CATALOG_ERROR_IO;
+    }
+    if ((size_t)info.st_size < sizeof(CatalogHeader)) {
+        close(fd);
+        return CATALOG_ERROR_CORRUPT;
+    }
+
+    void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return CATALOG_ERROR_IO;
+    }
+
+    Catalog* opened = allocMemory(allocator, sizeof(Catalog));
+    if (opened == NULL) {
+        munmap(mapping, (size_t)info.st_size);
+        return CATALOG_ERROR_NO_MEMORY;
+    }
+    opened->allocator = allocator;
+    opened->mapping = mapping;
+    opened->mappingSize = (size_t)info.st_size;
+    opened->header = mapping;
+
+    const char* base = mapping;
+    const CatalogHeader* header = opened->header;
+    size_t offset = sizeof(CatalogHeader);
+    opened->arcs = (const CatalogArc*)(base + offset);
+    offset += (size_t)header->arcCount * sizeof(CatalogArc);
+    opened->wordIds = (const uint32_t*)(base + offset);
+    offset += (size_t)header->wordCount * sizeof(uint32_t);
+    opened->nameOffsets = (const uint32_t*)(base + offset);
+    offset += (size_t)header->exerciseCount * sizeof(uint32_t);
+    opened->names = base + offset;
+
+    if (!validCatalog(opened)) {
+        closeCatalog(opened);
+        return CATALOG_ERROR_CORRUPT;
+    }
+    *catalog = opened;
+    return CATALOG_OK;
+}
+
+void closeCatalog(Catalog* catalog) {
+    if (catalog == NULL) {
+        return;
+    }
+    munmap(catalog->mapping, catalog->mappingSize);
+    releaseMemory(catalog->allocator, catalog, sizeof(Catalog));
+}
+
+// Arcs are few past the first characters of a name, so a linear scan is fastest
+static const CatalogArc* findArc(const Catalog* catalog, uint32_t state, unsigned char label) {
+    if (state == NO_STATE || state >= catalog->header->arcCount) {
+        return NULL;
+    }
+    for (const CatalogArc* arc = &catalog->arcs[state]; ; arc++) {
+        if (ARC_LABEL(arc) == label) {
+            return arc;
+        }
+        if (ARC_LABEL(arc) > label || (arc->target & ARC_LAST)) {
+            return NULL;
+        }
+    }
+}
+
+// Walk the automaton, normalizing the name on the way; the sum of the arcs'
+// counts is the name's index among all accepted names
+int catalogLookup(const Catalog* catalog, const char* name) {
+    const unsigned char* input = (const unsigned char*)name;
+    while (isNameSpace(*input)) {
+        input++;
+    }
+
+    uint32_t state = 0;
+    uint32_t index = 0;
+    bool final = false;
+    while (*input != '\0') {
+        unsigned char label;
+        if (isNameSpace(*input)) {
+            while (isNameSpace(*input)) {
+                input++;
+            }
+            if (*input == '\0') {
+                break;
+            }
+            label = ' ';
+        } else {
+            label = foldCase(*input++);
+        }
+
+        const CatalogArc* arc = findArc(catalog, state, label);
+        if (arc == NULL) {
+            return CATALOG_NOT_FOUND;
+        }
+        index += ARC_BEFORE(arc);
+        state = arc->target & ARC_TARGET_MASK;
+        final = (arc->target & ARC_FINAL) != 0;
+    }
+
+    if (!final || index >= catalog->header->wordCount) {
+        return CATALOG_NOT_FOUND;
+    }
+    return (int)catalog->wordIds[index];
+}
+
+const char* catalogName(const Catalog* catalog, int id) {
+    if (id < 0 || (uint32_t)id >= catalog->header->exerciseCount) {
+        return NULL;
+    }
+    return catalog->names + catalog->nameOffsets[id];
+}
+
+int catalogExerciseCount(const Catalog* catalog) {
+    return (int)catalog->header->exerciseCount;
+}
+
+int catalogNameCount(const Catalog* catalog) {
+    return (int)catalog->header->wordCount;
+}
+
+const char* catalogErrorString(int status) {
+    switch (status) {
+        case CATALOG_OK:
+            return "ok";
+        case CATALOG_ERROR_IO:
+            return "unable to read or write file";
+        case CATALOG_ERROR_NO_MEMORY:
+            return "out of memory";
+        case CATALOG_ERROR_CORRUPT:
+            return "not a compiled exercise catalog, or damaged";
+        case CATALOG_ERROR_SYNTAX:
+            return "malformed or overlong entry";
+        case CATALOG_ERROR_UNKNOWN_NAME:
+            return "alias of an exercise that is not listed";
+        case CATALOG_ERROR_DUPLICATE:
+            return "name stands for two different exercises";
+        case CATALOG_ERROR_TOO_LARGE:
+            return "too many names for one catalog";
+        default:
+            return "unknown error";
+    }
+}
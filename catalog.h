@@ -0,0 +1,44 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "alloc.h"
+
+// Exercise catalog: the canonical exercise names and their aliases, compiled
+// into a minimized acyclic automaton (a DAWG) that is memory-mapped read-only.
+// Every name the automaton accepts has a lexicographic index, computed while
+// walking it; a table maps that index to the canonical ID of the exercise.
+// Names are matched ignoring case and runs of whitespace.
+//
+// Source lists have one entry per line: a canonical name, or "alias = name"
+// for another spelling of a canonical name. Blank lines and lines starting
+// with '#' are skipped.
+
+#define CATALOG_MAX_NAME_LENGTH 255 // Longest name, after whitespace is collapsed
+
+// Catalog status codes
+#define CATALOG_OK 0
+#define CATALOG_ERROR_IO -1
+#define CATALOG_ERROR_NO_MEMORY -2
+#define CATALOG_ERROR_CORRUPT -3       // Compiled file is damaged or from another version
+#define CATALOG_ERROR_SYNTAX -4        // Source list line is malformed or too long
+#define CATALOG_ERROR_UNKNOWN_NAME -5  // An alias names no canonical exercise
+#define CATALOG_ERROR_DUPLICATE -6     // A name stands for two different exercises
+#define CATALOG_ERROR_TOO_LARGE -7     // More automaton states than a catalog file can address
+
+#define CATALOG_NOT_FOUND -1
+
+typedef struct Catalog Catalog;
+
+// Function prototypes for compiling a source list (errorLine is set for source errors)
+int buildCatalog(const char* listPath, const char* outputPath, Allocator* allocator, int* errorLine);
+
+// Function prototypes for using a compiled catalog
+int openCatalog(const char* path, Allocator* allocator, Catalog** catalog);
+void closeCatalog(Catalog* catalog);
+int catalogLookup(const Catalog* catalog, const char* name); // Canonical ID, or CATALOG_NOT_FOUND
+const char* catalogName(const Catalog* catalog, int id);
+int catalogExerciseCount(const Catalog* catalog);
+int catalogNameCount(const Catalog* catalog);      // Canonical names and aliases
+const char* catalogErrorString(int status);
+
+#endif // CATALOG_H
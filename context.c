@@ -0,0 +1,30 @@
+#include <stddef.h>
+#include "context.h"
+#include "semantic.h"
+
+void initCompileContext(CompileContext* context) {
+    for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+        context->allocators[i] = systemAllocator();
+    }
+    context->nodes = NULL;
+    context->symbols = NULL;
+    context->catalog = NULL;
+    context->semanticResult = SEMANTIC_OK;
+    context->syntaxError[0] = '\0';
+    context->errorOffset = NO_SOURCE_OFFSET;
+    context->outOfMemory = false;
+    context->pastImports = false;
+}
+
+const char* subsystemName(Subsystem subsystem) {
+    switch (subsystem) {
+        case SUBSYSTEM_LEXER:
+            return "lexer";
+        case SUBSYSTEM_PARSER:
+            return "parser";
+        case SUBSYSTEM_SEMANTIC:
+            return "semantic";
+        default:
+            return "unknown";
+    }
+}
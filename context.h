@@ -0,0 +1,40 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "alloc.h"
+
+#define DIAGNOSTIC_MESSAGE_SIZE 256
+#define NO_SOURCE_OFFSET ((size_t)-1) // Error location unknown
+
+// Front-end phases that own memory
+typedef enum {
+    SUBSYSTEM_LEXER,
+    SUBSYSTEM_PARSER,
+    SUBSYSTEM_SEMANTIC,
+    SUBSYSTEM_COUNT
+} Subsystem;
+
+struct NodeTable;
+struct SymbolTable;
+struct Catalog;
+
+// Compilation context passed through the lexer, parser and semantic analysis
+typedef struct CompileContext {
+    Allocator* allocators[SUBSYSTEM_COUNT]; // One allocator per phase
+    struct NodeTable* nodes;                // Hash-consing table (NULL disables sharing)
+    struct SymbolTable* symbols;            // When set, the parser validates statements as it builds them
+    const struct Catalog* catalog;          // When set, exercise aliases are replaced by their canonical names
+    int semanticResult;                     // First semantic error found while parsing (SEMANTIC_OK if none)
+    char syntaxError[DIAGNOSTIC_MESSAGE_SIZE]; // First syntax error reported by the parser ("" if none)
+    size_t errorOffset;                     // Input offset of the first syntax or fused semantic error
+    bool outOfMemory;                       // Set when an allocation failed during parsing
+    bool pastImports;                       // A statement other than an import has been parsed (imports come first)
+} CompileContext;
+
+// Initialize a context that uses the system allocator everywhere and shares nothing
+void initCompileContext(CompileContext* context);
+const char* subsystemName(Subsystem subsystem);
+
+#endif // CONTEXT_H
@@ -0,0 +1,517 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "diff.h"
+#include "hashcons.h"
+#include "semantic.h"
+
+#define FNV_OFFSET 1469598103934665603UL
+#define FNV_PRIME 1099511628211UL
+#define INITIAL_CLIENT_CAPACITY 16
+#define TREE_FANOUT_BITS 4
+#define TREE_FANOUT (1 << TREE_FANOUT_BITS)
+#define HASH_BITS 64
+
+// A client and its plans, in assignment order
+typedef struct {
+    const char* name;           // Points into the AST
+    unsigned long key;          // Mixed hash of the name: the client's place in the tree
+    unsigned long hash;         // Name and assignment hashes, in order
+    const ASTNode** plans;
+    int planCount;
+    int planCapacity;
+    int lastAssignment;         // Position + 1 of the last group assignment that gave a plan
+} DigestClient;
+
+struct ProgramDigest {
+    Allocator* allocator;
+    DigestClient* clients;      // Sorted by key, then name
+    int clientCount;
+    int clientCapacity;
+    unsigned long* sums;        // sums[i]: total of the mixed hashes of clients before i
+};
+
+// A client that differs between the versions (one side is NULL if it was added or removed)
+typedef struct {
+    const DigestClient* before;
+    const DigestClient* after;
+} ClientChange;
+
+typedef struct {
+    const ProgramDigest* before;
+    const ProgramDigest* after;
+    ClientChange* changes;
+    int changeCount;
+    int changeCapacity;
+    bool failed;
+} DiffState;
+
+/***
+ * Helper functions
+*/
+
+static unsigned long hashName(const char* name) {
+    unsigned long hash = FNV_OFFSET;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Spread every input bit over the whole word (the splitmix64 finalizer), so
+// the top bits can pick subtrees and sums of hashes do not cancel out
+static unsigned long mixHash(unsigned long hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9UL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebUL;
+    return hash ^ (hash >> 31);
+}
+
+static const char* nodeName(const ASTNode* node) {
+    switch (node->type) {
+        case NODE_PLAN:
+            return node->data.plan.name;
+        case NODE_DAY:
+            return node->data.day.name;
+        case NODE_EXERCISE:
+            return node->data.exercise.name;
+        default:
+            return "";
+    }
+}
+
+static int compareClients(const void* a, const void* b) {
+    const DigestClient* left = a;
+    const DigestClient* right = b;
+    if (left->key != right->key) {
+        return (left->key < right->key) ? -1 : 1;
+    }
+    return strcmp(left->name, right->name);
+}
+
+static int compareChanges(const void* a, const void* b) {
+    const ClientChange* left = a;
+    const ClientChange* right = b;
+    const char* leftName = (left->after != NULL) ? left->after->name : left->before->name;
+    const char* rightName = (right->after != NULL) ? right->after->name : right->before->name;
+    return strcmp(leftName, rightName);
+}
+
+/***
+ * Digest construction
+*/
+
+static DigestClient* addDigestClient(ProgramDigest* digest, const char* name) {
+    if (digest->clientCount == digest->clientCapacity) {
+        int newCapacity = (digest->clientCapacity == 0) ? INITIAL_CLIENT_CAPACITY : digest->clientCapacity * 2;
+        DigestClient* resized = reallocMemory(digest->allocator, digest->clients,
+            digest->clientCapacity * sizeof(DigestClient), newCapacity * sizeof(DigestClient));
+        if (resized == NULL) {
+            return NULL;
+        }
+        digest->clients = resized;
+        digest->clientCapacity = newCapacity;
+    }
+    DigestClient* client = &digest->clients[digest->clientCount++];
+    memset(client, 0, sizeof(DigestClient));
+    client->name = name;
+    client->key = mixHash(hashName(name));
+    client->hash = hashName(name);
+    return client;
+}
+
+// hash is the assignment's hash, as if it named the client
+static bool addDigestPlan(ProgramDigest* digest, DigestClient* client, const ASTNode* plan, unsigned long hash) {
+    if (client->planCount == client->planCapacity) {
+        int newCapacity = (client->planCapacity == 0) ? 2 : client->planCapacity * 2;
+        const ASTNode** resized = reallocMemory(digest->allocator, client->plans,
+            client->planCapacity * sizeof(ASTNode*), newCapacity * sizeof(ASTNode*));
+        if (resized == NULL) {
+            return false;
+        }
+        client->plans = resized;
+        client->planCapacity = newCapacity;
+    }
+    client->plans[client->planCount++] = plan;
+    client->hash = (client->hash ^ hash) * FNV_PRIME;
+    return true;
+}
+
+// Clients by name while the digest is built (entries are position + 1)
+static int* findSlot(int* slots, int capacity, const ProgramDigest* digest, const char* name) {
+    int slot = (int)(hashName(name) & (unsigned long)(capacity - 1));
+    while (slots[slot] != 0 && strcmp(digest->clients[slots[slot] - 1].name, name) != 0) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return &slots[slot];
+}
+
+// Find or add a client by name (NULL if out of memory)
+static DigestClient* digestClient(ProgramDigest* digest, int* slots, int capacity, const char* name) {
+    int* slot = findSlot(slots, capacity, digest, name);
+    if (*slot == 0) {
+        // Clients are declared before use, so the table never fills
+        if (addDigestClient(digest, name) == NULL) {
+            return NULL;
+        }
+        *slot = digest->clientCount;
+    }
+    return &digest->clients[*slot - 1];
+}
+
+// A group assignment is the same as assigning the plan to each member
+static int addGroupPlan(ProgramDigest* digest, int* slots, int capacity, const ASTNode* assignment, int position) {
+    const ASTNode* group = assignment->data.assignment.client;
+    const ASTNode* plan = assignment->data.assignment.plan;
+    for (int i = 0; i < group->childrenCount; i++) {
+        const char* name = group->children[i]->data.identifier.name;
+        DigestClient* client = digestClient(digest, slots, capacity, name);
+        if (client == NULL) {
+            return DIFF_ERROR_NO_MEMORY;
+        }
+        if (client->lastAssignment == position + 1) {
+            continue; // Listed twice in the group
+        }
+        client->lastAssignment = position + 1;
+        if (!addDigestPlan(digest, client, plan, assignmentHash(name, plan))) {
+            return DIFF_ERROR_NO_MEMORY;
+        }
+    }
+    return DIFF_OK;
+}
+
+static int countClients(const ASTNode* root) {
+    int count = 0;
+    for (int i = 0; i < root->childrenCount; i++) {
+        count += (root->children[i]->type == NODE_CLIENT_PROFILE);
+    }
+    return count;
+}
+
+static int fillDigest(ProgramDigest* digest, const ASTNode* root) {
+    int capacity = 2 * INITIAL_CLIENT_CAPACITY;
+    while (capacity < 2 * (countClients(root) + 1)) {
+        capacity *= 2;
+    }
+    int* slots = allocMemory(digest->allocator, capacity * sizeof(int));
+    if (slots == NULL) {
+        return DIFF_ERROR_NO_MEMORY;
+    }
+    memset(slots, 0, capacity * sizeof(int));
+
+    int result = DIFF_OK;
+    for (int i = 0; i < root->childrenCount && result == DIFF_OK; i++) {
+        const ASTNode* statement = root->children[i];
+        const char* name;
+        if (statement->type == NODE_CLIENT_PROFILE) {
+            name = statement->data.clientProfile.name;
+        } else if (statement->type == NODE_ASSIGNMENT && statement->data.assignment.client->type == NODE_GROUP) {
+            result = addGroupPlan(digest, slots, capacity, statement, i);
+            continue;
+        } else if (statement->type == NODE_ASSIGNMENT) {
+            name = statement->data.assignment.client->data.clientProfile.name;
+        } else {
+            continue; // Plans are compared through the assignments; groups through their members
+        }
+
+        DigestClient* client = digestClient(digest, slots, capacity, name);
+        if (client == NULL) {
+            result = DIFF_ERROR_NO_MEMORY;
+        } else if (statement->type == NODE_ASSIGNMENT &&
+                   !addDigestPlan(digest, client, statement->data.assignment.plan, statement->hash)) {
+            result = DIFF_ERROR_NO_MEMORY;
+        }
+    }
+    releaseMemory(digest->allocator, slots, capacity * sizeof(int));
+    return result;
+}
+
+/***
+ * Tree comparison
+*/
+
+// Total of the mixed client hashes in [begin, end)
+static unsigned long rangeSum(const ProgramDigest* digest, int begin, int end) {
+    return digest->sums[end] - digest->sums[begin];
+}
+
+// First position in [begin, end) whose key has a digit above digit at shift
+static int digitEnd(const ProgramDigest* digest, int begin, int end, int shift, unsigned long digit) {
+    while (begin < end) {
+        int middle = begin + (end - begin) / 2;
+        if (((digest->clients[middle].key >> shift) & (TREE_FANOUT - 1)) <= digit) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+static void recordChange(DiffState* state, const DigestClient* before, const DigestClient* after) {
+    if (state->changeCount == state->changeCapacity) {
+        int newCapacity = (state->changeCapacity == 0) ? INITIAL_CLIENT_CAPACITY : state->changeCapacity * 2;
+        Allocator* allocator = state->after->allocator;
+        ClientChange* resized = reallocMemory(allocator, state->changes,
+            state->changeCapacity * sizeof(ClientChange), newCapacity * sizeof(ClientChange));
+        if (resized == NULL) {
+            state->failed = true;
+            return;
+        }
+        state->changes = resized;
+        state->changeCapacity = newCapacity;
+    }
+    state->changes[state->changeCount].before = before;
+    state->changes[state->changeCount].after = after;
+    state->changeCount++;
+}
+
+// Compare two small ranges client by client; both are sorted the same way
+static void compareLeaves(DiffState* state, int oldBegin, int oldEnd, int newBegin, int newEnd) {
+    const DigestClient* oldClients = state->before->clients;
+    const DigestClient* newClients = state->after->clients;
+    while (oldBegin < oldEnd || newBegin < newEnd) {
+        int order = (oldBegin == oldEnd) ? 1 : (newBegin == newEnd) ? -1
+                  : compareClients(&oldClients[oldBegin], &newClients[newBegin]);
+        if (order < 0) {
+            recordChange(state, &oldClients[oldBegin++], NULL);
+        } else if (order > 0) {
+            recordChange(state, NULL, &newClients[newBegin++]);
+        } else {
+            if (oldClients[oldBegin].hash != newClients[newBegin].hash) {
+                recordChange(state, &oldClients[oldBegin], &newClients[newBegin]);
+            }
+            oldBegin++;
+            newBegin++;
+        }
+    }
+}
+
+// Compare the subtrees holding the clients whose keys share their bits above
+// shift. Equal sums mean equal clients, so nothing below is visited.
+static void compareSubtrees(DiffState* state, int oldBegin, int oldEnd, int newBegin, int newEnd, int shift) {
+    if (oldEnd - oldBegin == newEnd - newBegin &&
+        rangeSum(state->before, oldBegin, oldEnd) == rangeSum(state->after, newBegin, newEnd)) {
+        return;
+    }
+    if ((oldEnd - oldBegin) + (newEnd - newBegin) <= DIFF_LEAF_SIZE || shift < 0) {
+        compareLeaves(state, oldBegin, oldEnd, newBegin, newEnd);
+        return;
+    }
+    for (unsigned long digit = 0; digit < TREE_FANOUT && !state->failed; digit++) {
+        int oldSplit = digitEnd(state->before, oldBegin, oldEnd, shift, digit);
+        int newSplit = digitEnd(state->after, newBegin, newEnd, shift, digit);
+        compareSubtrees(state, oldBegin, oldSplit, newBegin, newSplit, shift - TREE_FANOUT_BITS);
+        oldBegin = oldSplit;
+        newBegin = newSplit;
+    }
+}
+
+/***
+ * Edit output
+*/
+
+// Position of the occurrence-th node (from 0) named name, or -1
+static int findNamed(const ASTNode* const* nodes, int count, const char* name, int occurrence) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(nodeName(nodes[i]), name) == 0 && occurrence-- == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// How many nodes before position are named like it
+static int occurrenceOf(const ASTNode* const* nodes, int position) {
+    int occurrence = 0;
+    for (int i = 0; i < position; i++) {
+        occurrence += (strcmp(nodeName(nodes[i]), nodeName(nodes[position])) == 0);
+    }
+    return occurrence;
+}
+
+static int writeEdits(Allocator* allocator, OutputWriter writer, void* writerData, const char* path,
+                      const ASTNode* const* before, int beforeCount, const ASTNode* const* after, int afterCount);
+
+// Whether two lists hold the same nodes, matched as writeEdits matches them,
+// so that only their order can differ
+static bool onlyReordered(const ASTNode* const* before, int beforeCount, const ASTNode* const* after, int afterCount) {
+    if (beforeCount != afterCount) {
+        return false;
+    }
+    for (int i = 0; i < beforeCount; i++) {
+        int match = findNamed(after, afterCount, nodeName(before[i]), occurrenceOf(before, i));
+        if (match < 0 || (before[i] != after[match] && before[i]->hash != after[match]->hash)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write how one plan, day or exercise changed; path names its parent
+static int writeNodeEdit(Allocator* allocator, OutputWriter writer, void* writerData, const char* path,
+                         const ASTNode* before, const ASTNode* after) {
+    if (before == after || before->hash == after->hash) {
+        return 0;
+    }
+    const char* separator = (path[0] != '\0') ? "/" : "";
+    if (after->type == NODE_EXERCISE) {
+        return writeFormatted(allocator, writer, writerData, "    ~ %s%s%s: sets %d -> %d, rest %d -> %d\n",
+                              path, separator, after->data.exercise.name,
+                              before->data.exercise.sets, after->data.exercise.sets,
+                              before->data.exercise.rest, after->data.exercise.rest);
+    }
+
+    size_t length = strlen(path) + strlen(separator) + strlen(nodeName(after)) + 1;
+    char* childPath = allocMemory(allocator, length);
+    if (childPath == NULL) {
+        return RUNTIME_ERROR;
+    }
+    snprintf(childPath, length, "%s%s%s", path, separator, nodeName(after));
+    const ASTNode* const* beforeChildren = (const ASTNode* const*)before->children;
+    const ASTNode* const* afterChildren = (const ASTNode* const*)after->children;
+    int result;
+    if (onlyReordered(beforeChildren, before->childrenCount, afterChildren, after->childrenCount)) {
+        // Nothing inside changed, or there would be an edit to print
+        result = writeFormatted(allocator, writer, writerData, "    ~ %s: order changed\n", childPath);
+    } else {
+        result = writeEdits(allocator, writer, writerData, childPath,
+                            beforeChildren, before->childrenCount, afterChildren, after->childrenCount);
+    }
+    releaseMemory(allocator, childPath, length);
+    return result;
+}
+
+static int writeAddedOrRemoved(Allocator* allocator, OutputWriter writer, void* writerData, const char* path,
+                               char sign, const ASTNode* node) {
+    const char* separator = (path[0] != '\0') ? "/" : "";
+    if (node->type == NODE_EXERCISE) {
+        return writeFormatted(allocator, writer, writerData, "    %c %s%s%s: sets %d, rest %d\n", sign,
+                              path, separator, node->data.exercise.name,
+                              node->data.exercise.sets, node->data.exercise.rest);
+    }
+    return writeFormatted(allocator, writer, writerData, "    %c %s%s%s\n", sign, path, separator, nodeName(node));
+}
+
+// Match two lists of plans, days or exercises by name (and by order among
+// equal names), and write what was removed, changed and added
+static int writeEdits(Allocator* allocator, OutputWriter writer, void* writerData, const char* path,
+                      const ASTNode* const* before, int beforeCount, const ASTNode* const* after, int afterCount) {
+    for (int i = 0; i < beforeCount; i++) {
+        int match = findNamed(after, afterCount, nodeName(before[i]), occurrenceOf(before, i));
+        int result = (match < 0)
+            ? writeAddedOrRemoved(allocator, writer, writerData, path, '-', before[i])
+            : writeNodeEdit(allocator, writer, writerData, path, before[i], after[match]);
+        if (result != 0) {
+            return result;
+        }
+    }
+    for (int i = 0; i < afterCount; i++) {
+        if (findNamed(before, beforeCount, nodeName(after[i]), occurrenceOf(after, i)) < 0 &&
+            writeAddedOrRemoved(allocator, writer, writerData, path, '+', after[i]) != 0) {
+            return RUNTIME_ERROR;
+        }
+    }
+    return 0;
+}
+
+static int writeChange(Allocator* allocator, OutputWriter writer, void* writerData, const ClientChange* change) {
+    const DigestClient* before = change->before;
+    const DigestClient* after = change->after;
+    char sign = (before == NULL) ? '+' : (after == NULL) ? '-' : '~';
+    if (writeFormatted(allocator, writer, writerData, "%c %s\n", sign, (after != NULL) ? after->name : before->name) != 0) {
+        return RUNTIME_ERROR;
+    }
+    if (after == NULL) {
+        return 0;
+    }
+    if (before != NULL && onlyReordered(before->plans, before->planCount, after->plans, after->planCount)) {
+        return writeFormatted(allocator, writer, writerData, "    ~ order changed\n");
+    }
+    return writeEdits(allocator, writer, writerData, "",
+                      (before != NULL) ? before->plans : NULL, (before != NULL) ? before->planCount : 0,
+                      after->plans, after->planCount);
+}
+
+/***
+ * Diff functions
+*/
+
+int createProgramDigest(const ASTNode* root, Allocator* allocator, ProgramDigest** result) {
+    *result = NULL;
+    ProgramDigest* digest = allocMemory(allocator, sizeof(ProgramDigest));
+    if (digest == NULL) {
+        return DIFF_ERROR_NO_MEMORY;
+    }
+    memset(digest, 0, sizeof(ProgramDigest));
+    digest->allocator = allocator;
+
+    int status = fillDigest(digest, root);
+    if (status == DIFF_OK) {
+        digest->sums = allocMemory(allocator, (digest->clientCount + 1) * sizeof(unsigned long));
+        status = (digest->sums != NULL) ? DIFF_OK : DIFF_ERROR_NO_MEMORY;
+    }
+    if (status != DIFF_OK) {
+        freeProgramDigest(digest);
+        return status;
+    }
+
+    if (digest->clientCount > 0) {
+        qsort(digest->clients, digest->clientCount, sizeof(DigestClient), compareClients);
+    }
+    digest->sums[0] = 0;
+    for (int i = 0; i < digest->clientCount; i++) {
+        digest->sums[i + 1] = digest->sums[i] + mixHash(digest->clients[i].hash);
+    }
+    *result = digest;
+    return DIFF_OK;
+}
+
+void freeProgramDigest(ProgramDigest* digest) {
+    if (digest == NULL) {
+        return;
+    }
+    for (int i = 0; i < digest->clientCount; i++) {
+        releaseMemory(digest->allocator, digest->clients[i].plans, digest->clients[i].planCapacity * sizeof(ASTNode*));
+    }
+    releaseMemory(digest->allocator, digest->clients, digest->clientCapacity * sizeof(DigestClient));
+    if (digest->sums != NULL) {
+        releaseMemory(digest->allocator, digest->sums, (digest->clientCount + 1) * sizeof(unsigned long));
+    }
+    releaseMemory(digest->allocator, digest, sizeof(ProgramDigest));
+}
+
+int digestClientCount(const ProgramDigest* digest) {
+    return digest->clientCount;
+}
+
+int diffPrograms(const ProgramDigest* before, const ProgramDigest* after,
+                 OutputWriter writer, void* writerData, int* changedClients) {
+    DiffState state = { before, after, NULL, 0, 0, false };
+    compareSubtrees(&state, 0, before->clientCount, 0, after->clientCount, HASH_BITS - TREE_FANOUT_BITS);
+    *changedClients = state.changeCount;
+
+    int status = state.failed ? DIFF_ERROR_NO_MEMORY : DIFF_OK;
+    if (state.changeCount > 0) {
+        qsort(state.changes, state.changeCount, sizeof(ClientChange), compareChanges);
+    }
+    for (int i = 0; i < state.changeCount && status == DIFF_OK; i++) {
+        if (writeChange(after->allocator, writer, writerData, &state.changes[i]) != 0) {
+            status = DIFF_ERROR_OUTPUT;
+        }
+    }
+    releaseMemory(after->allocator, state.changes, state.changeCapacity * sizeof(ClientChange));
+    return status;
+}
+
+const char* diffErrorString(int status) {
+    switch (status) {
+        case DIFF_OK: return "no error";
+        case DIFF_ERROR_NO_MEMORY: return "out of memory";
+        case DIFF_ERROR_OUTPUT: return "unable to write the output";
+        default: return "unknown error";
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "interpreter.h"
+
+// Plan diff between two versions of a program. Exercises, days and plans
+// carry a Merkle hash from hash-consing, and assignments one over their
+// client and plan (hashcons.h). A digest gives each client a hash over its
+// assignments, and arranges the clients in a hash tree keyed by the hash of
+// their name: a subtree's hash is the sum of its clients' hashes, so equal
+// sets of clients have equal subtrees whatever else is in the program.
+//
+// diffPrograms walks both trees from the top and only descends into subtrees
+// whose hashes differ, then into the plans, days and exercises that differ
+// for each changed client. Its cost follows the size of the change, not the
+// number of clients.
+//
+// Output has one line per changed client, "+ name" (added), "- name"
+// (removed) or "~ name" (changed), followed by indented edits such as
+//     ~ plan/Day/exercise: sets 3 -> 4, rest 1 -> 1
+//     + plan/Day
+//     - plan
+
+#define DIFF_LEAF_SIZE 16   // Clients compared one by one rather than split further
+
+// Diff status codes
+#define DIFF_OK 0
+#define DIFF_ERROR_NO_MEMORY -1
+#define DIFF_ERROR_OUTPUT -2
+
+typedef struct ProgramDigest ProgramDigest;
+
+// Function prototypes for digests. root must have passed semantic analysis
+// and outlive the digest.
+int createProgramDigest(const ASTNode* root, Allocator* allocator, ProgramDigest** digest);
+void freeProgramDigest(ProgramDigest* digest);
+int digestClientCount(const ProgramDigest* digest);
+
+// Write the changes from before to after; changedClients is set to their number
+int diffPrograms(const ProgramDigest* before, const ProgramDigest* after,
+                 OutputWriter writer, void* writerData, int* changedClients);
+const char* diffErrorString(int status);
+
+#endif // DIFF_H
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "fitlang.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "hashcons.h"
+#include "interpreter.h"
+#include "sourcemap.h"
+#include "registry.h"
+
+struct fl_context {
+    Allocator* allocator;
+    CompileContext compile;
+    ASTNode* program;
+    Environment* env;
+    fl_write_fn output;
+    void* outputData;
+    fl_diagnostic diagnostic;
+};
+
+struct fl_registry {
+    Allocator* allocator;
+    Registry* registry;
+};
+
+/***
+ * Helper functions
+*/
+
+static fl_status fail(fl_context* context, fl_status status, int code, const char* message) {
+    context->diagnostic.status = status;
+    context->diagnostic.code = code;
+    snprintf(context->diagnostic.message, sizeof(context->diagnostic.message), "%s", message);
+    return status;
+}
+
+// Fill in the line and column of a syntax or semantic error; the newlines are
+// only counted now that there is an error
+static void locateError(fl_context* context, const char* source, size_t length) {
+    if (context->compile.errorOffset == NO_SOURCE_OFFSET) {
+        return;
+    }
+    SourceMap* map = createBufferSourceMap("<buffer>", source, length, context->allocator);
+    if (map != NULL && !findSourcePosition(map, context->compile.errorOffset, &context->diagnostic.line, &context->diagnostic.column)) {
+        context->diagnostic.line = 0;
+        context->diagnostic.column = 0;
+    }
+    freeSourceMap(map);
+}
+
+// Drop the compiled program and everything derived from it
+static void resetProgram(fl_context* context) {
+    freeEnvironment(context->env);
+    freeAST(context->program);
+    freeSymbolTable(context->compile.symbols);
+    freeNodeTable(context->compile.nodes);
+    context->env = NULL;
+    context->program = NULL;
+
+    initCompileContext(&context->compile);
+    for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+        context->compile.allocators[i] = context->allocator;
+    }
+}
+
+/***
+ * Public API
+*/
+
+fl_context* fl_create(void) {
+    return fl_create_with_allocator(systemAllocator());
+}
+
+fl_context* fl_create_with_allocator(Allocator* allocator) {
+    if (allocator == NULL) {
+        return NULL;
+    }
+    fl_context* context = allocMemory(allocator, sizeof(fl_context));
+    if (context == NULL) {
+        return NULL;
+    }
+    memset(context, 0, sizeof(fl_context));
+    context->allocator = allocator;
+    resetProgram(context);
+    return context;
+}
+
+void fl_free(fl_context* context) {
+    if (context == NULL) {
+        return;
+    }
+    resetProgram(context);
+    releaseMemory(context->allocator, context, sizeof(fl_context));
+}
+
+void fl_set_output(fl_context* context, fl_write_fn write, void* user_data) {
+    if (context != NULL) {
+        context->output = write;
+        context->outputData = user_data;
+    }
+}
+
+fl_status fl_compile_buffer(fl_context* context, const char* source, size_t length) {
+    if (context == NULL) {
+        return FL_ERROR_INVALID_ARGUMENT;
+    }
+    resetProgram(context);
+    memset(&context->diagnostic, 0, sizeof(context->diagnostic));
+    if (source == NULL) {
+        return fail(context, FL_ERROR_INVALID_ARGUMENT, 0, "No source buffer given");
+    }
+
+    Token** tokens = lexerRange(source, length, context->compile.allocators[SUBSYSTEM_LEXER]);
+    if (tokens == NULL) {
+        return fail(context, FL_ERROR_LEXICAL, 0, "Lexical analysis failed");
+    }
+
+    // Parse and validate in one pass
+    context->compile.nodes = createNodeTableWithAllocator(context->allocator);
+    context->compile.symbols = createSymbolTableWithAllocator(context->allocator);
+    if (context->compile.nodes == NULL || context->compile.symbols == NULL) {
+        freeTokens(tokens, context->compile.allocators[SUBSYSTEM_LEXER]);
+        return fail(context, FL_ERROR_NO_MEMORY, 0, "Out of memory");
+    }
+    context->program = parseProgramWithContext(tokens, &context->compile);
+    freeTokens(tokens, context->compile.allocators[SUBSYSTEM_LEXER]);
+
+    if (context->program == NULL) {
+        locateError(context, source, length);
+        if (context->compile.outOfMemory) {
+            return fail(context, FL_ERROR_NO_MEMORY, 0, "Out of memory");
+        }
+        if (context->compile.semanticResult != SEMANTIC_OK) {
+            char message[sizeof(context->diagnostic.message)];
+            snprintf(message, sizeof(message), "Semantic analysis failed: %s",
+                     semanticErrorString(context->compile.semanticResult));
+            return fail(context, FL_ERROR_SEMANTIC, context->compile.semanticResult, message);
+        }
+        return fail(context, FL_ERROR_SYNTAX, 0, context->compile.syntaxError);
+    }
+
+    context->env = createEnvironment(context->allocator, context->output, context->outputData);
+    if (context->env == NULL) {
+        return fail(context, FL_ERROR_NO_MEMORY, 0, "Out of memory");
+    }
+    int result = evaluate(context->program, context->env);
+    if (result != 0) {
+        return fail(context, FL_ERROR_RUNTIME, result, "Evaluation failed");
+    }
+    return FL_OK;
+}
+
+fl_status fl_show_plans(fl_context* context, const char* client, fl_write_fn write, void* user_data) {
+    if (context == NULL || client == NULL) {
+        return FL_ERROR_INVALID_ARGUMENT;
+    }
+    if (context->env == NULL) {
+        return fail(context, FL_ERROR_NOT_COMPILED, 0, "No program has been compiled");
+    }
+
+    int result = showPlans(context->env, client, write, user_data);
+    if (result == UNDEFINED_IDENTIFIER) {
+        return fail(context, FL_ERROR_UNKNOWN_CLIENT, result, "Unknown client");
+    }
+    if (result != 0) {
+        return fail(context, FL_ERROR_OUTPUT, result, "Writing plans failed");
+    }
+    return FL_OK;
+}
+
+const fl_diagnostic* fl_get_diagnostic(const fl_context* context) {
+    return (context != NULL) ? &context->diagnostic : NULL;
+}
+
+/***
+ * Registry
+*/
+
+fl_registry* fl_registry_create(int max_readers) {
+    if (max_readers < 1) {
+        return NULL;
+    }
+    Allocator* allocator = systemAllocator();
+    fl_registry* registry = allocMemory(allocator, sizeof(fl_registry));
+    if (registry == NULL) {
+        return NULL;
+    }
+    registry->allocator = allocator;
+    registry->registry = createRegistry(allocator, max_readers);
+    if (registry->registry == NULL) {
+        releaseMemory(allocator, registry, sizeof(fl_registry));
+        return NULL;
+    }
+    return registry;
+}
+
+void fl_registry_free(fl_registry* registry) {
+    if (registry == NULL) {
+        return;
+    }
+    freeRegistry(registry->registry);
+    releaseMemory(registry->allocator, registry, sizeof(fl_registry));
+}
+
+fl_status fl_publish(fl_registry* registry, fl_context* context) {
+    if (registry == NULL || context == NULL) {
+        return FL_ERROR_INVALID_ARGUMENT;
+    }
+    if (context->env == NULL) {
+        return fail(context, FL_ERROR_NOT_COMPILED, 0, "No program has been compiled");
+    }
+    if (registryPublish(registry->registry, context->env) != 0) {
+        return fail(context, FL_ERROR_NO_MEMORY, 0, "Out of memory");
+    }
+    return FL_OK;
+}
+
+int fl_registry_reclaim(fl_registry* registry) {
+    return (registry != NULL) ? registryReclaim(registry->registry) : 0;
+}
+
+// Readers are the registry's own reader slots
+fl_reader* fl_reader_register(fl_registry* registry) {
+    return (registry != NULL) ? (fl_reader*)registryRegisterReader(registry->registry) : NULL;
+}
+
+void fl_reader_unregister(fl_reader* reader) {
+    if (reader != NULL) {
+        registryUnregisterReader((RegistryReader*)reader);
+    }
+}
+
+fl_status fl_read_plans(fl_reader* reader, const char* client, fl_write_fn write, void* user_data,
+                        unsigned long* version) {
+    if (reader == NULL || client == NULL) {
+        return FL_ERROR_INVALID_ARGUMENT;
+    }
+    const RegistrySnapshot* snapshot = registryEnter((RegistryReader*)reader);
+    if (version != NULL) {
+        *version = snapshotVersion(snapshot);
+    }
+    int result = (snapshot != NULL) ? snapshotShowPlans(snapshot, client, write, user_data) : 0;
+    registryExit((RegistryReader*)reader);
+
+    if (snapshot == NULL) {
+        return FL_ERROR_NOT_COMPILED;
+    }
+    if (result == UNDEFINED_IDENTIFIER) {
+        return FL_ERROR_UNKNOWN_CLIENT;
+    }
+    return (result == 0) ? FL_OK : FL_ERROR_OUTPUT;
+}
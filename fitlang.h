@@ -0,0 +1,88 @@
+#ifndef FITLANG_H
+#define FITLANG_H
+
+// libfitlang: embeddable FitLang compiler and runtime.
+//
+// Every call works on an opaque fl_context. Contexts share no state, so
+// independent contexts may be used from different threads at the same time.
+// A single context must not be used by two threads at once. Nothing is
+// printed; errors come back as status codes plus the context's diagnostic.
+//
+// A registry keeps the plans of a compiled program readable from many
+// threads while another program is compiled and published in its place.
+// Readers never lock. Plans are reference counted trees shared between the
+// registry and the contexts published to it, and the counts are not atomic:
+// publishing, reclaiming, freeing the registry, and compiling again or
+// freeing a context that was published, must all happen on one thread (or
+// under one lock). Readers do not touch the counts. Published plans are
+// freed with the allocator of the context they were compiled on, which must
+// therefore outlive the registry.
+
+#include <stddef.h>
+#include "alloc.h"
+
+typedef struct fl_context fl_context;
+typedef struct fl_registry fl_registry;
+typedef struct fl_reader fl_reader;
+
+typedef enum {
+    FL_OK = 0,
+    FL_ERROR_INVALID_ARGUMENT,
+    FL_ERROR_NO_MEMORY,
+    FL_ERROR_LEXICAL,
+    FL_ERROR_SYNTAX,
+    FL_ERROR_SEMANTIC,
+    FL_ERROR_RUNTIME,
+    FL_ERROR_NOT_COMPILED,
+    FL_ERROR_UNKNOWN_CLIENT,
+    FL_ERROR_OUTPUT
+} fl_status;
+
+// Details about the most recent failure on a context
+typedef struct {
+    fl_status status;
+    int code;          // Semantic error code from semantic.h, 0 if not applicable
+    size_t line;       // Where in the source the error is (from 1), 0 if not known
+    size_t column;
+    char message[256];
+} fl_diagnostic;
+
+// Receives output text; return 0 to continue, non-zero to abort
+typedef int (*fl_write_fn)(void* user_data, const char* text, size_t length);
+
+fl_context* fl_create(void);
+fl_context* fl_create_with_allocator(Allocator* allocator);
+void fl_free(fl_context* context);
+
+// Where showPlans statements inside compiled programs write (default: discarded)
+void fl_set_output(fl_context* context, fl_write_fn write, void* user_data);
+
+// Compile and run a program, replacing any program compiled earlier on the context
+fl_status fl_compile_buffer(fl_context* context, const char* source, size_t length);
+
+// Write the plans assigned to one client of the compiled program
+fl_status fl_show_plans(fl_context* context, const char* client, fl_write_fn write, void* user_data);
+
+const fl_diagnostic* fl_get_diagnostic(const fl_context* context);
+
+// Registry for at most max_readers reader threads at a time
+fl_registry* fl_registry_create(int max_readers);
+void fl_registry_free(fl_registry* registry); // No reader may be registered
+
+// Make the plans of the program compiled on context the ones readers see.
+// The snapshot they replace is freed once no reader can still hold it.
+fl_status fl_publish(fl_registry* registry, fl_context* context);
+
+// Free replaced snapshots whose readers have all left; returns how many are still held
+int fl_registry_reclaim(fl_registry* registry);
+
+// Each reader thread registers once (NULL when every reader slot is taken)
+fl_reader* fl_reader_register(fl_registry* registry);
+void fl_reader_unregister(fl_reader* reader);
+
+// Write the plans of one client as last published; version (if not NULL) is
+// set to the number of the publish they come from, 0 if nothing was published
+fl_status fl_read_plans(fl_reader* reader, const char* client, fl_write_fn write, void* user_data,
+                        unsigned long* version);
+
+#endif // FITLANG_H
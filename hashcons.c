@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "hashcons.h"
+
+#define INITIAL_NODE_TABLE_CAPACITY 64
+#define FNV_OFFSET 1469598103934665603UL
+#define FNV_PRIME 1099511628211UL
+
+/***
+ * Helper functions
+*/
+
+static bool isInternable(const ASTNode* node) {
+    return node->type == NODE_PLAN || node->type == NODE_DAY || node->type == NODE_EXERCISE;
+}
+
+static const char* nodeName(const ASTNode* node) {
+    switch (node->type) {
+        case NODE_PLAN:
+            return node->data.plan.name;
+        case NODE_DAY:
+            return node->data.day.name;
+        case NODE_EXERCISE:
+            return node->data.exercise.name;
+        default:
+            return NULL;
+    }
+}
+
+static unsigned long hashBytes(unsigned long hash, const void* data, size_t length) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Hash a node from its own data and the hashes of its (already interned) children
+static unsigned long hashNode(const ASTNode* node) {
+    unsigned long hash = hashBytes(FNV_OFFSET, &node->type, sizeof(node->type));
+
+    const char* name = nodeName(node);
+    if (name != NULL) {
+        hash = hashBytes(hash, name, strlen(name) + 1);
+    }
+    if (node->type == NODE_EXERCISE) {
+        hash = hashBytes(hash, &node->data.exercise.sets, sizeof(int));
+        hash = hashBytes(hash, &node->data.exercise.rest, sizeof(int));
+    }
+    for (int i = 0; i < node->childrenCount; i++) {
+        hash = hashBytes(hash, &node->children[i]->hash, sizeof(unsigned long));
+    }
+    return hash;
+}
+
+// Children are canonical, so comparing them by pointer is enough
+static bool nodesEqual(const ASTNode* a, const ASTNode* b) {
+    if (a == b) {
+        return true;
+    }
+    if (a->type != b->type || a->childrenCount != b->childrenCount) {
+        return false;
+    }
+
+    const char* nameA = nodeName(a);
+    const char* nameB = nodeName(b);
+    if ((nameA == NULL) != (nameB == NULL) || (nameA != NULL && strcmp(nameA, nameB) != 0)) {
+        return false;
+    }
+    if (a->type == NODE_EXERCISE &&
+        (a->data.exercise.sets != b->data.exercise.sets || a->data.exercise.rest != b->data.exercise.rest)) {
+        return false;
+    }
+    for (int i = 0; i < a->childrenCount; i++) {
+        if (a->children[i] != b->children[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool growNodeTable(struct NodeTable* table) {
+    int newCapacity = (table->capacity == 0) ? INITIAL_NODE_TABLE_CAPACITY : table->capacity * 2;
+    ASTNode** newSlots = allocMemory(table->allocator, newCapacity * sizeof(ASTNode*));
+    if (newSlots == NULL) {
+        return false;
+    }
+    memset(newSlots, 0, newCapacity * sizeof(ASTNode*));
+
+    for (int i = 0; i < table->capacity; i++) {
+        ASTNode* node = table->slots[i];
+        if (node == NULL) {
+            continue;
+        }
+        int index = (int)(node->hash & (unsigned long)(newCapacity - 1));
+        while (newSlots[index] != NULL) {
+            index = (index + 1) & (newCapacity - 1);
+        }
+        newSlots[index] = node;
+    }
+
+    releaseMemory(table->allocator, table->slots, table->capacity * sizeof(ASTNode*));
+    table->slots = newSlots;
+    table->capacity = newCapacity;
+    return true;
+}
+
+/***
+ * Node table functions
+*/
+
+// Create a new, empty node table
+struct NodeTable* createNodeTable() {
+    return createNodeTableWithAllocator(systemAllocator());
+}
+
+struct NodeTable* createNodeTableWithAllocator(Allocator* allocator) {
+    struct NodeTable* table = allocMemory(allocator, sizeof(struct NodeTable));
+    if (table != NULL) {
+        table->allocator = allocator;
+        table->slots = NULL;
+        table->size = 0;
+        table->capacity = 0;
+        table->internedCount = 0;
+        table->sharedCount = 0;
+    }
+    return table;
+}
+
+// Release the table's reference to every canonical node
+void freeNodeTable(struct NodeTable* table) {
+    if (table == NULL) {
+        return;
+    }
+    for (int i = 0; i < table->capacity; i++) {
+        freeAST(table->slots[i]);
+    }
+    releaseMemory(table->allocator, table->slots, table->capacity * sizeof(ASTNode*));
+    releaseMemory(table->allocator, table, sizeof(struct NodeTable));
+}
+
+// Intern bottom-up so parents can compare children by pointer
+static void internChildren(struct NodeTable* table, ASTNode* node) {
+    for (int i = 0; i < node->childrenCount; i++) {
+        node->children[i] = internNode(table, node->children[i]);
+    }
+    node->hash = hashNode(node);
+}
+
+ASTNode* internNode(struct NodeTable* table, ASTNode* node) {
+    if (table == NULL || node == NULL || !isInternable(node)) {
+        return node;
+    }
+
+    internChildren(table, node);
+    table->internedCount++;
+
+    if ((table->size + 1) * 4 > table->capacity * 3 && !growNodeTable(table)) {
+        return node; // Out of memory: keep the node unshared
+    }
+
+    int mask = table->capacity - 1;
+    int index = (int)(node->hash & (unsigned long)mask);
+    while (table->slots[index] != NULL) {
+        ASTNode* existing = table->slots[index];
+        if (existing->hash == node->hash && nodesEqual(existing, node)) {
+            retainASTNode(existing);
+            freeAST(node);
+            table->sharedCount++;
+            return existing;
+        }
+        index = (index + 1) & mask;
+    }
+
+    table->slots[index] = retainASTNode(node);
+    table->size++;
+    return node;
+}
+
+void internDefinition(struct NodeTable* table, ASTNode* plan) {
+    if (table != NULL && plan != NULL) {
+        internChildren(table, plan);
+    }
+}
+
+// An assignment's hash covers its client and its plan, so two program versions
+// can be compared a client at a time. Set once the plan is known: parsed and
+// interned, or linked from its definition.
+unsigned long assignmentHash(const char* client, const ASTNode* plan) {
+    NodeType type = NODE_ASSIGNMENT;
+    unsigned long hash = hashBytes(FNV_OFFSET, &type, sizeof(type));
+    hash = hashBytes(hash, client, strlen(client) + 1);
+    return hashBytes(hash, &plan->hash, sizeof(unsigned long));
+}
+
+void hashAssignment(ASTNode* assignment) {
+    assignment->hash = assignmentHash(assignedName(assignment), assignment->data.assignment.plan);
+}
+
+void printNodeTableStats(const struct NodeTable* table) {
+    if (table == NULL) {
+        return;
+    }
+
+    long unique = table->size;
+    double ratio = (unique > 0) ? (double)table->internedCount / (double)unique : 0.0;
+    long savedBytes = table->sharedCount * (long)sizeof(ASTNode);
+
+    printf("Plan/day/exercise nodes built: %ld\n", table->internedCount);
+    printf("Unique nodes stored: %ld\n", unique);
+    printf("Shared references: %ld\n", table->sharedCount);
+    printf("Sharing ratio: %.2f\n", ratio);
+    printf("Node memory saved: at least %ld bytes\n", savedBytes);
+}
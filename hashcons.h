@@ -0,0 +1,38 @@
+#ifndef HASHCONS_H
+#define HASHCONS_H
+
+#include "parser.h"
+
+// Hash-consing table: stores one canonical copy of every distinct
+// plan, day and exercise subtree so identical ones are shared by reference
+struct NodeTable {
+    Allocator* allocator; // Allocator for the slot array
+    ASTNode** slots;     // Open-addressed array of canonical nodes
+    int size;            // Number of canonical nodes stored
+    int capacity;        // Number of slots (always a power of two)
+    long internedCount;  // Nodes passed through internNode
+    long sharedCount;    // Nodes that were replaced by an existing canonical copy
+};
+
+// Function prototypes for node table management
+struct NodeTable* createNodeTable();
+struct NodeTable* createNodeTableWithAllocator(Allocator* allocator);
+void freeNodeTable(struct NodeTable* table);
+
+// Returns the canonical copy of node (interning its children first).
+// Ownership of node passes to the table; the caller owns the returned reference.
+ASTNode* internNode(struct NodeTable* table, ASTNode* node);
+
+// Interns the days of a plan definition and sets its hash, but keeps the
+// definition itself unshared: it is a statement, located at its own name
+void internDefinition(struct NodeTable* table, ASTNode* plan);
+
+// Sets the Merkle hash of an assignment whose plan is interned or linked
+void hashAssignment(ASTNode* assignment);
+
+// The hash an assignment of plan to client has (for expanding a group assignment per member)
+unsigned long assignmentHash(const char* client, const ASTNode* plan);
+
+void printNodeTableStats(const struct NodeTable* table);
+
+#endif // HASHCONS_H
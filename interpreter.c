@@ -1,73 +1,560 @@
-#include "interpreter.h"
-#include "lexer.h"    // Your lexer header
-#include "parser.h"   // Your parser header
-#include "semantic.h" // Your semantic analyzer header
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "interpreter.h"
+#include "semantic.h"
+#include "store.h"
+#include "postings.h"
 
-char* readFile(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Unable to open file");
-        exit(EXIT_FAILURE);
+#define INITIAL_CLIENT_CAPACITY 16
+#define OUTPUT_BUFFER_SIZE 256
+
+/***
+ * Helper functions
+*/
+
+static unsigned long hashName(const char* name) {
+    unsigned long hash = 1469598103934665603UL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 1099511628211UL;
     }
+    return hash;
+}
 
-    fseek(file, 0, SEEK_END);
-    long fileSize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+// Format text and pass it to the writer (a NULL writer discards it)
+int writeFormatted(Allocator* allocator, OutputWriter writer, void* writerData, const char* format, ...) {
+    if (writer == NULL) {
+        return 0;
+    }
+
+    char buffer[OUTPUT_BUFFER_SIZE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) {
+        return RUNTIME_ERROR;
+    }
+    if ((size_t)length < sizeof(buffer)) {
+        return writer(writerData, buffer, length) == 0 ? 0 : RUNTIME_ERROR;
+    }
+
+    // Long names: format again into a buffer that fits
+    char* text = allocMemory(allocator, length + 1);
+    if (text == NULL) {
+        return RUNTIME_ERROR;
+    }
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    int result = writer(writerData, text, length) == 0 ? 0 : RUNTIME_ERROR;
+    releaseMemory(allocator, text, length + 1);
+    return result;
+}
 
-    char* buffer = malloc(fileSize + 1);
-    if (buffer == NULL) {
-        perror("Unable to allocate memory for file content");
-        exit(EXIT_FAILURE);
+static int rebuildIndex(Environment* env, int newCapacity) {
+    int* newIndex = allocMemory(env->allocator, newCapacity * sizeof(int));
+    if (newIndex == NULL) {
+        return 0;
     }
+    memset(newIndex, 0, newCapacity * sizeof(int));
 
-    fread(buffer, 1, fileSize, file);
-    buffer[fileSize] = '\0';
+    for (int i = 0; i < env->clientCount; i++) {
+        int slot = (int)(hashName(env->clients[i].name) & (unsigned long)(newCapacity - 1));
+        while (newIndex[slot] != 0) {
+            slot = (slot + 1) & (newCapacity - 1);
+        }
+        newIndex[slot] = i + 1;
+    }
+    for (int i = 0; i < env->groupCount; i++) {
+        int slot = (int)(hashName(env->groups[i].name) & (unsigned long)(newCapacity - 1));
+        while (newIndex[slot] != 0) {
+            slot = (slot + 1) & (newCapacity - 1);
+        }
+        newIndex[slot] = -(i + 1);
+    }
 
-    fclose(file);
-    return buffer;
+    releaseMemory(env->allocator, env->index, env->indexCapacity * sizeof(int));
+    env->index = newIndex;
+    env->indexCapacity = newCapacity;
+    return 1;
 }
 
+// Keep the hash index at most half full with one more entry
+static int reserveIndex(Environment* env) {
+    return (env->clientCount + env->groupCount + 1) * 2 <= env->indexCapacity ||
+           rebuildIndex(env, env->indexCapacity == 0 ? INITIAL_CLIENT_CAPACITY * 2 : env->indexCapacity * 2);
+}
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <filename.fl>\n", argv[0]);
-        return EXIT_FAILURE;
+static void insertIndex(Environment* env, const char* name, int entry) {
+    int slot = (int)(hashName(name) & (unsigned long)(env->indexCapacity - 1));
+    while (env->index[slot] != 0) {
+        slot = (slot + 1) & (env->indexCapacity - 1);
     }
+    env->index[slot] = entry;
+}
 
-    char* sourceCode = readFile(argv[1]);
+static GroupRecord* findGroup(const Environment* env, const char* name) {
+    if (env->indexCapacity == 0) {
+        return NULL;
+    }
+    int slot = (int)(hashName(name) & (unsigned long)(env->indexCapacity - 1));
+    while (env->index[slot] != 0) {
+        if (env->index[slot] < 0) {
+            GroupRecord* group = &env->groups[-env->index[slot] - 1];
+            if (strcmp(group->name, name) == 0) {
+                return group;
+            }
+        }
+        slot = (slot + 1) & (env->indexCapacity - 1);
+    }
+    return NULL;
+}
 
-    // Lexer
-    Token** tokens = lexer(sourceCode);
-    if (tokens == NULL) {
-        fprintf(stderr, "Lexical analysis failed.\n");
-        return EXIT_FAILURE;
+static ClientRecord* addClient(Environment* env, const char* name) {
+    ClientRecord* existing = findClient(env, name);
+    if (existing != NULL) {
+        return existing;
     }
 
-    // Parser
-    ASTNode* root = parseProgram(tokens);
-    if (root == NULL) {
-        fprintf(stderr, "Parsing failed.\n");
-        return EXIT_FAILURE;
+    if (env->clientCount == env->clientCapacity) {
+        int newCapacity = (env->clientCapacity == 0) ? INITIAL_CLIENT_CAPACITY : env->clientCapacity * 2;
+        ClientRecord* resized = reallocMemory(env->allocator, env->clients,
+            env->clientCapacity * sizeof(ClientRecord), newCapacity * sizeof(ClientRecord));
+        if (resized == NULL) {
+            return NULL;
+        }
+        env->clients = resized;
+        env->clientCapacity = newCapacity;
+    }
+    if (!reserveIndex(env)) {
+        return NULL;
     }
 
-    // Semantic Analysis (if implemented)
-    struct SymbolTable* table = createSymbolTable();
-    int semanticResult = performSemanticAnalysis(root, table);
-    if (semanticResult != SEMANTIC_OK) {
-        fprintf(stderr, "Semantic analysis failed.\n");
-        return EXIT_FAILURE;
+    ClientRecord* client = &env->clients[env->clientCount];
+    client->name = allocString(env->allocator, name);
+    if (client->name == NULL) {
+        return NULL;
     }
+    client->plans = NULL;
+    client->orders = NULL;
+    client->planCount = 0;
+    client->planCapacity = 0;
+    client->groups = NULL;
+    client->groupCount = 0;
+    client->groupCapacity = 0;
 
-    // Interpretation
-    int result = evaluate(root, /* environment, if needed */);
+    insertIndex(env, name, ++env->clientCount);
+    return client;
+}
+
+static GroupRecord* addGroup(Environment* env, const char* name) {
+    GroupRecord* existing = findGroup(env, name);
+    if (existing != NULL) {
+        return existing;
+    }
 
-    // Clean up
-    freeAST(root);
-    freeSymbolTable(table);
-    free(sourceCode);
+    if (env->groupCount == env->groupCapacity) {
+        int newCapacity = (env->groupCapacity == 0) ? 4 : env->groupCapacity * 2;
+        GroupRecord* resized = reallocMemory(env->allocator, env->groups,
+            env->groupCapacity * sizeof(GroupRecord), newCapacity * sizeof(GroupRecord));
+        if (resized == NULL) {
+            return NULL;
+        }
+        env->groups = resized;
+        env->groupCapacity = newCapacity;
+    }
+    if (!reserveIndex(env)) {
+        return NULL;
+    }
+
+    GroupRecord* group = &env->groups[env->groupCount];
+    group->name = allocString(env->allocator, name);
+    if (group->name == NULL) {
+        return NULL;
+    }
+    group->members = NULL;
+    group->memberCount = 0;
+    group->memberCapacity = 0;
+    group->plans = NULL;
+    group->orders = NULL;
+    group->planCount = 0;
+    group->planCapacity = 0;
+
+    insertIndex(env, name, -++env->groupCount);
+    return group;
+}
+
+// Append a position to an int array; returns 0 if out of memory
+static int appendPosition(Allocator* allocator, int** items, int* count, int* capacity, int position) {
+    if (*count == *capacity) {
+        int newCapacity = (*capacity == 0) ? 2 : *capacity * 2;
+        int* resized = reallocMemory(allocator, *items, *capacity * sizeof(int), newCapacity * sizeof(int));
+        if (resized == NULL) {
+            return 0;
+        }
+        *items = resized;
+        *capacity = newCapacity;
+    }
+    (*items)[(*count)++] = position;
+    return 1;
+}
+
+// Add a plan (retained) to a plan list, keeping orders ascending. Plans
+// normally arrive in program order, so this is an append.
+static int insertPlan(Allocator* allocator, ASTNode*** plans, size_t** orders, int* count, int* capacity,
+                      ASTNode* plan, size_t order) {
+    if (*count == *capacity) {
+        int newCapacity = (*capacity == 0) ? 2 : *capacity * 2;
+        ASTNode** newPlans = allocMemory(allocator, newCapacity * sizeof(ASTNode*));
+        size_t* newOrders = allocMemory(allocator, newCapacity * sizeof(size_t));
+        if (newPlans == NULL || newOrders == NULL) {
+            releaseMemory(allocator, newPlans, newCapacity * sizeof(ASTNode*));
+            releaseMemory(allocator, newOrders, newCapacity * sizeof(size_t));
+            return 0;
+        }
+        if (*count > 0) {
+            memcpy(newPlans, *plans, *count * sizeof(ASTNode*));
+            memcpy(newOrders, *orders, *count * sizeof(size_t));
+        }
+        releaseMemory(allocator, *plans, *capacity * sizeof(ASTNode*));
+        releaseMemory(allocator, *orders, *capacity * sizeof(size_t));
+        *plans = newPlans;
+        *orders = newOrders;
+        *capacity = newCapacity;
+    }
+    int i = (*count)++;
+    while (i > 0 && (*orders)[i - 1] > order) {
+        (*plans)[i] = (*plans)[i - 1];
+        (*orders)[i] = (*orders)[i - 1];
+        i--;
+    }
+    (*plans)[i] = retainASTNode(plan);
+    (*orders)[i] = order;
+    return 1;
+}
+
+static int assignPlan(Environment* env, ClientRecord* client, ASTNode* plan, size_t order) {
+    return insertPlan(env->allocator, &client->plans, &client->orders, &client->planCount, &client->planCapacity,
+                      plan, order);
+}
+
+// Make a client a member of a group; joining twice changes nothing
+static int joinGroup(Environment* env, ClientRecord* client, int group) {
+    for (int i = 0; i < client->groupCount; i++) {
+        if (client->groups[i] == group) {
+            return 1;
+        }
+    }
+    GroupRecord* record = &env->groups[group];
+    return appendPosition(env->allocator, &record->members, &record->memberCount, &record->memberCapacity,
+                          (int)(client - env->clients)) &&
+           appendPosition(env->allocator, &client->groups, &client->groupCount, &client->groupCapacity, group);
+}
+
+// First position in an ascending order list whose order is at least from
+static int lowerBound(const size_t* orders, int count, size_t from) {
+    int low = 0;
+    int high = count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (orders[middle] < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static int evaluateGroup(ASTNode* node, Environment* env) {
+    GroupRecord* group = addGroup(env, node->data.group.name);
+    if (group == NULL) {
+        return RUNTIME_ERROR;
+    }
+    int position = (int)(group - env->groups);
+    for (int i = 0; i < node->childrenCount; i++) {
+        ClientRecord* client = addClient(env, node->children[i]->data.identifier.name);
+        if (client == NULL || !joinGroup(env, client, position)) {
+            return RUNTIME_ERROR;
+        }
+    }
+    return 0;
+}
 
+// Keep why the store refused a write, so the caller can say more than that evaluation failed
+static int storeFailed(Environment* env, int status, const ASTNode* node) {
+    if (env->storeResult == STORE_OK) {
+        env->storeResult = status;
+        env->storeOffset = node->offset;
+    }
+    return RUNTIME_ERROR;
+}
+
+// The plan is stored once, on the group; the store and the exercise index
+// are per client, so they get an entry for each member
+static int assignGroupPlan(ASTNode* node, Environment* env, ASTNode* plan) {
+    GroupRecord* group = findGroup(env, node->data.assignment.client->data.group.name);
+    if (group == NULL) {
+        return RUNTIME_ERROR;
+    }
+    if (!insertPlan(env->allocator, &group->plans, &group->orders, &group->planCount, &group->planCapacity,
+                    plan, node->offset)) {
+        return RUNTIME_ERROR;
+    }
+    for (int i = 0; i < group->memberCount; i++) {
+        int member = group->members[i];
+        int stored = (env->store != NULL) ? storeAppendPlan(env->store, env->clients[member].name, plan) : STORE_OK;
+        if (stored != STORE_OK) {
+            return storeFailed(env, stored, node);
+        }
+        if (env->exercises != NULL && indexAssignment(env->exercises, (uint32_t)member, plan) != POSTINGS_OK) {
+            return RUNTIME_ERROR;
+        }
+    }
+    return 0;
+}
+
+/***
+ * Environment functions
+*/
+
+Environment* createEnvironment(Allocator* allocator, OutputWriter writer, void* writerData) {
+    Environment* env = allocMemory(allocator, sizeof(Environment));
+    if (env == NULL) {
+        return NULL;
+    }
+    env->allocator = allocator;
+    env->clients = NULL;
+    env->clientCount = 0;
+    env->clientCapacity = 0;
+    env->groups = NULL;
+    env->groupCount = 0;
+    env->groupCapacity = 0;
+    env->index = NULL;
+    env->indexCapacity = 0;
+    env->writer = writer;
+    env->writerData = writerData;
+    env->store = NULL;
+    env->storeResult = STORE_OK;
+    env->storeOffset = NO_SOURCE_OFFSET;
+    env->exercises = NULL;
+    return env;
+}
+
+void freeEnvironment(Environment* env) {
+    if (env == NULL) {
+        return;
+    }
+    for (int i = 0; i < env->clientCount; i++) {
+        ClientRecord* client = &env->clients[i];
+        for (int j = 0; j < client->planCount; j++) {
+            freeAST(client->plans[j]);
+        }
+        releaseMemory(env->allocator, client->plans, client->planCapacity * sizeof(ASTNode*));
+        releaseMemory(env->allocator, client->orders, client->planCapacity * sizeof(size_t));
+        releaseMemory(env->allocator, client->groups, client->groupCapacity * sizeof(int));
+        releaseString(env->allocator, client->name);
+    }
+    releaseMemory(env->allocator, env->clients, env->clientCapacity * sizeof(ClientRecord));
+    for (int i = 0; i < env->groupCount; i++) {
+        GroupRecord* group = &env->groups[i];
+        for (int j = 0; j < group->planCount; j++) {
+            freeAST(group->plans[j]);
+        }
+        releaseMemory(env->allocator, group->plans, group->planCapacity * sizeof(ASTNode*));
+        releaseMemory(env->allocator, group->orders, group->planCapacity * sizeof(size_t));
+        releaseMemory(env->allocator, group->members, group->memberCapacity * sizeof(int));
+        releaseString(env->allocator, group->name);
+    }
+    releaseMemory(env->allocator, env->groups, env->groupCapacity * sizeof(GroupRecord));
+    releaseMemory(env->allocator, env->index, env->indexCapacity * sizeof(int));
+    releaseMemory(env->allocator, env, sizeof(Environment));
+}
+
+ClientRecord* findClient(const Environment* env, const char* name) {
+    if (env == NULL || env->indexCapacity == 0) {
+        return NULL;
+    }
+    int slot = (int)(hashName(name) & (unsigned long)(env->indexCapacity - 1));
+    while (env->index[slot] != 0) {
+        if (env->index[slot] > 0) {
+            ClientRecord* client = &env->clients[env->index[slot] - 1];
+            if (strcmp(client->name, name) == 0) {
+                return client;
+            }
+        }
+        slot = (slot + 1) & (env->indexCapacity - 1);
+    }
+    return NULL;
+}
+
+ASTNode* clientPlanFrom(const Environment* env, const ClientRecord* client, size_t from, size_t* order) {
+    ASTNode* plan = NULL;
+    int i = lowerBound(client->orders, client->planCount, from);
+    if (i < client->planCount) {
+        plan = client->plans[i];
+        *order = client->orders[i];
+    }
+    for (int g = 0; g < client->groupCount; g++) {
+        const GroupRecord* group = &env->groups[client->groups[g]];
+        i = lowerBound(group->orders, group->planCount, from);
+        if (i < group->planCount && (plan == NULL || group->orders[i] < *order)) {
+            plan = group->plans[i];
+            *order = group->orders[i];
+        }
+    }
+    return plan;
+}
+
+int listClientPlans(const Environment* env, const ClientRecord* client, ASTNode*** plans, int* count) {
+    int total = client->planCount;
+    for (int g = 0; g < client->groupCount; g++) {
+        total += env->groups[client->groups[g]].planCount;
+    }
+    *plans = NULL;
+    *count = 0;
+    if (total == 0) {
+        return 0;
+    }
+    *plans = allocMemory(env->allocator, total * sizeof(ASTNode*));
+    if (*plans == NULL) {
+        return RUNTIME_ERROR;
+    }
+    size_t from = 0;
+    size_t order;
+    ASTNode* plan;
+    while ((plan = clientPlanFrom(env, client, from, &order)) != NULL) {
+        (*plans)[(*count)++] = plan;
+        from = order + 1;
+    }
+    return 0;
+}
+
+// Write a client's plans, day by day
+int writePlans(Allocator* allocator, OutputWriter writer, void* writerData,
+               const char* clientName, ASTNode** plans, int planCount) {
+    if (writeFormatted(allocator, writer, writerData, "Plans for %s:\n", clientName) != 0) {
+        return RUNTIME_ERROR;
+    }
+    for (int i = 0; i < planCount; i++) {
+        ASTNode* plan = plans[i];
+        if (writeFormatted(allocator, writer, writerData, "Plan: %s\n", plan->data.plan.name) != 0) {
+            return RUNTIME_ERROR;
+        }
+        for (int j = 0; j < plan->childrenCount; j++) {
+            ASTNode* day = plan->children[j];
+            if (writeFormatted(allocator, writer, writerData, "  %s:\n", day->data.day.name) != 0) {
+                return RUNTIME_ERROR;
+            }
+            for (int k = 0; k < day->childrenCount; k++) {
+                ASTNode* exercise = day->children[k];
+                if (writeFormatted(allocator, writer, writerData, "    %s - sets: %d, rest: %d\n",
+                        exercise->data.exercise.name, exercise->data.exercise.sets, exercise->data.exercise.rest) != 0) {
+                    return RUNTIME_ERROR;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// Write every plan assigned to a client. With a store attached the plans come
+// from the store, so clients from earlier runs are included.
+int showPlans(const Environment* env, const char* clientName, OutputWriter writer, void* writerData) {
+    if (env->store != NULL) {
+        ASTNode** plans;
+        int planCount;
+        int result = storeLoadPlans(env->store, clientName, env->allocator, &plans, &planCount);
+        if (result == STORE_ERROR_NOT_FOUND) {
+            return UNDEFINED_IDENTIFIER;
+        }
+        if (result != STORE_OK) {
+            return RUNTIME_ERROR;
+        }
+        result = writePlans(env->allocator, writer, writerData, clientName, plans, planCount);
+        storeFreePlans(env->allocator, plans, planCount);
+        return result;
+    }
+
+    ClientRecord* client = findClient(env, clientName);
+    if (client == NULL) {
+        return UNDEFINED_IDENTIFIER;
+    }
+    if (client->groupCount == 0) {
+        return writePlans(env->allocator, writer, writerData, client->name, client->plans, client->planCount);
+    }
+
+    ASTNode** plans;
+    int planCount;
+    if (listClientPlans(env, client, &plans, &planCount) != 0) {
+        return RUNTIME_ERROR;
+    }
+    int result = writePlans(env->allocator, writer, writerData, client->name, plans, planCount);
+    releaseMemory(env->allocator, plans, planCount * sizeof(ASTNode*));
     return result;
 }
 
+int evaluate(ASTNode* node, Environment* env) {
+    if (node == NULL || env == NULL) {
+        return RUNTIME_ERROR;
+    }
+
+    switch (node->type) {
+        case NODE_MAIN:
+            for (int i = 0; i < node->childrenCount; i++) {
+                int result = evaluate(node->children[i], env);
+                if (result != 0) {
+                    return result;
+                }
+            }
+            return 0;
+
+        case NODE_CLIENT_PROFILE: {
+            if (addClient(env, node->data.clientProfile.name) == NULL) {
+                return RUNTIME_ERROR;
+            }
+            int stored = (env->store != NULL) ? storePutClient(env->store, node->data.clientProfile.name) : STORE_OK;
+            if (stored != STORE_OK) {
+                return storeFailed(env, stored, node);
+            }
+            return 0;
+        }
+
+        case NODE_ASSIGNMENT: {
+            ASTNode* plan = node->data.assignment.plan;
+            if (plan == NULL || plan->type != NODE_PLAN) {
+                return RUNTIME_ERROR; // Plan references must be resolved by semantic analysis
+            }
+            if (node->data.assignment.client->type == NODE_GROUP) {
+                return assignGroupPlan(node, env, plan);
+            }
+            const char* clientName = node->data.assignment.client->data.clientProfile.name;
+            ClientRecord* client = addClient(env, clientName);
+            if (client == NULL || !assignPlan(env, client, plan, node->offset)) {
+                return RUNTIME_ERROR;
+            }
+            int stored = (env->store != NULL) ? storeAppendPlan(env->store, clientName, plan) : STORE_OK;
+            if (stored != STORE_OK) {
+                return storeFailed(env, stored, node);
+            }
+            if (env->exercises != NULL &&
+                indexAssignment(env->exercises, (uint32_t)(client - env->clients), plan) != POSTINGS_OK) {
+                return RUNTIME_ERROR;
+            }
+            return 0;
+        }
+
+        case NODE_GROUP:
+            return evaluateGroup(node, env);
+
+        case NODE_SHOW_PLANS:
+            return showPlans(env, node->data.showPlans.clientName, env->writer, env->writerData);
+
+        default:
+            // Plan definitions and other nodes have no runtime effect of their own
+            return 0;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "parser.h" // Include the header file where your AST structure is defined
+#include "alloc.h"
+
+// Receives program output (e.g. showPlans); returns 0 on success
+typedef int (*OutputWriter)(void* userData, const char* text, size_t length);
+
+// Runtime record for one client and the plans assigned to it
+typedef struct {
+    char* name;
+    ASTNode** plans;  // Shared references to NODE_PLAN subtrees
+    size_t* orders;   // Program order of each plan's assignment, ascending (NULL in copies)
+    int planCount;
+    int planCapacity;
+    int* groups;      // Positions in env->groups of the groups the client belongs to
+    int groupCount;
+    int groupCapacity;
+} ClientRecord;
+
+// Runtime record for a client group. Plans assigned to the group are kept
+// here once, not copied to each member; a member's plans are its own merged
+// with its groups' in program order.
+typedef struct {
+    char* name;
+    int* members;     // Positions in env->clients
+    int memberCount;
+    int memberCapacity;
+    ASTNode** plans;
+    size_t* orders;
+    int planCount;
+    int planCapacity;
+} GroupRecord;
+
+struct Store;
+struct ExerciseIndex;
+
+// Runtime environment: every client seen so far and where output goes
+typedef struct {
+    Allocator* allocator;
+    ClientRecord* clients;  // Clients in declaration order
+    int clientCount;
+    int clientCapacity;
+    GroupRecord* groups;    // Groups in declaration order
+    int groupCount;
+    int groupCapacity;
+    int* index;             // Open-addressed hash index: position + 1 for clients, -(position + 1) for groups
+    int indexCapacity;
+    OutputWriter writer;    // Destination for showPlans statements (NULL discards output)
+    void* writerData;
+    struct Store* store;    // Persistent store written through and read by showPlans (NULL if none)
+    int storeResult;        // Store status code of the first write the store refused (0 if none)
+    size_t storeOffset;     // Input offset of the statement whose write was refused
+    struct ExerciseIndex* exercises; // Inverted index filled in by assignments (NULL if none)
+} Environment;
+
+// Function to create a new environment
+Environment* createEnvironment(Allocator* allocator, OutputWriter writer, void* writerData);
+
+// Function to free the environment
+void freeEnvironment(Environment* env);
+
+// Function to evaluate/execute an AST node; returns 0 on success
+int evaluate(ASTNode* node, Environment* env);
+
+// Functions to query the environment after evaluation
+ClientRecord* findClient(const Environment* env, const char* name);
+int showPlans(const Environment* env, const char* clientName, OutputWriter writer, void* writerData);
+
+// The client's first plan, own or through a group, whose assignment order is
+// at least from; order receives its order. NULL if there is none.
+ASTNode* clientPlanFrom(const Environment* env, const ClientRecord* client, size_t from, size_t* order);
+
+// All of a client's plans in program order, in a new array (free with
+// releaseMemory, count * sizeof(ASTNode*)); the plans are not retained
+int listClientPlans(const Environment* env, const ClientRecord* client, ASTNode*** plans, int* count);
+
+// Write plans in the showPlans format
+int writePlans(Allocator* allocator, OutputWriter writer, void* writerData,
+               const char* clientName, ASTNode** plans, int planCount);
+
+// Format text and pass it to a writer (a NULL writer discards it); returns 0 on success
+int writeFormatted(Allocator* allocator, OutputWriter writer, void* writerData, const char* format, ...);
+
+#endif // INTERPRETER_H
@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lazy.h"
+#include "lexer.h"
+#include "semantic.h"
+#include "hashcons.h"
+
+#define INITIAL_STATEMENT_CAPACITY 1024
+#define INITIAL_NAME_CAPACITY 256   // Hash index slots (a power of two)
+#define NO_STATEMENT -1
+
+// An indexed statement
+typedef struct {
+    StatementSpan span;
+    int next;                   // Next assignment to the same client or group (NO_STATEMENT at the end)
+    ASTNode* node;              // Plan definition or group, once parsed
+} LazyStatement;
+
+// A client, plan or group name, as a range of the input
+typedef struct {
+    size_t offset;
+    size_t length;
+    unsigned long hash;
+    int declaration;            // First statement declaring the name (NO_STATEMENT if none)
+    int firstAssignment;        // Assignments to the name as a client or group, in program order
+    int lastAssignment;
+    int pending;                // First assignment not yet evaluated
+    int firstGroup;             // Memberships of a client, latest first (NO_STATEMENT if none)
+    bool evaluated;             // The declaration has been evaluated
+} LazyName;
+
+// A client's membership of a group
+typedef struct {
+    int group;                  // Position in names
+    int next;                   // The client's next membership (NO_STATEMENT at the end)
+} LazyMembership;
+
+struct LazyProgram {
+    Allocator* allocator;
+    SourceText input;
+    LazyStatement* statements;
+    int statementCount;
+    int statementCapacity;
+    LazyName* names;
+    int nameCount;
+    int nameCapacity;
+    int* slots;                 // Open-addressed hash index into names (entries are position + 1)
+    int slotCapacity;
+    LazyMembership* memberships;
+    int membershipCount;
+    int membershipCapacity;
+    char* scratch;              // Name of the client being shown
+    size_t scratchCapacity;
+    CompileContext context;     // For parsing statements as they are needed
+    int parsedStatements;
+    int shownClients;
+};
+
+/***
+ * Index
+*/
+
+static unsigned long hashText(const char* text, size_t length) {
+    unsigned long hash = 1469598103934665603UL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static int* findSlot(const LazyProgram* program, const char* name, size_t length, unsigned long hash) {
+    int slot = (int)(hash & (unsigned long)(program->slotCapacity - 1));
+    while (program->slots[slot] != 0) {
+        const LazyName* entry = &program->names[program->slots[slot] - 1];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(program->input.text + entry->offset, name, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (program->slotCapacity - 1);
+    }
+    return &program->slots[slot];
+}
+
+static LazyName* lookupName(const LazyProgram* program, const char* name, size_t length) {
+    int position = *findSlot(program, name, length, hashText(name, length));
+    return (position != 0) ? &program->names[position - 1] : NULL;
+}
+
+static bool growSlots(LazyProgram* program) {
+    int newCapacity = program->slotCapacity * 2;
+    int* slots = allocMemory(program->allocator, newCapacity * sizeof(int));
+    if (slots == NULL) {
+        return false;
+    }
+    memset(slots, 0, newCapacity * sizeof(int));
+    for (int i = 0; i < program->nameCount; i++) {
+        int slot = (int)(program->names[i].hash & (unsigned long)(newCapacity - 1));
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (newCapacity - 1);
+        }
+        slots[slot] = i + 1;
+    }
+    releaseMemory(program->allocator, program->slots, program->slotCapacity * sizeof(int));
+    program->slots = slots;
+    program->slotCapacity = newCapacity;
+    return true;
+}
+
+// Find or add the name at offset in the input (NULL if out of memory)
+static LazyName* internName(LazyProgram* program, size_t offset, size_t length) {
+    const char* name = program->input.text + offset;
+    unsigned long hash = hashText(name, length);
+    int* slot = findSlot(program, name, length, hash);
+    if (*slot != 0) {
+        return &program->names[*slot - 1];
+    }
+    if (program->nameCount == program->nameCapacity) {
+        int newCapacity = (program->nameCapacity == 0) ? INITIAL_NAME_CAPACITY : program->nameCapacity * 2;
+        LazyName* resized = reallocMemory(program->allocator, program->names,
+            program->nameCapacity * sizeof(LazyName), newCapacity * sizeof(LazyName));
+        if (resized == NULL) {
+            return NULL;
+        }
+        program->names = resized;
+        program->nameCapacity = newCapacity;
+    }
+    LazyName* entry = &program->names[program->nameCount];
+    entry->offset = offset;
+    entry->length = length;
+    entry->hash = hash;
+    entry->declaration = NO_STATEMENT;
+    entry->firstAssignment = entry->lastAssignment = entry->pending = NO_STATEMENT;
+    entry->firstGroup = NO_STATEMENT;
+    entry->evaluated = false;
+    *slot = ++program->nameCount;
+    // Keep the index at most half full
+    if (program->nameCount * 2 > program->slotCapacity && !growSlots(program)) {
+        return NULL;
+    }
+    return entry;
+}
+
+// StatementVisitor that adds a statement to the index
+static int indexStatement(void* userData, const StatementSpan* span) {
+    LazyProgram* program = userData;
+    if (program->statementCount == program->statementCapacity) {
+        int newCapacity = (program->statementCapacity == 0) ? INITIAL_STATEMENT_CAPACITY : program->statementCapacity * 2;
+        LazyStatement* resized = reallocMemory(program->allocator, program->statements,
+            program->statementCapacity * sizeof(LazyStatement), newCapacity * sizeof(LazyStatement));
+        if (resized == NULL) {
+            return -1;
+        }
+        program->statements = resized;
+        program->statementCapacity = newCapacity;
+    }
+    int position = program->statementCount++;
+    LazyStatement* statement = &program->statements[position];
+    statement->span = *span;
+    statement->next = NO_STATEMENT;
+    statement->node = NULL;
+
+    if (span->kind == STATEMENT_CLIENT || span->kind == STATEMENT_PLAN || span->kind == STATEMENT_GROUP ||
+        span->kind == STATEMENT_ASSIGNMENT) {
+        LazyName* name = internName(program, span->nameOffset, span->nameLength);
+        if (name == NULL) {
+            return -1;
+        }
+        if (span->kind != STATEMENT_ASSIGNMENT) {
+            if (name->declaration == NO_STATEMENT) {
+                name->declaration = position;
+            }
+        } else if (name->lastAssignment == NO_STATEMENT) {
+            name->firstAssignment = name->lastAssignment = name->pending = position;
+        } else {
+            program->statements[name->lastAssignment].next = position;
+            name->lastAssignment = position;
+        }
+    }
+    return 0;
+}
+
+/***
+ * Materialization
+*/
+
+// Lex and parse one statement from its byte range (NULL on failure)
+static ASTNode* parseIndexed(LazyProgram* program, const StatementSpan* span) {
+    Allocator* lexerAllocator = program->context.allocators[SUBSYSTEM_LEXER];
+    Token** tokens = lexerRange(program->input.text + span->begin, span->end - span->begin, lexerAllocator);
+    if (tokens == NULL) {
+        return NULL;
+    }
+    for (Token** token = tokens; *token != NULL; token++) {
+        (*token)->offset += span->begin; // Offsets in the whole input, for diagnostics
+    }
+    Parser parser = { tokens, &program->context };
+    ASTNode* statement = parseStatement(&parser);
+    freeTokens(tokens, lexerAllocator);
+    program->parsedStatements++;
+    return statement;
+}
+
+// Plan definition a body-less assignment refers to, parsed on first use
+static ASTNode* definedPlan(LazyProgram* program, const ASTNode* reference) {
+    const char* name = reference->data.identifier.name;
+    LazyName* entry = lookupName(program, name, strlen(name));
+    if (entry == NULL || entry->declaration == NO_STATEMENT) {
+        return NULL;
+    }
+    LazyStatement* definition = &program->statements[entry->declaration];
+    if (definition->span.kind != STATEMENT_PLAN) {
+        return NULL;
+    }
+    if (definition->node == NULL) {
+        definition->node = parseIndexed(program, &definition->span);
+    }
+    return definition->node;
+}
+
+// Group an assignment's target names, or NULL if it names a client
+static ASTNode* definedGroup(LazyProgram* program, const ASTNode* target) {
+    const char* name = target->data.clientProfile.name;
+    LazyName* entry = lookupName(program, name, strlen(name));
+    if (entry == NULL || entry->declaration == NO_STATEMENT) {
+        return NULL;
+    }
+    LazyStatement* declaration = &program->statements[entry->declaration];
+    return (declaration->span.kind == STATEMENT_GROUP) ? declaration->node : NULL;
+}
+
+// Groups are parsed as soon as the program is checked, since a client's
+// plans depend on which groups list it. Each member gets a membership.
+static int indexGroups(LazyProgram* program) {
+    for (int i = 0; i < program->statementCount; i++) {
+        LazyStatement* statement = &program->statements[i];
+        if (statement->span.kind != STATEMENT_GROUP) {
+            continue;
+        }
+        statement->node = parseIndexed(program, &statement->span);
+        if (statement->node == NULL) {
+            return CHECK_ERROR_NO_MEMORY;
+        }
+        int group = (int)(lookupName(program, program->input.text + statement->span.nameOffset,
+                                     statement->span.nameLength) - program->names);
+        for (int j = 0; j < statement->node->childrenCount; j++) {
+            const char* member = statement->node->children[j]->data.identifier.name;
+            LazyName* client = lookupName(program, member, strlen(member));
+            if (client == NULL || (client->firstGroup != NO_STATEMENT &&
+                                   program->memberships[client->firstGroup].group == group)) {
+                continue; // Listed twice in the group
+            }
+            if (program->membershipCount == program->membershipCapacity) {
+                int newCapacity = (program->membershipCapacity == 0) ? INITIAL_NAME_CAPACITY : program->membershipCapacity * 2;
+                LazyMembership* resized = reallocMemory(program->allocator, program->memberships,
+                    program->membershipCapacity * sizeof(LazyMembership), newCapacity * sizeof(LazyMembership));
+                if (resized == NULL) {
+                    return CHECK_ERROR_NO_MEMORY;
+                }
+                program->memberships = resized;
+                program->membershipCapacity = newCapacity;
+            }
+            LazyMembership* membership = &program->memberships[program->membershipCount];
+            membership->group = group;
+            membership->next = client->firstGroup;
+            client->firstGroup = program->membershipCount++;
+        }
+    }
+    return CHECK_OK;
+}
+
+// Parse and evaluate an assignment
+static int evaluateAssignment(LazyProgram* program, Environment* env, int position) {
+    ASTNode* assignment = parseIndexed(program, &program->statements[position].span);
+    if (assignment == NULL) {
+        return RUNTIME_ERROR;
+    }
+    ASTNode* group = definedGroup(program, assignment->data.assignment.client);
+    if (group != NULL) {
+        freeAST(assignment->data.assignment.client);
+        assignment->data.assignment.client = retainASTNode(group);
+    }
+    ASTNode* plan = assignment->data.assignment.plan;
+    if (plan->type == NODE_IDENTIFIER) {
+        // Link it as semantic analysis would; the recognizer has checked that the plan exists
+        ASTNode* definition = definedPlan(program, plan);
+        if (definition == NULL) {
+            freeAST(assignment);
+            return RUNTIME_ERROR;
+        }
+        assignment->data.assignment.plan = retainASTNode(definition);
+        freeAST(plan);
+        hashAssignment(assignment);
+    }
+    int result = evaluate(assignment, env);
+    freeAST(assignment);
+    return result;
+}
+
+// Evaluate the declaration and assignments of a client or group that come
+// before position, and for a client those of the groups it belongs to
+static int materializeClient(LazyProgram* program, Environment* env, LazyName* client, int position) {
+    if (!client->evaluated && client->declaration != NO_STATEMENT && client->declaration < position) {
+        LazyStatement* statement = &program->statements[client->declaration];
+        int result = 0;
+        if (statement->span.kind == STATEMENT_CLIENT) {
+            ASTNode* declaration = parseIndexed(program, &statement->span);
+            result = (declaration != NULL) ? evaluate(declaration, env) : RUNTIME_ERROR;
+            freeAST(declaration);
+            program->shownClients++;
+        } else if (statement->span.kind == STATEMENT_GROUP) {
+            result = evaluate(statement->node, env);
+        }
+        if (result != 0) {
+            return result;
+        }
+        client->evaluated = true;
+    }
+    while (client->pending != NO_STATEMENT && client->pending < position) {
+        int result = evaluateAssignment(program, env, client->pending);
+        if (result != 0) {
+            return result;
+        }
+        client->pending = program->statements[client->pending].next;
+    }
+    for (int i = client->firstGroup; i != NO_STATEMENT; i = program->memberships[i].next) {
+        int result = materializeClient(program, env, &program->names[program->memberships[i].group], position);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+// Show a client's plans as of position
+static int showClientAt(LazyProgram* program, Environment* env, const char* name, size_t length, int position,
+                        OutputWriter writer, void* writerData) {
+    if (length + 1 > program->scratchCapacity) {
+        char* resized = reallocMemory(program->allocator, program->scratch, program->scratchCapacity, length + 1);
+        if (resized == NULL) {
+            return RUNTIME_ERROR;
+        }
+        program->scratch = resized;
+        program->scratchCapacity = length + 1;
+    }
+    memcpy(program->scratch, name, length);
+    program->scratch[length] = '\0';
+
+    LazyName* client = lookupName(program, name, length);
+    if (client != NULL) {
+        int result = materializeClient(program, env, client, position);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return showPlans(env, program->scratch, writer, writerData);
+}
+
+/***
+ * Program functions
+*/
+
+int openLazyProgram(const char* path, const Catalog* catalog, Allocator* allocator,
+                    LazyProgram** program, CheckResult* result) {
+    *program = NULL;
+    memset(result, 0, sizeof(CheckResult));
+    result->semanticResult = SEMANTIC_OK;
+    result->errorOffset = NO_SOURCE_OFFSET;
+
+    LazyProgram* opened = allocMemory(allocator, sizeof(LazyProgram));
+    if (opened == NULL) {
+        result->status = CHECK_ERROR_NO_MEMORY;
+        return CHECK_ERROR_NO_MEMORY;
+    }
+    memset(opened, 0, sizeof(LazyProgram));
+    opened->allocator = allocator;
+    opened->slotCapacity = INITIAL_NAME_CAPACITY;
+    opened->slots = allocMemory(allocator, INITIAL_NAME_CAPACITY * sizeof(int));
+    initCompileContext(&opened->context);
+    for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+        opened->context.allocators[i] = allocator;
+    }
+    opened->context.catalog = catalog;
+    opened->context.nodes = createNodeTableWithAllocator(allocator);
+    if (opened->slots == NULL || opened->context.nodes == NULL) {
+        freeLazyProgram(opened);
+        result->status = CHECK_ERROR_NO_MEMORY;
+        return CHECK_ERROR_NO_MEMORY;
+    }
+    memset(opened->slots, 0, INITIAL_NAME_CAPACITY * sizeof(int));
+
+    int status = CHECK_OK;
+    int sourceResult = loadSourceText(path, allocator, &opened->input);
+    if (sourceResult != SOURCE_OK) {
+        result->sourceResult = sourceResult;
+        status = result->status = CHECK_ERROR_SOURCE;
+    }
+    if (status == CHECK_OK) {
+        status = checkText(opened->input.text, opened->input.length, catalog, allocator, indexStatement, opened, result);
+    }
+    if (status == CHECK_OK) {
+        status = result->status = indexGroups(opened);
+    }
+    if (status != CHECK_OK) {
+        freeLazyProgram(opened);
+        return status;
+    }
+    *program = opened;
+    return CHECK_OK;
+}
+
+void freeLazyProgram(LazyProgram* program) {
+    if (program == NULL) {
+        return;
+    }
+    Allocator* allocator = program->allocator;
+    for (int i = 0; i < program->statementCount; i++) {
+        freeAST(program->statements[i].node);
+    }
+    freeNodeTable(program->context.nodes);
+    releaseSourceText(&program->input, allocator);
+    releaseMemory(allocator, program->statements, program->statementCapacity * sizeof(LazyStatement));
+    releaseMemory(allocator, program->names, program->nameCapacity * sizeof(LazyName));
+    releaseMemory(allocator, program->slots, program->slotCapacity * sizeof(int));
+    releaseMemory(allocator, program->memberships, program->membershipCapacity * sizeof(LazyMembership));
+    releaseMemory(allocator, program->scratch, program->scratchCapacity);
+    releaseMemory(allocator, program, sizeof(LazyProgram));
+}
+
+int runLazyProgram(LazyProgram* program, Environment* env) {
+    for (int i = 0; i < program->statementCount; i++) {
+        const StatementSpan* span = &program->statements[i].span;
+        if (span->kind == STATEMENT_SHOW_PLANS) {
+            int result = showClientAt(program, env, program->input.text + span->nameOffset, span->nameLength, i,
+                                      env->writer, env->writerData);
+            if (result != 0) {
+                return result;
+            }
+        }
+    }
+    return 0;
+}
+
+int showLazyClient(LazyProgram* program, Environment* env, const char* name, OutputWriter writer, void* writerData) {
+    return showClientAt(program, env, name, strlen(name), program->statementCount, writer, writerData);
+}
+
+void printLazyStats(const LazyProgram* program) {
+    size_t indexBytes = program->statementCapacity * sizeof(LazyStatement) +
+                        program->nameCapacity * sizeof(LazyName) + program->slotCapacity * sizeof(int) +
+                        program->membershipCapacity * sizeof(LazyMembership);
+    printf("Lazy: %d statements indexed (%zu bytes of index, %zu bytes of input), %d parsed, %d of %d names shown\n",
+           program->statementCount, indexBytes, program->input.length, program->parsedStatements,
+           program->shownClients, program->nameCount);
+}
@@ -0,0 +1,37 @@
+#ifndef LAZY_H
+#define LAZY_H
+
+#include "interpreter.h"
+#include "recognizer.h"
+
+// Lazy front end. The program is checked by the recognizer (recognizer.h),
+// which builds nothing; it only leaves an index of the top-level statements:
+// their kind, byte range and names, and for each client or group the
+// assignments that name it. The input stays in memory (mapped, for an
+// uncompressed file).
+//
+// Running the program parses nothing but its groups until a showPlans
+// statement, or showLazyClient, asks for a client. Then that client's
+// assignments up to that point, those of the groups it belongs to, and the
+// plan definitions they refer to, are lexed from their byte ranges, parsed
+// and evaluated, once each; the environment keeps the result. Trees are
+// therefore only built for the clients that are shown, while diagnostics
+// are the same as for a full compile.
+
+typedef struct LazyProgram LazyProgram;
+
+// Read and check path. Returns a check status code (recognizer.h); when it is
+// not CHECK_OK, result says why and no program is returned.
+int openLazyProgram(const char* path, const Catalog* catalog, Allocator* allocator,
+                    LazyProgram** program, CheckResult* result);
+void freeLazyProgram(LazyProgram* program);
+
+// Run the program's showPlans statements; returns 0 on success
+int runLazyProgram(LazyProgram* program, Environment* env);
+
+// Write every plan assigned to a client by the program (UNDEFINED_IDENTIFIER if there is no such client)
+int showLazyClient(LazyProgram* program, Environment* env, const char* name, OutputWriter writer, void* writerData);
+
+void printLazyStats(const LazyProgram* program);
+
+#endif // LAZY_H
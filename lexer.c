@@ -4,6 +4,7 @@
 #include "lexer.h"
 #include <stdbool.h>
 #define INITIAL_SIZE 32
+#define KEYWORD_BUFFER_SIZE 32
 
 // Helper functions
 bool is_identifier_start(char c) {
@@ -43,119 +44,442 @@ TokenType identifyKeywordOrIdentifier(const char* word) {
         return TOKEN_REST;
     } else if (strcmp(word, "showPlans") == 0) {
         return TOKEN_SHOW_PLANS;
+    } else if (strcmp(word, "Plan") == 0) {
+        return TOKEN_PLAN;
+    } else if (strcmp(word, "Group") == 0) {
+        return TOKEN_GROUP;
+    } else if (strcmp(word, "import") == 0) {
+        return TOKEN_IMPORT;
     }
     // "plan" and all other unrecognized words are identifiers
     return TOKEN_IDENTIFIER;
 }
 
 // Create the Tokens
-Token* createToken(TokenType type, const char* value) {
-    Token* token = (Token*)malloc(sizeof(Token));
+Token* createToken(Allocator* allocator, TokenType type, const char* value, size_t length) {
+    Token* token = (Token*)allocMemory(allocator, sizeof(Token));
     if (!token) {
         return NULL;
     }
 
-    token->value = strdup(value);
+    token->value = allocStringN(allocator, value, length);
     if (!token->value) {
-        free(token);
+        releaseMemory(allocator, token, sizeof(Token));
         return NULL;
     }
 
     token->type = type;
+    token->offset = 0;
     return token;
 }
 
-Token** lexer(const char* input) {
-    Token** tokens = malloc(sizeof(Token*) * INITIAL_SIZE);
+// Free a NULL-terminated token array produced by the lexer
+void freeTokens(Token** tokens, Allocator* allocator) {
+    if (tokens == NULL) {
+        return;
+    }
+
     int tokenCount = 0;
-    int capacity = INITIAL_SIZE;
+    while (tokens[tokenCount] != NULL) {
+        releaseString(allocator, tokens[tokenCount]->value);
+        releaseMemory(allocator, tokens[tokenCount], sizeof(Token));
+        tokenCount++;
+    }
+    releaseMemory(allocator, tokens, sizeof(Token*) * (tokenCount + 1));
+}
+
+// Token array under construction
+typedef struct {
+    Allocator* allocator;
+    Token** tokens;
+    int count;
+    int capacity;
+    const char* origin;   // Text being scanned...
+    size_t originOffset;  // ...and where it starts in the whole input
+    size_t end;           // Input seen so far; end-of-input tokens are placed here
+} TokenList;
+
+static bool initTokenList(TokenList* list, Allocator* allocator) {
+    list->allocator = allocator;
+    list->origin = NULL;
+    list->originOffset = 0;
+    list->end = 0;
+    list->tokens = allocMemory(allocator, sizeof(Token*) * INITIAL_SIZE);
+    list->count = 0;
+    list->capacity = INITIAL_SIZE;
+    return list->tokens != NULL;
+}
+
+// Free a partially built token array after an allocation failure
+static Token** abandonTokens(TokenList* list) {
+    for (int i = 0; i < list->count; ++i) {
+        releaseString(list->allocator, list->tokens[i]->value);
+        releaseMemory(list->allocator, list->tokens[i], sizeof(Token));
+    }
+    releaseMemory(list->allocator, list->tokens, sizeof(Token*) * list->capacity);
+    return NULL;
+}
+
+// Scan text that starts at the given offset of the whole input
+static void setTokenOrigin(TokenList* list, const char* origin, size_t offset) {
+    list->origin = origin;
+    list->originOffset = offset;
+}
+
+// Offset in the whole input of a position in the text being scanned
+static size_t offsetOf(const TokenList* list, const char* position) {
+    return list->originOffset + (size_t)(position - list->origin);
+}
+
+static bool appendToken(TokenList* list, TokenType type, const char* value, size_t length, size_t offset) {
+    if (list->count >= list->capacity) {
+        Token** resized = reallocMemory(list->allocator, list->tokens,
+            sizeof(Token*) * list->capacity, sizeof(Token*) * list->capacity * 2);
+        if (!resized) {
+            return false;
+        }
+        list->tokens = resized;
+        list->capacity *= 2;
+    }
+
+    Token* token = createToken(list->allocator, type, value, length);
+    if (token == NULL) {
+        return false;
+    }
+    token->offset = offset;
+    list->tokens[list->count++] = token;
+    return true;
+}
+
+// Terminate with an end-of-input token followed by NULL
+static Token** finishTokens(TokenList* list) {
+    if (!appendToken(list, TOKEN_EOF, "", 0, list->end)) {
+        return abandonTokens(list);
+    }
 
-    while (*input != '\0') {
+    Token** resized = reallocMemory(list->allocator, list->tokens,
+        sizeof(Token*) * list->capacity, sizeof(Token*) * (list->count + 1));
+    if (!resized) {
+        return abandonTokens(list);
+    }
+    resized[list->count] = NULL;
+    return resized;
+}
+
+// Tokenize input up to end. Unless final is set, stop before a word, number or
+// string that reaches end, since it may continue in the next piece of input.
+// Returns where scanning stopped, or NULL if an allocation failed.
+static const char* lexSpan(TokenList* list, const char* input, const char* end, bool final) {
+    bool ok = true;
+
+    while (input < end && ok) {
         if (isspace(*input)) {
             input++;
         } else if (is_identifier_start(*input)) {
             const char* start = input;
-            while (is_identifier_char(*input)) input++;
-
-            char* word = strndup(start, input - start);
-            TokenType type = identifyKeywordOrIdentifier(word);
-            tokens[tokenCount++] = createToken(type, word);
-            free(word);
+            while (input < end && is_identifier_char(*input)) input++;
+            if (input == end && !final) {
+                return start;
+            }
 
-            if (tokenCount >= capacity) {
-                capacity *= 2;
-                tokens = realloc(tokens, sizeof(Token*) * capacity);
+            // Keywords are short; anything longer than the buffer is an identifier
+            char word[KEYWORD_BUFFER_SIZE];
+            size_t wordLength = input - start;
+            TokenType type = TOKEN_IDENTIFIER;
+            if (wordLength < sizeof(word)) {
+                memcpy(word, start, wordLength);
+                word[wordLength] = '\0';
+                type = identifyKeywordOrIdentifier(word);
             }
+            ok = appendToken(list, type, start, input - start, offsetOf(list, start));
         } else if (*input == '"') {
+            const char* quote = input;
             input++;
             const char* start = input;
-            while (*input && *input != '"') input++;
-            if (*input == '"') {
-                size_t length = input - start;
-                char* literal = strndup(start, length);
-                tokens[tokenCount++] = createToken(TOKEN_STRING_LITERAL, literal);
-                free(literal);
+            while (input < end && *input != '"') input++;
+            if (input < end) {
+                ok = appendToken(list, TOKEN_STRING_LITERAL, start, input - start, offsetOf(list, quote));
                 input++;
+            } else if (!final) {
+                return quote;
             } else {
                 // Handle unterminated string literal error
             }
         } else if (isdigit(*input)) {
             const char* start = input;
-            while (isdigit(*input)) input++;
-            size_t length = input - start;
-            char* number = strndup(start, length);
-            tokens[tokenCount++] = createToken(TOKEN_INT_LITERAL, number);
-            free(number);
+            while (input < end && isdigit(*input)) input++;
+            if (input == end && !final) {
+                return start;
+            }
+            ok = appendToken(list, TOKEN_INT_LITERAL, start, input - start, offsetOf(list, start));
         } else {
             switch (*input) {
                 case '{':
-                    tokens[tokenCount++] = createToken(TOKEN_LEFT_BRACE, "{");
+                    ok = appendToken(list, TOKEN_LEFT_BRACE, "{", 1, offsetOf(list, input));
                     break;
                 case '}':
-                    tokens[tokenCount++] = createToken(TOKEN_RIGHT_BRACE, "}");
+                    ok = appendToken(list, TOKEN_RIGHT_BRACE, "}", 1, offsetOf(list, input));
                     break;
                 case ':':
-                    tokens[tokenCount++] = createToken(TOKEN_COLON, ":");
+                    ok = appendToken(list, TOKEN_COLON, ":", 1, offsetOf(list, input));
                     break;
                 case '|':
-                    tokens[tokenCount++] = createToken(TOKEN_PIPE, "|");
+                    ok = appendToken(list, TOKEN_PIPE, "|", 1, offsetOf(list, input));
                     break;
                 case ';':
-                    tokens[tokenCount++] = createToken(TOKEN_SEMICOLON, ";");
+                    ok = appendToken(list, TOKEN_SEMICOLON, ";", 1, offsetOf(list, input));
+                    break;
+                case ',':
+                    ok = appendToken(list, TOKEN_COMMA, ",", 1, offsetOf(list, input));
                     break;
                 // Add cases for other single-character tokens as needed
             }
             input++;
         }
+    }
+
+    return ok ? input : NULL;
+}
+
+Token** lexer(const char* input) {
+    return lexerWithAllocator(input, systemAllocator());
+}
+
+Token** lexerWithAllocator(const char* input, Allocator* allocator) {
+    return lexerRange(input, strlen(input), allocator);
+}
+
+// Tokenize exactly length bytes of input (no NUL terminator needed)
+Token** lexerRange(const char* input, size_t length, Allocator* allocator) {
+    TokenList list;
+    if (!initTokenList(&list, allocator)) {
+        return NULL;
+    }
+    setTokenOrigin(&list, input, 0);
+    list.end = length;
+    if (lexSpan(&list, input, input + length, true) == NULL) {
+        return abandonTokens(&list);
+    }
+    return finishTokens(&list);
+}
+
+// Number of bytes at the start of chunk that continue the token begun in carry
+static size_t tokenContinuation(const char* carry, const char* chunk, size_t chunkLength) {
+    size_t length = 0;
+    if (carry[0] == '"') {
+        while (length < chunkLength && chunk[length] != '"') length++;
+        return (length < chunkLength) ? length + 1 : length; // Include the closing quote
+    }
+    if (isdigit(carry[0])) {
+        while (length < chunkLength && isdigit(chunk[length])) length++;
+        return length;
+    }
+    while (length < chunkLength && is_identifier_char(chunk[length])) length++;
+    return length;
+}
+
+// Batches of whole top-level statements handed out while a source is lexed
+typedef struct {
+    int batchSize;              // Minimum number of tokens in a batch (except the last)
+    int depth;                  // Brace depth after the last scanned token
+    int scanned;                // Tokens at the front of the list already scanned
+    TokenBatchHandler handler;
+    void* userData;
+} BatchState;
+
+// Hand count tokens from the list to the batch handler, terminated like a
+// lexer result. The tokens belong to the batch from here on, even on failure.
+static bool emitBatch(TokenList* list, BatchState* batches, int start, int count) {
+    Allocator* allocator = list->allocator;
+    Token** batch = allocMemory(allocator, sizeof(Token*) * (count + 2));
+    Token* eof = createToken(allocator, TOKEN_EOF, "", 0);
+    if (eof != NULL) {
+        eof->offset = list->end;
+    }
+    if (batch == NULL || eof == NULL) {
+        releaseMemory(allocator, batch, sizeof(Token*) * (count + 2));
+        if (eof != NULL) {
+            releaseString(allocator, eof->value);
+            releaseMemory(allocator, eof, sizeof(Token));
+        }
+        for (int i = start; i < start + count; i++) {
+            releaseString(allocator, list->tokens[i]->value);
+            releaseMemory(allocator, list->tokens[i], sizeof(Token));
+        }
+        return false;
+    }
+
+    memcpy(batch, list->tokens + start, sizeof(Token*) * count);
+    batch[count] = eof;
+    batch[count + 1] = NULL;
+    return batches->handler(batches->userData, batch) == 0;
+}
+
+// Cut the list after a semicolon outside any braces once a batch is big enough;
+// every such semicolon ends a statement. The last batch takes whatever is left.
+static bool emitBatches(TokenList* list, BatchState* batches, bool final) {
+    bool ok = true;
+    int start = 0;
+    for (int i = batches->scanned; i < list->count && ok; i++) {
+        TokenType type = list->tokens[i]->type;
+        if (type == TOKEN_LEFT_BRACE) {
+            batches->depth++;
+        } else if (type == TOKEN_RIGHT_BRACE && batches->depth > 0) {
+            batches->depth--;
+        } else if (type == TOKEN_SEMICOLON && batches->depth == 0 && i + 1 - start >= batches->batchSize) {
+            ok = emitBatch(list, batches, start, i + 1 - start);
+            start = i + 1;
+        }
+    }
+    if (ok && final && start < list->count) {
+        ok = emitBatch(list, batches, start, list->count - start);
+        start = list->count;
+    }
+
+    // Tokens not handed out yet move to the front of the list
+    memmove(list->tokens, list->tokens + start, sizeof(Token*) * (list->count - start));
+    list->count -= start;
+    batches->scanned = list->count;
+    return ok;
+}
+
+// Tokenize a source chunk by chunk, reading each chunk in place. Only a token
+// cut off at the end of a chunk is copied, and finished with the next chunk.
+// With batches set, finished statements are handed out after every chunk.
+static bool lexChunks(Source* source, TokenList* list, BatchState* batches) {
+    Allocator* allocator = list->allocator;
+    char* carry = NULL;
+    size_t carryLength = 0;
+    size_t carryCapacity = 0;
+    size_t carryOffset = 0;     // Where the carried text starts in the input
+    const char* chunk;
+    size_t chunkLength;
+    int result;
+    bool ok = true;
 
-        if (tokenCount >= capacity) {
-            capacity *= 2;
-            Token** resized = realloc(tokens, sizeof(Token*) * capacity);
-            if (!resized) {
-                for (int i = 0; i < tokenCount; ++i) {
-                    free(tokens[i]->value);
-                    free(tokens[i]);
+    while (ok && (result = nextSourceChunk(source, &chunk, &chunkLength)) > 0) {
+        const char* input = chunk;
+        const char* end = chunk + chunkLength;
+        size_t chunkOffset = list->end;
+        list->end += chunkLength;
+        if (carryLength > 0) {
+            size_t take = tokenContinuation(carry, chunk, chunkLength);
+            if (carryLength + take > carryCapacity) {
+                size_t newCapacity = (carryLength + take) * 2;
+                char* resized = reallocMemory(allocator, carry, carryCapacity, newCapacity);
+                if (resized == NULL) {
+                    ok = false;
+                    break;
                 }
-                free(tokens);
-                return NULL;
+                carry = resized;
+                carryCapacity = newCapacity;
+            }
+            memcpy(carry + carryLength, chunk, take);
+            carryLength += take;
+            bool closedString = carry[0] == '"' && carryLength > 1 && carry[carryLength - 1] == '"';
+            if (take == chunkLength && !closedString) {
+                continue; // The token runs on into the next chunk
             }
-            tokens = resized;
+            setTokenOrigin(list, carry, carryOffset);
+            ok = lexSpan(list, carry, carry + carryLength, true) != NULL;
+            carryLength = 0;
+            input += take;
         }
-    }
 
-    Token** resized = realloc(tokens, sizeof(Token*) * (tokenCount + 1));
-    if (!resized) {
-        for (int i = 0; i < tokenCount; ++i) {
-            free(tokens[i]->value);
-            free(tokens[i]);
+        setTokenOrigin(list, chunk, chunkOffset);
+        const char* stop = ok ? lexSpan(list, input, end, false) : NULL;
+        if (stop == NULL) {
+            ok = false;
+            break;
         }
-        free(tokens);
+
+        // Keep the unfinished tail for the next chunk
+        size_t remaining = end - stop;
+        if (remaining > carryCapacity) {
+            char* resized = reallocMemory(allocator, carry, carryCapacity, remaining);
+            if (resized == NULL) {
+                ok = false;
+                break;
+            }
+            carry = resized;
+            carryCapacity = remaining;
+        }
+        if (remaining > 0) {
+            memcpy(carry, stop, remaining);
+        }
+        carryLength = remaining;
+        carryOffset = chunkOffset + (size_t)(stop - chunk);
+
+        if (batches != NULL) {
+            ok = emitBatches(list, batches, false);
+        }
+    }
+
+    if (ok && result == 0 && carryLength > 0) {
+        setTokenOrigin(list, carry, carryOffset);
+        ok = lexSpan(list, carry, carry + carryLength, true) != NULL;
+    }
+    if (ok && result == 0 && batches != NULL) {
+        ok = emitBatches(list, batches, true);
+    }
+    releaseMemory(allocator, carry, carryCapacity);
+    return ok && result == 0;
+}
+
+Token** lexerSource(Source* source, Allocator* allocator) {
+    TokenList list;
+    if (!initTokenList(&list, allocator)) {
         return NULL;
     }
-    tokens = resized;
-    tokens[tokenCount] = NULL;
+    if (!lexChunks(source, &list, NULL)) {
+        return abandonTokens(&list);
+    }
+    return finishTokens(&list);
+}
 
-    return tokens;
+int lexerSourceBatches(Source* source, Allocator* allocator, int batchSize, TokenBatchHandler handler, void* userData) {
+    TokenList list;
+    if (!initTokenList(&list, allocator)) {
+        return -1;
+    }
+    BatchState batches = { batchSize, 0, 0, handler, userData };
+    bool ok = lexChunks(source, &list, &batches);
+    abandonTokens(&list); // Empty unless lexing stopped early
+    return ok ? 0 : -1;
+}
+
+// Name of a token type for diagnostics
+const char* tokenTypeName(TokenType type) {
+    switch (type) {
+        case TOKEN_CLIENT_PROFILE: return "'ClientProfile'";
+        case TOKEN_ASSIGN: return "'assign'";
+        case TOKEN_LEFT_BRACE: return "'{'";
+        case TOKEN_RIGHT_BRACE: return "'}'";
+        case TOKEN_COLON: return "':'";
+        case TOKEN_TO: return "'to'";
+        case TOKEN_SEMICOLON: return "';'";
+        case TOKEN_PIPE: return "'|'";
+        case TOKEN_IDENTIFIER: return "identifier";
+        case TOKEN_STRING_LITERAL: return "string";
+        case TOKEN_EXERCISE: return "'exercise'";
+        case TOKEN_SETS: return "'sets'";
+        case TOKEN_REST: return "'rest'";
+        case TOKEN_INT_LITERAL: return "number";
+        case TOKEN_SHOW_PLANS: return "'showPlans'";
+        case TOKEN_MONDAY: return "'Monday'";
+        case TOKEN_TUESDAY: return "'Tuesday'";
+        case TOKEN_WEDNESDAY: return "'Wednesday'";
+        case TOKEN_THURSDAY: return "'Thursday'";
+        case TOKEN_FRIDAY: return "'Friday'";
+        case TOKEN_SATURDAY: return "'Saturday'";
+        case TOKEN_SUNDAY: return "'Sunday'";
+        case TOKEN_PLAN: return "'Plan'";
+        case TOKEN_GROUP: return "'Group'";
+        case TOKEN_COMMA: return "','";
+        case TOKEN_IMPORT: return "'import'";
+        case TOKEN_EOF: return "end of input";
+        default: return "unknown token";
+    }
 }
 
 void printToken(const Token* token) {
@@ -173,8 +497,6 @@ void testLexer(const char* input) {
 
     for (int i = 0; tokens[i] != NULL; i++) {
         printToken(tokens[i]);
-        free(tokens[i]->value);
-        free(tokens[i]);
     }
-    free(tokens);
+    freeTokens(tokens, systemAllocator());
 }
@@ -4,6 +4,8 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
+#include "alloc.h"
+#include "source.h"
 
 // Token types
 typedef enum {
@@ -28,15 +30,36 @@ typedef enum {
     TOKEN_THURSDAY,
     TOKEN_FRIDAY,
     TOKEN_SATURDAY,
-    TOKEN_SUNDAY
+    TOKEN_SUNDAY,
+    TOKEN_PLAN,
+    TOKEN_GROUP,
+    TOKEN_COMMA,
+    TOKEN_IMPORT,
+    TOKEN_EOF        // Always the last token, so the parser never runs off the array
 } TokenType;
 
 // Token structure
 typedef struct {
     TokenType type;  
     char* value;     
+    size_t offset;   // Byte offset of the token in the input (diagnostics find line and column from it)
 } Token;
 
 Token** lexer(const char* input);
+Token** lexerWithAllocator(const char* input, Allocator* allocator);
+Token** lexerRange(const char* input, size_t length, Allocator* allocator);
+Token** lexerSource(Source* source, Allocator* allocator);
+
+// Receives a batch of whole top-level statements, terminated like a lexer
+// result (TOKEN_EOF, then NULL) and owned by the handler from then on.
+// Returns 0 to keep lexing.
+typedef int (*TokenBatchHandler)(void* userData, Token** batch);
+
+// Lex a source in batches of at least batchSize tokens, each cut after a
+// statement. Returns 0 once the last batch was handled, -1 if lexing failed
+// or the handler stopped it.
+int lexerSourceBatches(Source* source, Allocator* allocator, int batchSize, TokenBatchHandler handler, void* userData);
+void freeTokens(Token** tokens, Allocator* allocator);
+const char* tokenTypeName(TokenType type);
 
 #endif
\ No newline at end of file
@@ -1,20 +1,864 @@
-#ifndef INTERPRETER_H
-#define INTERPRETER_H
+#include "interpreter.h"
+#include "lexer.h"    // Your lexer header
+#include "parser.h"   // Your parser header
+#include "semantic.h" // Your semantic analyzer header
+#include "hashcons.h"
+#include "store.h"
+#include "calendar.h"
+#include "source.h"
+#include "pipeline.h"
+#include "catalog.h"
+#include "shard.h"
+#include "sourcemap.h"
+#include "report.h"
+#include "postings.h"
+#include "diff.h"
+#include "recognizer.h"
+#include "schedule.h"
+#include "parallel.h"
+#include "lazy.h"
+#include "unit.h"
+#include "simulate.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
 
-#include "parser.h" // Include the header file where your AST structure is defined
+// Output writer that sends program output to a stdio stream
+static int writeToStream(void* userData, const char* text, size_t length) {
+    return fwrite(text, 1, length, (FILE*)userData) == length ? 0 : -1;
+}
 
-// If you have a specific environment structure for storing variables, function definitions, etc.
+// Declare a client from an earlier run so the program can refer to it
+static int declareStoredClient(void* userData, const char* name) {
+    return declareClient(userData, name) == SEMANTIC_OK ? 0 : STORE_ERROR_NO_MEMORY;
+}
+
+// Print one client's plans straight from the store, without a program
+static int queryStore(Store* store, const char* clientName, int showStats) {
+    Environment* env = createEnvironment(systemAllocator(), writeToStream, stdout);
+    if (env == NULL) {
+        fprintf(stderr, "Unable to allocate the runtime environment.\n");
+        storeClose(store);
+        return EXIT_FAILURE;
+    }
+    env->store = store;
+
+    int result = showPlans(env, clientName, writeToStream, stdout);
+    if (result == UNDEFINED_IDENTIFIER) {
+        fprintf(stderr, "Unknown client '%s'.\n", clientName);
+    } else if (result != 0) {
+        fprintf(stderr, "Unable to read plans for '%s'.\n", clientName);
+    }
+    if (showStats) {
+        printStoreStats(store);
+    }
+
+    freeEnvironment(env);
+    storeClose(store);
+    return (result == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Write every client's plans to "<directory>/<client>.txt", in the showPlans format
+static int writeClientReports(const Environment* env, const char* directory, ReportBackend backend, int showStats) {
+    ReportWriter* reports;
+    int status = openReportWriter(directory, backend, systemAllocator(), &reports);
+    if (status != REPORT_OK) {
+        fprintf(stderr, "Unable to write reports to '%s': %s\n", directory, reportErrorString(status));
+        return RUNTIME_ERROR;
+    }
+    ReportBackend used = reportBackend(reports);
+
+    int result = 0;
+    for (int i = 0; i < env->clientCount && result == 0; i++) {
+        const char* name = env->clients[i].name;
+        if (beginReport(reports, name) != REPORT_OK) {
+            break; // The writer has failed; closing it reports why
+        }
+        result = showPlans(env, name, writeReportOutput, reports);
+        if (result == 0) {
+            endReport(reports);
+        }
+    }
+    status = closeReportWriter(reports);
+    if (status != REPORT_OK) {
+        fprintf(stderr, "Unable to write reports to '%s': %s\n", directory, reportErrorString(status));
+        return RUNTIME_ERROR;
+    }
+    if (result != 0) {
+        fprintf(stderr, "Unable to render reports.\n");
+        return result;
+    }
+    if (showStats) {
+        printf("Reports: %d files written with %s\n", env->clientCount, reportBackendName(used));
+    }
+    return 0;
+}
+
+// Print the client named by each position in a query result
+static int printQueryClient(void* userData, uint32_t client) {
+    const Environment* env = userData;
+    return (printf("%s\n", env->clients[client].name) < 0) ? -1 : 0;
+}
+
+// Answer a --who query from the exercise index built during evaluation
+static int answerQuery(const Environment* env, const char* query, const Catalog* catalog, int showStats) {
+    RoaringBitmap clients;
+    roaringInit(&clients, systemAllocator());
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = queryExerciseIndex(env->exercises, query, catalog, &clients);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (status != POSTINGS_OK) {
+        fprintf(stderr, "Unable to answer '%s': %s\n", query, postingsErrorString(status));
+        return RUNTIME_ERROR;
+    }
+
+    int result = roaringForEach(&clients, printQueryClient, (void*)env);
+    if (showStats) {
+        double micros = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+        printExerciseIndexStats(env->exercises);
+        printf("Query: %llu clients in %.1f us\n", (unsigned long long)roaringCardinality(&clients), micros);
+    }
+    roaringClear(&clients);
+    return (result == 0) ? 0 : RUNTIME_ERROR;
+}
+
+// Forecast occupancy for --simulate and print the histograms
+static int runSimulation(const Environment* env, const SimulationOptions* options, int showStats) {
+    SimulationStats stats;
+    int status = simulateOccupancy(env, options, systemAllocator(), writeToStream, stdout, &stats);
+    if (status != SIMULATE_OK) {
+        fprintf(stderr, "Unable to simulate occupancy: %s\n", simulateErrorString(status));
+        return RUNTIME_ERROR;
+    }
+    if (showStats) {
+        printf("Simulation: %d sessions, %ld visits, %d stations\n", stats.sessions, stats.visits, stats.stations);
+        printf("Simulation: extracted in %.2f ms, %d scenarios on %d threads in %.2f ms\n",
+               stats.extractMilliseconds, options->scenarios, stats.threads, stats.simulateMilliseconds);
+    }
+    return 0;
+}
+
+// Compile an exercise list into a catalog file for --catalog
+static int compileCatalog(const char* listPath, const char* outputPath) {
+    int errorLine;
+    int result = buildCatalog(listPath, outputPath, systemAllocator(), &errorLine);
+    if (result != CATALOG_OK && errorLine > 0) {
+        fprintf(stderr, "%s:%d: %s\n", listPath, errorLine, catalogErrorString(result));
+    } else if (result != CATALOG_OK) {
+        fprintf(stderr, "Unable to build catalog '%s': %s\n", outputPath, catalogErrorString(result));
+    }
+    return (result == CATALOG_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Front end settings, shared by the main process and shard workers
+typedef struct {
+    const char* filename;
+    int usePools;
+    int fused;
+    int pipelined;
+    Catalog* catalog;
+    ScheduleLimits limits;
+    int semanticThreads;        // Threads for semantic analysis (0 for the serial pass)
+    const char* objectDirectory; // Object files of the program's units (NULL for none)
+    unsigned long catalogStamp; // Hash of the catalog file, which objects depend on
+} FrontEndOptions;
+
+// Per-phase allocators: fixed-size pools for tokens and nodes if requested,
+// with accounting on top when statistics are wanted
+static void setupAllocators(CompileContext* context, Allocator** pools, int usePools, int showStats) {
+    if (usePools) {
+        pools[SUBSYSTEM_LEXER] = createPoolAllocator(systemAllocator(), sizeof(Token));
+        pools[SUBSYSTEM_PARSER] = createPoolAllocator(systemAllocator(), sizeof(ASTNode));
+    }
+    for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+        Allocator* base = (pools[i] != NULL) ? pools[i] : systemAllocator();
+        context->allocators[i] = showStats ? createTrackingAllocator(base, subsystemName(i)) : base;
+    }
+}
+
+// Print the statistics if asked; a failed run only releases the allocators
+static void releaseAllocators(CompileContext* context, Allocator** pools, int showStats) {
+    for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+        Allocator* base = (pools[i] != NULL) ? pools[i] : systemAllocator();
+        if (context->allocators[i] != base) {
+            if (showStats) {
+                printAllocatorStats(context->allocators[i]);
+            }
+            destroyAllocator(context->allocators[i]);
+        }
+        destroyAllocator(pools[i]);
+    }
+}
+
+// Front end (identical plans, days and exercises are stored once). The
+// pipelined mode lexes, parses and checks on separate threads at once; the
+// fused mode runs the semantic checks inside the parser; otherwise each
+// phase finishes before the next one starts. Closes the source; returns the
+// checked program, or NULL after reporting why there is none. Errors are
+// located through map, if there is one.
+static ASTNode* compileProgram(Source* source, const FrontEndOptions* options, CompileContext* context,
+                               struct SymbolTable* table, SourceMap* map) {
+    ASTNode* root = NULL;
+    int sourceResult;
+    if (options->pipelined) {
+        root = compilePipelined(source, context, table);
+        sourceResult = sourceStatus(source);
+        closeSource(source);
+        if (sourceResult != SOURCE_OK) {
+            fprintf(stderr, "Unable to read '%s': %s\n", options->filename, sourceErrorString(sourceResult));
+            freeAST(root);
+            return NULL;
+        }
+    } else {
+        Token** tokens = lexerSource(source, context->allocators[SUBSYSTEM_LEXER]);
+        sourceResult = sourceStatus(source);
+        closeSource(source);
+        if (sourceResult != SOURCE_OK) {
+            fprintf(stderr, "Unable to read '%s': %s\n", options->filename, sourceErrorString(sourceResult));
+            freeTokens(tokens, context->allocators[SUBSYSTEM_LEXER]);
+            return NULL;
+        }
+        if (tokens == NULL) {
+            fprintf(stderr, "Lexical analysis failed.\n");
+            return NULL;
+        }
+
+        context->symbols = options->fused ? table : NULL;
+        root = parseProgramWithContext(tokens, context);
+        freeTokens(tokens, context->allocators[SUBSYSTEM_LEXER]);
+    }
+    // Fused checks are located by the parser, the pipeline's by semantic analysis.
+    // A statement is only checked once it has parsed, so a syntax error the
+    // pipeline's parser found after a failed check is further on and not reported.
+    size_t errorOffset = (table->errorOffset != NO_SOURCE_OFFSET) ? table->errorOffset : context->errorOffset;
+    if (root == NULL) {
+        if (context->semanticResult != SEMANTIC_OK) {
+            printDiagnostic(map, errorOffset, "Semantic analysis failed: %s", semanticErrorString(context->semanticResult));
+        } else if (context->outOfMemory) {
+            fprintf(stderr, "Parsing failed: out of memory.\n");
+        } else {
+            printDiagnostic(map, context->errorOffset, "Parsing failed: %s", context->syntaxError);
+        }
+        return NULL;
+    }
+
+    // Semantic Analysis
+    if (!options->fused && !options->pipelined) {
+        int semanticResult = (options->semanticThreads > 0)
+            ? performParallelSemanticAnalysis(root, table, options->semanticThreads)
+            : performSemanticAnalysis(root, table);
+        if (semanticResult != SEMANTIC_OK) {
+            printDiagnostic(map, table->errorOffset, "Semantic analysis failed: %s", semanticErrorString(semanticResult));
+            freeAST(root);
+            return NULL;
+        }
+    }
+    return root;
+}
+
+// Schedules across assignments, once every assignment of the whole program
+// has its plan. Errors are located through program, if there is one, or else
+// through map.
+static bool passesSchedules(const ASTNode* root, const FrontEndOptions* options, CompileContext* context,
+                            const Program* program, SourceMap* map) {
+    if (!scheduleChecksEnabled(&options->limits)) {
+        return true;
+    }
+    size_t scheduleOffset = NO_SOURCE_OFFSET;
+    int scheduleResult = checkSchedules(root, &options->limits, context->allocators[SUBSYSTEM_SEMANTIC], &scheduleOffset);
+    if (scheduleResult == SEMANTIC_OK) {
+        return true;
+    }
+    size_t fileOffset = scheduleOffset;
+    SourceMap* programMap = NULL;
+    if (program != NULL) {
+        fileOffset = NO_SOURCE_OFFSET;
+        const char* path = locateProgramOffset(program, scheduleOffset, &fileOffset);
+        programMap = (path != NULL) ? createSourceMap(path, systemAllocator()) : NULL;
+        map = programMap;
+    }
+    printDiagnostic(map, fileOffset, "Semantic analysis failed: %s", semanticErrorString(scheduleResult));
+    freeSourceMap(programMap);
+    return false;
+}
+
+// Compiler for each file of a program (unit.h)
 typedef struct {
-    // ... environment fields ...
-} Environment;
+    const FrontEndOptions* options;
+    CompileContext* context;
+} UnitCompilerData;
+
+static ASTNode* compileUnitFile(void* userData, const char* path, struct SymbolTable* table) {
+    UnitCompilerData* data = userData;
+    Source* source;
+    int sourceResult = openSource(path, systemAllocator(), &source);
+    if (sourceResult != SOURCE_OK) {
+        fprintf(stderr, "Unable to read '%s': %s\n", path, sourceErrorString(sourceResult));
+        return NULL;
+    }
+
+    // Each file starts without errors, but shares the allocators, node table and catalog
+    CompileContext* context = data->context;
+    CompileContext shared = *context;
+    initCompileContext(context);
+    memcpy(context->allocators, shared.allocators, sizeof(context->allocators));
+    context->nodes = shared.nodes;
+    context->catalog = shared.catalog;
+    table->catalog = data->options->catalog;
+
+    FrontEndOptions unitOptions = *data->options;
+    unitOptions.filename = path;
+    SourceMap* map = createSourceMap(path, systemAllocator());
+    ASTNode* root = compileProgram(source, &unitOptions, context, table, map);
+    freeSourceMap(map);
+    return root;
+}
+
+// Compile the program at filename and the files it imports, and link them.
+// Returns NULL after reporting why there is no program.
+static Program* compileUnits(const char* filename, const FrontEndOptions* options, CompileContext* context,
+                             const struct SymbolTable* predeclared) {
+    UnitCompilerData data = { options, context };
+    UnitOptions unitOptions = { compileUnitFile, &data, context->allocators[SUBSYSTEM_SEMANTIC],
+                                context->allocators[SUBSYSTEM_PARSER], context->nodes,
+                                options->objectDirectory, options->catalogStamp, predeclared };
+    Program* program;
+    int unitResult = buildProgram(filename, &unitOptions, &program);
+    if (unitResult == UNIT_ERROR_NO_MEMORY) {
+        fprintf(stderr, "Linking failed: out of memory.\n");
+    }
+    return (unitResult == UNIT_OK) ? program : NULL;
+}
+
+// Shard worker: compile and run one shard of the program. Each showPlans
+// statement's output is a separate record, so the coordinator can put the
+// shards' output back in program order.
+static int runShardWorker(void* userData, Source* source, ShardOutput* output) {
+    const FrontEndOptions* options = userData;
+    CompileContext context;
+    Allocator* pools[SUBSYSTEM_COUNT] = { NULL };
+    initCompileContext(&context);
+    setupAllocators(&context, pools, options->usePools, 0);
+
+    struct SymbolTable* table = createSymbolTableWithAllocator(context.allocators[SUBSYSTEM_SEMANTIC]);
+    context.nodes = createNodeTableWithAllocator(context.allocators[SUBSYSTEM_PARSER]);
+    context.catalog = options->catalog;
+    table->catalog = options->catalog;
+
+    // Offsets are into the shard's text rather than the file, so errors go to
+    // the coordinator with their offsets, and it locates them in the file
+    int result = RUNTIME_ERROR;
+    SourceMap* map = createOffsetSourceMap(systemAllocator());
+    ASTNode* root = compileProgram(source, options, &context, table, map);
+    if (root != NULL && !passesSchedules(root, options, &context, NULL, map)) {
+        freeAST(root);
+        root = NULL;
+    }
+    Environment* env = (root != NULL) ? createEnvironment(systemAllocator(), writeShardOutput, output) : NULL;
+    if (root != NULL && env == NULL) {
+        fprintf(stderr, "Unable to allocate the runtime environment.\n");
+    } else if (env != NULL) {
+        result = 0;
+        for (int i = 0; i < root->childrenCount && result == 0; i++) {
+            result = evaluate(root->children[i], env);
+            if (result == 0 && root->children[i]->type == NODE_SHOW_PLANS) {
+                result = endShardRecord(output);
+            }
+        }
+        if (result != 0) {
+            fprintf(stderr, "Runtime error.\n");
+        }
+    }
+
+    freeEnvironment(env);
+    freeAST(root);
+    freeNodeTable(context.nodes);
+    freeSymbolTable(table);
+    freeSourceMap(map);
+    releaseAllocators(&context, pools, 0);
+    return result;
+}
+
+// Compile one version of a program for --diff. Both versions intern into the
+// same node table, so their unchanged plans are the same nodes.
+static ASTNode* compileVersion(const char* filename, const FrontEndOptions* options, struct NodeTable* nodes) {
+    CompileContext context;
+    initCompileContext(&context);
+    context.nodes = nodes;
+    context.catalog = options->catalog;
+
+    Program* program = compileUnits(filename, options, &context, NULL);
+    ASTNode* root = NULL;
+    if (program != NULL && passesSchedules(programRoot(program), options, &context, program, NULL)) {
+        root = retainASTNode(programRoot(program));
+    }
+    freeProgram(program);
+    return root;
+}
+
+// Print the clients whose plans differ between two versions of a program
+static int diffVersions(const char* oldPath, const char* newPath, const FrontEndOptions* options, int showStats) {
+    struct NodeTable* nodes = createNodeTableWithAllocator(systemAllocator());
+    ASTNode* before = compileVersion(oldPath, options, nodes);
+    ASTNode* after = (before != NULL) ? compileVersion(newPath, options, nodes) : NULL;
+    ProgramDigest* beforeDigest = NULL;
+    ProgramDigest* afterDigest = NULL;
+    int status = DIFF_OK;
+    if (after != NULL) {
+        status = createProgramDigest(before, systemAllocator(), &beforeDigest);
+        if (status == DIFF_OK) {
+            status = createProgramDigest(after, systemAllocator(), &afterDigest);
+        }
+    }
+
+    if (after != NULL && status == DIFF_OK) {
+        int changed;
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = diffPrograms(beforeDigest, afterDigest, writeToStream, stdout, &changed);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (status == DIFF_OK && showStats) {
+            double micros = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+            printf("Diff: %d of %d clients changed, compared in %.1f us\n",
+                   changed, digestClientCount(afterDigest), micros);
+        }
+    }
+    if (status != DIFF_OK) {
+        fprintf(stderr, "Unable to compare '%s' and '%s': %s\n", oldPath, newPath, diffErrorString(status));
+    }
+
+    freeProgramDigest(beforeDigest);
+    freeProgramDigest(afterDigest);
+    freeAST(before);
+    freeAST(after);
+    freeNodeTable(nodes);
+    return (after != NULL && status == DIFF_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Validate a program with the recognizer, without building tokens or a tree
+// Report why a program failed the recognizer's check, as a full compile would
+static void printCheckFailure(const char* filename, int status, const CheckResult* result) {
+    if (status == CHECK_OK) {
+        return;
+    }
+    SourceMap* map = createSourceMap(filename, systemAllocator());
+    if (status == CHECK_ERROR_SOURCE) {
+        fprintf(stderr, "Unable to read '%s': %s\n", filename, sourceErrorString(result->sourceResult));
+    } else if (status == CHECK_ERROR_NO_MEMORY) {
+        fprintf(stderr, "Check failed: out of memory.\n");
+    } else if (status == CHECK_ERROR_SYNTAX) {
+        printDiagnostic(map, result->errorOffset, "Parsing failed: %s", result->message);
+    } else if (status == CHECK_ERROR_SEMANTIC) {
+        printDiagnostic(map, result->errorOffset, "Semantic analysis failed: %s", semanticErrorString(result->semanticResult));
+    }
+    freeSourceMap(map);
+}
+
+static int checkProgram(const char* filename, const Catalog* catalog, int showStats) {
+    Source* source;
+    int sourceResult = openSource(filename, systemAllocator(), &source);
+    if (sourceResult != SOURCE_OK) {
+        fprintf(stderr, "Unable to read '%s': %s\n", filename, sourceErrorString(sourceResult));
+        return EXIT_FAILURE;
+    }
+
+    CheckResult result;
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = checkSource(source, catalog, systemAllocator(), &result);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    closeSource(source);
+
+    printCheckFailure(filename, status, &result);
+
+    if (showStats) {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Check: %zu bytes, %zu tokens, %d names in %.3f ms (%.1f MB/s)\n",
+               result.bytes, result.tokens, result.names, seconds * 1e3,
+               (seconds > 0) ? result.bytes / seconds / 1e6 : 0.0);
+    }
+    return (status == CHECK_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Lazy: check and index the program, building trees only for the clients it shows
+static int runLazy(const char* filename, const Catalog* catalog, const char* showClient, int showStats) {
+    LazyProgram* program;
+    CheckResult check;
+    struct timespec start;
+    struct timespec indexed;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = openLazyProgram(filename, catalog, systemAllocator(), &program, &check);
+    clock_gettime(CLOCK_MONOTONIC, &indexed);
+    if (status != CHECK_OK) {
+        printCheckFailure(filename, status, &check);
+        return EXIT_FAILURE;
+    }
+
+    Environment* env = createEnvironment(systemAllocator(), writeToStream, stdout);
+    if (env == NULL) {
+        fprintf(stderr, "Unable to allocate the runtime environment.\n");
+        freeLazyProgram(program);
+        return EXIT_FAILURE;
+    }
+    int result = runLazyProgram(program, env);
+    if (result != 0) {
+        fprintf(stderr, "Runtime error.\n");
+    }
+    if (result == 0 && showClient != NULL && showLazyClient(program, env, showClient, writeToStream, stdout) != 0) {
+        fprintf(stderr, "Unknown client '%s'.\n", showClient);
+        result = RUNTIME_ERROR;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (showStats) {
+        printLazyStats(program);
+        printf("Lazy: indexed in %.3f ms, ran in %.3f ms\n",
+               ((indexed.tv_sec - start.tv_sec) + (indexed.tv_nsec - start.tv_nsec) / 1e9) * 1e3,
+               ((end.tv_sec - indexed.tv_sec) + (end.tv_nsec - indexed.tv_nsec) / 1e9) * 1e3);
+    }
+
+    freeEnvironment(env);
+    freeLazyProgram(program);
+    return (result == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    const char* filename = NULL;
+    int showStats = 0;
+    int usePools = 0;
+    int fused = 0;
+    int pipelined = 0;
+    int checkOnly = 0;
+    int lazy = 0;
+    int semanticThreads = 0;
+    ScheduleLimits limits = { 0, 0, 0 };
+    const char* storePath = NULL;
+    const char* showClient = NULL;
+    const char* catalogPath = NULL;
+    const char* objectDirectory = NULL;
+    CalendarDate calendarStart;
+    int calendarWeeks = 0;
+    int shardCount = 0;
+    const char* reportDirectory = NULL;
+    const char* query = NULL;
+    const char* diffPaths[2] = { NULL, NULL };
+    ReportBackend reportWriter = REPORT_BACKEND_AUTO;
+    SimulationOptions simulation = { 0, 80, 1, 0 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            showStats = 1;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            checkOnly = 1;
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            lazy = 1;
+        } else if (strcmp(argv[i], "--fused") == 0) {
+            fused = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipelined = 1;
+        } else if (strcmp(argv[i], "--store") == 0 && i + 1 < argc) {
+            storePath = argv[++i];
+        } else if (strcmp(argv[i], "--show") == 0 && i + 1 < argc) {
+            showClient = argv[++i];
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shardCount = atoi(argv[++i]);
+            if (shardCount < 1 || shardCount > SHARD_MAX_COUNT) {
+                fprintf(stderr, "Invalid shard count '%s' (expected 1 to %d)\n", argv[i], SHARD_MAX_COUNT);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--semantic-threads") == 0 && i + 1 < argc) {
+            semanticThreads = atoi(argv[++i]);
+            if (semanticThreads < 1 || semanticThreads > PARALLEL_MAX_THREADS) {
+                fprintf(stderr, "Invalid thread count '%s' (expected 1 to %d)\n", argv[i], PARALLEL_MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--conflicts") == 0) {
+            limits.conflicts = 1;
+        } else if ((strcmp(argv[i], "--max-daily-sets") == 0 || strcmp(argv[i], "--max-daily-rest") == 0) && i + 1 < argc) {
+            int* limit = (strcmp(argv[i], "--max-daily-sets") == 0) ? &limits.maxDailySets : &limits.maxDailyRest;
+            *limit = atoi(argv[++i]);
+            if (*limit < 1) {
+                fprintf(stderr, "Invalid daily limit '%s' (expected a positive number)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--catalog") == 0 && i + 1 < argc) {
+            catalogPath = argv[++i];
+        } else if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc) {
+            objectDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--build-catalog") == 0 && i + 2 < argc) {
+            return compileCatalog(argv[i + 1], argv[i + 2]);
+        } else if (strcmp(argv[i], "--calendar") == 0 && i + 2 < argc) {
+            calendarWeeks = atoi(argv[i + 2]);
+            if (!parseCalendarDate(argv[i + 1], &calendarStart) || calendarWeeks <= 0) {
+                fprintf(stderr, "Invalid calendar '%s %s' (expected YYYY-MM-DD and a number of weeks)\n", argv[i + 1], argv[i + 2]);
+                return EXIT_FAILURE;
+            }
+            i += 2;
+        } else if (strcmp(argv[i], "--diff") == 0 && i + 2 < argc) {
+            diffPaths[0] = argv[++i];
+            diffPaths[1] = argv[++i];
+        } else if (strcmp(argv[i], "--simulate") == 0 && i + 1 < argc) {
+            simulation.scenarios = atoi(argv[++i]);
+            if (simulation.scenarios < 1) {
+                fprintf(stderr, "Invalid scenario count '%s' (expected a positive number)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--attendance") == 0 && i + 1 < argc) {
+            simulation.attendance = atoi(argv[++i]);
+            if (simulation.attendance < 1 || simulation.attendance > 100) {
+                fprintf(stderr, "Invalid attendance '%s' (expected a percentage from 1 to 100)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            simulation.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--simulate-threads") == 0 && i + 1 < argc) {
+            simulation.threads = atoi(argv[++i]);
+            if (simulation.threads < 1 || simulation.threads > SIMULATE_MAX_THREADS) {
+                fprintf(stderr, "Invalid thread count '%s' (expected 1 to %d)\n", argv[i], SIMULATE_MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--who") == 0 && i + 1 < argc) {
+            query = argv[++i];
+        } else if (strcmp(argv[i], "--reports") == 0 && i + 1 < argc) {
+            reportDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--report-writer") == 0 && i + 1 < argc) {
+            const char* backend = argv[++i];
+            if (strcmp(backend, "uring") == 0) {
+                reportWriter = REPORT_BACKEND_URING;
+            } else if (strcmp(backend, "threads") == 0) {
+                reportWriter = REPORT_BACKEND_THREADS;
+            } else if (strcmp(backend, "auto") != 0) {
+                fprintf(stderr, "Unknown report writer '%s' (expected auto, uring or threads)\n", backend);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--allocator") == 0 && i + 1 < argc) {
+            const char* strategy = argv[++i];
+            if (strcmp(strategy, "pool") == 0) {
+                usePools = 1;
+            } else if (strcmp(strategy, "system") != 0) {
+                fprintf(stderr, "Unknown allocator '%s' (expected system or pool)\n", strategy);
+                return EXIT_FAILURE;
+            }
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (filename == NULL && diffPaths[0] == NULL && (storePath == NULL || showClient == NULL)) {
+        fprintf(stderr, "Usage: %s [--stats] [--fused | --pipeline | --semantic-threads n] [--allocator system|pool] [--objects directory] [--store path] [--show client] [--catalog file] [--conflicts] [--max-daily-sets n] [--max-daily-rest n] [--calendar YYYY-MM-DD weeks] [--shards count] [--reports directory [--report-writer auto|uring|threads]] [--who query] [--simulate scenarios [--attendance percent] [--seed n] [--simulate-threads n]] <filename.fl>\n", argv[0]);
+        fprintf(stderr, "       %s --store path --show client\n", argv[0]);
+        fprintf(stderr, "       %s --build-catalog exercises.txt catalog-file\n", argv[0]);
+        fprintf(stderr, "       %s [--stats] [--fused | --pipeline] [--objects directory] [--catalog file] --diff old.fl new.fl\n", argv[0]);
+        fprintf(stderr, "       %s [--stats] [--catalog file] --check <filename.fl>\n", argv[0]);
+        fprintf(stderr, "       %s [--stats] [--catalog file] [--show client] --lazy <filename.fl>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (fused && pipelined) {
+        fprintf(stderr, "--fused and --pipeline cannot be combined\n");
+        return EXIT_FAILURE;
+    }
+    if (semanticThreads > 0 && (fused || pipelined || checkOnly)) {
+        fprintf(stderr, "--semantic-threads cannot be combined with --fused, --pipeline or --check\n");
+        return EXIT_FAILURE;
+    }
+    if (shardCount > 0 && (storePath != NULL || showClient != NULL || calendarWeeks > 0 || showStats || reportDirectory != NULL || query != NULL ||
+                           simulation.scenarios > 0)) {
+        fprintf(stderr, "--shards cannot be combined with --store, --show, --calendar, --reports, --who, --simulate or --stats\n");
+        return EXIT_FAILURE;
+    }
+
+    if (diffPaths[0] != NULL && (filename != NULL || storePath != NULL || shardCount > 0)) {
+        fprintf(stderr, "--diff takes the place of a program and cannot be combined with --store or --shards\n");
+        return EXIT_FAILURE;
+    }
+    if (checkOnly && (filename == NULL || storePath != NULL || shardCount > 0 || diffPaths[0] != NULL ||
+                      fused || pipelined || calendarWeeks > 0 || reportDirectory != NULL || query != NULL ||
+                      simulation.scenarios > 0 || scheduleChecksEnabled(&limits))) {
+        fprintf(stderr, "--check takes one program and cannot be combined with --store, --shards, --diff, --fused, --pipeline, --calendar, --reports, --who, --simulate or schedule checks\n");
+        return EXIT_FAILURE;
+    }
+
+    if (lazy && (filename == NULL || storePath != NULL || shardCount > 0 || diffPaths[0] != NULL || checkOnly ||
+                 fused || pipelined || semanticThreads > 0 || calendarWeeks > 0 || reportDirectory != NULL ||
+                 query != NULL || simulation.scenarios > 0 || scheduleChecksEnabled(&limits))) {
+        fprintf(stderr, "--lazy takes one program and cannot be combined with --store, --shards, --diff, --check, --fused, --pipeline, --semantic-threads, --calendar, --reports, --who, --simulate or schedule checks\n");
+        return EXIT_FAILURE;
+    }
+
+    if (objectDirectory != NULL && (checkOnly || lazy || shardCount > 0)) {
+        fprintf(stderr, "--objects cannot be combined with --check, --lazy or --shards\n");
+        return EXIT_FAILURE;
+    }
+
+    // Persistent store: the program is applied on top of what earlier runs stored
+    Store* store = NULL;
+    if (storePath != NULL) {
+        int storeResult = storeOpen(storePath, systemAllocator(), &store);
+        if (storeResult != STORE_OK) {
+            fprintf(stderr, "Unable to open store '%s': %s\n", storePath, storeErrorString(storeResult));
+            return EXIT_FAILURE;
+        }
+        if (filename == NULL) {
+            return queryStore(store, showClient, showStats);
+        }
+    }
+
+    // Exercise catalog: exercise names are checked against it and aliases replaced
+    Catalog* catalog = NULL;
+    if (catalogPath != NULL) {
+        int catalogResult = openCatalog(catalogPath, systemAllocator(), &catalog);
+        if (catalogResult != CATALOG_OK) {
+            fprintf(stderr, "Unable to open catalog '%s': %s\n", catalogPath, catalogErrorString(catalogResult));
+            return EXIT_FAILURE;
+        }
+    }
+    // Objects of a program's files are only valid with the catalog they were checked against
+    unsigned long catalogStamp = (objectDirectory != NULL && catalogPath != NULL) ? hashFile(catalogPath) : 0;
+    FrontEndOptions options = { filename, usePools, fused, pipelined, catalog, limits, semanticThreads,
+                                objectDirectory, catalogStamp };
+
+    // Check: validate the program without compiling or running it
+    if (checkOnly) {
+        int checkResult = checkProgram(filename, catalog, showStats);
+        closeCatalog(catalog);
+        return checkResult;
+    }
+
+    // Lazy: only the clients the program shows are parsed
+    if (lazy) {
+        int lazyResult = runLazy(filename, catalog, showClient, showStats);
+        closeCatalog(catalog);
+        return lazyResult;
+    }
+
+    // Diff: compare two versions of a program instead of running one
+    if (diffPaths[0] != NULL) {
+        int diffResult = diffVersions(diffPaths[0], diffPaths[1], &options, showStats);
+        closeCatalog(catalog);
+        return diffResult;
+    }
+
+    // Sharded: worker processes compile and run the program split by client
+    if (shardCount > 0) {
+        CheckResult check;
+        int shardResult = runSharded(filename, shardCount, catalog, systemAllocator(), runShardWorker, &options,
+                                     writeToStream, stdout, &check);
+        if (shardResult == SHARD_ERROR_CHECK) {
+            printCheckFailure(filename, check.status, &check);
+        } else if (shardResult != SHARD_OK && shardResult != SHARD_ERROR_WORKER) {
+            fprintf(stderr, "Sharded compilation failed: %s\n", shardErrorString(shardResult));
+        }
+        closeCatalog(catalog);
+        return (shardResult == SHARD_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    CompileContext context;
+    Allocator* pools[SUBSYSTEM_COUNT] = { NULL };
+    initCompileContext(&context);
+    setupAllocators(&context, pools, usePools, showStats);
+
+    // Clients stored by earlier runs are declared for every file of the program
+    struct SymbolTable* stored = NULL;
+    if (store != NULL) {
+        stored = createSymbolTableWithAllocator(context.allocators[SUBSYSTEM_SEMANTIC]);
+        if (storeForEachClient(store, declareStoredClient, stored) != STORE_OK) {
+            fprintf(stderr, "Unable to read clients from the store.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    context.nodes = createNodeTableWithAllocator(context.allocators[SUBSYSTEM_PARSER]);
+    context.catalog = catalog;
+
+    // The program and the files it imports. Compressed files are decompressed
+    // on a helper thread while the lexer runs; diagnostics read a file again
+    // to find lines, so that costs nothing unless one is printed.
+    Program* program = compileUnits(filename, &options, &context, stored);
+    if (program == NULL || !passesSchedules(programRoot(program), &options, &context, program, NULL)) {
+        // Units dropped on the way, such as damaged objects, leave nothing behind either
+        freeProgram(program);
+        freeNodeTable(context.nodes);
+        freeSymbolTable(stored);
+        closeCatalog(catalog);
+        storeClose(store);
+        releaseAllocators(&context, pools, 0);
+        return EXIT_FAILURE;
+    }
+    ASTNode* root = programRoot(program);
+
+    // Interpretation
+    Environment* env = createEnvironment(systemAllocator(), writeToStream, stdout);
+    if (env == NULL) {
+        fprintf(stderr, "Unable to allocate the runtime environment.\n");
+        return EXIT_FAILURE;
+    }
+    env->store = store;
+    if (query != NULL && (env->exercises = createExerciseIndex(systemAllocator())) == NULL) {
+        fprintf(stderr, "Unable to allocate the exercise index.\n");
+        return EXIT_FAILURE;
+    }
+    int result = evaluate(root, env);
+    if (result != 0 && env->storeResult != STORE_OK) {
+        size_t fileOffset = NO_SOURCE_OFFSET;
+        const char* path = locateProgramOffset(program, env->storeOffset, &fileOffset);
+        SourceMap* map = (path != NULL) ? createSourceMap(path, systemAllocator()) : NULL;
+        printDiagnostic(map, fileOffset, "Runtime error: unable to store the client: %s", storeErrorString(env->storeResult));
+        freeSourceMap(map);
+    } else if (result != 0) {
+        fprintf(stderr, "Runtime error.\n");
+    }
+
+    // The whole program is one store transaction
+    if (store != NULL && result == 0) {
+        int storeResult = storeCommit(store);
+        if (storeResult != STORE_OK) {
+            fprintf(stderr, "Unable to save to the store: %s\n", storeErrorString(storeResult));
+            result = RUNTIME_ERROR;
+        }
+    } else if (store != NULL) {
+        storeRollback(store);
+    }
+    if (result == 0 && showClient != NULL && showPlans(env, showClient, writeToStream, stdout) != 0) {
+        fprintf(stderr, "Unknown client '%s'.\n", showClient);
+        result = RUNTIME_ERROR;
+    }
+    if (result == 0 && calendarWeeks > 0) {
+        result = expandCalendar(env, calendarStart, calendarWeeks, writeToStream, stdout);
+    }
+    if (result == 0 && reportDirectory != NULL) {
+        result = writeClientReports(env, reportDirectory, reportWriter, showStats);
+    }
+    if (result == 0 && query != NULL) {
+        result = answerQuery(env, query, catalog, showStats);
+    }
+    if (result == 0 && simulation.scenarios > 0) {
+        result = runSimulation(env, &simulation, showStats);
+    }
+
+    if (showStats) {
+        printProgramStats(program);
+        printNodeTableStats(context.nodes);
+        if (store != NULL) {
+            printStoreStats(store);
+        }
+    }
 
-// Function to create a new environment (if needed)
-Environment* createEnvironment();
+    // Clean up
+    freeExerciseIndex(env->exercises);
+    freeEnvironment(env);
+    freeProgram(program);
+    freeNodeTable(context.nodes);
+    freeSymbolTable(stored);
+    closeCatalog(catalog);
+    storeClose(store);
 
-// Function to free the environment (if needed)
-void freeEnvironment(Environment* env);
+    releaseAllocators(&context, pools, showStats);
 
-// Function to evaluate/execute an AST node
-int evaluate(ASTNode* node, Environment* env);
+    return (result == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-#endif // INTERPRETER_H
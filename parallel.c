@@ -0,0 +1,438 @@
+#include <stdatomic.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <string.h>
+#include "parallel.h"
+#include "catalog.h"
+#include "hashcons.h"
+
+#define NOT_DECLARED INT_MAX
+#define EARLIER_RUN -1          // Position of a name already in the symbol table
+
+// A declared name. The slot is claimed by setting name; position only ever decreases.
+typedef struct {
+    _Atomic(const char*) name;  // NULL for an empty slot
+    atomic_int position;        // Earliest statement declaring the name
+    const struct Symbol* symbol; // The symbol table's entry, for EARLIER_RUN
+} Declaration;
+
+typedef struct {
+    struct ASTNode* root;
+    const struct SymbolTable* table;
+    Declaration* declarations;
+    size_t mask;                // Slots - 1 (slots are a power of two)
+    atomic_int firstFailure;    // Earliest failed statement so far
+    bool open;                  // Undeclared names are external references (semantic.h), not errors
+} Analysis;
+
+// One thread's range of statements, and the first failure in it
+typedef struct {
+    Analysis* analysis;
+    int begin;
+    int end;
+    int failure;                // Position of the failed statement (NOT_DECLARED if none)
+    int result;
+    size_t errorOffset;
+} Worker;
+
+/***
+ * Declaration table
+*/
+
+static size_t hashName(const char* name) {
+    size_t hash = 1469598103934665603UL;
+    for (const char* c = name; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+// Name declared by a top-level statement, or NULL
+static const char* declaredName(const struct ASTNode* statement) {
+    switch (statement->type) {
+        case NODE_CLIENT_PROFILE:
+            return statement->data.clientProfile.name;
+        case NODE_PLAN:
+            return statement->data.plan.name;
+        case NODE_GROUP:
+            return statement->data.group.name;
+        default:
+            return NULL;
+    }
+}
+
+// Record a declaration at position; safe to call from several threads at once
+static Declaration* declare(Analysis* analysis, const char* name, int position) {
+    size_t slot = hashName(name) & analysis->mask;
+    for (;;) {
+        Declaration* declaration = &analysis->declarations[slot];
+        const char* current = atomic_load(&declaration->name);
+        if (current == NULL && atomic_compare_exchange_strong(&declaration->name, &current, name)) {
+            current = name;
+        }
+        // current is now the slot's name, whether this thread claimed it or another did
+        if (current == name || strcmp(current, name) == 0) {
+            int first = atomic_load(&declaration->position);
+            while (position < first && !atomic_compare_exchange_weak(&declaration->position, &first, position)) {
+                // first has been reloaded; retry while this position is still earlier
+            }
+            return declaration;
+        }
+        slot = (slot + 1) & analysis->mask;
+    }
+}
+
+// Only called once every declaration is in
+static const Declaration* findDeclaration(const Analysis* analysis, const char* name) {
+    size_t slot = hashName(name) & analysis->mask;
+    for (;;) {
+        const Declaration* declaration = &analysis->declarations[slot];
+        const char* current = atomic_load_explicit(&declaration->name, memory_order_relaxed);
+        if (current == NULL) {
+            return NULL;
+        }
+        if (strcmp(current, name) == 0) {
+            return declaration;
+        }
+        slot = (slot + 1) & analysis->mask;
+    }
+}
+
+// Earliest declaration of name if it is before position, else NULL
+static const Declaration* declaredBefore(const Analysis* analysis, const char* name, int position) {
+    const Declaration* declaration = findDeclaration(analysis, name);
+    if (declaration == NULL || atomic_load_explicit(&declaration->position, memory_order_relaxed) >= position) {
+        return NULL;
+    }
+    return declaration;
+}
+
+// Statement (or earlier run's node) behind a declaration if it declares the given type, else NULL
+static struct ASTNode* declaredNode(const Analysis* analysis, const Declaration* declaration, int type, NodeType nodeType) {
+    int position = atomic_load_explicit(&declaration->position, memory_order_relaxed);
+    if (position == EARLIER_RUN) {
+        return (declaration->symbol->type == type) ? declaration->symbol->value.node : NULL;
+    }
+    struct ASTNode* statement = analysis->root->children[position];
+    return (statement->type == nodeType) ? statement : NULL;
+}
+
+// Plan definition named by a declaration, or NULL if it names a client or group
+static struct ASTNode* declaredPlan(const Analysis* analysis, const Declaration* declaration) {
+    return declaredNode(analysis, declaration, TYPE_PLAN, NODE_PLAN);
+}
+
+// Group named by a declaration, or NULL
+static struct ASTNode* declaredGroup(const Analysis* analysis, const Declaration* declaration) {
+    return declaredNode(analysis, declaration, TYPE_GROUP, NODE_GROUP);
+}
+
+// Whether a declaration declares a client
+static bool declaresClient(const Analysis* analysis, const Declaration* declaration) {
+    int position = atomic_load_explicit(&declaration->position, memory_order_relaxed);
+    if (position == EARLIER_RUN) {
+        return declaration->symbol->type == TYPE_CLIENT;
+    }
+    return analysis->root->children[position]->type == NODE_CLIENT_PROFILE;
+}
+
+// Whether a reference at position may name a client (or, with groups set, a
+// group): declared before as one, as in checkAssignmentTarget, or left to the link step
+static bool refersToClient(const Analysis* analysis, const char* name, int position, bool groups) {
+    const Declaration* declaration = declaredBefore(analysis, name, position);
+    if (declaration == NULL) {
+        return analysis->open;
+    }
+    return declaresClient(analysis, declaration) || (groups && declaredGroup(analysis, declaration) != NULL);
+}
+
+/***
+ * Checks
+*/
+
+// Check the exercises under node, as checkNode does
+static int checkBody(const Analysis* analysis, const struct ASTNode* node, size_t* errorOffset) {
+    if (node->type == NODE_EXERCISE) {
+        int result = checkExerciseValues(node->data.exercise.sets, node->data.exercise.rest);
+        if (result == SEMANTIC_OK && node->data.exercise.catalogId < 0) {
+            result = checkExerciseName(analysis->table, node->data.exercise.name);
+        }
+        if (result != SEMANTIC_OK) {
+            *errorOffset = node->offset;
+        }
+        return result;
+    }
+    for (int i = 0; i < node->childrenCount; i++) {
+        int result = checkBody(analysis, node->children[i], errorOffset);
+        if (result != SEMANTIC_OK) {
+            return result;
+        }
+    }
+    return SEMANTIC_OK;
+}
+
+// Check the statement at position, with the same checks in the same order as checkNode
+static int checkStatementAt(const Analysis* analysis, int position, size_t* errorOffset) {
+    const struct ASTNode* statement = analysis->root->children[position];
+    switch (statement->type) {
+        case NODE_CLIENT_PROFILE:
+        case NODE_PLAN:
+            if (declaredBefore(analysis, declaredName(statement), position) != NULL) {
+                *errorOffset = statement->offset;
+                return REDECLARATION_OF_SYMBOL;
+            }
+            return checkBody(analysis, statement, errorOffset);
+
+        case NODE_ASSIGNMENT: {
+            const struct ASTNode* client = statement->data.assignment.client;
+            const struct ASTNode* plan = statement->data.assignment.plan;
+            if (!refersToClient(analysis, client->data.clientProfile.name, position, true)) {
+                *errorOffset = client->offset;
+                return UNDEFINED_IDENTIFIER;
+            }
+            if (plan->type == NODE_IDENTIFIER) {
+                const Declaration* definition = declaredBefore(analysis, plan->data.identifier.name, position);
+                if ((definition == NULL && !analysis->open) || (definition != NULL && declaredPlan(analysis, definition) == NULL)) {
+                    *errorOffset = plan->offset;
+                    return UNDEFINED_IDENTIFIER;
+                }
+                return SEMANTIC_OK;
+            }
+            return checkBody(analysis, plan, errorOffset);
+        }
+
+        case NODE_GROUP:
+            if (declaredBefore(analysis, statement->data.group.name, position) != NULL) {
+                *errorOffset = statement->offset;
+                return REDECLARATION_OF_SYMBOL;
+            }
+            for (int i = 0; i < statement->childrenCount; i++) {
+                const struct ASTNode* member = statement->children[i];
+                const Declaration* client = declaredBefore(analysis, member->data.identifier.name, position);
+                if ((client == NULL && !analysis->open) || (client != NULL && !declaresClient(analysis, client))) {
+                    *errorOffset = member->offset;
+                    return UNDEFINED_IDENTIFIER;
+                }
+            }
+            return SEMANTIC_OK;
+
+        case NODE_SHOW_PLANS:
+            if (!refersToClient(analysis, statement->data.showPlans.clientName, position, false)) {
+                *errorOffset = statement->offset;
+                return UNDEFINED_IDENTIFIER;
+            }
+            return SEMANTIC_OK;
+
+        case NODE_IMPORT:
+            if (!analysis->table->acceptImports) {
+                *errorOffset = statement->offset;
+                return UNSUPPORTED_IMPORT;
+            }
+            return SEMANTIC_OK;
+
+        default:
+            return checkBody(analysis, statement, errorOffset);
+    }
+}
+
+/***
+ * Workers
+*/
+
+// Phase 1: add the range's declarations
+static void* declareRange(void* argument) {
+    Worker* worker = argument;
+    for (int i = worker->begin; i < worker->end; i++) {
+        const char* name = declaredName(worker->analysis->root->children[i]);
+        if (name != NULL) {
+            declare(worker->analysis, name, i);
+        }
+    }
+    return NULL;
+}
+
+// Phase 2: check the range up to its first failure, or one found earlier by another worker
+static void* checkRange(void* argument) {
+    Worker* worker = argument;
+    Analysis* analysis = worker->analysis;
+    for (int i = worker->begin; i < worker->end; i++) {
+        if (i > atomic_load_explicit(&analysis->firstFailure, memory_order_relaxed)) {
+            break;
+        }
+        int result = checkStatementAt(analysis, i, &worker->errorOffset);
+        if (result != SEMANTIC_OK) {
+            worker->failure = i;
+            worker->result = result;
+            int first = atomic_load(&analysis->firstFailure);
+            while (i < first && !atomic_compare_exchange_weak(&analysis->firstFailure, &first, i)) {
+                // first has been reloaded
+            }
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Run a phase on every worker; the calling thread takes the first range
+static void runWorkers(Worker* workers, int count, void* (*phase)(void*)) {
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    bool started[PARALLEL_MAX_THREADS];
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, phase, &workers[i]) == 0;
+    }
+    phase(&workers[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            phase(&workers[i]); // No thread to be had: do it here
+        }
+    }
+}
+
+/***
+ * Analysis
+*/
+
+// In an open unit, record a name used at position as an external reference
+// unless a statement before it declares the name
+static int referBefore(const Analysis* analysis, struct SymbolTable* table, const char* name, int type,
+                       size_t offset, int position) {
+    if (!analysis->open || declaredBefore(analysis, name, position) != NULL) {
+        return SEMANTIC_OK;
+    }
+    return referExternal(table, name, type, offset);
+}
+
+// Link plan references and add the declarations to table, in program order.
+// An open unit's external references are recorded in the same order as well.
+static int finishAnalysis(const Analysis* analysis, struct SymbolTable* table) {
+    struct ASTNode* root = analysis->root;
+    table->openUnit = table->openUnit || analysis->open;
+    for (int i = 0; i < root->childrenCount; i++) {
+        struct ASTNode* statement = root->children[i];
+        const char* name = declaredName(statement);
+        int result = SEMANTIC_OK;
+        if (name != NULL) {
+            int type = (statement->type == NODE_PLAN) ? TYPE_PLAN : (statement->type == NODE_GROUP) ? TYPE_GROUP : TYPE_CLIENT;
+            if (!addSymbol(table, name, type, 0)) {
+                table->errorOffset = statement->offset;
+                return RUNTIME_ERROR;
+            }
+            if (type != TYPE_CLIENT) {
+                table->symbols[table->size - 1].value.node = statement;
+            }
+            for (int j = 0; j < statement->childrenCount && type == TYPE_GROUP && result == SEMANTIC_OK; j++) {
+                struct ASTNode* member = statement->children[j];
+                result = referBefore(analysis, table, member->data.identifier.name, TYPE_CLIENT, member->offset, i);
+            }
+        } else if (statement->type == NODE_ASSIGNMENT) {
+            struct ASTNode* client = statement->data.assignment.client;
+            const Declaration* target = findDeclaration(analysis, client->data.clientProfile.name);
+            result = referBefore(analysis, table, client->data.clientProfile.name, TYPE_IDENTIFIER, client->offset, i);
+            struct ASTNode* group = (target != NULL) ? declaredGroup(analysis, target) : NULL;
+            if (group != NULL) {
+                statement->data.assignment.client = retainASTNode(group);
+                freeAST(client);
+            }
+            if (result == SEMANTIC_OK && statement->data.assignment.plan->type == NODE_IDENTIFIER) {
+                struct ASTNode* reference = statement->data.assignment.plan;
+                const Declaration* definition = findDeclaration(analysis, reference->data.identifier.name);
+                result = referBefore(analysis, table, reference->data.identifier.name, TYPE_PLAN, reference->offset, i);
+                // A plan left to the link step stays a reference
+                struct ASTNode* plan = (definition != NULL) ? declaredPlan(analysis, definition) : NULL;
+                if (plan != NULL) {
+                    statement->data.assignment.plan = retainASTNode(plan);
+                    freeAST(reference);
+                    hashAssignment(statement);
+                }
+            }
+        } else if (statement->type == NODE_SHOW_PLANS) {
+            result = referBefore(analysis, table, statement->data.showPlans.clientName, TYPE_CLIENT, statement->offset, i);
+        }
+        if (result != SEMANTIC_OK) {
+            table->errorOffset = statement->offset;
+            return result;
+        }
+    }
+    return SEMANTIC_OK;
+}
+
+int performParallelSemanticAnalysis(struct ASTNode* ast, struct SymbolTable* table, int threadCount) {
+    if (ast == NULL || ast->type != NODE_MAIN) {
+        return performSemanticAnalysis(ast, table);
+    }
+    int statements = ast->childrenCount;
+    threadCount = (threadCount < 1) ? 1 : (threadCount > PARALLEL_MAX_THREADS) ? PARALLEL_MAX_THREADS : threadCount;
+    if (threadCount > statements) {
+        threadCount = (statements > 0) ? statements : 1;
+    }
+
+    // At most half the slots are used
+    int names = table->size;
+    for (int i = 0; i < statements; i++) {
+        names += (declaredName(ast->children[i]) != NULL);
+    }
+    size_t slots = 16;
+    while (slots < (size_t)names * 2) {
+        slots *= 2;
+    }
+    Analysis analysis;
+    analysis.root = ast;
+    analysis.table = table;
+    analysis.mask = slots - 1;
+    analysis.declarations = allocMemory(table->allocator, slots * sizeof(Declaration));
+    if (analysis.declarations == NULL) {
+        return RUNTIME_ERROR;
+    }
+    for (size_t i = 0; i < slots; i++) {
+        atomic_init(&analysis.declarations[i].name, NULL);
+        atomic_init(&analysis.declarations[i].position, NOT_DECLARED);
+        analysis.declarations[i].symbol = NULL;
+    }
+    atomic_init(&analysis.firstFailure, NOT_DECLARED);
+    // Imports come first, and make the unit open as they do for checkNode
+    analysis.open = table->openUnit ||
+                    (table->acceptImports && statements > 0 && ast->children[0]->type == NODE_IMPORT);
+
+    // Names from the table (declared by earlier runs) come before every statement
+    for (int i = 0; i < table->size; i++) {
+        if (table->symbols[i].name != NULL) {
+            Declaration* declaration = declare(&analysis, table->symbols[i].name, EARLIER_RUN);
+            if (declaration->symbol == NULL) {
+                declaration->symbol = &table->symbols[i];
+            }
+        }
+    }
+
+    Worker workers[PARALLEL_MAX_THREADS];
+    for (int i = 0; i < threadCount; i++) {
+        workers[i].analysis = &analysis;
+        workers[i].begin = (int)((long)statements * i / threadCount);
+        workers[i].end = (int)((long)statements * (i + 1) / threadCount);
+        workers[i].failure = NOT_DECLARED;
+        workers[i].result = SEMANTIC_OK;
+        workers[i].errorOffset = NO_SOURCE_OFFSET;
+    }
+    runWorkers(workers, threadCount, declareRange);
+    runWorkers(workers, threadCount, checkRange);
+
+    // Ranges are in program order, so the first worker that failed has the earliest failure
+    int result = SEMANTIC_OK;
+    for (int i = 0; i < threadCount && result == SEMANTIC_OK; i++) {
+        if (workers[i].failure != NOT_DECLARED) {
+            result = workers[i].result;
+            if (table->errorOffset == NO_SOURCE_OFFSET) {
+                table->errorOffset = workers[i].errorOffset;
+            }
+        }
+    }
+    if (result == SEMANTIC_OK) {
+        result = finishAnalysis(&analysis, table);
+    }
+
+    releaseMemory(table->allocator, analysis.declarations, slots * sizeof(Declaration));
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "semantic.h"
+
+// Parallel semantic analysis, for a program that has been parsed completely.
+// It runs in two phases, each over contiguous ranges of the top-level
+// statements, one range per thread:
+//   1. Declarations (client profiles, plan definitions and groups) go into a
+//      lock-free hash table keyed by name. Slots are claimed with a
+//      compare-and-swap on the name, and each slot keeps the position of the
+//      earliest statement declaring it, lowered atomically.
+//   2. Every statement is checked against that table. A name is declared
+//      before statement p if its earliest declaration is before p, and a
+//      declaration is a redeclaration unless it is the earliest.
+// Each thread stops at its first failure, and the failure from the earliest
+// statement is reported, so the result and error location are the same as
+// for performSemanticAnalysis. Plan and group references are then linked and the
+// declarations added to table in program order, as the serial pass leaves
+// them.
+
+#define PARALLEL_MAX_THREADS 64
+
+int performParallelSemanticAnalysis(struct ASTNode* ast, struct SymbolTable* table, int threadCount);
+
+#endif // PARALLEL_H
@@ -1,51 +1,25 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "parser.h"
 #include "lexer.h"
 #include <stdbool.h>
 #include <stdio.h>
-#include <err.h>
+#include <stdarg.h>
 #include "semantic.h"
+#include "hashcons.h"
+#include "catalog.h"
 
 
-/***
- * Helper functions
-*/
-bool isDayToken(TokenType type) {
-    switch (type) {
-        case TOKEN_MONDAY:
-        case TOKEN_TUESDAY:
-        case TOKEN_WEDNESDAY:
-        case TOKEN_THURSDAY:
-        case TOKEN_FRIDAY:
-        case TOKEN_SATURDAY:
-        case TOKEN_SUNDAY:
-            return true;
-        default:
-            return false;
-    }
-}
+// Trace output for debugging the parser; compiled in only with -DFITLANG_DEBUG
+#ifdef FITLANG_DEBUG
+#define PARSER_TRACE(...) printf(__VA_ARGS__)
+#else
+#define PARSER_TRACE(...) ((void)0)
+#endif
 
-// Helper function to parse an integer attribute (sets or rest)
-int parseAttribute(Token*** tokens, int* attributeValue) {
-    // Expecting a colon
-    if ((**tokens)->type == TOKEN_COLON) {
-        (*tokens)++; // Consume colon token
-
-        // Expecting an integer literal
-        if ((**tokens)->type == TOKEN_INT_LITERAL) {
-            *attributeValue = atoi((**tokens)->value);
-            printf("Debug: Parsed attribute value: %d\n", *attributeValue);
-            (*tokens)++; // Consume integer literal token
-            return 0; // Success
-        } else {
-            fprintf(stderr, "Debug: Expected TOKEN_INT_LITERAL, got %d\n", (**tokens)->type);
-            return -1; // Error
-        }
-    } else {
-        fprintf(stderr, "Debug: Expected TOKEN_COLON, got %d\n", (**tokens)->type);
-        return -1; // Error
-    }
-}
+static void reportSyntaxError(Parser* parser, const char* format, ...);
+static const char* describeToken(const Token* token);
 
 /***
  * AST functions
@@ -53,63 +27,101 @@ int parseAttribute(Token*** tokens, int* attributeValue) {
 
 // Create a new AST node
 ASTNode* createASTNode(NodeType type, const char* value, int intValue) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
+    return createASTNodeWithAllocator(systemAllocator(), type, value, intValue);
+}
+
+// Create a new AST node whose memory comes from the given allocator
+ASTNode* createASTNodeWithAllocator(Allocator* allocator, NodeType type, const char* value, int intValue) {
+    ASTNode* node = (ASTNode*)allocMemory(allocator, sizeof(ASTNode));
     if (node == NULL) {
-        fprintf(stderr, "Failed to allocate memory for ASTNode.\n");
-        exit(EXIT_FAILURE);
+        return NULL;
     }
     
     // Initialize the node
     node->type = type;
+    node->allocator = allocator;
     node->children = NULL;
     node->childrenCount = 0;
+    node->refCount = 1;
+    node->hash = 0;
+    node->offset = NO_SOURCE_OFFSET;
+    memset(&node->data, 0, sizeof(node->data));
+
+    // Copy the name up front so a failed allocation leaves nothing half-built
+    char* name = NULL;
+    if (value != NULL && type != NODE_MAIN && type != NODE_ASSIGNMENT && type != NODE_LITERAL) {
+        name = allocString(allocator, value);
+        if (name == NULL) {
+            releaseMemory(allocator, node, sizeof(ASTNode));
+            return NULL;
+        }
+    }
 
-    printf("Debug: Creating ASTNode. Type: %d, ", type);  // Debug statement
+    PARSER_TRACE("Debug: Creating ASTNode. Type: %d, ", type);  // Debug statement
     
     // Set the data based on the node type
     switch (type) {
         case NODE_MAIN:
-            printf("NODE_MAIN\n");
+            PARSER_TRACE("NODE_MAIN\n");
             break;
         case NODE_IDENTIFIER:
             if (value != NULL) {
-                node->data.identifier.name = strdup(value);
-                printf("NODE_IDENTIFIER, Name: %s\n", node->data.identifier.name);
+                node->data.identifier.name = name;
+                PARSER_TRACE("NODE_IDENTIFIER, Name: %s\n", node->data.identifier.name);
             }
             break;
         case NODE_CLIENT_PROFILE:
             if (value != NULL) {
-                node->data.clientProfile.name = strdup(value);
-                printf("NODE_CLIENT_PROFILE, Name: %s\n", node->data.clientProfile.name);
+                node->data.clientProfile.name = name;
+                PARSER_TRACE("NODE_CLIENT_PROFILE, Name: %s\n", node->data.clientProfile.name);
             }
             break;
         case NODE_PLAN:
             if (value != NULL) {
-                node->data.plan.name = strdup(value);
-                printf("NODE_PLAN, Name: %s\n", node->data.plan.name);
+                node->data.plan.name = name;
+                PARSER_TRACE("NODE_PLAN, Name: %s\n", node->data.plan.name);
+            }
+            break;
+        case NODE_GROUP:
+            if (value != NULL) {
+                node->data.group.name = name;
+                PARSER_TRACE("NODE_GROUP, Name: %s\n", node->data.group.name);
+            }
+            break;
+        case NODE_IMPORT:
+            if (value != NULL) {
+                node->data.import.path = name;
+                PARSER_TRACE("NODE_IMPORT, Path: %s\n", node->data.import.path);
             }
             break;
         case NODE_DAY:
             if (value != NULL) {
-                node->data.day.name = strdup(value);
-                printf("NODE_DAY, Name: %s\n", node->data.day.name);
+                node->data.day.name = name;
+                PARSER_TRACE("NODE_DAY, Name: %s\n", node->data.day.name);
             }
             break;
         case NODE_EXERCISE:
+            node->data.exercise.catalogId = -1;
+            if (value != NULL) {
+                node->data.exercise.name = name;
+                PARSER_TRACE("NODE_EXERCISE, Name: %s\n", node->data.exercise.name);
+            }
+            break;
+        case NODE_SHOW_PLANS:
             if (value != NULL) {
-                node->data.exercise.name = strdup(value);
-                printf("NODE_EXERCISE, Name: %s\n", node->data.exercise.name);
+                node->data.showPlans.clientName = name;
+                PARSER_TRACE("NODE_SHOW_PLANS, Client: %s\n", node->data.showPlans.clientName);
             }
             break;
         case NODE_ASSIGNMENT:
-            printf("NODE_ASSIGNMENT\n");
+            PARSER_TRACE("NODE_ASSIGNMENT\n");
             break;
         case NODE_LITERAL:
             node->data.literal.value = intValue;
-            printf("NODE_LITERAL, Value: %d\n", node->data.literal.value);
+            PARSER_TRACE("NODE_LITERAL, Value: %d\n", node->data.literal.value);
             break;
         default:
-            printf("Unknown NodeType\n");
+            PARSER_TRACE("Unknown NodeType\n");
             break;
     }
     
@@ -117,27 +129,39 @@ ASTNode* createASTNode(NodeType type, const char* value, int intValue) {
 }
 
 
-// Revised addASTChildNode function
-void addASTChildNode(ASTNode* parent, ASTNode* child) {
+// Revised addASTChildNode function; returns false if the children array cannot grow
+bool addASTChildNode(ASTNode* parent, ASTNode* child) {
     if (parent == NULL || child == NULL) {
-        fprintf(stderr, "Invalid parent or child node.\n");
-        return;
+        return false;
     }
     
-    // Increment the children count
-    parent->childrenCount++;
-    
     // Reallocate memory for children array
-    parent->children = (ASTNode**)realloc(parent->children, parent->childrenCount * sizeof(ASTNode*));
-    if (parent->children == NULL) {
-        fprintf(stderr, "Failed to allocate memory for children array.\n");
-        exit(EXIT_FAILURE);
+    ASTNode** children = (ASTNode**)reallocMemory(parent->allocator, parent->children,
+        parent->childrenCount * sizeof(ASTNode*), (parent->childrenCount + 1) * sizeof(ASTNode*));
+    if (children == NULL) {
+        return false;
     }
     
     // Add the child node to the parent's children array
-    parent->children[parent->childrenCount - 1] = child;
+    parent->children = children;
+    parent->children[parent->childrenCount++] = child;
+
+    PARSER_TRACE("Debug: Added child node. Parent type: %d, Child type: %d\n", parent->type, child->type); // Debug statement
+    return true;
+}
+
+// Take an additional reference to a shared node
+ASTNode* retainASTNode(ASTNode* node) {
+    if (node != NULL) {
+        node->refCount++;
+    }
+    return node;
+}
 
-    printf("Debug: Added child node. Parent type: %d, Child type: %d\n", parent->type, child->type); // Debug statement
+// Name of the client or group an assignment is to
+const char* assignedName(const ASTNode* assignment) {
+    const ASTNode* target = assignment->data.assignment.client;
+    return (target->type == NODE_GROUP) ? target->data.group.name : target->data.clientProfile.name;
 }
 
 // Free the entire AST
@@ -145,6 +169,11 @@ void freeAST(ASTNode* root) {
     if (root == NULL) {
         return;
     }
+
+    // Shared subtrees are only freed when their last owner releases them
+    if (--root->refCount > 0) {
+        return;
+    }
     
     // Recursively free child nodes
     for (int i = 0; i < root->childrenCount; i++) {
@@ -154,13 +183,32 @@ void freeAST(ASTNode* root) {
     // Free data associated with the node
     switch (root->type) {
         case NODE_IDENTIFIER:
-            free(root->data.identifier.name);
+            releaseString(root->allocator, root->data.identifier.name);
             break;
         case NODE_CLIENT_PROFILE:
-            free(root->data.clientProfile.name);
+            releaseString(root->allocator, root->data.clientProfile.name);
+            break;
+        case NODE_PLAN:
+            releaseString(root->allocator, root->data.plan.name);
+            break;
+        case NODE_GROUP:
+            releaseString(root->allocator, root->data.group.name);
+            break;
+        case NODE_IMPORT:
+            releaseString(root->allocator, root->data.import.path);
             break;
         case NODE_DAY:
-            free(root->data.day.name);
+            releaseString(root->allocator, root->data.day.name);
+            break;
+        case NODE_EXERCISE:
+            releaseString(root->allocator, root->data.exercise.name);
+            break;
+        case NODE_SHOW_PLANS:
+            releaseString(root->allocator, root->data.showPlans.clientName);
+            break;
+        case NODE_ASSIGNMENT:
+            freeAST(root->data.assignment.client);
+            freeAST(root->data.assignment.plan);
             break;
         // Add cases for other node types as needed...
         default:
@@ -168,8 +216,8 @@ void freeAST(ASTNode* root) {
     }
     
     // Free the children array and the node itself
-    free(root->children);
-    free(root);
+    releaseMemory(root->allocator, root->children, root->childrenCount * sizeof(ASTNode*));
+    releaseMemory(root->allocator, root, sizeof(ASTNode));
 }
 
 
@@ -177,377 +225,637 @@ void freeAST(ASTNode* root) {
  * All parsing functions for each node type
 */
 
-// Parse a client profile
-ASTNode* parseClientProfile(Token*** tokens) {
-    printf("Debug: parseClientProfile - Starting\n");
-    
-    if ((**tokens)->type != TOKEN_CLIENT_PROFILE) {
-        fprintf(stderr, "Debug: parseClientProfile - Expected client profile declaration, got %s\n", (**tokens)->value);
+// Create a node from the parser's allocator
+static ASTNode* newASTNode(Parser* parser, const Token* at, NodeType type, const char* value, int intValue) {
+    ASTNode* node = createASTNodeWithAllocator(parser->context->allocators[SUBSYSTEM_PARSER], type, value, intValue);
+    if (node == NULL) {
+        parser->context->outOfMemory = true;
         return NULL;
     }
-    printf("Debug: parseClientProfile - Consumed TOKEN_CLIENT_PROFILE\n");
-    (*tokens)++;
+    node->offset = at->offset;
+    return node;
+}
 
-    if ((**tokens)->type != TOKEN_IDENTIFIER) {
-        fprintf(stderr, "Debug: parseClientProfile - Expected identifier for client profile, got %s\n", (**tokens)->value);
-        return NULL;
+// Append a child node, recording an allocation failure in the context
+static bool addChild(Parser* parser, ASTNode* parent, ASTNode* child) {
+    if (!addASTChildNode(parent, child)) {
+        parser->context->outOfMemory = true;
+        return false;
     }
-    printf("Debug: parseClientProfile - Consumed TOKEN_IDENTIFIER: %s\n", (**tokens)->value);
-    ASTNode* node = createASTNode(NODE_CLIENT_PROFILE, (**tokens)->value, 0);
-    (*tokens)++;
+    return true;
+}
 
-    if ((**tokens)->type != TOKEN_SEMICOLON) {
-        fprintf(stderr, "Debug: parseClientProfile - Expected semicolon, got %s\n", (**tokens)->value);
-        freeAST(node);
-        return NULL;
-    }
-    printf("Debug: parseClientProfile - Consumed TOKEN_SEMICOLON\n");
-    (*tokens)++;
+// Describe a token for an error message: its text, or what it is if it has none
+static const char* describeToken(const Token* token) {
+    return (token->value[0] != '\0') ? token->value : tokenTypeName(token->type);
+}
 
-    printf("Debug: parseClientProfile - Finished\n");
-    return node;
+// Record the first syntax error in the compilation context, at the current token
+static void reportSyntaxError(Parser* parser, const char* format, ...) {
+    CompileContext* context = parser->context;
+    if (context->syntaxError[0] == '\0') {
+        context->errorOffset = (*parser->current)->offset;
+        va_list args;
+        va_start(args, format);
+        vsnprintf(context->syntaxError, sizeof(context->syntaxError), format, args);
+        va_end(args);
+    }
+    PARSER_TRACE("Debug: %s\n", context->syntaxError);
 }
 
-// Parse a showPlans statement
-ASTNode* parseShowPlans(Token*** tokens) {
-    if ((**tokens)->type != TOKEN_SHOW_PLANS) {
-        fprintf(stderr, "Expected 'showPlans', got %s\n", (**tokens)->value);
-        return NULL;
-    }
-    (*tokens)++;  // Consume TOKEN_SHOW_PLANS
+// Fused mode: the parser runs the semantic checks itself as each statement is built
+static bool isFusedMode(const Parser* parser) {
+    return parser->context->symbols != NULL;
+}
 
-    if ((**tokens)->type != TOKEN_IDENTIFIER) {
-        fprintf(stderr, "Expected an identifier for client name, got %s\n", (**tokens)->value);
-        return NULL;
+// Record the result of a fused semantic check on the construct at a token;
+// returns false if parsing must stop
+static bool passesCheck(Parser* parser, const Token* at, int result) {
+    if (result != SEMANTIC_OK) {
+        PARSER_TRACE("Debug: Semantic check failed with code %d\n", result);
+        parser->context->semanticResult = result;
+        parser->context->errorOffset = at->offset;
+        return false;
     }
+    return true;
+}
 
-    ASTNode* node = createASTNode(NODE_SHOW_PLANS, (**tokens)->value, 0);
-    (*tokens)++;  // Consume TOKEN_IDENTIFIER
-
-    if ((**tokens)->type != TOKEN_SEMICOLON) {
-        fprintf(stderr, "Expected semicolon, got %s\n", (**tokens)->value);
-        freeAST(node);
-        return NULL;
+// Result of a fused check of a reference to the name at a token. In an open
+// unit (semantic.h) a name the file declares nowhere is left to the link step.
+static int checkReference(Parser* parser, const Token* at, int type, int result) {
+    if (result == UNDEFINED_IDENTIFIER) {
+        result = referExternal(parser->context->symbols, at->value, type, at->offset);
     }
-    (*tokens)++;  // Consume TOKEN_SEMICOLON
-
-    return node;
+    return result;
 }
 
-ASTNode* parseExercise(Token*** tokens) {
-    printf("Debug: parseExercise - Starting\n");
+/***
+ * Grammar
+*/
 
-    // Expecting TOKEN_EXERCISE
-    if ((**tokens)->type != TOKEN_EXERCISE) {
-        fprintf(stderr, "Debug: parseExercise - Expected TOKEN_EXERCISE, got %d\n", (**tokens)->type);
-        return NULL;
+#define TOKEN_TYPE_COUNT (TOKEN_EOF + 1)
+#define PARSER_MAX_DEPTH 8  // Productions in progress at once; the grammar nests three deep
+
+// Computed-goto dispatch of actions where the compiler has it, a switch otherwise
+#if defined(__GNUC__) && !defined(FITLANG_NO_COMPUTED_GOTO)
+#define PARSER_COMPUTED_GOTO
+#endif
+
+// Parser states. Each is a position inside a production, and has a default
+// transition for tokens the action table gives it none, and the syntax error
+// reported when that default is to fail. Plan and day bodies skip stray
+// tokens; a missing ':' or number after sets/rest leaves the value unset, and
+// anything but '|' ends an exercise.
+#define PARSER_STATES(X) \
+    X(ERROR,               STOP,                             NULL) \
+    X(RETURN,              STOP,                             NULL) /* pops the state to go on with */ \
+    X(ACCEPT,              STOP,                             NULL) /* the statement is complete */ \
+    X(STATEMENT,           STOP,                             "Unexpected token: %s") \
+    X(CLIENT_NAME,         STOP,                             "parseClientProfile - Expected identifier for client profile, got %s") \
+    X(CLIENT_END,          STOP,                             "parseClientProfile - Expected semicolon, got %s") \
+    X(SHOW_NAME,           STOP,                             "Expected an identifier for client name, got %s") \
+    X(SHOW_END,            STOP,                             "Expected semicolon, got %s") \
+    X(PLAN_NAME,           STOP,                             "parsePlanDefinition - Expected plan identifier, got %s") \
+    X(PLAN_OPEN,           STOP,                             "Expected '{', got %s") \
+    X(DEFINITION_END,      STOP,                             "parsePlanDefinition - Expected semicolon, got %s") \
+    X(ASSIGN_PLAN,         STOP,                             "Expected plan identifier, got %s") \
+    X(ASSIGN_TO,           STOP,                             "Expected 'to', got %s") \
+    X(ASSIGN_CLIENT,       STOP,                             "Expected client identifier, got %s") \
+    X(ASSIGN_BODY,         STOP,                             "Expected '{', got %s") \
+    X(ASSIGN_END,          STOP,                             "Expected semicolon, got %s") \
+    X(GROUP_NAME,          STOP,                             "parseGroup - Expected group identifier, got %s") \
+    X(GROUP_OPEN,          STOP,                             "parseGroup - Expected '{', got %s") \
+    X(GROUP_FIRST,         STOP,                             "parseGroup - Expected member identifier, got %s") \
+    X(GROUP_NEXT,          STOP,                             "parseGroup - Expected ',' or '}', got %s") \
+    X(GROUP_MEMBER,        STOP,                             "parseGroup - Expected member identifier, got %s") \
+    X(GROUP_END,           STOP,                             "parseGroup - Expected semicolon, got %s") \
+    X(IMPORT_PATH,         STOP,                             "parseImport - Expected file name string, got %s") \
+    X(IMPORT_END,          STOP,                             "parseImport - Expected semicolon, got %s") \
+    X(PLAN_BODY,           GO(PLAN_BODY),                    "Expected '}' before end of input") \
+    X(DAY_OPEN,            STOP,                             "parseDay - Expected left brace, got %s") \
+    X(DAY_BODY,            GO(DAY_BODY),                     "parseDay - Expected right brace, got %s") \
+    X(EXERCISE_COLON,      STOP,                             "parseExercise - Expected TOKEN_COLON after 'exercise', got %s") \
+    X(EXERCISE_NAME,       STOP,                             "parseExercise - Expected TOKEN_STRING_LITERAL, got %s") \
+    X(EXERCISE_ATTRIBUTES, AGAIN(DAY_BODY, END_EXERCISE),    NULL) \
+    X(ATTRIBUTE,           STOP,                             "parseExercise - Expected TOKEN_SETS or TOKEN_REST, got %s") \
+    X(ATTRIBUTE_COLON,     AGAIN(EXERCISE_ATTRIBUTES, NONE), NULL) \
+    X(ATTRIBUTE_VALUE,     AGAIN(EXERCISE_ATTRIBUTES, NONE), NULL)
+
+// Actions run on a transition, with the token it was taken on
+#define PARSER_ACTIONS(X) \
+    X(NONE) \
+    X(IMPORT)               /* imports only come before other statements */ \
+    X(IMPORT_PATH) \
+    X(DECLARE_CLIENT) \
+    X(SHOW_CLIENT) \
+    X(DECLARE_PLAN)         /* the plan named by a definition */ \
+    X(REMEMBER_PLAN)        /* the plan named by an assignment */ \
+    X(ASSIGN_CLIENT) \
+    X(REFERENCE_PLAN)       /* an assignment without a body */ \
+    X(END_ASSIGNMENT) \
+    X(END_DEFINITION) \
+    X(DECLARE_GROUP) \
+    X(GROUP_MEMBER) \
+    X(BEGIN_PLAN) \
+    X(END_PLAN) \
+    X(BEGIN_DAY) \
+    X(END_DAY) \
+    X(BEGIN_EXERCISE) \
+    X(EXERCISE_NAME) \
+    X(SELECT_SETS) \
+    X(SELECT_REST) \
+    X(ATTRIBUTE_VALUE) \
+    X(END_EXERCISE)
+
+typedef enum {
+#define STATE_ENUM(name, otherwise, error) STATE_##name,
+    PARSER_STATES(STATE_ENUM)
+#undef STATE_ENUM
+    STATE_COUNT
+} ParserState;
+
+typedef enum {
+#define ACTION_ENUM(name) ACTION_##name,
+    PARSER_ACTIONS(ACTION_ENUM)
+#undef ACTION_ENUM
+    ACTION_COUNT
+} ParserAction;
+
+typedef struct {
+    uint8_t next;           // STATE_ERROR: use the state's default
+    uint8_t action;
+    uint8_t push;           // State to go on with once next's production returns (STATE_ERROR for none)
+    bool reprocess;         // Handle the same token again in the next state
+} Transition;
+
+#define STOP { STATE_ERROR, ACTION_NONE, STATE_ERROR, false }
+#define GO(state) { STATE_##state, ACTION_NONE, STATE_ERROR, false }
+#define DO(state, action) { STATE_##state, ACTION_##action, STATE_ERROR, false }
+#define CALL(state, action, then) { STATE_##state, ACTION_##action, STATE_##then, false }
+#define RETURN(action) { STATE_RETURN, ACTION_##action, STATE_ERROR, false }
+#define AGAIN(state, action) { STATE_##state, ACTION_##action, STATE_ERROR, true }
+#define FAIL { STATE_ERROR, ACTION_NONE, STATE_ERROR, true }   // Unlike an empty entry, never takes the default
+#define ON_DAYS(transition) \
+    [TOKEN_MONDAY] = transition, [TOKEN_TUESDAY] = transition, [TOKEN_WEDNESDAY] = transition, \
+    [TOKEN_THURSDAY] = transition, [TOKEN_FRIDAY] = transition, [TOKEN_SATURDAY] = transition, \
+    [TOKEN_SUNDAY] = transition
+
+// The action table: one row per state, one entry per token type. Tokens
+// without an entry take the state's default.
+static const Transition transitions[STATE_COUNT][TOKEN_TYPE_COUNT] = {
+    [STATE_STATEMENT] = {
+        [TOKEN_CLIENT_PROFILE] = GO(CLIENT_NAME),
+        [TOKEN_ASSIGN] = GO(ASSIGN_PLAN),
+        [TOKEN_SHOW_PLANS] = GO(SHOW_NAME),
+        [TOKEN_PLAN] = GO(PLAN_NAME),
+        [TOKEN_GROUP] = GO(GROUP_NAME),
+        [TOKEN_IMPORT] = DO(IMPORT_PATH, IMPORT),
+        ON_DAYS(DO(DAY_OPEN, BEGIN_DAY)),
+    },
+    [STATE_CLIENT_NAME] = { [TOKEN_IDENTIFIER] = DO(CLIENT_END, DECLARE_CLIENT) },
+    [STATE_CLIENT_END] = { [TOKEN_SEMICOLON] = RETURN(NONE) },
+    [STATE_SHOW_NAME] = { [TOKEN_IDENTIFIER] = DO(SHOW_END, SHOW_CLIENT) },
+    [STATE_SHOW_END] = { [TOKEN_SEMICOLON] = RETURN(NONE) },
+    [STATE_PLAN_NAME] = { [TOKEN_IDENTIFIER] = DO(PLAN_OPEN, DECLARE_PLAN) },
+    [STATE_PLAN_OPEN] = { [TOKEN_LEFT_BRACE] = CALL(PLAN_BODY, BEGIN_PLAN, DEFINITION_END) },
+    [STATE_DEFINITION_END] = { [TOKEN_SEMICOLON] = RETURN(END_DEFINITION) },
+    [STATE_ASSIGN_PLAN] = { [TOKEN_IDENTIFIER] = DO(ASSIGN_TO, REMEMBER_PLAN) },
+    [STATE_ASSIGN_TO] = { [TOKEN_TO] = GO(ASSIGN_CLIENT) },
+    [STATE_ASSIGN_CLIENT] = { [TOKEN_IDENTIFIER] = DO(ASSIGN_BODY, ASSIGN_CLIENT) },
+    [STATE_ASSIGN_BODY] = {
+        [TOKEN_SEMICOLON] = RETURN(REFERENCE_PLAN),
+        [TOKEN_LEFT_BRACE] = CALL(PLAN_BODY, BEGIN_PLAN, ASSIGN_END),
+    },
+    [STATE_ASSIGN_END] = { [TOKEN_SEMICOLON] = RETURN(END_ASSIGNMENT) },
+    [STATE_GROUP_NAME] = { [TOKEN_IDENTIFIER] = DO(GROUP_OPEN, DECLARE_GROUP) },
+    [STATE_GROUP_OPEN] = { [TOKEN_LEFT_BRACE] = GO(GROUP_FIRST) },
+    [STATE_GROUP_FIRST] = {
+        [TOKEN_IDENTIFIER] = DO(GROUP_NEXT, GROUP_MEMBER),
+        [TOKEN_RIGHT_BRACE] = GO(GROUP_END),
+    },
+    [STATE_GROUP_NEXT] = {
+        [TOKEN_COMMA] = GO(GROUP_MEMBER),
+        [TOKEN_RIGHT_BRACE] = GO(GROUP_END),
+    },
+    [STATE_GROUP_MEMBER] = { [TOKEN_IDENTIFIER] = DO(GROUP_NEXT, GROUP_MEMBER) },
+    [STATE_GROUP_END] = { [TOKEN_SEMICOLON] = RETURN(NONE) },
+    [STATE_IMPORT_PATH] = { [TOKEN_STRING_LITERAL] = DO(IMPORT_END, IMPORT_PATH) },
+    [STATE_IMPORT_END] = { [TOKEN_SEMICOLON] = RETURN(NONE) },
+    [STATE_PLAN_BODY] = {
+        ON_DAYS(CALL(DAY_OPEN, BEGIN_DAY, PLAN_BODY)),
+        [TOKEN_RIGHT_BRACE] = RETURN(END_PLAN),
+        [TOKEN_EOF] = FAIL,
+    },
+    [STATE_DAY_OPEN] = { [TOKEN_LEFT_BRACE] = GO(DAY_BODY) },
+    [STATE_DAY_BODY] = {
+        [TOKEN_EXERCISE] = DO(EXERCISE_COLON, BEGIN_EXERCISE),
+        [TOKEN_RIGHT_BRACE] = RETURN(END_DAY),
+        [TOKEN_EOF] = FAIL,
+    },
+    [STATE_EXERCISE_COLON] = { [TOKEN_COLON] = GO(EXERCISE_NAME) },
+    [STATE_EXERCISE_NAME] = { [TOKEN_STRING_LITERAL] = DO(EXERCISE_ATTRIBUTES, EXERCISE_NAME) },
+    [STATE_EXERCISE_ATTRIBUTES] = { [TOKEN_PIPE] = GO(ATTRIBUTE) },
+    [STATE_ATTRIBUTE] = {
+        [TOKEN_SETS] = DO(ATTRIBUTE_COLON, SELECT_SETS),
+        [TOKEN_REST] = DO(ATTRIBUTE_COLON, SELECT_REST),
+    },
+    [STATE_ATTRIBUTE_COLON] = { [TOKEN_COLON] = GO(ATTRIBUTE_VALUE) },
+    [STATE_ATTRIBUTE_VALUE] = { [TOKEN_INT_LITERAL] = DO(EXERCISE_ATTRIBUTES, ATTRIBUTE_VALUE) },
+};
+
+static const struct {
+    Transition otherwise;
+    const char* error;
+} defaults[STATE_COUNT] = {
+#define STATE_DEFAULT(name, otherwise, error) [STATE_##name] = { otherwise, error },
+    PARSER_STATES(STATE_DEFAULT)
+#undef STATE_DEFAULT
+};
+
+#ifdef FITLANG_DEBUG
+static const char* const stateNames[STATE_COUNT] = {
+#define STATE_NAME(name, otherwise, error) #name,
+    PARSER_STATES(STATE_NAME)
+#undef STATE_NAME
+};
+#endif
+
+static const char* const dayNames[] = {
+    "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"
+};
+
+/***
+ * Parsing functions
+*/
+
+// What the actions of one statement have built so far
+typedef struct {
+    const Token* first;         // The statement's first token
+    const Token* name;          // Plan named by a definition or assignment
+    const Token* client;        // Client or group named by an assignment
+    const Token* exercise;      // 'exercise' token of the exercise being parsed
+    const char* exerciseName;   // Token values stay valid for the whole parse, no copy needed
+    int sets;
+    int rest;
+    int* attribute;             // sets or rest, whichever is being given
+    ASTNode* node;              // The statement's node, once made
+    ASTNode* plan;              // Plan body being parsed, or an assignment's plan
+    ASTNode* day;               // Day being parsed
+} Statement;
+
+// Link an assignment's client and plan; the fused mode links an assignment to a group to the group's node
+static bool finishAssignment(Parser* parser, Statement* statement) {
+    const Token* client = statement->client;
+    ASTNode* group = isFusedMode(parser) ? resolveGroupReference(parser->context->symbols, client->value) : NULL;
+    ASTNode* clientNode = (group != NULL) ? retainASTNode(group)
+                                          : newASTNode(parser, client, NODE_CLIENT_PROFILE, client->value, 0);
+    if (clientNode == NULL) {
+        return false;
+    }
+    ASTNode* assignmentNode = newASTNode(parser, statement->first, NODE_ASSIGNMENT, NULL, 0);
+    if (assignmentNode == NULL) {
+        freeAST(clientNode);
+        return false;
+    }
+    assignmentNode->data.assignment.plan = statement->plan;
+    assignmentNode->data.assignment.client = clientNode;
+    if (statement->plan->type == NODE_PLAN) {
+        hashAssignment(assignmentNode); // Plan references are hashed once linked
     }
-    (*tokens)++; // Consume TOKEN_EXERCISE
+    PARSER_TRACE("Debug: Assignment of %s to %s\n", statement->plan->data.plan.name, assignedName(assignmentNode));
+    statement->plan = NULL;
+    statement->node = assignmentNode;
+    return true;
+}
 
-    // Expecting a colon after "exercise"
-    if ((**tokens)->type != TOKEN_COLON) {
-        fprintf(stderr, "Debug: parseExercise - Expected TOKEN_COLON after 'exercise', got %d\n", (**tokens)->type);
-        return NULL;
+// Build an exercise node from the exercise just parsed and add it to the day
+static bool finishExercise(Parser* parser, Statement* statement) {
+    // Catalog aliases are stored under their canonical name, so they also share nodes
+    const Catalog* catalog = parser->context->catalog;
+    const char* exerciseName = statement->exerciseName;
+    int catalogId = (catalog != NULL) ? catalogLookup(catalog, exerciseName) : CATALOG_NOT_FOUND;
+    if (catalogId != CATALOG_NOT_FOUND) {
+        exerciseName = catalogName(catalog, catalogId);
     }
-    (*tokens)++; // Consume TOKEN_COLON
 
-    // Expecting a string literal for the exercise name
-    if ((**tokens)->type != TOKEN_STRING_LITERAL) {
-        fprintf(stderr, "Debug: parseExercise - Expected TOKEN_STRING_LITERAL, got %d\n", (**tokens)->type);
-        return NULL;
+    if (isFusedMode(parser) && !passesCheck(parser, statement->exercise, checkExerciseValues(statement->sets, statement->rest))) {
+        return false;
     }
-    char* exerciseName = strdup((**tokens)->value);
-    printf("Debug: parseExercise - Exercise Name: %s\n", exerciseName);
-    (*tokens)++; // Consume TOKEN_STRING_LITERAL
-
-    // Initialize exercise attributes
-    int sets = 0;
-    int rest = 0;
-
-    // Parse exercise attributes
-    while ((**tokens)->type == TOKEN_PIPE) {
-        printf("Debug: parseExercise - Found TOKEN_PIPE\n");
-        (*tokens)++; // Consume TOKEN_PIPE
-
-        // Parse sets
-        if ((**tokens)->type == TOKEN_SETS) {
-            (*tokens)++; // Consume TOKEN_SETS
-            if ((**tokens)->type == TOKEN_COLON) {
-                (*tokens)++; // Consume TOKEN_COLON
-                if ((**tokens)->type == TOKEN_INT_LITERAL) {
-                    sets = atoi((**tokens)->value);
-                    printf("Debug: parseExercise - Sets: %d\n", sets);
-                    (*tokens)++; // Consume TOKEN_INT_LITERAL
-                }
-            }
-        }
-        // Parse rest
-        else if ((**tokens)->type == TOKEN_REST) {
-            (*tokens)++; // Consume TOKEN_REST
-            if ((**tokens)->type == TOKEN_COLON) {
-                (*tokens)++; // Consume TOKEN_COLON
-                if ((**tokens)->type == TOKEN_INT_LITERAL) {
-                    rest = atoi((**tokens)->value);
-                    printf("Debug: parseExercise - Rest: %d\n", rest);
-                    (*tokens)++; // Consume TOKEN_INT_LITERAL
-                }
-            }
-        } else {
-            fprintf(stderr, "Debug: parseExercise - Expected TOKEN_SETS or TOKEN_REST, got %d\n", (**tokens)->type);
-            free(exerciseName);
-            return NULL;
-        }
+    if (isFusedMode(parser) && catalog != NULL &&
+        !passesCheck(parser, statement->exercise, catalogId != CATALOG_NOT_FOUND ? SEMANTIC_OK : UNKNOWN_EXERCISE)) {
+        return false;
     }
 
-    // Create the exercise node with the exercise name
-    ASTNode* node = createASTNode(NODE_EXERCISE, exerciseName, 0);
-    node->data.exercise.sets = sets;
-    node->data.exercise.rest = rest;
-    free(exerciseName);
-
-    printf("Debug: parseExercise - Exiting\n");
-    return node;
+    ASTNode* node = newASTNode(parser, statement->exercise, NODE_EXERCISE, exerciseName, 0);
+    if (node == NULL) {
+        return false;
+    }
+    node->data.exercise.sets = statement->sets;
+    node->data.exercise.rest = statement->rest;
+    node->data.exercise.catalogId = catalogId;
+    if (!addChild(parser, statement->day, node)) {
+        freeAST(node);
+        return false;
+    }
+    return true;
 }
 
-
-
-// Parse a day
-ASTNode* parseDay(Token*** tokens) {
-    printf("Debug: parseDay - Starting\n");
-
-    // Check if the current token is a day token
-    const char* dayName;
-    switch ((**tokens)->type) {
-        case TOKEN_MONDAY:
-            dayName = "Monday";
-            break;
-        case TOKEN_TUESDAY:
-            dayName = "Tuesday";
-            break;
-        case TOKEN_WEDNESDAY:
-            dayName = "Wednesday";
-            break;
-        case TOKEN_THURSDAY:
-            dayName = "Thursday";
-            break;
-        case TOKEN_FRIDAY:
-            dayName = "Friday";
-            break;
-        case TOKEN_SATURDAY:
-            dayName = "Saturday";
-            break;
-        case TOKEN_SUNDAY:
-            dayName = "Sunday";
-            break;
-        default:
-            fprintf(stderr, "Debug: parseDay - Expected day token, got %d\n", (**tokens)->type);
-            return NULL;
+// Parse one top-level statement at the cursor (NULL on error, recorded in the context).
+// The grammar tables drive the parse: each token selects a transition of the
+// current state, whose action builds the tree, and productions that nest (plan
+// bodies, days) keep the state to return to on a small stack.
+ASTNode* parseStatement(Parser* parser) {
+    Token** cursor = parser->current;
+    const Token* token = *cursor;
+    if (token->type != TOKEN_IMPORT) {
+        parser->context->pastImports = true;
+    }
+
+    Statement statement;
+    memset(&statement, 0, sizeof(Statement));
+    statement.first = token;
+    statement.attribute = &statement.sets;
+    uint8_t returns[PARSER_MAX_DEPTH];
+    int depth = 0;
+    returns[depth++] = STATE_ACCEPT;
+    int state = STATE_STATEMENT;
+    Transition transition;
+
+#ifdef PARSER_COMPUTED_GOTO
+    static const void* const targets[ACTION_COUNT] = {
+#define ACTION_TARGET(name) &&target_##name,
+        PARSER_ACTIONS(ACTION_TARGET)
+#undef ACTION_TARGET
+    };
+#define TARGET(name) target_##name
+#define DISPATCH() goto *targets[transition.action];
+#else
+#define TARGET(name) case ACTION_##name
+#define DISPATCH() switch (transition.action)
+#endif
+
+next:
+    token = *cursor;
+    transition = transitions[state][token->type];
+    if (transition.next == STATE_ERROR && !transition.reprocess) {
+        transition = defaults[state].otherwise;
+    }
+    if (transition.next == STATE_ERROR) {
+        parser->current = cursor;
+        reportSyntaxError(parser, defaults[state].error, describeToken(token));
+        goto fail;
+    }
+    PARSER_TRACE("Debug: %s, %s -> %s\n", stateNames[state], tokenTypeName(token->type),
+                 stateNames[transition.next == STATE_RETURN ? returns[depth - 1] : transition.next]);
+    if (transition.push != STATE_ERROR) {
+        if (depth == PARSER_MAX_DEPTH) {
+            parser->current = cursor;
+            reportSyntaxError(parser, "Statement nested too deeply at %s", describeToken(token));
+            goto fail;
+        }
+        returns[depth++] = transition.push;
     }
+    state = (transition.next == STATE_RETURN) ? returns[--depth] : transition.next;
 
-    printf("Debug: parseDay - Consumed day token: %s\n", dayName);
-    ASTNode* dayNode = createASTNode(NODE_DAY, dayName, 0);
-    (*tokens)++; // Consume day token
+    DISPATCH() {
+        TARGET(NONE):
+            goto advance;
 
-    // Expecting a left brace to start the day's exercises
-    if ((**tokens)->type != TOKEN_LEFT_BRACE) {
-        fprintf(stderr, "Debug: parseDay - Expected left brace, got %d\n", (**tokens)->type);
-        freeAST(dayNode);
-        return NULL;
-    }
-    printf("Debug: parseDay - Consumed left brace\n");
-    (*tokens)++; // Consume left brace
-
-    while ((**tokens)->type != TOKEN_RIGHT_BRACE) {
-        if ((**tokens)->type == TOKEN_EXERCISE) {
-            printf("Debug: parseDay - Parsing exercise\n");
-            ASTNode* exerciseNode = parseExercise(tokens);
-            if (exerciseNode) {
-                printf("Debug: Adding exercise node: %s to day node: %s\n", exerciseNode->data.exercise.name, dayNode->data.day.name);
-                addASTChildNode(dayNode, exerciseNode);
-            } else {
-                fprintf(stderr, "Debug: parseDay - Error parsing exercise\n");
-                freeAST(dayNode);
-                return NULL;
+        TARGET(IMPORT):
+            if (parser->context->pastImports) {
+                parser->current = cursor;
+                reportSyntaxError(parser, "parseImport - Imports must come before other statements");
+                goto fail;
             }
-        } else {
-            fprintf(stderr, "Debug: parseDay - Expected TOKEN_EXERCISE or TOKEN_RIGHT_BRACE, got %d\n", (**tokens)->type);
-            (*tokens)++; // Skip unexpected tokens
-        }
-    }
+            goto advance;
 
-    // Expecting a right brace to end the day's exercises
-    if ((**tokens)->type != TOKEN_RIGHT_BRACE) {
-        fprintf(stderr, "Debug: parseDay - Expected right brace, got %d\n", (**tokens)->type);
-        freeAST(dayNode);
-        return NULL;
-    }
-    printf("Debug: parseDay - Consumed right brace\n");
-    (*tokens)++; // Consume right brace
+        TARGET(IMPORT_PATH):
+            if (isFusedMode(parser) && !passesCheck(parser, statement.first, checkImport(parser->context->symbols))) {
+                goto fail;
+            }
+            statement.node = newASTNode(parser, statement.first, NODE_IMPORT, token->value, 0);
+            if (statement.node == NULL) {
+                goto fail;
+            }
+            goto advance;
 
-    printf("Debug: parseDay - Finished\n");
-    return dayNode;
-}
+        TARGET(DECLARE_CLIENT):
+            if (isFusedMode(parser) && !passesCheck(parser, token, declareClient(parser->context->symbols, token->value))) {
+                goto fail;
+            }
+            statement.node = newASTNode(parser, token, NODE_CLIENT_PROFILE, token->value, 0);
+            if (statement.node == NULL) {
+                goto fail;
+            }
+            goto advance;
+
+        TARGET(SHOW_CLIENT):
+            if (isFusedMode(parser) && !passesCheck(parser, token,
+                    checkReference(parser, token, TYPE_CLIENT, checkClientReference(parser->context->symbols, token->value)))) {
+                goto fail;
+            }
+            statement.node = newASTNode(parser, token, NODE_SHOW_PLANS, token->value, 0);
+            if (statement.node == NULL) {
+                goto fail;
+            }
+            goto advance;
 
+        TARGET(DECLARE_PLAN):
+            // Reject a redeclared plan before building its body
+            statement.name = token;
+            if (isFusedMode(parser) && !passesCheck(parser, token, declarePlan(parser->context->symbols, token->value, NULL))) {
+                goto fail;
+            }
+            goto advance;
+
+        TARGET(REMEMBER_PLAN):
+            statement.name = token;
+            goto advance;
+
+        TARGET(ASSIGN_CLIENT):
+            // Reject assignments to unknown clients before building the plan body
+            statement.client = token;
+            if (isFusedMode(parser) && !passesCheck(parser, token,
+                    checkReference(parser, token, TYPE_IDENTIFIER, checkAssignmentTarget(parser->context->symbols, token->value)))) {
+                goto fail;
+            }
+            goto advance;
+
+        TARGET(REFERENCE_PLAN): {
+            // No body: the plan refers to a 'Plan' definition. The fused mode links it
+            // now, unless another unit defines it; otherwise semantic analysis resolves the reference.
+            const Token* plan = statement.name;
+            ASTNode* definition = isFusedMode(parser) ? resolvePlanReference(parser->context->symbols, plan->value) : NULL;
+            if (isFusedMode(parser) && definition == NULL &&
+                !passesCheck(parser, plan, checkReference(parser, plan, TYPE_PLAN, UNDEFINED_IDENTIFIER))) {
+                goto fail;
+            }
+            statement.plan = (definition != NULL) ? retainASTNode(definition)
+                                                  : newASTNode(parser, plan, NODE_IDENTIFIER, plan->value, 0);
+            if (statement.plan == NULL || !finishAssignment(parser, &statement)) {
+                goto fail;
+            }
+            goto advance;
+        }
 
-// Parse an assignment
-ASTNode* parseAssignment(Token*** tokens) {
-    printf("Debug: Entering parseAssignment\n");
+        TARGET(END_ASSIGNMENT):
+            if (!finishAssignment(parser, &statement)) {
+                goto fail;
+            }
+            goto advance;
+
+        TARGET(END_DEFINITION):
+            statement.node = statement.plan;
+            statement.plan = NULL;
+            goto advance;
+
+        TARGET(DECLARE_GROUP):
+            statement.node = newASTNode(parser, token, NODE_GROUP, token->value, 0);
+            if (statement.node == NULL ||
+                (isFusedMode(parser) && !passesCheck(parser, token, declareGroup(parser->context->symbols, token->value, statement.node)))) {
+                goto fail;
+            }
+            goto advance;
 
-    // Check for 'assign' token
-    if ((**tokens)->type != TOKEN_ASSIGN) {
-        fprintf(stderr, "Debug: Error - Expected 'assign', got %s\n", (**tokens)->value);
-        return NULL;
-    }
-    printf("Debug: Consumed 'assign' token\n");
-    (*tokens)++;
+        TARGET(GROUP_MEMBER): {
+            if (isFusedMode(parser) && !passesCheck(parser, token,
+                    checkReference(parser, token, TYPE_CLIENT, checkGroupMember(parser->context->symbols, token->value)))) {
+                goto fail;
+            }
+            ASTNode* member = newASTNode(parser, token, NODE_IDENTIFIER, token->value, 0);
+            if (member == NULL || !addChild(parser, statement.node, member)) {
+                freeAST(member);
+                goto fail;
+            }
+            goto advance;
+        }
 
-    // Check for plan identifier
-    if ((**tokens)->type != TOKEN_IDENTIFIER) {
-        fprintf(stderr, "Debug: Error - Expected plan identifier, got %s\n", (**tokens)->value);
-        return NULL;
-    }
-    char* planName = strdup((**tokens)->value);
-    printf("Debug: Plan identifier: %s\n", planName);
-    (*tokens)++;
+        TARGET(BEGIN_PLAN):
+            // An inline body's node is made at its '{'; a definition is a statement, located at its name
+            statement.plan = newASTNode(parser, (statement.first->type == TOKEN_PLAN) ? statement.name : token,
+                                        NODE_PLAN, statement.name->value, 0);
+            if (statement.plan == NULL) {
+                goto fail;
+            }
+            goto advance;
 
-    // Check for 'to' keyword
-    if ((**tokens)->type != TOKEN_TO) {
-        free(planName);
-        fprintf(stderr, "Debug: Error - Expected 'to', got %s\n", (**tokens)->value);
-        return NULL;
-    }
-    printf("Debug: Consumed 'to' token\n");
-    (*tokens)++;
+        TARGET(END_PLAN):
+            if (statement.first->type != TOKEN_PLAN) {
+                statement.plan = internNode(parser->context->nodes, statement.plan);
+                goto advance;
+            }
+            internDefinition(parser->context->nodes, statement.plan);
+            if (isFusedMode(parser)) {
+                findSymbol(parser->context->symbols, statement.name->value)->value.node = statement.plan;
+            }
+            goto advance;
 
-    // Check for client identifier
-    if ((**tokens)->type != TOKEN_IDENTIFIER) {
-        free(planName);
-        fprintf(stderr, "Debug: Error - Expected client identifier, got %s\n", (**tokens)->value);
-        return NULL;
-    }
-    char* clientName = strdup((**tokens)->value);
-    printf("Debug: Client identifier: %s\n", clientName);
-    (*tokens)++;
+        TARGET(BEGIN_DAY):
+            statement.day = newASTNode(parser, token, NODE_DAY, dayNames[token->type - TOKEN_MONDAY], 0);
+            if (statement.day == NULL) {
+                goto fail;
+            }
+            goto advance;
 
-    // Expecting an opening brace '{'
-    if ((**tokens)->type != TOKEN_LEFT_BRACE) {
-        free(planName);
-        free(clientName);
-        fprintf(stderr, "Debug: Error - Expected '{', got %s\n", (**tokens)->value);
-        return NULL;
-    }
-    printf("Debug: Consumed opening brace '{'\n");
-    (*tokens)++; // Consume opening brace '{'
-
-    // Create and initialize plan node
-    ASTNode* planNode = createASTNode(NODE_PLAN, planName, 0);
-    printf("Debug: Created plan node with name: %s\n", planName);
-    free(planName);
-
-    // Parse days inside the plan
-    while ((**tokens)->type != TOKEN_RIGHT_BRACE) {
-        if (isDayToken((**tokens)->type)) {
-            ASTNode* dayNode = parseDay(tokens);
-            if (dayNode) {
-                printf("Debug: Adding day node: %s to plan node: %s\n", dayNode->data.day.name, planNode->data.plan.name);
-                addASTChildNode(planNode, dayNode);
-            } else {
-                free(clientName);
-                freeAST(planNode);
-                fprintf(stderr, "Debug: Error in parsing day node\n");
-                return NULL;
+        TARGET(END_DAY):
+            // A day inside a plan body belongs to the plan; one on its own is the statement
+            if (statement.plan != NULL && !addChild(parser, statement.plan, statement.day)) {
+                goto fail;
             }
-        } else {
-            printf("Debug: Skipping unexpected token: %d\n", (**tokens)->type);
-            (*tokens)++;
-        }
+            if (statement.plan == NULL) {
+                statement.node = statement.day;
+            }
+            statement.day = NULL;
+            goto advance;
+
+        TARGET(BEGIN_EXERCISE):
+            statement.exercise = token;
+            statement.sets = 0;
+            statement.rest = 0;
+            goto advance;
+
+        TARGET(EXERCISE_NAME):
+            statement.exerciseName = token->value;
+            goto advance;
+
+        TARGET(SELECT_SETS):
+            statement.attribute = &statement.sets;
+            goto advance;
+
+        TARGET(SELECT_REST):
+            statement.attribute = &statement.rest;
+            goto advance;
+
+        TARGET(ATTRIBUTE_VALUE):
+            *statement.attribute = atoi(token->value);
+            goto advance;
+
+        TARGET(END_EXERCISE):
+            if (!finishExercise(parser, &statement)) {
+                goto fail;
+            }
+            goto advance;
     }
-    printf("Debug: Consumed closing brace '}'\n");
-    (*tokens)++; // Consume closing brace '}'
+#undef TARGET
+#undef DISPATCH
 
-    // Expecting a semicolon at the end of the assignment
-    if ((**tokens)->type != TOKEN_SEMICOLON) {
-        fprintf(stderr, "Debug: Error - Expected semicolon, got %s\n", (**tokens)->value);
-        freeAST(planNode);
-        free(clientName);
-        return NULL;
+advance:
+    if (!transition.reprocess) {
+        cursor++;
     }
-    printf("Debug: Consumed semicolon\n");
-    (*tokens)++; // Consume semicolon
-
-    // Create client node
-    ASTNode* clientNode = createASTNode(NODE_CLIENT_PROFILE, clientName, 0);
-    printf("Debug: Created client node with name: %s\n", clientName);
-    free(clientName);
-
-    // Create assignment node and link client and plan
-    ASTNode* assignmentNode = createASTNode(NODE_ASSIGNMENT, NULL, 0);
-    assignmentNode->data.assignment.plan = planNode;
-    assignmentNode->data.assignment.client = clientNode;
-    printf("Debug: Linking plan node and client node to assignment node\n");
+    if (state != STATE_ACCEPT) {
+        goto next;
+    }
+    parser->current = cursor;
+    return statement.node;
 
-    printf("Debug: Exiting parseAssignment with plan - %s and client - %s\n",
-        planNode->data.plan.name, clientNode->data.clientProfile.name);
-    return assignmentNode;
+fail:
+    freeAST(statement.day);
+    freeAST(statement.plan);
+    freeAST(statement.node);
+    return NULL;
 }
 
 // Parse the entire program
 ASTNode* parseProgram(Token** tokens) {
-    printf("Debug: parseProgram - Starting\n");
-    ASTNode* root = createASTNode(NODE_MAIN, NULL, 0);
+    CompileContext context;
+    initCompileContext(&context);
+    return parseProgramWithContext(tokens, &context);
+}
+
+// Parse the entire program, allocating from the context's parser allocator and
+// sharing identical plans, days and exercises through its node table (if any).
+// If the context has a symbol table, statements are also semantically checked
+// as they are parsed and the first failure is left in context->semanticResult.
+ASTNode* parseProgramWithContext(Token** tokens, CompileContext* context) {
+    Parser state = { tokens, context };
+    Parser* parser = &state;
+
+    PARSER_TRACE("Debug: parseProgram - Starting\n");
+    ASTNode* root = newASTNode(parser, *parser->current, NODE_MAIN, NULL, 0);
     if (!root) {
-        fprintf(stderr, "Debug: Error - Failed to create root node\n");
+        PARSER_TRACE("Debug: Error - Failed to create root node\n");
         return NULL;
     }
 
-    Token** currentToken = tokens;  // Use a separate pointer to advance through tokens
-
-    while (*currentToken) {
-        printf("Debug: Current token type: %d, value: %s\n", (*currentToken)->type, (*currentToken)->value);
-        ASTNode* child = NULL;
-
-        switch ((*currentToken)->type) {
-            case TOKEN_CLIENT_PROFILE:
-                printf("Debug: Found TOKEN_CLIENT_PROFILE\n");
-                child = parseClientProfile(&currentToken);
-                break;
-            case TOKEN_ASSIGN:
-                printf("Debug: Found TOKEN_ASSIGN\n");
-                child = parseAssignment(&currentToken);
-                break;
-            case TOKEN_SHOW_PLANS:
-                printf("Debug: Found TOKEN_SHOW_PLANS\n");
-                child = parseShowPlans(&currentToken);
-                break;
-            case TOKEN_MONDAY:
-            case TOKEN_TUESDAY:
-            case TOKEN_WEDNESDAY:
-            case TOKEN_THURSDAY:
-            case TOKEN_FRIDAY:
-            case TOKEN_SATURDAY:
-            case TOKEN_SUNDAY:
-                printf("Debug: Found a day token\n");
-                child = parseDay(&currentToken);
-                break;
-            // Add other cases as needed
-            default:
-                fprintf(stderr, "Debug: Unexpected token: %s\n", (*currentToken)->value);
+    while ((*parser->current)->type != TOKEN_EOF) {
+        ASTNode* child = parseStatement(parser);
+        if (child) {
+            PARSER_TRACE("Debug: Adding child node to root\n");
+            if (!addChild(parser, root, child)) {
+                freeAST(child);
                 freeAST(root);
                 return NULL;
-        }
-
-        if (child) {
-            printf("Debug: Adding child node to root\n");
-            addASTChildNode(root, child);
+            }
         } else {
-            fprintf(stderr, "Debug: Error occurred during parsing, no child node created\n");
+            PARSER_TRACE("Debug: Error occurred during parsing, no child node created\n");
             // Error occurred during parsing, cleanup and return NULL
             freeAST(root);
             return NULL;
         }
     }
 
-    printf("Debug: Exiting parseProgram\n");
+    PARSER_TRACE("Debug: Exiting parseProgram\n");
     return root;
 }
 
@@ -586,13 +894,20 @@ void printAST(ASTNode* node, int depth) {
             printf("Exercise: %s, Sets: %d, Rest: %d\n", node->data.exercise.name, node->data.exercise.sets, node->data.exercise.rest);
             break;
         case NODE_ASSIGNMENT:
-            printf("Assignment: Client - %s, Plan - %s\n", 
-                node->data.assignment.client->data.clientProfile.name, 
+            printf("Assignment: %s - %s, Plan - %s\n",
+                node->data.assignment.client->type == NODE_GROUP ? "Group" : "Client",
+                assignedName(node),
                 node->data.assignment.plan->data.plan.name);
             break;
         case NODE_SHOW_PLANS:
             printf("ShowPlans for: %s\n", node->data.showPlans.clientName);
             break;
+        case NODE_GROUP:
+            printf("Group: %s\n", node->data.group.name);
+            break;
+        case NODE_IMPORT:
+            printf("Import: %s\n", node->data.import.path);
+            break;
         case NODE_SETS:
             printf("Sets: %d\n", node->data.exercise.sets);
             break;
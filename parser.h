@@ -2,6 +2,10 @@
 #define PARSER_H
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include "lexer.h"
+#include "alloc.h"
+#include "context.h"
 
 // Define the types of nodes that can appear in the AST
 typedef enum {
@@ -16,6 +20,8 @@ typedef enum {
     NODE_LITERAL,        // Represents a literal value (e.g., "squats", number of sets)
     NODE_ASSIGNMENT,     // Represents an assignment of a plan to a client
     NODE_IDENTIFIER,     // Represents an identifier (e.g., "John")
+    NODE_GROUP,          // Represents a group of clients; its children are the members' identifiers
+    NODE_IMPORT,         // Represents an import of another file (see unit.h)
 } NodeType;
 
 // Define the structure of an AST node
@@ -27,7 +33,7 @@ typedef struct {
 } ASTMain;
 
 typedef struct {
-    ASTNode* client; // Points to the client node for an assignment
+    ASTNode* client; // Points to the client node for an assignment (the NODE_GROUP once linked to a group)
     ASTNode* plan;   // Points to the plan node for an assignment
 } ASTAssignment;
 
@@ -39,10 +45,19 @@ typedef struct {
     char* name; // Plan name for NODE_PLAN
 } ASTPlan;
 
+typedef struct {
+    char* name; // Group name for NODE_GROUP
+} ASTGroup;
+
+typedef struct {
+    char* path; // File named by NODE_IMPORT, as written
+} ASTImport;
+
 typedef struct {
     char* name; // Exercise name for NODE_EXERCISE
     int sets;
     int rest;
+    int catalogId; // Canonical ID in the exercise catalog, -1 if not in it (or no catalog)
 } ASTExercise;
 
 typedef struct {
@@ -72,20 +87,41 @@ typedef union {
     ASTExercise exercise;
     ASTShowPlans showPlans;
     ASTPlan plan;
+    ASTGroup group;
+    ASTImport import;
     ASTLiteral literal;
 } ASTNodeData;
 
 // Definition of AST node
 struct ASTNode {
     NodeType type;
+    Allocator* allocator; // Allocator the node and its data came from
     ASTNodeData data;
     ASTNode** children;
     int childrenCount;
+    int refCount;        // Number of owners; shared (hash-consed) nodes have more than one
+    unsigned long hash;  // Structural hash, set when the node is interned
+    size_t offset;       // Input offset of the node's first token (a shared node keeps its first)
 };
 
+// Parser state: the token cursor and the context it allocates from
+typedef struct {
+    Token** current;
+    CompileContext* context;
+} Parser;
+
 // Function declarations for creating and manipulating AST nodes
 ASTNode* createASTNode(NodeType type, const char* value, int intValue);
-void addASTChildNode(ASTNode* parent, ASTNode* child);
+ASTNode* createASTNodeWithAllocator(Allocator* allocator, NodeType type, const char* value, int intValue);
+bool addASTChildNode(ASTNode* parent, ASTNode* child);
+ASTNode* retainASTNode(ASTNode* node);
 void freeAST(ASTNode* root);
+const char* assignedName(const ASTNode* assignment);
+
+// Function declarations for parsing and printing
+ASTNode* parseProgram(Token** tokens);
+ASTNode* parseProgramWithContext(Token** tokens, CompileContext* context);
+ASTNode* parseStatement(Parser* parser);
+void printAST(ASTNode* node, int depth);
 
 #endif
\ No newline at end of file
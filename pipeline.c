@@ -0,0 +1,321 @@
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "semantic.h"
+
+#define CACHE_LINE_SIZE 64
+#define RING_SPIN_LIMIT 128 // Polls before a waiting stage goes to sleep
+#define RING_MAX_CAPACITY (2 * PIPELINE_QUEUE_DEPTH)
+
+// Bounded single-producer/single-consumer ring. The producer only writes
+// tail and the consumer only writes head, so passing an entry takes no lock.
+// A stage that has to wait spins briefly and then sleeps; the other side only
+// takes the lock to wake it when someone is asleep.
+typedef struct {
+    atomic_size_t head;                 // Next entry to take (written by the consumer)
+    char headPadding[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    atomic_size_t tail;                 // Next free slot (written by the producer)
+    char tailPadding[CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+    atomic_int sleepers;                // Stages waiting on changed
+    atomic_bool abandoned;              // The consumer has stopped; pushes fail
+    size_t capacity;
+    void* slots[RING_MAX_CAPACITY];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} RingBuffer;
+
+// State shared by the stages
+typedef struct {
+    CompileContext* context;
+    Source* source;
+    RingBuffer batches;                 // Token batches, lexer to parser (NULL ends the input)
+    RingBuffer consumed;                // Parsed batches, back to the lexer to be freed
+    RingBuffer statements;              // Top-level statements, parser to semantic analysis (NULL ends)
+    bool lexerFailed;                   // Written by the lexer thread, read once it has been joined
+} Pipeline;
+
+/***
+ * Ring buffer functions
+*/
+
+static void initRing(RingBuffer* ring, size_t capacity) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->sleepers, 0);
+    atomic_init(&ring->abandoned, false);
+    ring->capacity = capacity;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->changed, NULL);
+}
+
+static void destroyRing(RingBuffer* ring) {
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->changed);
+}
+
+// Wake a sleeping stage. The index stores before this and the sleeper count
+// update in waitRing are sequentially consistent, so either the sleeper sees
+// the new index or this sees the sleeper.
+static void wakeRing(RingBuffer* ring) {
+    if (atomic_load(&ring->sleepers) > 0) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+// Wait until index moves on from seen, or the ring is abandoned
+static void waitRing(RingBuffer* ring, atomic_size_t* index, size_t seen) {
+    for (int i = 0; i < RING_SPIN_LIMIT; i++) {
+        if (atomic_load_explicit(index, memory_order_acquire) != seen || atomic_load(&ring->abandoned)) {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    atomic_fetch_add(&ring->sleepers, 1);
+    while (atomic_load(index) == seen && !atomic_load(&ring->abandoned)) {
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    atomic_fetch_sub(&ring->sleepers, 1);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// Add an entry, waiting while the ring is full. Returns false if the consumer
+// has abandoned the ring; the entry then still belongs to the caller.
+static bool pushRing(RingBuffer* ring, void* entry) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head;
+    while (tail - (head = atomic_load_explicit(&ring->head, memory_order_acquire)) == ring->capacity) {
+        if (atomic_load(&ring->abandoned)) {
+            return false;
+        }
+        waitRing(ring, &ring->head, head);
+    }
+    if (atomic_load(&ring->abandoned)) {
+        return false;
+    }
+
+    ring->slots[tail % ring->capacity] = entry;
+    atomic_store(&ring->tail, tail + 1);
+    wakeRing(ring);
+    return true;
+}
+
+// Take the oldest entry, waiting while the ring is empty
+static void* popRing(RingBuffer* ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+        waitRing(ring, &ring->tail, head);
+    }
+
+    void* entry = ring->slots[head % ring->capacity];
+    atomic_store(&ring->head, head + 1);
+    wakeRing(ring);
+    return entry;
+}
+
+// Take the oldest entry if there is one
+static bool tryPopRing(RingBuffer* ring, void** entry) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+        return false;
+    }
+    *entry = ring->slots[head % ring->capacity];
+    atomic_store(&ring->head, head + 1);
+    wakeRing(ring);
+    return true;
+}
+
+// Called by the consumer when it stops taking entries, so the producer stops too
+static void abandonRing(RingBuffer* ring) {
+    atomic_store(&ring->abandoned, true);
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/***
+ * Stages
+*/
+
+// Tokens are freed on the lexer thread, so the lexer allocator is never shared
+static void freeConsumedBatches(Pipeline* pipeline) {
+    void* batch;
+    while (tryPopRing(&pipeline->consumed, &batch)) {
+        freeTokens(batch, pipeline->context->allocators[SUBSYSTEM_LEXER]);
+    }
+}
+
+static int queueBatch(void* userData, Token** batch) {
+    Pipeline* pipeline = userData;
+    freeConsumedBatches(pipeline);
+    if (!pushRing(&pipeline->batches, batch)) {
+        freeTokens(batch, pipeline->context->allocators[SUBSYSTEM_LEXER]);
+        return -1;
+    }
+    return 0;
+}
+
+static void* runLexer(void* argument) {
+    Pipeline* pipeline = argument;
+    Allocator* allocator = pipeline->context->allocators[SUBSYSTEM_LEXER];
+    if (lexerSourceBatches(pipeline->source, allocator, PIPELINE_BATCH_TOKENS, queueBatch, pipeline) != 0) {
+        pipeline->lexerFailed = true;
+    }
+    freeConsumedBatches(pipeline);
+    pushRing(&pipeline->batches, NULL); // End of input (ignored if the parser has stopped)
+    return NULL;
+}
+
+// Parse each batch into statements; a batch always ends on a statement boundary
+static void* runParser(void* argument) {
+    Pipeline* pipeline = argument;
+    bool ok = true;
+    Token** batch;
+
+    while (ok && (batch = popRing(&pipeline->batches)) != NULL) {
+        Parser parser = { batch, pipeline->context };
+        while (ok && (*parser.current)->type != TOKEN_EOF) {
+            ASTNode* statement = parseStatement(&parser);
+            if (statement == NULL) {
+                ok = false;
+            } else if (!pushRing(&pipeline->statements, statement)) {
+                freeAST(statement);
+                ok = false;
+            }
+        }
+        pushRing(&pipeline->consumed, batch);
+    }
+
+    if (!ok) {
+        abandonRing(&pipeline->batches);
+    }
+    pushRing(&pipeline->statements, NULL); // End of program (ignored if analysis has stopped)
+    return NULL;
+}
+
+// Keep a checked statement until the program node is built
+static bool keepStatement(Allocator* allocator, ASTNode*** statements, int* count, int* capacity, ASTNode* statement) {
+    if (*count == *capacity) {
+        int newCapacity = (*capacity == 0) ? 64 : *capacity * 2;
+        ASTNode** resized = reallocMemory(allocator, *statements, *capacity * sizeof(ASTNode*), newCapacity * sizeof(ASTNode*));
+        if (resized == NULL) {
+            return false;
+        }
+        *statements = resized;
+        *capacity = newCapacity;
+    }
+    (*statements)[(*count)++] = statement;
+    return true;
+}
+
+/***
+ * Pipeline
+*/
+
+ASTNode* compilePipelined(Source* source, CompileContext* context, struct SymbolTable* table) {
+    Allocator* lexerAllocator = context->allocators[SUBSYSTEM_LEXER];
+    Allocator* parserAllocator = context->allocators[SUBSYSTEM_PARSER];
+    Allocator* semanticAllocator = context->allocators[SUBSYSTEM_SEMANTIC];
+
+    Pipeline pipeline;
+    pipeline.context = context;
+    pipeline.source = source;
+    pipeline.lexerFailed = false;
+    initRing(&pipeline.batches, PIPELINE_QUEUE_DEPTH);
+    initRing(&pipeline.consumed, RING_MAX_CAPACITY); // Room for every batch in flight, so returns never wait
+    initRing(&pipeline.statements, PIPELINE_QUEUE_DEPTH);
+
+    pthread_t lexerThread;
+    pthread_t parserThread;
+    bool lexerStarted = pthread_create(&lexerThread, NULL, runLexer, &pipeline) == 0;
+    bool parserStarted = lexerStarted && pthread_create(&parserThread, NULL, runParser, &pipeline) == 0;
+
+    // Semantic analysis runs here, one statement at a time and in program order.
+    // Statements are only read until the parser is done with the shared nodes.
+    ASTNode** statements = NULL;
+    int count = 0;
+    int capacity = 0;
+    ASTNode* unkept = NULL;
+    bool ok = parserStarted;
+    ASTNode* statement;
+    while (ok && (statement = popRing(&pipeline.statements)) != NULL) {
+        if (!keepStatement(semanticAllocator, &statements, &count, &capacity, statement)) {
+            unkept = statement;
+            ok = false;
+        } else {
+            context->semanticResult = checkStatement(statement, table);
+            ok = context->semanticResult == SEMANTIC_OK;
+        }
+    }
+    if (!ok) {
+        abandonRing(&pipeline.statements);
+        if (lexerStarted && !parserStarted) {
+            abandonRing(&pipeline.batches);
+        }
+    }
+
+    if (parserStarted) {
+        pthread_join(parserThread, NULL);
+    }
+    if (lexerStarted) {
+        pthread_join(lexerThread, NULL);
+    }
+
+    // Only this thread is left; free whatever is still queued
+    void* entry;
+    while (tryPopRing(&pipeline.statements, &entry)) {
+        freeAST(entry);
+    }
+    while (tryPopRing(&pipeline.batches, &entry)) {
+        freeTokens(entry, lexerAllocator);
+    }
+    while (tryPopRing(&pipeline.consumed, &entry)) {
+        freeTokens(entry, lexerAllocator);
+    }
+    destroyRing(&pipeline.batches);
+    destroyRing(&pipeline.consumed);
+    destroyRing(&pipeline.statements);
+    freeAST(unkept);
+
+    // The lexer also stops when the parser gives up; that is not a failure of its own
+    bool lexerFailed = pipeline.lexerFailed && !atomic_load(&pipeline.batches.abandoned);
+    bool failed = !ok || lexerFailed || context->syntaxError[0] != '\0' || context->outOfMemory;
+    if ((!parserStarted || unkept != NULL || lexerFailed) && sourceStatus(source) == SOURCE_OK) {
+        context->outOfMemory = true;
+    }
+
+    // Build the program node from the checked statements
+    ASTNode* root = failed ? NULL : createASTNodeWithAllocator(parserAllocator, NODE_MAIN, NULL, 0);
+    if (root != NULL && count > 0) {
+        root->children = allocMemory(parserAllocator, count * sizeof(ASTNode*));
+        if (root->children == NULL) {
+            freeAST(root);
+            root = NULL;
+        } else {
+            memcpy(root->children, statements, count * sizeof(ASTNode*));
+            root->childrenCount = count;
+            count = 0;
+        }
+    }
+    if (root == NULL && !failed) {
+        context->outOfMemory = true;
+    }
+    for (int i = 0; i < count; i++) {
+        freeAST(statements[i]);
+    }
+    releaseMemory(semanticAllocator, statements, capacity * sizeof(ASTNode*));
+
+    // Plan references were checked in order; link them now that no other thread shares the nodes
+    if (root != NULL) {
+        context->semanticResult = linkPlanReferences(root, table);
+        if (context->semanticResult != SEMANTIC_OK) {
+            freeAST(root);
+            root = NULL;
+        }
+    }
+    return root;
+}
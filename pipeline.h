@@ -0,0 +1,28 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "parser.h"
+#include "source.h"
+
+// Pipelined front end. The lexer and the parser each run on their own
+// thread and the semantic checks run on the caller's, so lexing and analysis
+// overlap with parsing instead of waiting for it. Stages hand work on through
+// bounded single-producer/single-consumer rings: batches of tokens that end
+// on a statement boundary, then parsed top-level statements. A full ring
+// stalls the stage feeding it, so only PIPELINE_QUEUE_DEPTH batches of tokens
+// exist at any time instead of the whole token array.
+//
+// Each stage allocates only from its own subsystem allocator; token batches
+// go back to the lexer thread to be freed. Errors are reported in program
+// order, as in the fused mode: the first statement that fails to parse or to
+// check stops the pipeline.
+
+#define PIPELINE_QUEUE_DEPTH 8      // Entries per ring (a power of two)
+#define PIPELINE_BATCH_TOKENS 1024  // Tokens per batch before it is cut at a statement end
+
+// Compile source into a checked program. Returns NULL on failure, with the
+// reason left in context as for parseProgramWithContext (semanticResult,
+// syntaxError or outOfMemory); read errors are left in the source.
+ASTNode* compilePipelined(Source* source, CompileContext* context, struct SymbolTable* table);
+
+#endif // PIPELINE_H
@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "postings.h"
+
+#define INITIAL_LIST_CAPACITY 64
+#define INITIAL_PLAN_CAPACITY 16
+#define MAX_TERM_LENGTH 255
+
+// Clients for one exercise on one day. A NULL day is the exercise on any
+// day; a NULL exercise is everyone training on the day.
+typedef struct {
+    char* exercise;
+    char* day;
+    unsigned long hash;
+    RoaringBitmap clients;
+} PostingList;
+
+// Posting lists a plan adds its clients to, so a plan assigned to many
+// clients is only walked once. Plans are keyed by node: the environment
+// holds a reference to every assigned plan, so the nodes stay alive.
+typedef struct {
+    const ASTNode* plan;
+    int* lists;
+    int count;
+} PlanPostings;
+
+struct ExerciseIndex {
+    Allocator* allocator;
+    PostingList* lists;
+    int listCount;
+    int listCapacity;
+    int* slots;                 // Open-addressed hash index into lists (entries are position + 1)
+    int slotCapacity;
+    PlanPostings* plans;        // Open-addressed by plan node
+    int planCount;
+    int planCapacity;
+    unsigned long assignments;
+};
+
+// Query being evaluated
+typedef struct {
+    const ExerciseIndex* index;
+    const Catalog* catalog;
+    const char* text;
+    int status;
+} QueryParser;
+
+/***
+ * Helper functions
+*/
+
+static unsigned long hashKey(const char* exercise, const char* day) {
+    unsigned long hash = 1469598103934665603UL;
+    for (const char* c = (exercise != NULL) ? exercise : ""; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211UL;
+    }
+    hash ^= (exercise != NULL) ? 0xfe : 0xff; // Separator; also tells "" from NULL
+    hash *= 1099511628211UL;
+    for (const char* c = (day != NULL) ? day : ""; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211UL;
+    }
+    return hash ^ ((day != NULL) ? 0 : 1);
+}
+
+static unsigned long hashPlan(const ASTNode* plan) {
+    unsigned long hash = (unsigned long)(uintptr_t)plan;
+    return (hash >> 4) * 11400714819323198485UL;
+}
+
+static bool sameName(const char* a, const char* b) {
+    return (a == NULL || b == NULL) ? a == b : strcmp(a, b) == 0;
+}
+
+static bool rebuildSlots(ExerciseIndex* index, int newCapacity) {
+    int* slots = allocMemory(index->allocator, newCapacity * sizeof(int));
+    if (slots == NULL) {
+        return false;
+    }
+    memset(slots, 0, newCapacity * sizeof(int));
+    for (int i = 0; i < index->listCount; i++) {
+        int slot = (int)(index->lists[i].hash & (unsigned long)(newCapacity - 1));
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (newCapacity - 1);
+        }
+        slots[slot] = i + 1;
+    }
+    releaseMemory(index->allocator, index->slots, index->slotCapacity * sizeof(int));
+    index->slots = slots;
+    index->slotCapacity = newCapacity;
+    return true;
+}
+
+// Position of the posting list for a key, or -1 if there is none
+static int lookupList(const ExerciseIndex* index, const char* exercise, const char* day, unsigned long hash) {
+    if (index->slotCapacity == 0) {
+        return -1;
+    }
+    int slot = (int)(hash & (unsigned long)(index->slotCapacity - 1));
+    while (index->slots[slot] != 0) {
+        const PostingList* list = &index->lists[index->slots[slot] - 1];
+        if (list->hash == hash && sameName(list->exercise, exercise) && sameName(list->day, day)) {
+            return index->slots[slot] - 1;
+        }
+        slot = (slot + 1) & (index->slotCapacity - 1);
+    }
+    return -1;
+}
+
+// Position of the posting list for a key, created empty if need be; -1 if out of memory
+static int internList(ExerciseIndex* index, const char* exercise, const char* day) {
+    unsigned long hash = hashKey(exercise, day);
+    int position = lookupList(index, exercise, day, hash);
+    if (position >= 0) {
+        return position;
+    }
+
+    if (index->listCount == index->listCapacity) {
+        int newCapacity = (index->listCapacity == 0) ? INITIAL_LIST_CAPACITY : index->listCapacity * 2;
+        PostingList* resized = reallocMemory(index->allocator, index->lists,
+            index->listCapacity * sizeof(PostingList), newCapacity * sizeof(PostingList));
+        if (resized == NULL) {
+            return -1;
+        }
+        index->lists = resized;
+        index->listCapacity = newCapacity;
+    }
+    // Keep the hash index at most half full
+    if ((index->listCount + 1) * 2 > index->slotCapacity &&
+        !rebuildSlots(index, index->slotCapacity == 0 ? INITIAL_LIST_CAPACITY * 2 : index->slotCapacity * 2)) {
+        return -1;
+    }
+
+    PostingList* list = &index->lists[index->listCount];
+    list->exercise = (exercise != NULL) ? allocString(index->allocator, exercise) : NULL;
+    list->day = (day != NULL) ? allocString(index->allocator, day) : NULL;
+    if ((exercise != NULL && list->exercise == NULL) || (day != NULL && list->day == NULL)) {
+        releaseString(index->allocator, list->exercise);
+        releaseString(index->allocator, list->day);
+        return -1;
+    }
+    list->hash = hash;
+    roaringInit(&list->clients, index->allocator);
+
+    int slot = (int)(hash & (unsigned long)(index->slotCapacity - 1));
+    while (index->slots[slot] != 0) {
+        slot = (slot + 1) & (index->slotCapacity - 1);
+    }
+    index->slots[slot] = ++index->listCount;
+    return index->listCount - 1;
+}
+
+static bool growPlans(ExerciseIndex* index) {
+    int newCapacity = (index->planCapacity == 0) ? INITIAL_PLAN_CAPACITY : index->planCapacity * 2;
+    PlanPostings* plans = allocMemory(index->allocator, newCapacity * sizeof(PlanPostings));
+    if (plans == NULL) {
+        return false;
+    }
+    memset(plans, 0, newCapacity * sizeof(PlanPostings));
+    for (int i = 0; i < index->planCapacity; i++) {
+        if (index->plans[i].plan != NULL) {
+            int slot = (int)(hashPlan(index->plans[i].plan) & (unsigned long)(newCapacity - 1));
+            while (plans[slot].plan != NULL) {
+                slot = (slot + 1) & (newCapacity - 1);
+            }
+            plans[slot] = index->plans[i];
+        }
+    }
+    releaseMemory(index->allocator, index->plans, index->planCapacity * sizeof(PlanPostings));
+    index->plans = plans;
+    index->planCapacity = newCapacity;
+    return true;
+}
+
+// The posting lists of a plan: each day, and each exercise with and without its day
+static PlanPostings* planPostings(ExerciseIndex* index, const ASTNode* plan) {
+    if ((index->planCount + 1) * 2 > index->planCapacity && !growPlans(index)) {
+        return NULL;
+    }
+    int slot = (int)(hashPlan(plan) & (unsigned long)(index->planCapacity - 1));
+    while (index->plans[slot].plan != NULL) {
+        if (index->plans[slot].plan == plan) {
+            return &index->plans[slot];
+        }
+        slot = (slot + 1) & (index->planCapacity - 1);
+    }
+
+    int count = 0;
+    for (int i = 0; i < plan->childrenCount; i++) {
+        count += 1 + 2 * plan->children[i]->childrenCount;
+    }
+    int* lists = allocMemory(index->allocator, (count > 0 ? count : 1) * sizeof(int));
+    if (lists == NULL) {
+        return NULL;
+    }
+    int filled = 0;
+    for (int i = 0; i < plan->childrenCount; i++) {
+        const ASTNode* day = plan->children[i];
+        lists[filled++] = internList(index, NULL, day->data.day.name);
+        for (int j = 0; j < day->childrenCount; j++) {
+            const char* exercise = day->children[j]->data.exercise.name;
+            lists[filled++] = internList(index, exercise, NULL);
+            lists[filled++] = internList(index, exercise, day->data.day.name);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (lists[i] < 0) {
+            releaseMemory(index->allocator, lists, (count > 0 ? count : 1) * sizeof(int));
+            return NULL;
+        }
+    }
+
+    PlanPostings* entry = &index->plans[slot];
+    entry->plan = plan;
+    entry->lists = lists;
+    entry->count = count;
+    index->planCount++;
+    return entry;
+}
+
+/***
+ * Query evaluation
+*/
+
+static bool isQueryOperator(char c) {
+    return c == '&' || c == '|' || c == '(' || c == ')';
+}
+
+static void skipSpace(QueryParser* parser) {
+    while (isspace((unsigned char)*parser->text)) {
+        parser->text++;
+    }
+}
+
+static bool querySyntaxError(QueryParser* parser) {
+    parser->status = POSTINGS_ERROR_SYNTAX;
+    return false;
+}
+
+static bool queryNoMemory(QueryParser* parser) {
+    parser->status = POSTINGS_ERROR_NO_MEMORY;
+    return false;
+}
+
+// exercise, exercise@Day or @Day
+static bool parseTerm(QueryParser* parser, RoaringBitmap* result) {
+    const char* start = parser->text;
+    while (*parser->text != '\0' && !isQueryOperator(*parser->text)) {
+        parser->text++;
+    }
+    const char* end = parser->text;
+    while (end > start && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    if (end == start || (size_t)(end - start) > MAX_TERM_LENGTH) {
+        return querySyntaxError(parser);
+    }
+
+    char term[MAX_TERM_LENGTH + 1];
+    memcpy(term, start, end - start);
+    term[end - start] = '\0';
+    char* at = strrchr(term, '@');
+    const char* day = NULL;
+    if (at != NULL) {
+        *at = '\0';
+        day = at + 1;
+        while (isspace((unsigned char)*day)) {
+            day++;
+        }
+        if (*day == '\0') {
+            return querySyntaxError(parser);
+        }
+    }
+    char* exercise = term;
+    for (char* c = at != NULL ? at : term + strlen(term); c > exercise && isspace((unsigned char)c[-1]); c--) {
+        c[-1] = '\0';
+    }
+    if (*exercise == '\0') {
+        if (day == NULL) {
+            return querySyntaxError(parser);
+        }
+        exercise = NULL;
+    }
+
+    const char* name = exercise;
+    if (name != NULL && parser->catalog != NULL) {
+        int id = catalogLookup(parser->catalog, name);
+        if (id != CATALOG_NOT_FOUND) {
+            name = catalogName(parser->catalog, id);
+        }
+    }
+    const RoaringBitmap* clients = findPostings(parser->index, name, day);
+    if (clients == NULL) {
+        roaringClear(result);
+        return true;
+    }
+    return roaringCopy(clients, result) || queryNoMemory(parser);
+}
+
+static bool parseOr(QueryParser* parser, RoaringBitmap* result);
+
+static bool parsePrimary(QueryParser* parser, RoaringBitmap* result) {
+    skipSpace(parser);
+    if (*parser->text != '(') {
+        return parseTerm(parser, result);
+    }
+    parser->text++;
+    if (!parseOr(parser, result)) {
+        return false;
+    }
+    skipSpace(parser);
+    if (*parser->text != ')') {
+        return querySyntaxError(parser);
+    }
+    parser->text++;
+    return true;
+}
+
+static bool parseAnd(QueryParser* parser, RoaringBitmap* result) {
+    if (!parsePrimary(parser, result)) {
+        return false;
+    }
+    RoaringBitmap operand;
+    roaringInit(&operand, result->allocator);
+    bool ok = true;
+    skipSpace(parser);
+    while (ok && *parser->text == '&') {
+        parser->text++;
+        ok = parsePrimary(parser, &operand) &&
+             (roaringAnd(result, &operand, result) || queryNoMemory(parser));
+        skipSpace(parser);
+    }
+    roaringClear(&operand);
+    return ok;
+}
+
+static bool parseOr(QueryParser* parser, RoaringBitmap* result) {
+    if (!parseAnd(parser, result)) {
+        return false;
+    }
+    RoaringBitmap operand;
+    roaringInit(&operand, result->allocator);
+    bool ok = true;
+    while (ok && *parser->text == '|') {
+        parser->text++;
+        ok = parseAnd(parser, &operand) &&
+             (roaringOr(result, &operand, result) || queryNoMemory(parser));
+    }
+    roaringClear(&operand);
+    return ok;
+}
+
+/***
+ * Exercise index functions
+*/
+
+ExerciseIndex* createExerciseIndex(Allocator* allocator) {
+    ExerciseIndex* index = allocMemory(allocator, sizeof(ExerciseIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    memset(index, 0, sizeof(ExerciseIndex));
+    index->allocator = allocator;
+    return index;
+}
+
+void freeExerciseIndex(ExerciseIndex* index) {
+    if (index == NULL) {
+        return;
+    }
+    for (int i = 0; i < index->listCount; i++) {
+        releaseString(index->allocator, index->lists[i].exercise);
+        releaseString(index->allocator, index->lists[i].day);
+        roaringClear(&index->lists[i].clients);
+    }
+    for (int i = 0; i < index->planCapacity; i++) {
+        PlanPostings* entry = &index->plans[i];
+        if (entry->plan != NULL) {
+            releaseMemory(index->allocator, entry->lists, (entry->count > 0 ? entry->count : 1) * sizeof(int));
+        }
+    }
+    releaseMemory(index->allocator, index->plans, index->planCapacity * sizeof(PlanPostings));
+    releaseMemory(index->allocator, index->lists, index->listCapacity * sizeof(PostingList));
+    releaseMemory(index->allocator, index->slots, index->slotCapacity * sizeof(int));
+    releaseMemory(index->allocator, index, sizeof(ExerciseIndex));
+}
+
+int indexAssignment(ExerciseIndex* index, uint32_t client, const ASTNode* plan) {
+    PlanPostings* entry = planPostings(index, plan);
+    if (entry == NULL) {
+        return POSTINGS_ERROR_NO_MEMORY;
+    }
+    for (int i = 0; i < entry->count; i++) {
+        if (!roaringAdd(&index->lists[entry->lists[i]].clients, client)) {
+            return POSTINGS_ERROR_NO_MEMORY;
+        }
+    }
+    index->assignments++;
+    return POSTINGS_OK;
+}
+
+const RoaringBitmap* findPostings(const ExerciseIndex* index, const char* exercise, const char* day) {
+    int position = lookupList(index, exercise, day, hashKey(exercise, day));
+    return (position >= 0) ? &index->lists[position].clients : NULL;
+}
+
+int queryExerciseIndex(const ExerciseIndex* index, const char* query, const Catalog* catalog, RoaringBitmap* result) {
+    QueryParser parser = { index, catalog, query, POSTINGS_OK };
+    if (parseOr(&parser, result)) {
+        skipSpace(&parser);
+        if (*parser.text != '\0') {
+            parser.status = POSTINGS_ERROR_SYNTAX; // Unbalanced ')'
+        }
+    }
+    if (parser.status != POSTINGS_OK) {
+        roaringClear(result);
+    }
+    return parser.status;
+}
+
+const char* postingsErrorString(int status) {
+    switch (status) {
+        case POSTINGS_OK: return "no error";
+        case POSTINGS_ERROR_NO_MEMORY: return "out of memory";
+        case POSTINGS_ERROR_SYNTAX: return "malformed query";
+        default: return "unknown error";
+    }
+}
+
+void printExerciseIndexStats(const ExerciseIndex* index) {
+    size_t bytes = 0;
+    for (int i = 0; i < index->listCount; i++) {
+        bytes += roaringMemoryUsage(&index->lists[i].clients);
+    }
+    printf("Exercise index: %d posting lists, %d distinct plans, %lu assignments, %zu bytes of postings\n",
+           index->listCount, index->planCount, index->assignments, bytes);
+}
@@ -0,0 +1,39 @@
+#ifndef POSTINGS_H
+#define POSTINGS_H
+
+#include "parser.h"
+#include "roaring.h"
+#include "catalog.h"
+
+// Inverted index from exercises to the clients whose plans contain them,
+// filled in while assignments are evaluated. Clients are numbered by their
+// position in the environment. Each exercise has a posting list of client
+// numbers (a Roaring bitmap), and so does each (exercise, day) pair and each
+// day, so reverse lookups never scan the assignments.
+//
+// Queries combine terms with & (and), | (or) and parentheses; & binds
+// tighter than |. A term is an exercise name, "exercise@Day" for clients
+// doing it on that day, or "@Day" for clients training that day, e.g.
+//     romanian deadlift@Monday | leg press & @Friday
+
+// Postings status codes
+#define POSTINGS_OK 0
+#define POSTINGS_ERROR_NO_MEMORY -1
+#define POSTINGS_ERROR_SYNTAX -2
+
+typedef struct ExerciseIndex ExerciseIndex;
+
+// Function prototypes for building an index
+ExerciseIndex* createExerciseIndex(Allocator* allocator);
+void freeExerciseIndex(ExerciseIndex* index);
+int indexAssignment(ExerciseIndex* index, uint32_t client, const ASTNode* plan);
+
+// Function prototypes for querying an index. Exercise names in a query are
+// replaced by their canonical name when a catalog is given. result must be
+// initialized and is replaced.
+const RoaringBitmap* findPostings(const ExerciseIndex* index, const char* exercise, const char* day); // NULL if empty
+int queryExerciseIndex(const ExerciseIndex* index, const char* query, const Catalog* catalog, RoaringBitmap* result);
+const char* postingsErrorString(int status);
+void printExerciseIndexStats(const ExerciseIndex* index);
+
+#endif // POSTINGS_H
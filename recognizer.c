@@ -0,0 +1,864 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include "recognizer.h"
+#include "semantic.h"
+
+#define INITIAL_NAME_CAPACITY 256   // Hash set slots (a power of two)
+#define INITIAL_TEXT_CAPACITY 4096
+#define MAX_QUOTED_TOKEN 64         // Longest token text quoted in a syntax error
+
+/***
+ * Scanner
+*/
+
+// Character classes; every other byte (whitespace included) separates tokens
+#define CHAR_IDENTIFIER_START 0x01
+#define CHAR_DIGIT 0x02
+#define CHAR_QUOTE 0x04
+#define CHAR_PUNCTUATION 0x08
+#define CHAR_IDENTIFIER (CHAR_IDENTIFIER_START | CHAR_DIGIT)
+
+typedef enum {
+    KIND_EOF,
+    KIND_CLIENT_PROFILE,
+    KIND_ASSIGN,
+    KIND_TO,
+    KIND_PLAN,
+    KIND_GROUP,
+    KIND_SHOW_PLANS,
+    KIND_DAY,
+    KIND_EXERCISE,
+    KIND_SETS,
+    KIND_REST,
+    KIND_IDENTIFIER,
+    KIND_STRING,
+    KIND_INT,
+    KIND_LEFT_BRACE,
+    KIND_RIGHT_BRACE,
+    KIND_COLON,
+    KIND_PIPE,
+    KIND_SEMICOLON,
+    KIND_COMMA,
+    KIND_IMPORT,
+    KIND_COUNT
+} TokenKind;
+
+// The same classes as the lexer in the C locale
+static const uint8_t charClasses[256] = {
+    ['a'] = CHAR_IDENTIFIER_START, ['b'] = CHAR_IDENTIFIER_START, ['c'] = CHAR_IDENTIFIER_START, ['d'] = CHAR_IDENTIFIER_START,
+    ['e'] = CHAR_IDENTIFIER_START, ['f'] = CHAR_IDENTIFIER_START, ['g'] = CHAR_IDENTIFIER_START, ['h'] = CHAR_IDENTIFIER_START,
+    ['i'] = CHAR_IDENTIFIER_START, ['j'] = CHAR_IDENTIFIER_START, ['k'] = CHAR_IDENTIFIER_START, ['l'] = CHAR_IDENTIFIER_START,
+    ['m'] = CHAR_IDENTIFIER_START, ['n'] = CHAR_IDENTIFIER_START, ['o'] = CHAR_IDENTIFIER_START, ['p'] = CHAR_IDENTIFIER_START,
+    ['q'] = CHAR_IDENTIFIER_START, ['r'] = CHAR_IDENTIFIER_START, ['s'] = CHAR_IDENTIFIER_START, ['t'] = CHAR_IDENTIFIER_START,
+    ['u'] = CHAR_IDENTIFIER_START, ['v'] = CHAR_IDENTIFIER_START, ['w'] = CHAR_IDENTIFIER_START, ['x'] = CHAR_IDENTIFIER_START,
+    ['y'] = CHAR_IDENTIFIER_START, ['z'] = CHAR_IDENTIFIER_START,
+    ['A'] = CHAR_IDENTIFIER_START, ['B'] = CHAR_IDENTIFIER_START, ['C'] = CHAR_IDENTIFIER_START, ['D'] = CHAR_IDENTIFIER_START,
+    ['E'] = CHAR_IDENTIFIER_START, ['F'] = CHAR_IDENTIFIER_START, ['G'] = CHAR_IDENTIFIER_START, ['H'] = CHAR_IDENTIFIER_START,
+    ['I'] = CHAR_IDENTIFIER_START, ['J'] = CHAR_IDENTIFIER_START, ['K'] = CHAR_IDENTIFIER_START, ['L'] = CHAR_IDENTIFIER_START,
+    ['M'] = CHAR_IDENTIFIER_START, ['N'] = CHAR_IDENTIFIER_START, ['O'] = CHAR_IDENTIFIER_START, ['P'] = CHAR_IDENTIFIER_START,
+    ['Q'] = CHAR_IDENTIFIER_START, ['R'] = CHAR_IDENTIFIER_START, ['S'] = CHAR_IDENTIFIER_START, ['T'] = CHAR_IDENTIFIER_START,
+    ['U'] = CHAR_IDENTIFIER_START, ['V'] = CHAR_IDENTIFIER_START, ['W'] = CHAR_IDENTIFIER_START, ['X'] = CHAR_IDENTIFIER_START,
+    ['Y'] = CHAR_IDENTIFIER_START, ['Z'] = CHAR_IDENTIFIER_START,
+    ['_'] = CHAR_IDENTIFIER_START,
+    ['0'] = CHAR_DIGIT, ['1'] = CHAR_DIGIT, ['2'] = CHAR_DIGIT, ['3'] = CHAR_DIGIT, ['4'] = CHAR_DIGIT,
+    ['5'] = CHAR_DIGIT, ['6'] = CHAR_DIGIT, ['7'] = CHAR_DIGIT, ['8'] = CHAR_DIGIT, ['9'] = CHAR_DIGIT,
+    ['"'] = CHAR_QUOTE,
+    ['{'] = CHAR_PUNCTUATION, ['}'] = CHAR_PUNCTUATION, [':'] = CHAR_PUNCTUATION,
+    ['|'] = CHAR_PUNCTUATION, [';'] = CHAR_PUNCTUATION, [','] = CHAR_PUNCTUATION
+};
+
+static const uint8_t punctuationKinds[256] = {
+    ['{'] = KIND_LEFT_BRACE,
+    ['}'] = KIND_RIGHT_BRACE,
+    [':'] = KIND_COLON,
+    ['|'] = KIND_PIPE,
+    [';'] = KIND_SEMICOLON,
+    [','] = KIND_COMMA
+};
+
+typedef struct {
+    Source* source;
+    Allocator* allocator;
+    const char* chunk;          // Current chunk of input
+    const char* position;
+    const char* end;
+    size_t chunkOffset;         // Input offset of chunk
+    bool atEnd;                 // The source has no more chunks
+    int sourceResult;
+    char* carry;                // Text of a token that spans chunks
+    size_t carryLength;
+    size_t carryCapacity;
+} Scanner;
+
+typedef struct {
+    TokenKind kind;
+    const char* text;           // Valid until the next token is scanned
+    size_t length;
+    size_t offset;
+} ScannedToken;
+
+static const char emptyChunk[] = "";
+
+static bool nextChunk(Scanner* scanner) {
+    scanner->chunkOffset += (size_t)(scanner->end - scanner->chunk);
+    scanner->chunk = scanner->position = scanner->end = emptyChunk;
+    if (scanner->atEnd) {
+        return false;
+    }
+    const char* data;
+    size_t length;
+    int result = nextSourceChunk(scanner->source, &data, &length);
+    if (result <= 0) {
+        scanner->atEnd = true;
+        scanner->sourceResult = (result < 0) ? result : SOURCE_OK;
+        return false;
+    }
+    scanner->chunk = scanner->position = data;
+    scanner->end = data + length;
+    return true;
+}
+
+static bool appendCarry(Scanner* scanner, const char* text, size_t length) {
+    if (scanner->carryLength + length > scanner->carryCapacity) {
+        size_t newCapacity = (scanner->carryCapacity == 0) ? INITIAL_TEXT_CAPACITY : scanner->carryCapacity * 2;
+        while (newCapacity < scanner->carryLength + length) {
+            newCapacity *= 2;
+        }
+        char* resized = reallocMemory(scanner->allocator, scanner->carry, scanner->carryCapacity, newCapacity);
+        if (resized == NULL) {
+            return false;
+        }
+        scanner->carry = resized;
+        scanner->carryCapacity = newCapacity;
+    }
+    memcpy(scanner->carry + scanner->carryLength, text, length);
+    scanner->carryLength += length;
+    return true;
+}
+
+// Scan a word, a number (bytes in mask) or the inside of a string (up to a
+// quote), going on into later chunks if it reaches the end of this one. Sets
+// *closed to whether a string's closing quote was found.
+static int scanSpan(Scanner* scanner, uint8_t mask, bool quoted, ScannedToken* token, bool* closed) {
+    const char* start = scanner->position;
+    const char* p = start;
+    bool carried = false;
+    scanner->carryLength = 0;
+    for (;;) {
+        if (quoted) {
+            p = memchr(p, '"', (size_t)(scanner->end - p));
+            p = (p != NULL) ? p : scanner->end;
+        } else {
+            while (p < scanner->end && (charClasses[(unsigned char)*p] & mask)) {
+                p++;
+            }
+        }
+        if (p < scanner->end) {
+            break;
+        }
+        // The span reaches the end of the chunk: keep it and go on in the next one
+        if (!appendCarry(scanner, start, (size_t)(p - start))) {
+            return CHECK_ERROR_NO_MEMORY;
+        }
+        carried = true;
+        bool more = nextChunk(scanner);
+        start = p = scanner->position;
+        if (!more) {
+            break;
+        }
+    }
+
+    if (carried) {
+        if (!appendCarry(scanner, start, (size_t)(p - start))) {
+            return CHECK_ERROR_NO_MEMORY;
+        }
+        token->text = scanner->carry;
+        token->length = scanner->carryLength;
+    } else {
+        token->text = start;
+        token->length = (size_t)(p - start);
+    }
+    *closed = p < scanner->end;
+    scanner->position = (quoted && *closed) ? p + 1 : p;
+    return CHECK_OK;
+}
+
+static TokenKind keywordKind(const char* word, size_t length) {
+    switch (length) {
+        case 2:
+            return memcmp(word, "to", 2) == 0 ? KIND_TO : KIND_IDENTIFIER;
+        case 4:
+            if (memcmp(word, "sets", 4) == 0) return KIND_SETS;
+            if (memcmp(word, "rest", 4) == 0) return KIND_REST;
+            if (memcmp(word, "Plan", 4) == 0) return KIND_PLAN;
+            return KIND_IDENTIFIER;
+        case 5:
+            return memcmp(word, "Group", 5) == 0 ? KIND_GROUP : KIND_IDENTIFIER;
+        case 6:
+            if (memcmp(word, "assign", 6) == 0) return KIND_ASSIGN;
+            if (memcmp(word, "import", 6) == 0) return KIND_IMPORT;
+            if (memcmp(word, "Monday", 6) == 0 || memcmp(word, "Friday", 6) == 0 ||
+                memcmp(word, "Sunday", 6) == 0) return KIND_DAY;
+            return KIND_IDENTIFIER;
+        case 7:
+            return memcmp(word, "Tuesday", 7) == 0 ? KIND_DAY : KIND_IDENTIFIER;
+        case 8:
+            if (memcmp(word, "exercise", 8) == 0) return KIND_EXERCISE;
+            if (memcmp(word, "Thursday", 8) == 0 || memcmp(word, "Saturday", 8) == 0) return KIND_DAY;
+            return KIND_IDENTIFIER;
+        case 9:
+            if (memcmp(word, "Wednesday", 9) == 0) return KIND_DAY;
+            if (memcmp(word, "showPlans", 9) == 0) return KIND_SHOW_PLANS;
+            return KIND_IDENTIFIER;
+        case 13:
+            return memcmp(word, "ClientProfile", 13) == 0 ? KIND_CLIENT_PROFILE : KIND_IDENTIFIER;
+        default:
+            return KIND_IDENTIFIER;
+    }
+}
+
+static int nextToken(Scanner* scanner, ScannedToken* token) {
+    for (;;) {
+        const char* p = scanner->position;
+        while (p < scanner->end && charClasses[(unsigned char)*p] == 0) {
+            p++;
+        }
+        scanner->position = p;
+        if (p == scanner->end) {
+            if (!nextChunk(scanner)) {
+                token->kind = KIND_EOF;
+                token->text = "";
+                token->length = 0;
+                token->offset = scanner->chunkOffset;
+                return CHECK_OK;
+            }
+            continue;
+        }
+
+        token->offset = scanner->chunkOffset + (size_t)(p - scanner->chunk);
+        uint8_t charClass = charClasses[(unsigned char)*p];
+        bool closed;
+        if (charClass == CHAR_PUNCTUATION) {
+            token->kind = (TokenKind)punctuationKinds[(unsigned char)*p];
+            token->text = p;
+            token->length = 1;
+            scanner->position = p + 1;
+            return CHECK_OK;
+        } else if (charClass == CHAR_IDENTIFIER_START) {
+            int result = scanSpan(scanner, CHAR_IDENTIFIER, false, token, &closed);
+            token->kind = keywordKind(token->text, token->length);
+            return result;
+        } else if (charClass == CHAR_DIGIT) {
+            token->kind = KIND_INT;
+            return scanSpan(scanner, CHAR_DIGIT, false, token, &closed);
+        }
+
+        // A string; one left open at the end of the input is dropped, as the lexer does
+        scanner->position = p + 1;
+        int result = scanSpan(scanner, 0, true, token, &closed);
+        if (result != CHECK_OK || closed) {
+            token->kind = KIND_STRING;
+            return result;
+        }
+    }
+}
+
+/***
+ * Declared names
+*/
+
+#define NAME_CLIENT 1
+#define NAME_PLAN 2
+#define NAME_GROUP 3
+
+typedef struct {
+    size_t offset;              // Into NameSet.text
+    size_t length;
+    unsigned long hash;
+    int kind;                   // 0 for an empty slot
+} NameEntry;
+
+typedef struct {
+    Allocator* allocator;
+    NameEntry* slots;
+    int capacity;
+    int count;
+    char* text;
+    size_t textLength;
+    size_t textCapacity;
+} NameSet;
+
+static unsigned long hashText(const char* text, size_t length) {
+    unsigned long hash = 1469598103934665603UL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static NameEntry* findName(const NameSet* names, const char* text, size_t length, unsigned long hash) {
+    int slot = (int)(hash & (unsigned long)(names->capacity - 1));
+    while (names->slots[slot].kind != 0) {
+        NameEntry* entry = &names->slots[slot];
+        if (entry->hash == hash && entry->length == length && memcmp(names->text + entry->offset, text, length) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & (names->capacity - 1);
+    }
+    return &names->slots[slot];
+}
+
+static bool growNames(NameSet* names) {
+    int newCapacity = names->capacity * 2;
+    NameEntry* slots = allocMemory(names->allocator, newCapacity * sizeof(NameEntry));
+    if (slots == NULL) {
+        return false;
+    }
+    memset(slots, 0, newCapacity * sizeof(NameEntry));
+    for (int i = 0; i < names->capacity; i++) {
+        if (names->slots[i].kind != 0) {
+            int slot = (int)(names->slots[i].hash & (unsigned long)(newCapacity - 1));
+            while (slots[slot].kind != 0) {
+                slot = (slot + 1) & (newCapacity - 1);
+            }
+            slots[slot] = names->slots[i];
+        }
+    }
+    releaseMemory(names->allocator, names->slots, names->capacity * sizeof(NameEntry));
+    names->slots = slots;
+    names->capacity = newCapacity;
+    return true;
+}
+
+// Add a name; returns false if out of memory
+static bool addName(NameSet* names, NameEntry* slot, const char* text, size_t length, unsigned long hash, int kind) {
+    if (names->textLength + length > names->textCapacity) {
+        size_t newCapacity = names->textCapacity * 2;
+        while (newCapacity < names->textLength + length) {
+            newCapacity *= 2;
+        }
+        char* resized = reallocMemory(names->allocator, names->text, names->textCapacity, newCapacity);
+        if (resized == NULL) {
+            return false;
+        }
+        names->text = resized;
+        names->textCapacity = newCapacity;
+    }
+    memcpy(names->text + names->textLength, text, length);
+    slot->offset = names->textLength;
+    slot->length = length;
+    slot->hash = hash;
+    slot->kind = kind;
+    names->textLength += length;
+    names->count++;
+    // Keep the set at most half full
+    return names->count * 2 <= names->capacity || growNames(names);
+}
+
+/***
+ * Grammar
+*/
+
+typedef enum {
+    STATE_ERROR,                // No transition: a syntax error
+    STATE_PROLOGUE,             // Before the first statement that is not an import
+    STATE_STATEMENT,
+    STATE_LATE_IMPORT,          // An import after other statements
+    STATE_IMPORT_PATH,
+    STATE_IMPORT_END,
+    STATE_CLIENT_NAME,
+    STATE_CLIENT_END,
+    STATE_SHOW_NAME,
+    STATE_SHOW_END,
+    STATE_PLAN_NAME,
+    STATE_PLAN_OPEN,
+    STATE_DEFINITION_END,
+    STATE_ASSIGN_PLAN,
+    STATE_ASSIGN_TO,
+    STATE_ASSIGN_CLIENT,
+    STATE_ASSIGN_BODY,
+    STATE_ASSIGN_END,
+    STATE_GROUP_NAME,
+    STATE_GROUP_OPEN,
+    STATE_GROUP_FIRST,          // After '{': a member or '}'
+    STATE_GROUP_NEXT,           // After a member: ',' or '}'
+    STATE_GROUP_MEMBER,         // After ','
+    STATE_GROUP_END,
+    STATE_PLAN_BODY,
+    STATE_DAY_OPEN,
+    STATE_DAY_BODY,
+    STATE_EXERCISE_COLON,
+    STATE_EXERCISE_NAME,
+    STATE_EXERCISE_ATTRIBUTES,
+    STATE_ATTRIBUTE,
+    STATE_ATTRIBUTE_COLON,
+    STATE_ATTRIBUTE_VALUE,
+    STATE_DONE,
+    STATE_COUNT
+} State;
+
+typedef enum {
+    ACTION_NONE,
+    ACTION_IMPORT,              // Imports are only followed by a full compile
+    ACTION_DECLARE_CLIENT,
+    ACTION_REFERENCE_CLIENT,    // An assignment's client or group
+    ACTION_SHOW_CLIENT,         // showPlans takes a client only
+    ACTION_REMEMBER_PLAN,       // Plan named by a definition or assignment
+    ACTION_DECLARE_PLAN,        // A definition's body: its '}' is followed by the definition's ';'
+    ACTION_REFERENCE_PLAN,
+    ACTION_DECLARE_GROUP,
+    ACTION_GROUP_MEMBER,        // Members must be declared clients
+    ACTION_INLINE_BODY,         // A plan body whose '}' is followed by the assignment's ';'
+    ACTION_END_PLAN,
+    ACTION_PLAN_DAY,            // A day inside a plan body
+    ACTION_STATEMENT_DAY,       // A day on its own, as a statement
+    ACTION_END_DAY,
+    ACTION_BEGIN_EXERCISE,
+    ACTION_EXERCISE_NAME,
+    ACTION_SELECT_SETS,
+    ACTION_SELECT_REST,
+    ACTION_ATTRIBUTE_VALUE,
+    ACTION_END_EXERCISE
+} Action;
+
+typedef struct {
+    uint8_t next;               // STATE_ERROR: use the state's default
+    uint8_t action;
+    bool reprocess;             // Handle the same token again in the next state
+} Transition;
+
+#define GO(state) { (state), ACTION_NONE, false }
+#define DO(state, action) { (state), (action), false }
+#define AGAIN(state, action) { (state), (action), true }
+#define FAIL { STATE_ERROR, ACTION_NONE, true }   // Unlike an empty entry, never takes the default
+
+// What the parser accepts, one row per state. Tokens without an entry take
+// the state's default below.
+static const Transition transitions[STATE_COUNT][KIND_COUNT] = {
+    [STATE_PROLOGUE] = { [KIND_IMPORT] = DO(STATE_IMPORT_PATH, ACTION_IMPORT) },
+    [STATE_IMPORT_PATH] = { [KIND_STRING] = GO(STATE_IMPORT_END) },
+    [STATE_IMPORT_END] = { [KIND_SEMICOLON] = GO(STATE_PROLOGUE) },
+    [STATE_STATEMENT] = {
+        [KIND_IMPORT] = AGAIN(STATE_LATE_IMPORT, ACTION_NONE),
+        [KIND_EOF] = GO(STATE_DONE),
+        [KIND_CLIENT_PROFILE] = GO(STATE_CLIENT_NAME),
+        [KIND_ASSIGN] = GO(STATE_ASSIGN_PLAN),
+        [KIND_SHOW_PLANS] = GO(STATE_SHOW_NAME),
+        [KIND_PLAN] = GO(STATE_PLAN_NAME),
+        [KIND_GROUP] = GO(STATE_GROUP_NAME),
+        [KIND_DAY] = DO(STATE_DAY_OPEN, ACTION_STATEMENT_DAY),
+    },
+    [STATE_CLIENT_NAME] = { [KIND_IDENTIFIER] = DO(STATE_CLIENT_END, ACTION_DECLARE_CLIENT) },
+    [STATE_CLIENT_END] = { [KIND_SEMICOLON] = GO(STATE_STATEMENT) },
+    [STATE_SHOW_NAME] = { [KIND_IDENTIFIER] = DO(STATE_SHOW_END, ACTION_SHOW_CLIENT) },
+    [STATE_SHOW_END] = { [KIND_SEMICOLON] = GO(STATE_STATEMENT) },
+    [STATE_PLAN_NAME] = { [KIND_IDENTIFIER] = DO(STATE_PLAN_OPEN, ACTION_REMEMBER_PLAN) },
+    [STATE_PLAN_OPEN] = { [KIND_LEFT_BRACE] = DO(STATE_PLAN_BODY, ACTION_DECLARE_PLAN) },
+    [STATE_DEFINITION_END] = { [KIND_SEMICOLON] = GO(STATE_STATEMENT) },
+    [STATE_ASSIGN_PLAN] = { [KIND_IDENTIFIER] = DO(STATE_ASSIGN_TO, ACTION_REMEMBER_PLAN) },
+    [STATE_ASSIGN_TO] = { [KIND_TO] = GO(STATE_ASSIGN_CLIENT) },
+    [STATE_ASSIGN_CLIENT] = { [KIND_IDENTIFIER] = DO(STATE_ASSIGN_BODY, ACTION_REFERENCE_CLIENT) },
+    [STATE_ASSIGN_BODY] = {
+        [KIND_SEMICOLON] = DO(STATE_STATEMENT, ACTION_REFERENCE_PLAN),
+        [KIND_LEFT_BRACE] = DO(STATE_PLAN_BODY, ACTION_INLINE_BODY),
+    },
+    [STATE_ASSIGN_END] = { [KIND_SEMICOLON] = GO(STATE_STATEMENT) },
+    [STATE_GROUP_NAME] = { [KIND_IDENTIFIER] = DO(STATE_GROUP_OPEN, ACTION_DECLARE_GROUP) },
+    [STATE_GROUP_OPEN] = { [KIND_LEFT_BRACE] = GO(STATE_GROUP_FIRST) },
+    [STATE_GROUP_FIRST] = {
+        [KIND_IDENTIFIER] = DO(STATE_GROUP_NEXT, ACTION_GROUP_MEMBER),
+        [KIND_RIGHT_BRACE] = GO(STATE_GROUP_END),
+    },
+    [STATE_GROUP_NEXT] = {
+        [KIND_COMMA] = GO(STATE_GROUP_MEMBER),
+        [KIND_RIGHT_BRACE] = GO(STATE_GROUP_END),
+    },
+    [STATE_GROUP_MEMBER] = { [KIND_IDENTIFIER] = DO(STATE_GROUP_NEXT, ACTION_GROUP_MEMBER) },
+    [STATE_GROUP_END] = { [KIND_SEMICOLON] = GO(STATE_STATEMENT) },
+    [STATE_PLAN_BODY] = {
+        [KIND_RIGHT_BRACE] = DO(STATE_STATEMENT, ACTION_END_PLAN),
+        [KIND_DAY] = DO(STATE_DAY_OPEN, ACTION_PLAN_DAY),
+        [KIND_EOF] = FAIL,
+    },
+    [STATE_DAY_OPEN] = { [KIND_LEFT_BRACE] = GO(STATE_DAY_BODY) },
+    [STATE_DAY_BODY] = {
+        [KIND_RIGHT_BRACE] = DO(STATE_STATEMENT, ACTION_END_DAY),
+        [KIND_EXERCISE] = DO(STATE_EXERCISE_COLON, ACTION_BEGIN_EXERCISE),
+        [KIND_EOF] = FAIL,
+    },
+    [STATE_EXERCISE_COLON] = { [KIND_COLON] = GO(STATE_EXERCISE_NAME) },
+    [STATE_EXERCISE_NAME] = { [KIND_STRING] = DO(STATE_EXERCISE_ATTRIBUTES, ACTION_EXERCISE_NAME) },
+    [STATE_EXERCISE_ATTRIBUTES] = { [KIND_PIPE] = GO(STATE_ATTRIBUTE) },
+    [STATE_ATTRIBUTE] = {
+        [KIND_SETS] = DO(STATE_ATTRIBUTE_COLON, ACTION_SELECT_SETS),
+        [KIND_REST] = DO(STATE_ATTRIBUTE_COLON, ACTION_SELECT_REST),
+    },
+    [STATE_ATTRIBUTE_COLON] = { [KIND_COLON] = GO(STATE_ATTRIBUTE_VALUE) },
+    [STATE_ATTRIBUTE_VALUE] = { [KIND_INT] = DO(STATE_EXERCISE_ATTRIBUTES, ACTION_ATTRIBUTE_VALUE) },
+};
+
+// Default per state, and the syntax error if there is none. Plan and day
+// bodies skip stray tokens; a missing ':' or number after sets/rest leaves
+// the value unset, and anything but '|' ends an exercise, as in the parser.
+static const struct {
+    Transition otherwise;
+    const char* error;
+} defaults[STATE_COUNT] = {
+    [STATE_PROLOGUE] = { AGAIN(STATE_STATEMENT, ACTION_NONE), NULL },
+    [STATE_STATEMENT] = { GO(STATE_ERROR), "Unexpected token: %.*s" },
+    [STATE_LATE_IMPORT] = { GO(STATE_ERROR), "parseImport - Imports must come before other statements" },
+    [STATE_IMPORT_PATH] = { GO(STATE_ERROR), "parseImport - Expected file name string, got %.*s" },
+    [STATE_IMPORT_END] = { GO(STATE_ERROR), "parseImport - Expected semicolon, got %.*s" },
+    [STATE_CLIENT_NAME] = { GO(STATE_ERROR), "parseClientProfile - Expected identifier for client profile, got %.*s" },
+    [STATE_CLIENT_END] = { GO(STATE_ERROR), "parseClientProfile - Expected semicolon, got %.*s" },
+    [STATE_SHOW_NAME] = { GO(STATE_ERROR), "Expected an identifier for client name, got %.*s" },
+    [STATE_SHOW_END] = { GO(STATE_ERROR), "Expected semicolon, got %.*s" },
+    [STATE_PLAN_NAME] = { GO(STATE_ERROR), "parsePlanDefinition - Expected plan identifier, got %.*s" },
+    [STATE_PLAN_OPEN] = { GO(STATE_ERROR), "Expected '{', got %.*s" },
+    [STATE_DEFINITION_END] = { GO(STATE_ERROR), "parsePlanDefinition - Expected semicolon, got %.*s" },
+    [STATE_ASSIGN_PLAN] = { GO(STATE_ERROR), "Expected plan identifier, got %.*s" },
+    [STATE_ASSIGN_TO] = { GO(STATE_ERROR), "Expected 'to', got %.*s" },
+    [STATE_ASSIGN_CLIENT] = { GO(STATE_ERROR), "Expected client identifier, got %.*s" },
+    [STATE_ASSIGN_BODY] = { GO(STATE_ERROR), "Expected '{', got %.*s" },
+    [STATE_ASSIGN_END] = { GO(STATE_ERROR), "Expected semicolon, got %.*s" },
+    [STATE_GROUP_NAME] = { GO(STATE_ERROR), "parseGroup - Expected group identifier, got %.*s" },
+    [STATE_GROUP_OPEN] = { GO(STATE_ERROR), "parseGroup - Expected '{', got %.*s" },
+    [STATE_GROUP_FIRST] = { GO(STATE_ERROR), "parseGroup - Expected member identifier, got %.*s" },
+    [STATE_GROUP_NEXT] = { GO(STATE_ERROR), "parseGroup - Expected ',' or '}', got %.*s" },
+    [STATE_GROUP_MEMBER] = { GO(STATE_ERROR), "parseGroup - Expected member identifier, got %.*s" },
+    [STATE_GROUP_END] = { GO(STATE_ERROR), "parseGroup - Expected semicolon, got %.*s" },
+    [STATE_PLAN_BODY] = { GO(STATE_PLAN_BODY), "Expected '}' before %.*s" },
+    [STATE_DAY_OPEN] = { GO(STATE_ERROR), "parseDay - Expected left brace, got %.*s" },
+    [STATE_DAY_BODY] = { GO(STATE_DAY_BODY), "parseDay - Expected right brace, got %.*s" },
+    [STATE_EXERCISE_COLON] = { GO(STATE_ERROR), "parseExercise - Expected TOKEN_COLON after 'exercise', got %.*s" },
+    [STATE_EXERCISE_NAME] = { GO(STATE_ERROR), "parseExercise - Expected TOKEN_STRING_LITERAL, got %.*s" },
+    [STATE_EXERCISE_ATTRIBUTES] = { AGAIN(STATE_DAY_BODY, ACTION_END_EXERCISE), NULL },
+    [STATE_ATTRIBUTE] = { GO(STATE_ERROR), "parseExercise - Expected TOKEN_SETS or TOKEN_REST, got %.*s" },
+    [STATE_ATTRIBUTE_COLON] = { AGAIN(STATE_EXERCISE_ATTRIBUTES, ACTION_NONE), NULL },
+    [STATE_ATTRIBUTE_VALUE] = { AGAIN(STATE_EXERCISE_ATTRIBUTES, ACTION_NONE), NULL },
+};
+
+// Recognizer state besides the grammar state
+typedef struct {
+    const Catalog* catalog;
+    NameSet names;
+    State planReturn;           // Where a plan body's '}' leads
+    State dayReturn;            // Where a day body's '}' leads
+    char* pending;              // Plan named by the current assignment, or the current exercise's name
+    size_t pendingLength;
+    size_t pendingCapacity;
+    size_t pendingOffset;
+    size_t exerciseOffset;
+    int sets;
+    int rest;
+    int* attribute;             // sets or rest, whichever is being given
+    CheckResult* result;
+    StatementVisitor visitor;   // Told about each statement (NULL if none)
+    void* visitorData;
+    StatementSpan statement;    // Statement being recognized
+} Recognizer;
+
+static bool keepPending(Recognizer* recognizer, Allocator* allocator, const ScannedToken* token) {
+    if (token->length + 1 > recognizer->pendingCapacity) {
+        size_t newCapacity = token->length + 1 + 64;
+        char* resized = reallocMemory(allocator, recognizer->pending, recognizer->pendingCapacity, newCapacity);
+        if (resized == NULL) {
+            return false;
+        }
+        recognizer->pending = resized;
+        recognizer->pendingCapacity = newCapacity;
+    }
+    memcpy(recognizer->pending, token->text, token->length);
+    recognizer->pending[token->length] = '\0';
+    recognizer->pendingLength = token->length;
+    recognizer->pendingOffset = token->offset;
+    return true;
+}
+
+// Remember the first semantic error; checking goes on for syntax errors
+static void semanticError(Recognizer* recognizer, int code, size_t offset) {
+    if (recognizer->result->semanticResult == SEMANTIC_OK) {
+        recognizer->result->semanticResult = code;
+        recognizer->result->errorOffset = offset;
+    }
+}
+
+// atoi's value for a run of digits: strtol saturates, then the long is narrowed
+static int literalValue(const char* digits, size_t length) {
+    long value = 0;
+    for (size_t i = 0; i < length; i++) {
+        int digit = digits[i] - '0';
+        value = (value > (LONG_MAX - digit) / 10) ? LONG_MAX : value * 10 + digit;
+    }
+    return (int)value;
+}
+
+// Declare a client or plan; every name is declared once
+static int declareName(Recognizer* recognizer, const char* text, size_t length, size_t offset, int kind) {
+    unsigned long hash = hashText(text, length);
+    NameEntry* slot = findName(&recognizer->names, text, length, hash);
+    if (slot->kind != 0) {
+        semanticError(recognizer, REDECLARATION_OF_SYMBOL, offset);
+        return CHECK_OK;
+    }
+    return addName(&recognizer->names, slot, text, length, hash, kind) ? CHECK_OK : CHECK_ERROR_NO_MEMORY;
+}
+
+static int runAction(Recognizer* recognizer, Action action, const ScannedToken* token, State* state) {
+    NameSet* names = &recognizer->names;
+    switch (action) {
+        case ACTION_IMPORT:
+            semanticError(recognizer, UNSUPPORTED_IMPORT, token->offset);
+            break;
+
+        case ACTION_DECLARE_CLIENT:
+            return declareName(recognizer, token->text, token->length, token->offset, NAME_CLIENT);
+
+        case ACTION_DECLARE_PLAN:
+            // Declared at the '{', but a redeclaration is reported at the name, as for clients and groups
+            recognizer->planReturn = STATE_DEFINITION_END;
+            return declareName(recognizer, recognizer->pending, recognizer->pendingLength, recognizer->pendingOffset, NAME_PLAN);
+
+        case ACTION_REFERENCE_CLIENT: {
+            // A client or a group, as in checkAssignmentTarget
+            int kind = findName(names, token->text, token->length, hashText(token->text, token->length))->kind;
+            if (kind != NAME_CLIENT && kind != NAME_GROUP) {
+                semanticError(recognizer, UNDEFINED_IDENTIFIER, token->offset);
+            }
+            break;
+        }
+
+        case ACTION_SHOW_CLIENT:
+            if (findName(names, token->text, token->length, hashText(token->text, token->length))->kind != NAME_CLIENT) {
+                semanticError(recognizer, UNDEFINED_IDENTIFIER, token->offset);
+            }
+            break;
+
+        case ACTION_REMEMBER_PLAN:
+            return keepPending(recognizer, names->allocator, token) ? CHECK_OK : CHECK_ERROR_NO_MEMORY;
+
+        case ACTION_REFERENCE_PLAN: {
+            const char* plan = recognizer->pending;
+            size_t length = recognizer->pendingLength;
+            if (findName(names, plan, length, hashText(plan, length))->kind != NAME_PLAN) {
+                semanticError(recognizer, UNDEFINED_IDENTIFIER, recognizer->pendingOffset);
+            }
+            break;
+        }
+
+        case ACTION_DECLARE_GROUP:
+            return declareName(recognizer, token->text, token->length, token->offset, NAME_GROUP);
+
+        case ACTION_GROUP_MEMBER:
+            if (findName(names, token->text, token->length, hashText(token->text, token->length))->kind != NAME_CLIENT) {
+                semanticError(recognizer, UNDEFINED_IDENTIFIER, token->offset);
+            }
+            break;
+
+        case ACTION_INLINE_BODY:
+            recognizer->planReturn = STATE_ASSIGN_END;
+            break;
+
+        case ACTION_END_PLAN:
+            *state = recognizer->planReturn;
+            break;
+
+        case ACTION_PLAN_DAY:
+            recognizer->dayReturn = STATE_PLAN_BODY;
+            break;
+
+        case ACTION_STATEMENT_DAY:
+            recognizer->dayReturn = STATE_STATEMENT;
+            break;
+
+        case ACTION_END_DAY:
+            *state = recognizer->dayReturn;
+            break;
+
+        case ACTION_BEGIN_EXERCISE:
+            recognizer->sets = 0;
+            recognizer->rest = 0;
+            recognizer->exerciseOffset = token->offset;
+            break;
+
+        case ACTION_EXERCISE_NAME:
+            // The name is only needed for the catalog, after sets and rest are checked
+            if (recognizer->catalog != NULL && !keepPending(recognizer, names->allocator, token)) {
+                return CHECK_ERROR_NO_MEMORY;
+            }
+            break;
+
+        case ACTION_SELECT_SETS:
+            recognizer->attribute = &recognizer->sets;
+            break;
+
+        case ACTION_SELECT_REST:
+            recognizer->attribute = &recognizer->rest;
+            break;
+
+        case ACTION_ATTRIBUTE_VALUE:
+            *recognizer->attribute = literalValue(token->text, token->length);
+            break;
+
+        case ACTION_END_EXERCISE:
+            if (checkExerciseValues(recognizer->sets, recognizer->rest) != SEMANTIC_OK) {
+                semanticError(recognizer, INVALID_EXERCISE_DEFINITION, recognizer->exerciseOffset);
+            } else if (recognizer->catalog != NULL && catalogLookup(recognizer->catalog, recognizer->pending) == CATALOG_NOT_FOUND) {
+                semanticError(recognizer, UNKNOWN_EXERCISE, recognizer->exerciseOffset);
+            }
+            break;
+
+        case ACTION_NONE:
+            break;
+    }
+    return CHECK_OK;
+}
+
+static void syntaxError(CheckResult* result, const char* format, const ScannedToken* token) {
+    const char* text = token->text;
+    int length = (int)(token->length < MAX_QUOTED_TOKEN ? token->length : MAX_QUOTED_TOKEN);
+    if (length == 0) {
+        text = (token->kind == KIND_EOF) ? "end of input" : "string";
+        length = (int)strlen(text);
+    }
+    snprintf(result->message, sizeof(result->message), format, length, text);
+    result->status = CHECK_ERROR_SYNTAX;
+    result->errorOffset = token->offset;
+}
+
+// Follow statement boundaries and names for the visitor. previous is the
+// state token was handled in, state the one it led to.
+static int trackStatement(Recognizer* recognizer, State previous, State state, const ScannedToken* token) {
+    StatementSpan* statement = &recognizer->statement;
+    switch (previous) {
+        case STATE_PROLOGUE:
+        case STATE_STATEMENT:
+            statement->begin = token->offset;
+            statement->kind = (token->kind == KIND_IMPORT) ? STATEMENT_IMPORT
+                            : (token->kind == KIND_CLIENT_PROFILE) ? STATEMENT_CLIENT
+                            : (token->kind == KIND_ASSIGN) ? STATEMENT_ASSIGNMENT
+                            : (token->kind == KIND_SHOW_PLANS) ? STATEMENT_SHOW_PLANS
+                            : (token->kind == KIND_PLAN) ? STATEMENT_PLAN
+                            : (token->kind == KIND_GROUP) ? STATEMENT_GROUP : STATEMENT_DAY;
+            statement->nameOffset = statement->planOffset = token->offset;
+            statement->nameLength = statement->planLength = 0;
+            statement->hasBody = (token->kind == KIND_PLAN);
+            break;
+        case STATE_CLIENT_NAME:
+        case STATE_SHOW_NAME:
+        case STATE_PLAN_NAME:
+        case STATE_GROUP_NAME:
+        case STATE_ASSIGN_CLIENT:
+            statement->nameOffset = token->offset;
+            statement->nameLength = token->length;
+            break;
+        case STATE_ASSIGN_PLAN:
+            statement->planOffset = token->offset;
+            statement->planLength = token->length;
+            break;
+        case STATE_ASSIGN_BODY:
+            statement->hasBody = (token->kind == KIND_LEFT_BRACE);
+            break;
+        default:
+            break;
+    }
+    bool between = (state == STATE_STATEMENT || state == STATE_PROLOGUE);
+    if (previous != STATE_STATEMENT && previous != STATE_PROLOGUE && between) {
+        statement->end = token->offset + token->length;
+        return (recognizer->visitor(recognizer->visitorData, statement) == 0) ? CHECK_OK : CHECK_ERROR_NO_MEMORY;
+    }
+    return CHECK_OK;
+}
+
+static int recognize(Scanner* scanner, const Catalog* catalog, Allocator* allocator,
+                     StatementVisitor visitor, void* visitorData, CheckResult* result) {
+    memset(result, 0, sizeof(CheckResult));
+    result->semanticResult = SEMANTIC_OK;
+    result->errorOffset = NO_SOURCE_OFFSET;
+
+    Recognizer recognizer;
+    memset(&recognizer, 0, sizeof(Recognizer));
+    recognizer.catalog = catalog;
+    recognizer.result = result;
+    recognizer.attribute = &recognizer.sets;
+    recognizer.visitor = visitor;
+    recognizer.visitorData = visitorData;
+    recognizer.names.allocator = allocator;
+    recognizer.names.capacity = INITIAL_NAME_CAPACITY;
+    recognizer.names.textCapacity = INITIAL_TEXT_CAPACITY;
+    recognizer.names.slots = allocMemory(allocator, INITIAL_NAME_CAPACITY * sizeof(NameEntry));
+    recognizer.names.text = allocMemory(allocator, INITIAL_TEXT_CAPACITY);
+
+    int status = CHECK_OK;
+    if (recognizer.names.slots == NULL || recognizer.names.text == NULL) {
+        status = CHECK_ERROR_NO_MEMORY;
+    } else {
+        memset(recognizer.names.slots, 0, INITIAL_NAME_CAPACITY * sizeof(NameEntry));
+    }
+
+    State state = STATE_PROLOGUE;
+    ScannedToken token;
+    while (status == CHECK_OK && state != STATE_DONE) {
+        status = nextToken(scanner, &token);
+        if (status != CHECK_OK) {
+            break;
+        }
+        result->tokens++;
+
+        bool again = true;
+        while (again && status == CHECK_OK) {
+            Transition transition = transitions[state][token.kind];
+            if (transition.next == STATE_ERROR && !transition.reprocess) {
+                transition = defaults[state].otherwise;
+            }
+            if (transition.next == STATE_ERROR) {
+                syntaxError(result, defaults[state].error, &token);
+                status = CHECK_ERROR_SYNTAX;
+                break;
+            }
+            State previous = state;
+            state = (State)transition.next;
+            status = runAction(&recognizer, (Action)transition.action, &token, &state);
+            if (status == CHECK_OK && visitor != NULL) {
+                status = trackStatement(&recognizer, previous, state, &token);
+            }
+            again = transition.reprocess;
+        }
+    }
+
+    result->bytes = scanner->chunkOffset + (size_t)(scanner->end - scanner->chunk);
+    result->names = recognizer.names.count;
+    if (scanner->sourceResult != SOURCE_OK) {
+        result->sourceResult = scanner->sourceResult;
+        status = CHECK_ERROR_SOURCE;
+    } else if (status == CHECK_OK && result->semanticResult != SEMANTIC_OK) {
+        status = CHECK_ERROR_SEMANTIC;
+    }
+    result->status = status;
+
+    releaseMemory(allocator, scanner->carry, scanner->carryCapacity);
+    releaseMemory(allocator, recognizer.pending, recognizer.pendingCapacity);
+    releaseMemory(allocator, recognizer.names.slots, recognizer.names.capacity * sizeof(NameEntry));
+    releaseMemory(allocator, recognizer.names.text, recognizer.names.textCapacity);
+    return status;
+}
+
+/***
+ * Check functions
+*/
+
+int checkSource(Source* source, const Catalog* catalog, Allocator* allocator, CheckResult* result) {
+    Scanner scanner = { source, allocator, emptyChunk, emptyChunk, emptyChunk, 0, false, SOURCE_OK, NULL, 0, 0 };
+    return recognize(&scanner, catalog, allocator, NULL, NULL, result);
+}
+
+int checkText(const char* text, size_t length, const Catalog* catalog, Allocator* allocator,
+              StatementVisitor visitor, void* visitorData, CheckResult* result) {
+    // The whole input is one chunk, so tokens never need the carry buffer
+    Scanner scanner = { NULL, allocator, text, text, text + length, 0, true, SOURCE_OK, NULL, 0, 0 };
+    return recognize(&scanner, catalog, allocator, visitor, visitorData, result);
+}
@@ -0,0 +1,75 @@
+#ifndef RECOGNIZER_H
+#define RECOGNIZER_H
+
+#include <stddef.h>
+#include "source.h"
+#include "context.h"
+#include "catalog.h"
+
+// Validate-only front end for --check. Runs straight over the source bytes:
+// a character class table drives the scanner, and a transition table indexed
+// by state and token kind drives the grammar, so no token or node is ever
+// allocated. It accepts exactly what the lexer and parseProgram accept, and
+// applies the semantic rules that need no tree: positive sets and rest,
+// names declared once and before use, plan references to defined plans,
+// group members that are clients, and exercise names in the catalog if there
+// is one. Declared names are kept in
+// a hash set whose text lives in one growing buffer.
+//
+// As in a full compile, a syntax error anywhere is reported in preference to
+// an earlier semantic error. Imports (unit.h) are recognized, but the files
+// they name are not read, so a program with imports fails the check with
+// UNSUPPORTED_IMPORT.
+
+// Check status codes
+#define CHECK_OK 0
+#define CHECK_ERROR_SYNTAX -1
+#define CHECK_ERROR_SEMANTIC -2     // See semanticResult
+#define CHECK_ERROR_SOURCE -3       // The input could not be read (see sourceResult)
+#define CHECK_ERROR_NO_MEMORY -4
+
+typedef struct {
+    int status;
+    int semanticResult;             // Semantic status code (semantic.h) of the first semantic error
+    int sourceResult;
+    size_t errorOffset;             // Input offset of the error (NO_SOURCE_OFFSET if none)
+    char message[DIAGNOSTIC_MESSAGE_SIZE]; // Description of a syntax error
+    size_t bytes;                   // Input bytes read
+    size_t tokens;                  // Tokens recognized
+    int names;                      // Clients, plans and groups declared
+} CheckResult;
+
+typedef enum {
+    STATEMENT_CLIENT,
+    STATEMENT_ASSIGNMENT,
+    STATEMENT_SHOW_PLANS,
+    STATEMENT_PLAN,
+    STATEMENT_DAY,
+    STATEMENT_GROUP,
+    STATEMENT_IMPORT
+} StatementKind;
+
+// A top-level statement, as input offsets
+typedef struct {
+    StatementKind kind;
+    size_t begin;                   // First token
+    size_t end;                     // Just past the last token
+    size_t nameOffset;              // Client declared or referred to, or the plan or group defined
+    size_t nameLength;              // 0 for a day
+    size_t planOffset;              // Plan named by an assignment
+    size_t planLength;
+    int hasBody;                    // A plan definition, or an assignment with an inline plan
+} StatementSpan;
+
+// Told about each statement once it has been recognized; returns 0 to go on
+// or nonzero if out of memory
+typedef int (*StatementVisitor)(void* userData, const StatementSpan* statement);
+
+// Check a program; source is read to the end (or the first syntax error) but not closed
+int checkSource(Source* source, const Catalog* catalog, Allocator* allocator, CheckResult* result);
+
+// Check a program held in memory, telling visitor (if not NULL) about each statement
+int checkText(const char* text, size_t length, const Catalog* catalog, Allocator* allocator,
+              StatementVisitor visitor, void* visitorData, CheckResult* result);
+
+#endif // RECOGNIZER_H
@@ -0,0 +1,290 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "registry.h"
+#include "semantic.h"
+
+#define READER_SLOT_SIZE 128 // Keeps each reader's epoch on its own cache lines
+
+struct RegistrySnapshot {
+    unsigned long version;
+    Allocator* allocator;
+    ClientRecord* clients;
+    int clientCount;
+    int* index;                        // Open-addressed hash index into clients (entries are position + 1)
+    int indexCapacity;
+    unsigned long retiredEpoch;        // Epoch in which the snapshot was replaced
+    RegistrySnapshot* nextRetired;
+};
+
+struct RegistryReader {
+    atomic_ulong epoch;                // Epoch the reader entered in, 0 while outside
+    atomic_bool inUse;
+    Registry* registry;
+    char padding[READER_SLOT_SIZE - sizeof(atomic_ulong) - sizeof(atomic_bool) - sizeof(Registry*)];
+};
+
+struct Registry {
+    Allocator* allocator;
+    _Atomic(RegistrySnapshot*) current;
+    atomic_ulong epoch;                // Advanced by every publish
+    RegistryReader* readers;
+    int maxReaders;
+    pthread_mutex_t writerLock;        // Serializes publishing and reclamation
+    RegistrySnapshot* retired;         // Replaced snapshots not yet freed
+    unsigned long nextVersion;
+};
+
+/***
+ * Snapshot helpers
+*/
+
+static unsigned long hashName(const char* name) {
+    unsigned long hash = 1469598103934665603UL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static void freeSnapshot(RegistrySnapshot* snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+    Allocator* allocator = snapshot->allocator;
+    for (int i = 0; i < snapshot->clientCount; i++) {
+        ClientRecord* client = &snapshot->clients[i];
+        for (int j = 0; j < client->planCount; j++) {
+            freeAST(client->plans[j]);
+        }
+        releaseMemory(allocator, client->plans, client->planCapacity * sizeof(ASTNode*));
+        releaseString(allocator, client->name);
+    }
+    releaseMemory(allocator, snapshot->clients, snapshot->clientCount * sizeof(ClientRecord));
+    releaseMemory(allocator, snapshot->index, snapshot->indexCapacity * sizeof(int));
+    releaseMemory(allocator, snapshot, sizeof(RegistrySnapshot));
+}
+
+// Copy the environment's clients; plans are shared by reference
+static RegistrySnapshot* buildSnapshot(Allocator* allocator, const Environment* env) {
+    RegistrySnapshot* snapshot = allocMemory(allocator, sizeof(RegistrySnapshot));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    memset(snapshot, 0, sizeof(RegistrySnapshot));
+    snapshot->allocator = allocator;
+
+    int indexCapacity = 16;
+    while (indexCapacity < env->clientCount * 2) {
+        indexCapacity *= 2;
+    }
+    snapshot->clients = allocMemory(allocator, env->clientCount * sizeof(ClientRecord));
+    snapshot->index = allocMemory(allocator, indexCapacity * sizeof(int));
+    if ((snapshot->clients == NULL && env->clientCount > 0) || snapshot->index == NULL) {
+        releaseMemory(allocator, snapshot->clients, env->clientCount * sizeof(ClientRecord));
+        releaseMemory(allocator, snapshot->index, indexCapacity * sizeof(int));
+        releaseMemory(allocator, snapshot, sizeof(RegistrySnapshot));
+        return NULL;
+    }
+    snapshot->indexCapacity = indexCapacity;
+    memset(snapshot->index, 0, indexCapacity * sizeof(int));
+
+    for (int i = 0; i < env->clientCount; i++) {
+        const ClientRecord* source = &env->clients[i];
+        ClientRecord* client = &snapshot->clients[i];
+        // Group plans are copied in, so a snapshot client has every plan of its own
+        int planCount = source->planCount;
+        for (int j = 0; j < source->groupCount; j++) {
+            planCount += env->groups[source->groups[j]].planCount;
+        }
+        client->name = allocString(allocator, source->name);
+        client->plans = allocMemory(allocator, planCount * sizeof(ASTNode*));
+        client->orders = NULL;
+        client->planCount = 0;
+        client->planCapacity = planCount;
+        client->groups = NULL;
+        client->groupCount = 0;
+        client->groupCapacity = 0;
+        snapshot->clientCount = i + 1;
+        if (client->name == NULL || (client->plans == NULL && planCount > 0)) {
+            freeSnapshot(snapshot);
+            return NULL;
+        }
+        size_t order = 0;
+        for (ASTNode* plan = clientPlanFrom(env, source, 0, &order); plan != NULL;
+             plan = clientPlanFrom(env, source, order + 1, &order)) {
+            client->plans[client->planCount++] = retainASTNode(plan);
+        }
+
+        int slot = (int)(hashName(client->name) & (unsigned long)(indexCapacity - 1));
+        while (snapshot->index[slot] != 0) {
+            slot = (slot + 1) & (indexCapacity - 1);
+        }
+        snapshot->index[slot] = i + 1;
+    }
+    return snapshot;
+}
+
+// Free retired snapshots that no reader can still hold; call with the writer lock held
+static int reclaimRetired(Registry* registry) {
+    // Readers that entered in an epoch after a snapshot was retired can only see newer ones
+    unsigned long oldestActive = 0;
+    for (int i = 0; i < registry->maxReaders; i++) {
+        unsigned long epoch = atomic_load(&registry->readers[i].epoch);
+        if (epoch != 0 && (oldestActive == 0 || epoch < oldestActive)) {
+            oldestActive = epoch;
+        }
+    }
+
+    int waiting = 0;
+    RegistrySnapshot** link = &registry->retired;
+    while (*link != NULL) {
+        RegistrySnapshot* snapshot = *link;
+        if (oldestActive == 0 || snapshot->retiredEpoch < oldestActive) {
+            *link = snapshot->nextRetired;
+            freeSnapshot(snapshot);
+        } else {
+            link = &snapshot->nextRetired;
+            waiting++;
+        }
+    }
+    return waiting;
+}
+
+/***
+ * Registry functions
+*/
+
+Registry* createRegistry(Allocator* allocator, int maxReaders) {
+    Registry* registry = allocMemory(allocator, sizeof(Registry));
+    if (registry == NULL) {
+        return NULL;
+    }
+    registry->readers = allocMemory(allocator, maxReaders * sizeof(RegistryReader));
+    if (registry->readers == NULL || pthread_mutex_init(&registry->writerLock, NULL) != 0) {
+        releaseMemory(allocator, registry->readers, maxReaders * sizeof(RegistryReader));
+        releaseMemory(allocator, registry, sizeof(Registry));
+        return NULL;
+    }
+
+    registry->allocator = allocator;
+    registry->maxReaders = maxReaders;
+    registry->retired = NULL;
+    registry->nextVersion = 0;
+    atomic_init(&registry->current, NULL);
+    atomic_init(&registry->epoch, 1);
+    for (int i = 0; i < maxReaders; i++) {
+        atomic_init(&registry->readers[i].epoch, 0);
+        atomic_init(&registry->readers[i].inUse, false);
+        registry->readers[i].registry = registry;
+    }
+    return registry;
+}
+
+void freeRegistry(Registry* registry) {
+    if (registry == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&registry->writerLock);
+    freeSnapshot(atomic_exchange(&registry->current, NULL));
+    while (registry->retired != NULL) {
+        RegistrySnapshot* next = registry->retired->nextRetired;
+        freeSnapshot(registry->retired);
+        registry->retired = next;
+    }
+    pthread_mutex_unlock(&registry->writerLock);
+
+    pthread_mutex_destroy(&registry->writerLock);
+    releaseMemory(registry->allocator, registry->readers, registry->maxReaders * sizeof(RegistryReader));
+    releaseMemory(registry->allocator, registry, sizeof(Registry));
+}
+
+// Build a snapshot of env off to the side and make it the current one
+int registryPublish(Registry* registry, const Environment* env) {
+    pthread_mutex_lock(&registry->writerLock);
+    RegistrySnapshot* snapshot = buildSnapshot(registry->allocator, env);
+    if (snapshot == NULL) {
+        pthread_mutex_unlock(&registry->writerLock);
+        return RUNTIME_ERROR;
+    }
+    snapshot->version = ++registry->nextVersion;
+
+    RegistrySnapshot* old = atomic_exchange(&registry->current, snapshot);
+    if (old != NULL) {
+        old->retiredEpoch = atomic_fetch_add(&registry->epoch, 1);
+        old->nextRetired = registry->retired;
+        registry->retired = old;
+    }
+    reclaimRetired(registry);
+    pthread_mutex_unlock(&registry->writerLock);
+    return 0;
+}
+
+int registryReclaim(Registry* registry) {
+    pthread_mutex_lock(&registry->writerLock);
+    int waiting = reclaimRetired(registry);
+    pthread_mutex_unlock(&registry->writerLock);
+    return waiting;
+}
+
+RegistryReader* registryRegisterReader(Registry* registry) {
+    for (int i = 0; i < registry->maxReaders; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&registry->readers[i].inUse, &expected, true)) {
+            return &registry->readers[i];
+        }
+    }
+    return NULL;
+}
+
+void registryUnregisterReader(RegistryReader* reader) {
+    atomic_store(&reader->epoch, 0);
+    atomic_store(&reader->inUse, false);
+}
+
+// Announce the current epoch, then read the snapshot pointer. Both are
+// sequentially consistent, so a publisher that retires the snapshot seen here
+// either sees this reader's epoch or swapped before the pointer was read.
+const RegistrySnapshot* registryEnter(RegistryReader* reader) {
+    Registry* registry = reader->registry;
+    atomic_store(&reader->epoch, atomic_load(&registry->epoch));
+    return atomic_load(&registry->current);
+}
+
+void registryExit(RegistryReader* reader) {
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+/***
+ * Snapshot functions
+*/
+
+unsigned long snapshotVersion(const RegistrySnapshot* snapshot) {
+    return (snapshot != NULL) ? snapshot->version : 0;
+}
+
+const ClientRecord* snapshotFindClient(const RegistrySnapshot* snapshot, const char* name) {
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    int slot = (int)(hashName(name) & (unsigned long)(snapshot->indexCapacity - 1));
+    while (snapshot->index[slot] != 0) {
+        const ClientRecord* client = &snapshot->clients[snapshot->index[slot] - 1];
+        if (strcmp(client->name, name) == 0) {
+            return client;
+        }
+        slot = (slot + 1) & (snapshot->indexCapacity - 1);
+    }
+    return NULL;
+}
+
+// Readers format with the system allocator, which is safe to use from any thread
+int snapshotShowPlans(const RegistrySnapshot* snapshot, const char* clientName, OutputWriter writer, void* writerData) {
+    const ClientRecord* client = snapshotFindClient(snapshot, clientName);
+    if (client == NULL) {
+        return UNDEFINED_IDENTIFIER;
+    }
+    return writePlans(systemAllocator(), writer, writerData, client->name, client->plans, client->planCount);
+}
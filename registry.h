@@ -0,0 +1,38 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "interpreter.h"
+
+// Read-mostly plan registry. Readers look clients up in an immutable
+// snapshot without taking locks; a reload builds a new snapshot from an
+// evaluated Environment, publishes it with one atomic swap and frees the old
+// one once every reader that could still see it has left (epoch-based
+// reclamation).
+//
+// Threads: any number of reader threads, each with its own RegistryReader.
+// registryPublish, registryReclaim and freeRegistry serialize among
+// themselves, and also change AST reference counts, so ASTs shared with the
+// published environment must only be freed under the same discipline.
+
+typedef struct RegistrySnapshot RegistrySnapshot;
+typedef struct RegistryReader RegistryReader;
+typedef struct Registry Registry;
+
+// Function prototypes for the registry
+Registry* createRegistry(Allocator* allocator, int maxReaders);
+void freeRegistry(Registry* registry); // No reader may be inside the registry
+int registryPublish(Registry* registry, const Environment* env);
+int registryReclaim(Registry* registry); // Returns the number of snapshots still waiting for readers
+
+// Function prototypes for readers
+RegistryReader* registryRegisterReader(Registry* registry); // NULL when every reader slot is taken
+void registryUnregisterReader(RegistryReader* reader);
+const RegistrySnapshot* registryEnter(RegistryReader* reader);
+void registryExit(RegistryReader* reader);
+
+// Function prototypes for reading a snapshot (valid between registryEnter and registryExit)
+unsigned long snapshotVersion(const RegistrySnapshot* snapshot);
+const ClientRecord* snapshotFindClient(const RegistrySnapshot* snapshot, const char* name);
+int snapshotShowPlans(const RegistrySnapshot* snapshot, const char* clientName, OutputWriter writer, void* writerData);
+
+#endif // REGISTRY_H
@@ -0,0 +1,606 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "report.h"
+
+#define REPORT_FILE_SUFFIX ".txt"
+#define URING_ENTRIES (2 * REPORT_QUEUE_DEPTH) // A buffer has at most a write and a close queued
+#define URING_SUBMIT_BATCH 32                   // Opens queued before they are submitted
+
+// Report buffer. A buffer is free, being rendered, or owned by the backend
+// until its file has been closed.
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    char* fileName;             // Client name made safe for a file name, plus the suffix
+    size_t fileNameCapacity;
+    int fd;
+} ReportBuffer;
+
+// io_uring rings, mapped from the kernel
+typedef struct {
+    int fd;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    unsigned pending;           // Entries queued since the last submit
+    unsigned inFlight;          // Operations submitted and not yet completed
+} Uring;
+
+struct ReportWriter {
+    Allocator* allocator;
+    ReportBackend backend;
+    int directory;              // Directory file descriptor files are opened in
+    int status;                 // First error
+    ReportBuffer buffers[REPORT_QUEUE_DEPTH];
+    int freeBuffers[REPORT_QUEUE_DEPTH];
+    int freeCount;
+    ReportBuffer* current;      // Report being rendered (NULL between reports)
+
+    Uring uring;
+
+    // Thread backend: a queue of rendered buffers for the threads to write
+    pthread_t threads[REPORT_WRITER_THREADS];
+    int threadCount;
+    int queue[REPORT_QUEUE_DEPTH];
+    int queueHead;
+    int queueCount;
+    bool closing;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // Signalled when a buffer is queued or freed, or on close
+};
+
+// Operation in a completion's user data, next to the buffer index
+enum { URING_OPEN, URING_WRITE, URING_CLOSE };
+#define URING_DATA(index, op) (((uint64_t)(index) << 2) | (op))
+
+/***
+ * Helper functions
+*/
+
+static void setStatus(ReportWriter* writer, int status) {
+    if (writer->status == REPORT_OK) {
+        writer->status = status;
+    }
+}
+
+static bool reserve(Allocator* allocator, char** data, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t newCapacity = (*capacity > 0) ? *capacity : REPORT_BUFFER_SIZE;
+    while (newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    char* resized = reallocMemory(allocator, *data, *capacity, newCapacity);
+    if (resized == NULL) {
+        return false;
+    }
+    *data = resized;
+    *capacity = newCapacity;
+    return true;
+}
+
+// "<name>.txt", with '%XX' in place of bytes that are unsafe in a file name
+static bool setFileName(ReportWriter* writer, ReportBuffer* buffer, const char* name) {
+    size_t length = strlen(name);
+    if (!reserve(writer->allocator, &buffer->fileName, &buffer->fileNameCapacity,
+                 3 * length + sizeof(REPORT_FILE_SUFFIX))) {
+        return false;
+    }
+    char* out = buffer->fileName;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (c == '/' || c == '%' || c < 0x20 || c == 0x7f || (i == 0 && c == '.')) {
+            out += sprintf(out, "%%%02X", c);
+        } else {
+            *out++ = (char)c;
+        }
+    }
+    memcpy(out, REPORT_FILE_SUFFIX, sizeof(REPORT_FILE_SUFFIX));
+    return true;
+}
+
+// Write a buffer's file with plain system calls
+static int writeReportFile(int directory, ReportBuffer* buffer) {
+    int fd = openat(directory, buffer->fileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return REPORT_ERROR_IO;
+    }
+    int result = REPORT_OK;
+    for (size_t written = 0; written < buffer->length && result == REPORT_OK; ) {
+        ssize_t count = write(fd, buffer->data + written, buffer->length - written);
+        if (count < 0 && errno != EINTR) {
+            result = REPORT_ERROR_IO;
+        } else if (count > 0) {
+            written += (size_t)count;
+        }
+    }
+    if (close(fd) != 0) {
+        result = REPORT_ERROR_IO;
+    }
+    return result;
+}
+
+/***
+ * io_uring backend
+*/
+
+static int uringSetup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned submit, unsigned wait) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Whether the kernel knows the operations reports need (openat and close
+// arrived after io_uring itself)
+static bool uringSupportsReports(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, size);
+    if (probe == NULL) {
+        return false;
+    }
+    bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) >= 0;
+    const int needed[] = { IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE };
+    for (size_t i = 0; supported && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        supported = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return supported;
+}
+
+static void uringClose(Uring* uring) {
+    if (uring->cqRing != NULL && uring->cqRing != uring->sqRing) {
+        munmap(uring->cqRing, uring->cqRingSize);
+    }
+    if (uring->sqRing != NULL) {
+        munmap(uring->sqRing, uring->sqRingSize);
+    }
+    if (uring->sqes != NULL) {
+        munmap(uring->sqes, uring->sqesSize);
+    }
+    if (uring->fd >= 0) {
+        close(uring->fd);
+    }
+}
+
+static bool uringOpen(Uring* uring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(uring, 0, sizeof(Uring));
+    uring->fd = uringSetup(URING_ENTRIES, &params);
+    if (uring->fd < 0) {
+        return false; // ENOSYS, or disabled by the system
+    }
+    if (!(params.features & IORING_FEAT_NODROP) || !uringSupportsReports(uring->fd)) {
+        uringClose(uring);
+        return false;
+    }
+
+    uring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cqRingSize > uring->sqRingSize) {
+            uring->sqRingSize = uring->cqRingSize;
+        }
+        uring->cqRingSize = uring->sqRingSize;
+    }
+    void* sqRing = mmap(NULL, uring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        uring->fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        uringClose(uring);
+        return false;
+    }
+    uring->sqRing = sqRing;
+    void* cqRing = sqRing;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cqRing = mmap(NULL, uring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      uring->fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            uringClose(uring);
+            return false;
+        }
+    }
+    uring->cqRing = cqRing;
+    uring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, uring->sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        uringClose(uring);
+        return false;
+    }
+    uring->sqes = sqes;
+
+    char* sq = sqRing;
+    char* cq = cqRing;
+    uring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    uring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    uring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    uring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    uring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    uring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    uring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+// Next free submission entry. There is always one: every buffer has at most
+// two entries queued, and the ring has room for two per buffer.
+static struct io_uring_sqe* uringEntry(Uring* uring, int op, uint64_t userData) {
+    unsigned tail = *uring->sqTail;
+    unsigned index = tail & *uring->sqMask;
+    struct io_uring_sqe* sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)op;
+    sqe->user_data = userData;
+    uring->sqArray[index] = index;
+    __atomic_store_n(uring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    uring->pending++;
+    return sqe;
+}
+
+// Submit the queued entries, waiting for at least wait completions
+static int uringSubmit(Uring* uring, unsigned wait) {
+    while (uring->pending > 0 || wait > 0) {
+        int submitted = uringEnter(uring->fd, uring->pending, wait);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            return REPORT_ERROR_IO;
+        }
+        uring->pending -= (unsigned)submitted;
+        uring->inFlight += (unsigned)submitted;
+        if (uring->pending == 0) {
+            break;
+        }
+    }
+    return REPORT_OK;
+}
+
+static void queueOpen(ReportWriter* writer, int index) {
+    struct io_uring_sqe* sqe = uringEntry(&writer->uring, IORING_OP_OPENAT, URING_DATA(index, URING_OPEN));
+    sqe->fd = writer->directory;
+    sqe->addr = (uint64_t)(uintptr_t)writer->buffers[index].fileName;
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    sqe->len = 0644;
+}
+
+// Write and close, linked so the close waits for the write
+static void queueWriteAndClose(ReportWriter* writer, int index) {
+    ReportBuffer* buffer = &writer->buffers[index];
+    struct io_uring_sqe* sqe = uringEntry(&writer->uring, IORING_OP_WRITE, URING_DATA(index, URING_WRITE));
+    sqe->fd = buffer->fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer->data;
+    sqe->len = (uint32_t)buffer->length;
+    sqe->off = 0;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe = uringEntry(&writer->uring, IORING_OP_CLOSE, URING_DATA(index, URING_CLOSE));
+    sqe->fd = buffer->fd;
+}
+
+static void releaseBuffer(ReportWriter* writer, int index) {
+    writer->buffers[index].fd = -1;
+    writer->freeBuffers[writer->freeCount++] = index;
+}
+
+static void uringComplete(ReportWriter* writer, int index, int op, int result) {
+    ReportBuffer* buffer = &writer->buffers[index];
+    switch (op) {
+        case URING_OPEN:
+            if (result < 0) {
+                setStatus(writer, REPORT_ERROR_IO);
+                releaseBuffer(writer, index);
+            } else {
+                buffer->fd = result;
+                queueWriteAndClose(writer, index);
+            }
+            break;
+
+        case URING_WRITE:
+            // A short write breaks the link, so the close is cancelled and the
+            // file is still open to finish the write here
+            if (result < 0) {
+                setStatus(writer, REPORT_ERROR_IO);
+            } else if ((size_t)result < buffer->length) {
+                for (size_t written = (size_t)result; written < buffer->length; ) {
+                    ssize_t count = pwrite(buffer->fd, buffer->data + written, buffer->length - written, (off_t)written);
+                    if (count <= 0 && errno != EINTR) {
+                        setStatus(writer, REPORT_ERROR_IO);
+                        break;
+                    }
+                    written += (count > 0) ? (size_t)count : 0;
+                }
+            }
+            break;
+
+        case URING_CLOSE:
+            if (result == -ECANCELED) {
+                if (close(buffer->fd) != 0) {
+                    setStatus(writer, REPORT_ERROR_IO);
+                }
+            } else if (result < 0) {
+                setStatus(writer, REPORT_ERROR_IO);
+            }
+            releaseBuffer(writer, index);
+            break;
+    }
+}
+
+// Handle every completion that has arrived
+static void uringReap(ReportWriter* writer) {
+    Uring* uring = &writer->uring;
+    unsigned head = *uring->cqHead;
+    unsigned tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &uring->cqes[head & *uring->cqMask];
+        uint64_t data = cqe->user_data;
+        int result = cqe->res;
+        head++;
+        __atomic_store_n(uring->cqHead, head, __ATOMIC_RELEASE);
+        uring->inFlight--;
+        uringComplete(writer, (int)(data >> 2), (int)(data & 3), result);
+        tail = __atomic_load_n(uring->cqTail, __ATOMIC_ACQUIRE);
+    }
+}
+
+// Submit what is queued; wait for completions if a free buffer is wanted
+// and there is none, or until everything is done
+static int uringProgress(ReportWriter* writer, bool drain) {
+    Uring* uring = &writer->uring;
+    uringReap(writer);
+    while (uring->pending > 0 || (drain ? uring->inFlight > 0 : writer->freeCount == 0)) {
+        unsigned wait = (drain || writer->freeCount == 0) && uring->inFlight + uring->pending > 0 ? 1 : 0;
+        if (uringSubmit(uring, wait) != REPORT_OK) {
+            return REPORT_ERROR_IO;
+        }
+        uringReap(writer);
+        if (wait == 0 && uring->pending == 0) {
+            break;
+        }
+    }
+    return REPORT_OK;
+}
+
+/***
+ * Thread backend
+*/
+
+static void* reportThread(void* userData) {
+    ReportWriter* writer = userData;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->queueCount == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+        if (writer->queueCount == 0) {
+            break; // Closing, and nothing left to write
+        }
+        int index = writer->queue[writer->queueHead];
+        writer->queueHead = (writer->queueHead + 1) % REPORT_QUEUE_DEPTH;
+        writer->queueCount--;
+        pthread_mutex_unlock(&writer->lock);
+
+        int result = writeReportFile(writer->directory, &writer->buffers[index]);
+
+        pthread_mutex_lock(&writer->lock);
+        if (result != REPORT_OK) {
+            setStatus(writer, result);
+        }
+        writer->freeBuffers[writer->freeCount++] = index;
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+static bool startThreads(ReportWriter* writer) {
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+    for (int i = 0; i < REPORT_WRITER_THREADS; i++) {
+        if (pthread_create(&writer->threads[i], NULL, reportThread, writer) != 0) {
+            break;
+        }
+        writer->threadCount++;
+    }
+    return writer->threadCount > 0;
+}
+
+static void stopThreads(ReportWriter* writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = true;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    for (int i = 0; i < writer->threadCount; i++) {
+        pthread_join(writer->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->changed);
+}
+
+/***
+ * Report writer functions
+*/
+
+int openReportWriter(const char* directory, ReportBackend backend, Allocator* allocator, ReportWriter** result) {
+    *result = NULL;
+    ReportWriter* writer = allocMemory(allocator, sizeof(ReportWriter));
+    if (writer == NULL) {
+        return REPORT_ERROR_NO_MEMORY;
+    }
+    memset(writer, 0, sizeof(ReportWriter));
+    writer->allocator = allocator;
+    writer->uring.fd = -1;
+    for (int i = 0; i < REPORT_QUEUE_DEPTH; i++) {
+        writer->buffers[i].fd = -1;
+        writer->freeBuffers[i] = REPORT_QUEUE_DEPTH - 1 - i;
+    }
+    writer->freeCount = REPORT_QUEUE_DEPTH;
+
+    writer->directory = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (writer->directory < 0) {
+        releaseMemory(allocator, writer, sizeof(ReportWriter));
+        return REPORT_ERROR_DIRECTORY;
+    }
+
+    if (backend != REPORT_BACKEND_THREADS && uringOpen(&writer->uring)) {
+        writer->backend = REPORT_BACKEND_URING;
+    } else if (backend != REPORT_BACKEND_URING && startThreads(writer)) {
+        writer->backend = REPORT_BACKEND_THREADS;
+    } else {
+        close(writer->directory);
+        releaseMemory(allocator, writer, sizeof(ReportWriter));
+        return (backend == REPORT_BACKEND_URING) ? REPORT_ERROR_BACKEND : REPORT_ERROR_NO_MEMORY;
+    }
+    *result = writer;
+    return REPORT_OK;
+}
+
+int closeReportWriter(ReportWriter* writer) {
+    if (writer == NULL) {
+        return REPORT_OK;
+    }
+    if (writer->current != NULL) {
+        endReport(writer); // Unfinished report: queue it anyway
+    }
+    if (writer->backend == REPORT_BACKEND_URING) {
+        if (uringProgress(writer, true) != REPORT_OK) {
+            setStatus(writer, REPORT_ERROR_IO);
+        }
+        uringClose(&writer->uring);
+    } else {
+        stopThreads(writer);
+    }
+
+    int status = writer->status;
+    for (int i = 0; i < REPORT_QUEUE_DEPTH; i++) {
+        releaseMemory(writer->allocator, writer->buffers[i].data, writer->buffers[i].capacity);
+        releaseMemory(writer->allocator, writer->buffers[i].fileName, writer->buffers[i].fileNameCapacity);
+    }
+    close(writer->directory);
+    releaseMemory(writer->allocator, writer, sizeof(ReportWriter));
+    return status;
+}
+
+// Take a free buffer, waiting for a file to be written if there is none
+int beginReport(ReportWriter* writer, const char* clientName) {
+    if (writer->current != NULL) {
+        endReport(writer);
+    }
+    if (writer->backend == REPORT_BACKEND_URING) {
+        if (writer->freeCount == 0 && uringProgress(writer, false) != REPORT_OK) {
+            setStatus(writer, REPORT_ERROR_IO);
+            return writer->status;
+        }
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->freeCount == 0) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+    }
+    // Stop at the first failed file; closeReportWriter returns the error too
+    int status = writer->status;
+    int index = (status == REPORT_OK) ? writer->freeBuffers[--writer->freeCount] : -1;
+    if (writer->backend == REPORT_BACKEND_THREADS) {
+        pthread_mutex_unlock(&writer->lock);
+    }
+    if (status != REPORT_OK) {
+        return status;
+    }
+
+    ReportBuffer* buffer = &writer->buffers[index];
+    buffer->length = 0;
+    if (!setFileName(writer, buffer, clientName)) {
+        writer->status = REPORT_ERROR_NO_MEMORY;
+        return writer->status;
+    }
+    writer->current = buffer;
+    return REPORT_OK;
+}
+
+int writeReportOutput(void* userData, const char* text, size_t length) {
+    ReportWriter* writer = userData;
+    ReportBuffer* buffer = writer->current;
+    if (buffer == NULL) {
+        return REPORT_ERROR_IO;
+    }
+    if (!reserve(writer->allocator, &buffer->data, &buffer->capacity, buffer->length + length)) {
+        return REPORT_ERROR_NO_MEMORY;
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    return REPORT_OK;
+}
+
+// Hand the rendered report to the backend
+int endReport(ReportWriter* writer) {
+    ReportBuffer* buffer = writer->current;
+    if (buffer == NULL) {
+        return REPORT_ERROR_IO;
+    }
+    writer->current = NULL;
+    int index = (int)(buffer - writer->buffers);
+    if (writer->backend == REPORT_BACKEND_URING) {
+        if (buffer->length > UINT32_MAX) {
+            // Longer than one write can take
+            int result = writeReportFile(writer->directory, buffer);
+            releaseBuffer(writer, index);
+            return result;
+        }
+        queueOpen(writer, index);
+        return (writer->uring.pending >= URING_SUBMIT_BATCH) ? uringProgress(writer, false) : REPORT_OK;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->queue[(writer->queueHead + writer->queueCount) % REPORT_QUEUE_DEPTH] = index;
+    writer->queueCount++;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    return REPORT_OK;
+}
+
+ReportBackend reportBackend(const ReportWriter* writer) {
+    return writer->backend;
+}
+
+const char* reportBackendName(ReportBackend backend) {
+    switch (backend) {
+        case REPORT_BACKEND_URING: return "io_uring";
+        case REPORT_BACKEND_THREADS: return "threads";
+        default: return "auto";
+    }
+}
+
+const char* reportErrorString(int status) {
+    switch (status) {
+        case REPORT_OK: return "no error";
+        case REPORT_ERROR_IO: return "I/O error";
+        case REPORT_ERROR_NO_MEMORY: return "out of memory";
+        case REPORT_ERROR_DIRECTORY: return "cannot open the output directory";
+        case REPORT_ERROR_BACKEND: return "io_uring is not available";
+        default: return "unknown error";
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stddef.h>
+#include "alloc.h"
+
+// Per-client report files: one "<client>.txt" in an output directory for each
+// client. A report is rendered into a buffer from a fixed pool and handed to a
+// backend that opens, writes and closes the file while the next reports are
+// rendered. With io_uring the open, write and close of many files go to the
+// kernel in batches; where io_uring is unavailable a small pool of threads
+// makes the same calls. At most REPORT_QUEUE_DEPTH reports are in flight, and
+// rendering waits for a buffer when all of them are.
+
+#define REPORT_QUEUE_DEPTH 256      // Report buffers, so files being written at once
+#define REPORT_BUFFER_SIZE 4096     // Initial size of a report buffer (grown for long reports)
+#define REPORT_WRITER_THREADS 8     // Threads of the fallback backend
+
+// Report status codes
+#define REPORT_OK 0
+#define REPORT_ERROR_IO -1
+#define REPORT_ERROR_NO_MEMORY -2
+#define REPORT_ERROR_DIRECTORY -3   // The output directory could not be opened
+#define REPORT_ERROR_BACKEND -4     // The requested backend is not available
+
+typedef enum {
+    REPORT_BACKEND_AUTO,            // io_uring if the kernel supports it, otherwise threads
+    REPORT_BACKEND_URING,
+    REPORT_BACKEND_THREADS
+} ReportBackend;
+
+typedef struct ReportWriter ReportWriter;
+
+// Function prototypes for opening and closing a report writer. closeReportWriter
+// waits for every file to be written and returns the first error, if any.
+int openReportWriter(const char* directory, ReportBackend backend, Allocator* allocator, ReportWriter** writer);
+int closeReportWriter(ReportWriter* writer);
+
+// Function prototypes for writing one report: beginReport, then any number of
+// writeReportOutput calls (an OutputWriter), then endReport to queue the file
+int beginReport(ReportWriter* writer, const char* clientName);
+int writeReportOutput(void* userData, const char* text, size_t length);
+int endReport(ReportWriter* writer);
+
+ReportBackend reportBackend(const ReportWriter* writer); // The backend in use (never AUTO)
+const char* reportBackendName(ReportBackend backend);
+const char* reportErrorString(int status);
+
+#endif // REPORT_H
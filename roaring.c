@@ -0,0 +1,474 @@
+#include <string.h>
+#include "roaring.h"
+
+#define BITMAP_WORDS 1024           // 65536 bits
+#define BITMAP_BYTES (BITMAP_WORDS * sizeof(uint64_t))
+#define INITIAL_ARRAY_CAPACITY 4
+#define INITIAL_CONTAINER_CAPACITY 4
+
+// Values sharing their high 16 bits. An array container keeps the low bits
+// sorted; a dense container has one bit per possible low value.
+struct RoaringContainer {
+    uint16_t key;
+    bool dense;
+    uint32_t cardinality;
+    uint32_t capacity;              // Array capacity in values (unused when dense)
+    uint16_t* values;               // Array container
+    uint64_t* words;                // Dense container
+};
+
+/***
+ * Container functions
+*/
+
+static void releaseContainer(Allocator* allocator, RoaringContainer* container) {
+    if (container->dense) {
+        releaseMemory(allocator, container->words, BITMAP_BYTES);
+    } else {
+        releaseMemory(allocator, container->values, container->capacity * sizeof(uint16_t));
+    }
+}
+
+static bool newArray(Allocator* allocator, RoaringContainer* container, uint16_t key, uint32_t capacity) {
+    memset(container, 0, sizeof(RoaringContainer));
+    container->key = key;
+    container->capacity = (capacity > 0) ? capacity : 1;
+    container->values = allocMemory(allocator, container->capacity * sizeof(uint16_t));
+    return container->values != NULL;
+}
+
+static bool newDense(Allocator* allocator, RoaringContainer* container, uint16_t key) {
+    memset(container, 0, sizeof(RoaringContainer));
+    container->key = key;
+    container->dense = true;
+    container->words = allocMemory(allocator, BITMAP_BYTES);
+    if (container->words == NULL) {
+        return false;
+    }
+    memset(container->words, 0, BITMAP_BYTES);
+    return true;
+}
+
+static uint32_t countWords(const uint64_t* words) {
+    uint32_t count = 0;
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        count += (uint32_t)__builtin_popcountll(words[i]);
+    }
+    return count;
+}
+
+static bool toDense(Allocator* allocator, RoaringContainer* container) {
+    RoaringContainer dense;
+    if (!newDense(allocator, &dense, container->key)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < container->cardinality; i++) {
+        uint16_t low = container->values[i];
+        dense.words[low >> 6] |= 1ULL << (low & 63);
+    }
+    dense.cardinality = container->cardinality;
+    releaseContainer(allocator, container);
+    *container = dense;
+    return true;
+}
+
+// Dense containers that have shrunk to the array limit become arrays again
+static bool toArrayIfSmall(Allocator* allocator, RoaringContainer* container) {
+    if (!container->dense || container->cardinality > ROARING_ARRAY_LIMIT) {
+        return true;
+    }
+    RoaringContainer array;
+    if (!newArray(allocator, &array, container->key, container->cardinality)) {
+        return false;
+    }
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        uint64_t word = container->words[i];
+        while (word != 0) {
+            array.values[array.cardinality++] = (uint16_t)(i * 64 + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+    releaseContainer(allocator, container);
+    *container = array;
+    return true;
+}
+
+static bool copyContainer(Allocator* allocator, const RoaringContainer* source, RoaringContainer* copy) {
+    if (source->dense) {
+        if (!newDense(allocator, copy, source->key)) {
+            return false;
+        }
+        memcpy(copy->words, source->words, BITMAP_BYTES);
+    } else {
+        if (!newArray(allocator, copy, source->key, source->cardinality)) {
+            return false;
+        }
+        memcpy(copy->values, source->values, source->cardinality * sizeof(uint16_t));
+    }
+    copy->cardinality = source->cardinality;
+    return true;
+}
+
+// First position in values[0, count) not below low
+static uint32_t lowerBound(const uint16_t* values, uint32_t count, uint16_t low) {
+    uint32_t begin = 0;
+    while (begin < count) {
+        uint32_t middle = begin + (count - begin) / 2;
+        if (values[middle] < low) {
+            begin = middle + 1;
+        } else {
+            count = middle;
+        }
+    }
+    return begin;
+}
+
+static bool containerAdd(Allocator* allocator, RoaringContainer* container, uint16_t low) {
+    if (container->dense) {
+        uint64_t bit = 1ULL << (low & 63);
+        if (!(container->words[low >> 6] & bit)) {
+            container->words[low >> 6] |= bit;
+            container->cardinality++;
+        }
+        return true;
+    }
+
+    // Appending is the common case: client IDs are handed out in order
+    uint32_t position = container->cardinality;
+    if (position > 0 && container->values[position - 1] >= low) {
+        position = lowerBound(container->values, container->cardinality, low);
+        if (container->values[position] == low) {
+            return true;
+        }
+    }
+    if (container->cardinality == ROARING_ARRAY_LIMIT) {
+        return toDense(allocator, container) && containerAdd(allocator, container, low);
+    }
+    if (container->cardinality == container->capacity) {
+        uint32_t newCapacity = container->capacity * 2;
+        if (newCapacity > ROARING_ARRAY_LIMIT) {
+            newCapacity = ROARING_ARRAY_LIMIT;
+        }
+        uint16_t* resized = reallocMemory(allocator, container->values,
+            container->capacity * sizeof(uint16_t), newCapacity * sizeof(uint16_t));
+        if (resized == NULL) {
+            return false;
+        }
+        container->values = resized;
+        container->capacity = newCapacity;
+    }
+    memmove(container->values + position + 1, container->values + position,
+            (container->cardinality - position) * sizeof(uint16_t));
+    container->values[position] = low;
+    container->cardinality++;
+    return true;
+}
+
+static bool containerContains(const RoaringContainer* container, uint16_t low) {
+    if (container->dense) {
+        return (container->words[low >> 6] >> (low & 63)) & 1;
+    }
+    uint32_t position = lowerBound(container->values, container->cardinality, low);
+    return position < container->cardinality && container->values[position] == low;
+}
+
+// Intersection of two containers with the same key; empty results have cardinality 0
+static bool andContainers(Allocator* allocator, const RoaringContainer* a, const RoaringContainer* b,
+                          RoaringContainer* result) {
+    if (a->dense && b->dense) {
+        if (!newDense(allocator, result, a->key)) {
+            return false;
+        }
+        for (int i = 0; i < BITMAP_WORDS; i++) {
+            result->words[i] = a->words[i] & b->words[i];
+        }
+        result->cardinality = countWords(result->words);
+        return toArrayIfSmall(allocator, result);
+    }
+    if (a->dense || b->dense) {
+        // Probe the bitmap with each array value
+        const RoaringContainer* array = a->dense ? b : a;
+        const RoaringContainer* dense = a->dense ? a : b;
+        if (!newArray(allocator, result, a->key, array->cardinality)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < array->cardinality; i++) {
+            if (containerContains(dense, array->values[i])) {
+                result->values[result->cardinality++] = array->values[i];
+            }
+        }
+        return true;
+    }
+
+    // Merge two arrays, skipping through the longer one by binary search
+    const RoaringContainer* small = (a->cardinality <= b->cardinality) ? a : b;
+    const RoaringContainer* large = (small == a) ? b : a;
+    if (!newArray(allocator, result, a->key, small->cardinality)) {
+        return false;
+    }
+    uint32_t j = 0;
+    for (uint32_t i = 0; i < small->cardinality && j < large->cardinality; i++) {
+        uint16_t value = small->values[i];
+        if (large->values[j] < value) {
+            j += lowerBound(large->values + j, large->cardinality - j, value);
+        }
+        if (j < large->cardinality && large->values[j] == value) {
+            result->values[result->cardinality++] = value;
+            j++;
+        }
+    }
+    return true;
+}
+
+// Union of two containers with the same key
+static bool orContainers(Allocator* allocator, const RoaringContainer* a, const RoaringContainer* b,
+                         RoaringContainer* result) {
+    if (!a->dense && !b->dense && a->cardinality + b->cardinality <= ROARING_ARRAY_LIMIT) {
+        if (!newArray(allocator, result, a->key, a->cardinality + b->cardinality)) {
+            return false;
+        }
+        uint32_t i = 0;
+        uint32_t j = 0;
+        while (i < a->cardinality || j < b->cardinality) {
+            uint16_t value;
+            if (j == b->cardinality || (i < a->cardinality && a->values[i] < b->values[j])) {
+                value = a->values[i++];
+            } else if (i == a->cardinality || b->values[j] < a->values[i]) {
+                value = b->values[j++];
+            } else {
+                value = a->values[i++];
+                j++;
+            }
+            result->values[result->cardinality++] = value;
+        }
+        return true;
+    }
+
+    if (!newDense(allocator, result, a->key)) {
+        return false;
+    }
+    const RoaringContainer* sides[2] = { a, b };
+    for (int side = 0; side < 2; side++) {
+        const RoaringContainer* container = sides[side];
+        if (container->dense) {
+            for (int i = 0; i < BITMAP_WORDS; i++) {
+                result->words[i] |= container->words[i];
+            }
+        } else {
+            for (uint32_t i = 0; i < container->cardinality; i++) {
+                uint16_t low = container->values[i];
+                result->words[low >> 6] |= 1ULL << (low & 63);
+            }
+        }
+    }
+    result->cardinality = countWords(result->words);
+    return toArrayIfSmall(allocator, result);
+}
+
+/***
+ * Bitmap helpers
+*/
+
+// Position of the container for key, or -(insertion point) - 1
+static int findContainer(const RoaringBitmap* bitmap, uint16_t key) {
+    if (bitmap->count > 0 && bitmap->containers[bitmap->count - 1].key == key) {
+        return bitmap->count - 1;
+    }
+    int begin = 0;
+    int end = bitmap->count;
+    while (begin < end) {
+        int middle = begin + (end - begin) / 2;
+        if (bitmap->containers[middle].key < key) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    if (begin < bitmap->count && bitmap->containers[begin].key == key) {
+        return begin;
+    }
+    return -begin - 1;
+}
+
+static bool reserveContainers(RoaringBitmap* bitmap, int needed) {
+    if (needed <= bitmap->capacity) {
+        return true;
+    }
+    int newCapacity = (bitmap->capacity == 0) ? INITIAL_CONTAINER_CAPACITY : bitmap->capacity * 2;
+    while (newCapacity < needed) {
+        newCapacity *= 2;
+    }
+    RoaringContainer* resized = reallocMemory(bitmap->allocator, bitmap->containers,
+        bitmap->capacity * sizeof(RoaringContainer), newCapacity * sizeof(RoaringContainer));
+    if (resized == NULL) {
+        return false;
+    }
+    bitmap->containers = resized;
+    bitmap->capacity = newCapacity;
+    return true;
+}
+
+// Append a container built for the result; empty ones are dropped
+static bool appendContainer(RoaringBitmap* bitmap, RoaringContainer* container) {
+    if (container->cardinality == 0) {
+        releaseContainer(bitmap->allocator, container);
+        return true;
+    }
+    if (!reserveContainers(bitmap, bitmap->count + 1)) {
+        releaseContainer(bitmap->allocator, container);
+        return false;
+    }
+    bitmap->containers[bitmap->count++] = *container;
+    return true;
+}
+
+// Move a finished result into place (so the result may also be an input)
+static bool finishResult(RoaringBitmap* built, RoaringBitmap* result, bool ok) {
+    if (!ok) {
+        roaringClear(built);
+        return false;
+    }
+    roaringClear(result);
+    *result = *built;
+    return true;
+}
+
+/***
+ * Bitmap functions
+*/
+
+void roaringInit(RoaringBitmap* bitmap, Allocator* allocator) {
+    memset(bitmap, 0, sizeof(RoaringBitmap));
+    bitmap->allocator = allocator;
+}
+
+void roaringClear(RoaringBitmap* bitmap) {
+    for (int i = 0; i < bitmap->count; i++) {
+        releaseContainer(bitmap->allocator, &bitmap->containers[i]);
+    }
+    releaseMemory(bitmap->allocator, bitmap->containers, bitmap->capacity * sizeof(RoaringContainer));
+    roaringInit(bitmap, bitmap->allocator);
+}
+
+bool roaringAdd(RoaringBitmap* bitmap, uint32_t value) {
+    uint16_t key = (uint16_t)(value >> 16);
+    int position = findContainer(bitmap, key);
+    if (position < 0) {
+        position = -position - 1;
+        if (!reserveContainers(bitmap, bitmap->count + 1)) {
+            return false;
+        }
+        RoaringContainer container;
+        if (!newArray(bitmap->allocator, &container, key, INITIAL_ARRAY_CAPACITY)) {
+            return false;
+        }
+        memmove(bitmap->containers + position + 1, bitmap->containers + position,
+                (bitmap->count - position) * sizeof(RoaringContainer));
+        bitmap->containers[position] = container;
+        bitmap->count++;
+    }
+    return containerAdd(bitmap->allocator, &bitmap->containers[position], (uint16_t)value);
+}
+
+bool roaringAnd(const RoaringBitmap* a, const RoaringBitmap* b, RoaringBitmap* result) {
+    RoaringBitmap built;
+    roaringInit(&built, result->allocator);
+    bool ok = true;
+    int i = 0;
+    int j = 0;
+    while (ok && i < a->count && j < b->count) {
+        const RoaringContainer* left = &a->containers[i];
+        const RoaringContainer* right = &b->containers[j];
+        if (left->key < right->key) {
+            i++;
+        } else if (right->key < left->key) {
+            j++;
+        } else {
+            RoaringContainer container;
+            ok = andContainers(built.allocator, left, right, &container) && appendContainer(&built, &container);
+            i++;
+            j++;
+        }
+    }
+    return finishResult(&built, result, ok);
+}
+
+bool roaringOr(const RoaringBitmap* a, const RoaringBitmap* b, RoaringBitmap* result) {
+    RoaringBitmap built;
+    roaringInit(&built, result->allocator);
+    bool ok = true;
+    int i = 0;
+    int j = 0;
+    while (ok && (i < a->count || j < b->count)) {
+        RoaringContainer container;
+        if (j == b->count || (i < a->count && a->containers[i].key < b->containers[j].key)) {
+            ok = copyContainer(built.allocator, &a->containers[i++], &container);
+        } else if (i == a->count || b->containers[j].key < a->containers[i].key) {
+            ok = copyContainer(built.allocator, &b->containers[j++], &container);
+        } else {
+            ok = orContainers(built.allocator, &a->containers[i++], &b->containers[j++], &container);
+        }
+        ok = ok && appendContainer(&built, &container);
+    }
+    return finishResult(&built, result, ok);
+}
+
+bool roaringCopy(const RoaringBitmap* source, RoaringBitmap* result) {
+    RoaringBitmap built;
+    roaringInit(&built, result->allocator);
+    bool ok = reserveContainers(&built, source->count);
+    for (int i = 0; ok && i < source->count; i++) {
+        RoaringContainer container;
+        ok = copyContainer(built.allocator, &source->containers[i], &container) && appendContainer(&built, &container);
+    }
+    return finishResult(&built, result, ok);
+}
+
+bool roaringContains(const RoaringBitmap* bitmap, uint32_t value) {
+    int position = findContainer(bitmap, (uint16_t)(value >> 16));
+    return position >= 0 && containerContains(&bitmap->containers[position], (uint16_t)value);
+}
+
+uint64_t roaringCardinality(const RoaringBitmap* bitmap) {
+    uint64_t count = 0;
+    for (int i = 0; i < bitmap->count; i++) {
+        count += bitmap->containers[i].cardinality;
+    }
+    return count;
+}
+
+int roaringForEach(const RoaringBitmap* bitmap, RoaringVisitor visit, void* userData) {
+    for (int i = 0; i < bitmap->count; i++) {
+        const RoaringContainer* container = &bitmap->containers[i];
+        uint32_t high = (uint32_t)container->key << 16;
+        if (container->dense) {
+            for (int w = 0; w < BITMAP_WORDS; w++) {
+                uint64_t word = container->words[w];
+                while (word != 0) {
+                    int result = visit(userData, high | (uint32_t)(w * 64 + __builtin_ctzll(word)));
+                    if (result != 0) {
+                        return result;
+                    }
+                    word &= word - 1;
+                }
+            }
+        } else {
+            for (uint32_t v = 0; v < container->cardinality; v++) {
+                int result = visit(userData, high | container->values[v]);
+                if (result != 0) {
+                    return result;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+size_t roaringMemoryUsage(const RoaringBitmap* bitmap) {
+    size_t bytes = bitmap->capacity * sizeof(RoaringContainer);
+    for (int i = 0; i < bitmap->count; i++) {
+        const RoaringContainer* container = &bitmap->containers[i];
+        bytes += container->dense ? BITMAP_BYTES : container->capacity * sizeof(uint16_t);
+    }
+    return bytes;
+}
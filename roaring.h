@@ -0,0 +1,46 @@
+#ifndef ROARING_H
+#define ROARING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "alloc.h"
+
+// Compressed set of 32-bit integers in the Roaring layout. Values are split
+// by their high 16 bits into containers, kept sorted by that key. A container
+// holds the low 16 bits either as a sorted array (up to ROARING_ARRAY_LIMIT
+// values) or as a 65536-bit bitmap, whichever is smaller. Sparse and dense
+// ranges both stay compact, and AND/OR work a container at a time: merging
+// arrays, probing a bitmap with an array, or combining bitmaps a word at a time.
+
+#define ROARING_ARRAY_LIMIT 4096    // Most values in an array container (8 KB, the size of a bitmap)
+
+typedef struct RoaringContainer RoaringContainer;
+
+typedef struct {
+    Allocator* allocator;
+    RoaringContainer* containers;   // Sorted by key
+    int count;
+    int capacity;
+} RoaringBitmap;
+
+// Called once per value, in ascending order; a non-zero return stops the walk
+// and is returned by roaringForEach
+typedef int (*RoaringVisitor)(void* userData, uint32_t value);
+
+// Function prototypes for creating and changing bitmaps
+void roaringInit(RoaringBitmap* bitmap, Allocator* allocator);
+void roaringClear(RoaringBitmap* bitmap); // Releases the containers; the bitmap can be used again
+bool roaringAdd(RoaringBitmap* bitmap, uint32_t value);
+
+// Function prototypes for combining bitmaps; result must be initialized and is replaced
+bool roaringAnd(const RoaringBitmap* a, const RoaringBitmap* b, RoaringBitmap* result);
+bool roaringOr(const RoaringBitmap* a, const RoaringBitmap* b, RoaringBitmap* result);
+bool roaringCopy(const RoaringBitmap* source, RoaringBitmap* result);
+
+// Function prototypes for reading bitmaps
+bool roaringContains(const RoaringBitmap* bitmap, uint32_t value);
+uint64_t roaringCardinality(const RoaringBitmap* bitmap);
+int roaringForEach(const RoaringBitmap* bitmap, RoaringVisitor visit, void* userData);
+size_t roaringMemoryUsage(const RoaringBitmap* bitmap);
+
+#endif // ROARING_H
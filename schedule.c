@@ -0,0 +1,198 @@
+#include <string.h>
+#include "schedule.h"
+#include "semantic.h"
+
+#define INITIAL_ENTRY_CAPACITY 1024 // Hash table slots (a power of two)
+
+// A client's day (exercise NULL), or an exercise on it. A client's own
+// entry (day and exercise NULL) marks the last group assignment joined for it.
+typedef struct {
+    const char* client;
+    const char* day;
+    const char* exercise;
+    unsigned long hash;         // 0 for an empty slot
+    int assignment;             // Position of the assignment that first gave the exercise (last, for a client)
+    long sets;                  // Day totals
+    long rest;
+} ScheduleEntry;
+
+typedef struct {
+    Allocator* allocator;
+    ScheduleEntry* entries;
+    int capacity;
+    int count;
+} ScheduleTable;
+
+/***
+ * Helper functions
+*/
+
+static unsigned long hashName(unsigned long hash, const char* name) {
+    for (const char* c = (name != NULL) ? name : ""; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211UL;
+    }
+    hash ^= (name != NULL) ? 0xfe : 0xff; // Separator; also tells "" from NULL
+    hash *= 1099511628211UL;
+    return hash;
+}
+
+static int sameName(const char* a, const char* b) {
+    return a == b || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+static ScheduleEntry* allocEntries(Allocator* allocator, int capacity) {
+    ScheduleEntry* entries = allocMemory(allocator, capacity * sizeof(ScheduleEntry));
+    if (entries != NULL) {
+        memset(entries, 0, capacity * sizeof(ScheduleEntry));
+    }
+    return entries;
+}
+
+static int growTable(ScheduleTable* table) {
+    int newCapacity = table->capacity * 2;
+    ScheduleEntry* entries = allocEntries(table->allocator, newCapacity);
+    if (entries == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->entries[i].hash != 0) {
+            int slot = (int)(table->entries[i].hash & (unsigned long)(newCapacity - 1));
+            while (entries[slot].hash != 0) {
+                slot = (slot + 1) & (newCapacity - 1);
+            }
+            entries[slot] = table->entries[i];
+        }
+    }
+    releaseMemory(table->allocator, table->entries, table->capacity * sizeof(ScheduleEntry));
+    table->entries = entries;
+    table->capacity = newCapacity;
+    return 1;
+}
+
+// Find or add the entry for a key; hash is the key's hash (never 0). NULL if out of memory.
+static ScheduleEntry* findEntry(ScheduleTable* table, const char* client, const char* day,
+                                const char* exercise, unsigned long hash, int assignment) {
+    if ((table->count + 1) * 2 > table->capacity && !growTable(table)) {
+        return NULL;
+    }
+    int slot = (int)(hash & (unsigned long)(table->capacity - 1));
+    while (table->entries[slot].hash != 0) {
+        ScheduleEntry* entry = &table->entries[slot];
+        if (entry->hash == hash && sameName(entry->exercise, exercise) &&
+            sameName(entry->day, day) && sameName(entry->client, client)) {
+            return entry;
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    ScheduleEntry* entry = &table->entries[slot];
+    entry->client = client;
+    entry->day = day;
+    entry->exercise = exercise;
+    entry->hash = hash;
+    entry->assignment = assignment;
+    table->count++;
+    return entry;
+}
+
+static int overLimit(long total, int limit) {
+    return limit > 0 && total > limit;
+}
+
+// Add the days of one assignment of plan to client to the table
+static int joinAssignment(ScheduleTable* table, const char* client, const ASTNode* plan, int position,
+                          const ScheduleLimits* limits) {
+    unsigned long clientHash = hashName(1469598103934665603UL, client);
+    for (int i = 0; i < plan->childrenCount; i++) {
+        const ASTNode* day = plan->children[i];
+        if (day->type != NODE_DAY) {
+            continue;
+        }
+        unsigned long dayHash = hashName(clientHash, day->data.day.name);
+        long sets = 0;
+        long rest = 0;
+        for (int j = 0; j < day->childrenCount; j++) {
+            const ASTNode* exercise = day->children[j];
+            if (exercise->type != NODE_EXERCISE) {
+                continue;
+            }
+            sets += exercise->data.exercise.sets;
+            rest += exercise->data.exercise.rest;
+            if (limits->conflicts) {
+                const char* name = exercise->data.exercise.name;
+                ScheduleEntry* entry = findEntry(table, client, day->data.day.name, name, hashName(dayHash, name) | 1, position);
+                if (entry == NULL) {
+                    return RUNTIME_ERROR;
+                }
+                // The same exercise twice within one assignment is that plan's own business
+                if (entry->assignment != position) {
+                    return CONFLICTING_ASSIGNMENT;
+                }
+            }
+        }
+
+        ScheduleEntry* totals = findEntry(table, client, day->data.day.name, NULL, hashName(dayHash, NULL) | 1, position);
+        if (totals == NULL) {
+            return RUNTIME_ERROR;
+        }
+        totals->sets += sets;
+        totals->rest += rest;
+        if (overLimit(totals->sets, limits->maxDailySets) || overLimit(totals->rest, limits->maxDailyRest)) {
+            return DAILY_LIMIT_EXCEEDED;
+        }
+    }
+    return SEMANTIC_OK;
+}
+
+// A group assignment is joined for each member, once even if the group lists it twice
+static int joinGroupAssignment(ScheduleTable* table, const ASTNode* assignment, int position, const ScheduleLimits* limits) {
+    const ASTNode* group = assignment->data.assignment.client;
+    for (int i = 0; i < group->childrenCount; i++) {
+        const char* client = group->children[i]->data.identifier.name;
+        unsigned long clientHash = hashName(1469598103934665603UL, client);
+        ScheduleEntry* marker = findEntry(table, client, NULL, NULL, hashName(hashName(clientHash, NULL), NULL) | 1, -1);
+        if (marker == NULL) {
+            return RUNTIME_ERROR;
+        }
+        if (marker->assignment == position) {
+            continue;
+        }
+        marker->assignment = position;
+        int result = joinAssignment(table, client, assignment->data.assignment.plan, position, limits);
+        if (result != SEMANTIC_OK) {
+            return result;
+        }
+    }
+    return SEMANTIC_OK;
+}
+
+/***
+ * Check functions
+*/
+
+int scheduleChecksEnabled(const ScheduleLimits* limits) {
+    return limits->conflicts || limits->maxDailySets > 0 || limits->maxDailyRest > 0;
+}
+
+int checkSchedules(const ASTNode* root, const ScheduleLimits* limits, Allocator* allocator, size_t* errorOffset) {
+    ScheduleTable table = { allocator, allocEntries(allocator, INITIAL_ENTRY_CAPACITY), INITIAL_ENTRY_CAPACITY, 0 };
+    if (table.entries == NULL) {
+        return RUNTIME_ERROR;
+    }
+
+    int result = SEMANTIC_OK;
+    for (int i = 0; i < root->childrenCount && result == SEMANTIC_OK; i++) {
+        const ASTNode* statement = root->children[i];
+        if (statement->type == NODE_ASSIGNMENT && statement->data.assignment.plan->type == NODE_PLAN) {
+            const ASTNode* client = statement->data.assignment.client;
+            result = (client->type == NODE_GROUP) ? joinGroupAssignment(&table, statement, i, limits) :
+                     joinAssignment(&table, client->data.clientProfile.name, statement->data.assignment.plan, i, limits);
+            if (result != SEMANTIC_OK) {
+                *errorOffset = statement->offset;
+            }
+        }
+    }
+
+    releaseMemory(allocator, table.entries, table.capacity * sizeof(ScheduleEntry));
+    return result;
+}
@@ -0,0 +1,29 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "parser.h"
+
+// Schedule checks across assignments. A client can be given several plans,
+// so one day of theirs can be built up by more than one assignment. The
+// check joins every assignment's days on (client, day) in a hash table, in
+// one pass over the exercises: each (client, day) entry keeps the day's
+// total sets and rest, and each (client, day, exercise) entry remembers the
+// assignment that gave it, so neither check compares assignments pairwise.
+//
+// Failures are semantic errors, located at the assignment that caused them:
+// CONFLICTING_ASSIGNMENT for an exercise two assignments give a client on
+// the same day, DAILY_LIMIT_EXCEEDED for a day over the sets or rest limit.
+
+typedef struct {
+    int conflicts;              // Flag exercises given twice on a day by different assignments
+    int maxDailySets;           // Sets a client may do in a day (0 for no limit)
+    int maxDailyRest;           // Rest a client may take in a day (0 for no limit)
+} ScheduleLimits;
+
+int scheduleChecksEnabled(const ScheduleLimits* limits);
+
+// Check the assignments of a program that passed semantic analysis. Returns
+// a semantic status code; errorOffset is set to where the first failure is.
+int checkSchedules(const ASTNode* root, const ScheduleLimits* limits, Allocator* allocator, size_t* errorOffset);
+
+#endif // SCHEDULE_H
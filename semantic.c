@@ -1,17 +1,37 @@
 #include "semantic.h"
+#include "catalog.h"
+#include "hashcons.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 // Function to create a new symbol table
 struct SymbolTable *createSymbolTable()
 {
-    struct SymbolTable *table = (struct SymbolTable *)malloc(sizeof(struct SymbolTable));
+    return createSymbolTableWithAllocator(systemAllocator());
+}
+
+// Function to create a new symbol table that allocates from the given allocator
+struct SymbolTable *createSymbolTableWithAllocator(Allocator *allocator)
+{
+    struct SymbolTable *table = (struct SymbolTable *)allocMemory(allocator, sizeof(struct SymbolTable));
     if (table != NULL)
     {
+        table->allocator = allocator;
+        table->catalog = NULL;
         table->symbols = NULL;
         table->size = 0;
         table->capacity = 0;
+        table->index = NULL;
+        table->indexCapacity = 0;
+        table->groupCount = 0;
+        table->errorOffset = NO_SOURCE_OFFSET;
+        table->acceptImports = 0;
+        table->openUnit = 0;
+        table->externals = NULL;
+        table->externalCount = 0;
+        table->externalCapacity = 0;
     }
     return table;
 }
@@ -23,13 +43,69 @@ void freeSymbolTable(struct SymbolTable *table)
     {
         for (int i = 0; i < table->size; i++)
         {
-            free(table->symbols[i].name);
+            releaseString(table->allocator, table->symbols[i].name);
+        }
+        releaseMemory(table->allocator, table->symbols, table->capacity * sizeof(struct Symbol));
+        releaseMemory(table->allocator, table->index, table->indexCapacity * sizeof(int));
+        for (int i = 0; i < table->externalCount; i++)
+        {
+            releaseString(table->allocator, table->externals[i].name);
+        }
+        releaseMemory(table->allocator, table->externals, table->externalCapacity * sizeof(struct ExternalReference));
+        releaseMemory(table->allocator, table, sizeof(struct SymbolTable));
+    }
+}
+
+static unsigned long hashSymbolName(const char *name) {
+    unsigned long hash = 1469598103934665603UL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+// Slot of name in the index: the one holding it, or the empty slot where it would go
+static int findSlot(const struct SymbolTable *table, const char *name) {
+    int mask = table->indexCapacity - 1;
+    int slot = (int)(hashSymbolName(name) & (unsigned long)mask);
+    while (table->index[slot] != 0 && strcmp(table->symbols[table->index[slot] - 1].name, name) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Index the symbol at position, unless an earlier symbol has the same name
+static void indexSymbol(struct SymbolTable *table, int position) {
+    const char *name = table->symbols[position].name;
+    if (name != NULL) {
+        int slot = findSlot(table, name);
+        if (table->index[slot] == 0) {
+            table->index[slot] = position + 1;
         }
-        free(table->symbols);
-        free(table);
     }
 }
 
+// Keep the index at most half full, so probes stay short
+static int growIndex(struct SymbolTable *table) {
+    if ((table->size + 1) * 2 <= table->indexCapacity) {
+        return 1;
+    }
+    int newCapacity = (table->indexCapacity == 0) ? 16 : table->indexCapacity * 2;
+    int *index = allocMemory(table->allocator, newCapacity * sizeof(int));
+    if (index == NULL) {
+        return 0;
+    }
+    memset(index, 0, newCapacity * sizeof(int));
+    releaseMemory(table->allocator, table->index, table->indexCapacity * sizeof(int));
+    table->index = index;
+    table->indexCapacity = newCapacity;
+    for (int i = 0; i < table->size; i++) {
+        indexSymbol(table, i);
+    }
+    return 1;
+}
+
 // Function to add a symbol to the table
 int addSymbol(struct SymbolTable *table, const char *name, int type, int intValue) {
     if (table == NULL) {
@@ -39,16 +115,23 @@ int addSymbol(struct SymbolTable *table, const char *name, int type, int intValu
     // Resize the symbol table array if necessary
     if (table->size == table->capacity) {
         int newCapacity = (table->capacity == 0) ? 1 : table->capacity * 2;
-        struct Symbol *resizedArray = (struct Symbol *)realloc(table->symbols, newCapacity * sizeof(struct Symbol));
+        struct Symbol *resizedArray = (struct Symbol *)reallocMemory(table->allocator, table->symbols,
+            table->capacity * sizeof(struct Symbol), newCapacity * sizeof(struct Symbol));
         if (resizedArray == NULL) {
             return 0; // Memory allocation error
         }
         table->symbols = resizedArray;
         table->capacity = newCapacity;
     }
+    if (!growIndex(table)) {
+        return 0;
+    }
 
     // Allocate memory for the symbol's name and set its value
-    table->symbols[table->size].name = strdup(name);
+    table->symbols[table->size].name = allocString(table->allocator, name);
+    if (name != NULL && table->symbols[table->size].name == NULL) {
+        return 0;
+    }
     table->symbols[table->size].type = type;
     
     // Set the value of the symbol based on its type
@@ -60,28 +143,207 @@ int addSymbol(struct SymbolTable *table, const char *name, int type, int intValu
         table->symbols[table->size].value.intValue = 0;
     }
 
+    indexSymbol(table, table->size);
     table->size++;
+    if (type == TYPE_GROUP) {
+        table->groupCount++;
+    }
     return 1; // Success
 }
 
 
-// Function to find a symbol in the table
+// Function to find a symbol in the table (the first declared, if a name was added twice)
 struct Symbol *findSymbol(const struct SymbolTable *table, const char *name)
 {
-    if (table != NULL)
+    if (table != NULL && table->indexCapacity > 0 && name != NULL)
     {
-        for (int i = 0; i < table->size; i++)
+        int slot = findSlot(table, name);
+        if (table->index[slot] != 0)
         {
-            if (strcmp(table->symbols[i].name, name) == 0)
-            {
-                return &table->symbols[i];
-            }
+            return &table->symbols[table->index[slot] - 1];
         }
     }
     return NULL; // Not found
 }
 
-int performSemanticAnalysis(struct ASTNode *node, struct SymbolTable *table) {
+/***
+ * Per-statement checks, shared by the tree walk and the parser's fused mode
+*/
+
+// Declare a client; a name can only be declared once
+int declareClient(struct SymbolTable *table, const char *name) {
+    if (findSymbol(table, name) != NULL) {
+        return REDECLARATION_OF_SYMBOL;
+    }
+    if (!addSymbol(table, name, TYPE_CLIENT, 0)) {
+        return RUNTIME_ERROR;
+    }
+    return SEMANTIC_OK;
+}
+
+// Declare a reusable plan and remember its definition node
+int declarePlan(struct SymbolTable *table, const char *name, struct ASTNode *plan) {
+    if (findSymbol(table, name) != NULL) {
+        return REDECLARATION_OF_SYMBOL;
+    }
+    if (!addSymbol(table, name, TYPE_PLAN, 0)) {
+        return RUNTIME_ERROR;
+    }
+    table->symbols[table->size - 1].value.node = plan;
+    return SEMANTIC_OK;
+}
+
+// Declare a group of clients and remember its node
+int declareGroup(struct SymbolTable *table, const char *name, struct ASTNode *group) {
+    if (findSymbol(table, name) != NULL) {
+        return REDECLARATION_OF_SYMBOL;
+    }
+    if (!addSymbol(table, name, TYPE_GROUP, 0)) {
+        return RUNTIME_ERROR;
+    }
+    table->symbols[table->size - 1].value.node = group;
+    return SEMANTIC_OK;
+}
+
+// Clients must be declared before showPlans refers to them (not plans or groups)
+int checkClientReference(const struct SymbolTable *table, const char *name) {
+    struct Symbol *client = findSymbol(table, name);
+    if (client == NULL || client->type != TYPE_CLIENT) {
+        return UNDEFINED_IDENTIFIER;
+    }
+    return SEMANTIC_OK;
+}
+
+// An assignment is to a declared client, or to a group, which stands for its clients
+int checkAssignmentTarget(const struct SymbolTable *table, const char *name) {
+    struct Symbol *target = findSymbol(table, name);
+    if (target == NULL || (target->type != TYPE_CLIENT && target->type != TYPE_GROUP)) {
+        return UNDEFINED_IDENTIFIER;
+    }
+    return SEMANTIC_OK;
+}
+
+// Group members must be clients declared before the group (not plans or other groups)
+int checkGroupMember(const struct SymbolTable *table, const char *name) {
+    struct Symbol *member = findSymbol(table, name);
+    if (member == NULL || member->type != TYPE_CLIENT) {
+        return UNDEFINED_IDENTIFIER;
+    }
+    return SEMANTIC_OK;
+}
+
+// Sets and rest must both be positive
+int checkExerciseValues(int sets, int rest) {
+    if (sets <= 0 || rest <= 0) {
+        return INVALID_EXERCISE_DEFINITION;
+    }
+    return SEMANTIC_OK;
+}
+
+// With a catalog, exercise names must be canonical names or known aliases
+int checkExerciseName(const struct SymbolTable *table, const char *name) {
+    if (table->catalog != NULL && catalogLookup(table->catalog, name) == CATALOG_NOT_FOUND) {
+        return UNKNOWN_EXERCISE;
+    }
+    return SEMANTIC_OK;
+}
+
+// Find the definition of a plan named by a body-less assignment (NULL if undefined)
+struct ASTNode *resolvePlanReference(const struct SymbolTable *table, const char *name) {
+    struct Symbol *plan = findSymbol(table, name);
+    if (plan == NULL || plan->type != TYPE_PLAN) {
+        return NULL;
+    }
+    return plan->value.node;
+}
+
+// Find the group an assignment is to (NULL if it is to a client)
+struct ASTNode *resolveGroupReference(const struct SymbolTable *table, const char *name) {
+    if (table->groupCount == 0) {
+        return NULL;
+    }
+    struct Symbol *group = findSymbol(table, name);
+    if (group == NULL || group->type != TYPE_GROUP) {
+        return NULL;
+    }
+    return group->value.node;
+}
+
+// An import makes the file a unit of a larger program: from here on, names it
+// does not declare may be declared by the files it imports
+int checkImport(struct SymbolTable *table) {
+    if (!table->acceptImports) {
+        return UNSUPPORTED_IMPORT;
+    }
+    table->openUnit = 1;
+    return SEMANTIC_OK;
+}
+
+// A reference that failed its check. In an open unit, a name that is not
+// declared here at all is recorded for the link step instead.
+int referExternal(struct SymbolTable *table, const char *name, int type, size_t offset) {
+    if (!table->openUnit || findSymbol(table, name) != NULL) {
+        return UNDEFINED_IDENTIFIER;
+    }
+    if (table->externalCount == table->externalCapacity) {
+        int newCapacity = (table->externalCapacity == 0) ? 16 : table->externalCapacity * 2;
+        struct ExternalReference *resized = reallocMemory(table->allocator, table->externals,
+            table->externalCapacity * sizeof(struct ExternalReference), newCapacity * sizeof(struct ExternalReference));
+        if (resized == NULL) {
+            return RUNTIME_ERROR;
+        }
+        table->externals = resized;
+        table->externalCapacity = newCapacity;
+    }
+    struct ExternalReference *external = &table->externals[table->externalCount];
+    external->name = allocString(table->allocator, name);
+    if (external->name == NULL) {
+        return RUNTIME_ERROR;
+    }
+    external->type = type;
+    external->offset = offset;
+    table->externalCount++;
+    return SEMANTIC_OK;
+}
+
+// Link a body-less assignment to the plan definition it names
+static int linkPlanReference(struct ASTNode *assignment, const struct SymbolTable *table) {
+    struct ASTNode *plan = resolvePlanReference(table, assignment->data.assignment.plan->data.identifier.name);
+    if (plan == NULL) {
+        return UNDEFINED_IDENTIFIER;
+    }
+    freeAST(assignment->data.assignment.plan);
+    assignment->data.assignment.plan = retainASTNode(plan);
+    hashAssignment(assignment);
+    return SEMANTIC_OK;
+}
+
+// Link an assignment to a group to the group's node, which lists the members
+static void linkGroupReference(struct ASTNode *assignment, const struct SymbolTable *table) {
+    struct ASTNode *client = assignment->data.assignment.client;
+    if (client->type != NODE_CLIENT_PROFILE) {
+        return;
+    }
+    struct ASTNode *group = resolveGroupReference(table, client->data.clientProfile.name);
+    if (group != NULL) {
+        assignment->data.assignment.client = retainASTNode(group);
+        freeAST(client);
+    }
+}
+
+static int analyzeNode(struct ASTNode *node, struct SymbolTable *table, bool link);
+
+// Remember where the first failed check was; the innermost failing node is seen first
+static int recordFailure(struct SymbolTable *table, const struct ASTNode *node, int result) {
+    if (result != SEMANTIC_OK && table->errorOffset == NO_SOURCE_OFFSET) {
+        table->errorOffset = node->offset;
+    }
+    return result;
+}
+
+// Check node and its children. Unless link is set the tree is only read, and
+// plan references are checked but left for linkPlanReferences.
+static int checkNode(struct ASTNode *node, struct SymbolTable *table, bool link) {
     if (node == NULL) {
         return SEMANTIC_OK;
     }
@@ -90,33 +352,98 @@ int performSemanticAnalysis(struct ASTNode *node, struct SymbolTable *table) {
 
     switch (node->type) {
         case NODE_CLIENT_PROFILE:
-            if (findSymbol(table, node->data.clientProfile.name) != NULL) {
-                return REDECLARATION_OF_SYMBOL;
+            result = declareClient(table, node->data.clientProfile.name);
+            if (result != SEMANTIC_OK) {
+                return result;
             }
-            addSymbol(table, node->data.clientProfile.name, TYPE_CLIENT, 0);
             break;
 
-        case NODE_ASSIGNMENT:
-            if (findSymbol(table, node->data.assignment.client->data.clientProfile.name) == NULL) {
-                return UNDEFINED_IDENTIFIER;
+        case NODE_ASSIGNMENT: {
+            struct ASTNode *client = node->data.assignment.client;
+            result = checkAssignmentTarget(table, client->data.clientProfile.name);
+            if (result == UNDEFINED_IDENTIFIER) {
+                result = referExternal(table, client->data.clientProfile.name, TYPE_IDENTIFIER, client->offset);
+            }
+            if (result != SEMANTIC_OK) {
+                return recordFailure(table, client, result);
+            }
+            if (link) {
+                linkGroupReference(node, table);
+            }
+            if (node->data.assignment.plan->type == NODE_IDENTIFIER) {
+                // A body-less assignment names a plan definition; link it by reference
+                struct ASTNode *reference = node->data.assignment.plan;
+                if (link) {
+                    result = linkPlanReference(node, table);
+                } else if (resolvePlanReference(table, reference->data.identifier.name) == NULL) {
+                    result = UNDEFINED_IDENTIFIER;
+                }
+                // An external plan stays a reference until the units are linked
+                if (result == UNDEFINED_IDENTIFIER) {
+                    result = referExternal(table, reference->data.identifier.name, TYPE_PLAN, reference->offset);
+                }
+                if (result != SEMANTIC_OK) {
+                    return recordFailure(table, reference, result);
+                }
+            } else {
+                // Inline plan bodies hang off the assignment rather than its children
+                struct ASTNode *plan = node->data.assignment.plan;
+                for (int i = 0; i < plan->childrenCount; i++) {
+                    result = analyzeNode(plan->children[i], table, link);
+                    if (result != SEMANTIC_OK) {
+                        return result;
+                    }
+                }
             }
-            // Perform additional checks or actions if necessary
             break;
+        }
 
         case NODE_EXERCISE:
-            if (node->data.exercise.sets <= 0 || node->data.exercise.rest <= 0) {
-                return INVALID_EXERCISE_DEFINITION;
+            result = checkExerciseValues(node->data.exercise.sets, node->data.exercise.rest);
+            if (result != SEMANTIC_OK) {
+                return result;
+            }
+            // Names the parser already found in the catalog need no second lookup
+            if (node->data.exercise.catalogId < 0) {
+                result = checkExerciseName(table, node->data.exercise.name);
+                if (result != SEMANTIC_OK) {
+                    return result;
+                }
             }
-            // Perform additional checks or actions if necessary
             break;
 
+        case NODE_GROUP:
+            result = declareGroup(table, node->data.group.name, node);
+            if (result != SEMANTIC_OK) {
+                return result;
+            }
+            // The members are identifiers, but they name clients rather than declare anything
+            for (int i = 0; i < node->childrenCount; i++) {
+                const char *member = node->children[i]->data.identifier.name;
+                result = checkGroupMember(table, member);
+                if (result == UNDEFINED_IDENTIFIER) {
+                    result = referExternal(table, member, TYPE_CLIENT, node->children[i]->offset);
+                }
+                if (result != SEMANTIC_OK) {
+                    return recordFailure(table, node->children[i], result);
+                }
+            }
+            return SEMANTIC_OK;
+
         case NODE_SHOW_PLANS:
-            if (findSymbol(table, node->data.showPlans.clientName) == NULL) {
-                return UNDEFINED_IDENTIFIER;
+            result = checkClientReference(table, node->data.showPlans.clientName);
+            if (result == UNDEFINED_IDENTIFIER) {
+                result = referExternal(table, node->data.showPlans.clientName, TYPE_CLIENT, node->offset);
+            }
+            if (result != SEMANTIC_OK) {
+                return result;
             }
-            // Perform additional checks or actions if necessary
             break;
 
+        case NODE_IMPORT:
+            // The unit driver reads the file; here an import only opens the unit
+            return checkImport(table);
+
         case NODE_LITERAL:
             if (node->data.literal.value <= 0) {
                 return INVALID_EXERCISE_DEFINITION;
@@ -132,6 +459,13 @@ int performSemanticAnalysis(struct ASTNode *node, struct SymbolTable *table) {
             break;
 
         case NODE_PLAN:
+            // Only plan definitions are reached as plan nodes; inline bodies are checked from their assignment
+            result = declarePlan(table, node->data.plan.name, node);
+            if (result != SEMANTIC_OK) {
+                return result;
+            }
+            break;
+
         case NODE_DAY:
         case NODE_SETS:
         case NODE_REST:
@@ -150,7 +484,7 @@ int performSemanticAnalysis(struct ASTNode *node, struct SymbolTable *table) {
 
     // Recursively analyze children
     for (int i = 0; i < node->childrenCount; i++) {
-        result = performSemanticAnalysis(node->children[i], table);
+        result = analyzeNode(node->children[i], table, link);
         if (result != SEMANTIC_OK) {
             return result;
         }
@@ -158,3 +492,66 @@ int performSemanticAnalysis(struct ASTNode *node, struct SymbolTable *table) {
 
     return SEMANTIC_OK;
 }
+
+static int analyzeNode(struct ASTNode *node, struct SymbolTable *table, bool link) {
+    return (node != NULL) ? recordFailure(table, node, checkNode(node, table, link)) : SEMANTIC_OK;
+}
+
+int performSemanticAnalysis(struct ASTNode *ast, struct SymbolTable *table) {
+    return analyzeNode(ast, table, true);
+}
+
+// Check one top-level statement without changing the tree, so it can run
+// while other statements are still being parsed
+int checkStatement(struct ASTNode *statement, struct SymbolTable *table) {
+    return analyzeNode(statement, table, false);
+}
+
+// Link the plan and group references left by checkStatement once every statement is checked
+int linkPlanReferences(struct ASTNode *root, struct SymbolTable *table) {
+    for (int i = 0; i < root->childrenCount; i++) {
+        struct ASTNode *statement = root->children[i];
+        if (statement->type != NODE_ASSIGNMENT) {
+            continue;
+        }
+        linkGroupReference(statement, table);
+        if (statement->data.assignment.plan->type == NODE_IDENTIFIER) {
+            int result = linkPlanReference(statement, table);
+            // checkStatement already recorded the plans an open unit leaves for the link step
+            if (result == UNDEFINED_IDENTIFIER && table->openUnit) {
+                continue;
+            }
+            if (result != SEMANTIC_OK) {
+                return recordFailure(table, statement->data.assignment.plan, result);
+            }
+        }
+    }
+    return SEMANTIC_OK;
+}
+
+const char* semanticErrorString(int code) {
+    switch (code) {
+        case SEMANTIC_OK:
+            return "no error";
+        case UNDEFINED_IDENTIFIER:
+            return "undefined client or plan";
+        case INVALID_EXERCISE_DEFINITION:
+            return "sets and rest must be positive";
+        case REDECLARATION_OF_SYMBOL:
+            return "name declared twice";
+        case RUNTIME_ERROR:
+            return "out of memory";
+        case UNKNOWN_EXERCISE:
+            return "exercise not in the catalog";
+        case CONFLICTING_ASSIGNMENT:
+            return "exercise given twice on one day by different assignments";
+        case DAILY_LIMIT_EXCEEDED:
+            return "daily sets or rest over the limit";
+        case CYCLIC_DEPENDENCY:
+            return "files import each other";
+        case UNSUPPORTED_IMPORT:
+            return "imports are not supported in this mode";
+        default:
+            return "semantic error";
+    }
+}
@@ -14,6 +14,7 @@
 #define TYPE_SHOW_PLAN 7
 #define TYPE_REST 8
 #define TYPE_SETS 9
+#define TYPE_GROUP 10
 
 // Define error codes for semantic analysis
 #define SEMANTIC_OK 100
@@ -32,6 +33,10 @@
 #define CYCLIC_DEPENDENCY -13
 #define INVALID_ARRAY_INDEX -14
 #define RUNTIME_ERROR -15
+#define UNKNOWN_EXERCISE -16
+#define CONFLICTING_ASSIGNMENT -17
+#define DAILY_LIMIT_EXCEEDED -18
+#define UNSUPPORTED_IMPORT -19
 
 // Symbol structure for semantic analysis
 struct Symbol {
@@ -40,24 +45,65 @@ struct Symbol {
     union {
         char* strValue;
         int intValue;
+        struct ASTNode* node; // Definition node for TYPE_PLAN and TYPE_GROUP symbols
     } value;
 };
 
+// A name an open unit uses without declaring it, left for the link step (unit.h)
+struct ExternalReference {
+    char* name;
+    int type;               // TYPE_PLAN, TYPE_CLIENT (a group member or showPlans) or TYPE_IDENTIFIER (an assignment's client or group)
+    size_t offset;          // Input offset of the reference
+};
+
+struct Catalog;
 
 // Symbol Table structure
 struct SymbolTable {
+    Allocator* allocator;   // Allocator for symbols and their names
+    const struct Catalog* catalog; // Exercise names must be in this catalog (NULL accepts any name)
     struct Symbol* symbols; // Array of symbols
     int size;               // Number of symbols
     int capacity;           // Capacity of the symbol array
+    int* index;             // Open-addressed hash index into symbols by name (entries are position + 1)
+    int indexCapacity;      // Slots in index (a power of two, at most half used)
+    int groupCount;         // Symbols of TYPE_GROUP (group lookups are skipped while there are none)
+    size_t errorOffset;     // Input offset of the node that failed the first check (NO_SOURCE_OFFSET if none)
+    int acceptImports;      // Import statements are allowed (the unit driver follows them); otherwise they fail
+    int openUnit;           // Names not declared here become external references rather than errors
+    struct ExternalReference* externals; // Those references, in program order
+    int externalCount;
+    int externalCapacity;
 };
 
 // Function prototypes for symbol table management
 struct SymbolTable* createSymbolTable();
+struct SymbolTable* createSymbolTableWithAllocator(Allocator* allocator);
 void freeSymbolTable(struct SymbolTable* table);
 int addSymbol(struct SymbolTable* table, const char* name, int type, int intValue);
 struct Symbol* findSymbol(const struct SymbolTable* table, const char* name);
 
+// Function prototypes for per-statement checks (also used by the parser's fused mode)
+int declareClient(struct SymbolTable* table, const char* name);
+int declarePlan(struct SymbolTable* table, const char* name, struct ASTNode* plan);
+int declareGroup(struct SymbolTable* table, const char* name, struct ASTNode* group);
+int checkClientReference(const struct SymbolTable* table, const char* name);
+int checkAssignmentTarget(const struct SymbolTable* table, const char* name);
+int checkGroupMember(const struct SymbolTable* table, const char* name);
+int checkExerciseValues(int sets, int rest);
+int checkExerciseName(const struct SymbolTable* table, const char* name);
+struct ASTNode* resolvePlanReference(const struct SymbolTable* table, const char* name);
+struct ASTNode* resolveGroupReference(const struct SymbolTable* table, const char* name);
+int checkImport(struct SymbolTable* table);
+int referExternal(struct SymbolTable* table, const char* name, int type, size_t offset);
+
 // Function prototype for semantic analysis
 int performSemanticAnalysis(struct ASTNode* ast, struct SymbolTable* table);
 
+// Function prototypes for statement-at-a-time analysis (used by the pipelined front end)
+int checkStatement(struct ASTNode* statement, struct SymbolTable* table);
+int linkPlanReferences(struct ASTNode* root, struct SymbolTable* table);
+
+const char* semanticErrorString(int code);
+
 #endif // SEMANTIC_H
\ No newline at end of file
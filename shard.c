@@ -0,0 +1,676 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "shard.h"
+#include "lexer.h"
+#include "sourcemap.h"
+
+#define SHARD_COPY_SIZE (64 * 1024)
+#define SHARD_FRAME_LIMIT 0x40000000u // Longest frame; longer writes are split
+
+// Records are a sequence of frames, each a 32-bit length and that many
+// bytes; an empty frame ends the record
+struct ShardOutput {
+    FILE* file;
+};
+
+// Where a run of the shard's text came from: bytes from shardOffset on are
+// the input's from fileOffset on, up to the next segment
+typedef struct {
+    size_t shardOffset;
+    size_t fileOffset;
+} ShardSegment;
+
+// Coordinator's view of one worker
+typedef struct {
+    pid_t pid;
+    int status;              // From waitpid
+    FILE* input;             // Write end of the worker's pipe (NULL once it stopped reading)
+    FILE* output;            // Records written by the worker
+    FILE* diagnostics;       // The worker's stderr
+    size_t written;          // Bytes of text sent so far
+    ShardSegment* segments;  // In shard order, to locate the worker's diagnostics
+    int segmentCount;
+    int segmentCapacity;
+} Shard;
+
+typedef struct {
+    Allocator* allocator;
+    Shard* shards;
+    int shardCount;
+    FILE* order;             // Shard of each showPlans statement, one byte each, in program order
+    const char* text;        // The whole input
+    char** groups;           // Open-addressed set of the group names seen so far
+    int groupCount;
+    int groupCapacity;
+    bool failed;             // The coordinator ran out of memory or disk
+} Coordinator;
+
+/***
+ * Worker side
+*/
+
+int writeShardOutput(void* userData, const char* text, size_t length) {
+    ShardOutput* output = userData;
+    while (length > 0) {
+        uint32_t frame = (length > SHARD_FRAME_LIMIT) ? SHARD_FRAME_LIMIT : (uint32_t)length;
+        if (fwrite(&frame, sizeof(frame), 1, output->file) != 1 || fwrite(text, 1, frame, output->file) != frame) {
+            return -1;
+        }
+        text += frame;
+        length -= frame;
+    }
+    return 0;
+}
+
+int endShardRecord(ShardOutput* output) {
+    uint32_t frame = 0;
+    return fwrite(&frame, sizeof(frame), 1, output->file) == 1 ? 0 : -1;
+}
+
+// Body of a forked worker; never returns
+static void runWorker(Coordinator* coordinator, int index, int* pipes, ShardWorker worker, void* workerData) {
+    for (int i = 0; i < coordinator->shardCount; i++) {
+        close(pipes[2 * i + 1]);
+        if (i != index) {
+            close(pipes[2 * i]);
+        }
+    }
+
+    Shard* shard = &coordinator->shards[index];
+    int result = -1;
+    if (dup2(fileno(shard->diagnostics), STDERR_FILENO) >= 0) {
+        FILE* input = fdopen(pipes[2 * index], "rb");
+        Source* source = NULL;
+        if (input == NULL) {
+            fprintf(stderr, "Unable to read shard %d.\n", index);
+        } else if (openSourceStream(input, SOURCE_PLAIN, systemAllocator(), &source) != SOURCE_OK) {
+            fprintf(stderr, "Unable to read shard %d: out of memory.\n", index);
+        } else {
+            ShardOutput output = { shard->output };
+            result = worker(workerData, source, &output);
+            if (fflush(shard->output) != 0 && result == 0) {
+                fprintf(stderr, "Unable to write the output of shard %d.\n", index);
+                result = -1;
+            }
+        }
+    }
+    fflush(NULL);
+    _exit(result == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/***
+ * Routing
+*/
+
+static unsigned long hashClient(const char* name, size_t length) {
+    unsigned long hash = 1469598103934665603UL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static int clientShard(const Coordinator* coordinator, const char* name, size_t length) {
+    return (int)(hashClient(name, length) % coordinator->shardCount);
+}
+
+static char** findGroup(const Coordinator* coordinator, const char* name, size_t length) {
+    int slot = (int)(hashClient(name, length) & (unsigned long)(coordinator->groupCapacity - 1));
+    while (coordinator->groups[slot] != NULL &&
+           (strncmp(coordinator->groups[slot], name, length) != 0 || coordinator->groups[slot][length] != '\0')) {
+        slot = (slot + 1) & (coordinator->groupCapacity - 1);
+    }
+    return &coordinator->groups[slot];
+}
+
+static bool isGroup(const Coordinator* coordinator, const char* name, size_t length) {
+    return coordinator->groupCapacity > 0 && *findGroup(coordinator, name, length) != NULL;
+}
+
+static bool addGroup(Coordinator* coordinator, const char* name, size_t length) {
+    if (isGroup(coordinator, name, length)) {
+        return true;
+    }
+    if ((coordinator->groupCount + 1) * 2 > coordinator->groupCapacity) {
+        int newCapacity = (coordinator->groupCapacity == 0) ? 16 : coordinator->groupCapacity * 2;
+        char** groups = allocMemory(coordinator->allocator, newCapacity * sizeof(char*));
+        if (groups == NULL) {
+            return false;
+        }
+        memset(groups, 0, newCapacity * sizeof(char*));
+        char** old = coordinator->groups;
+        int oldCapacity = coordinator->groupCapacity;
+        coordinator->groups = groups;
+        coordinator->groupCapacity = newCapacity;
+        for (int i = 0; i < oldCapacity; i++) {
+            if (old[i] != NULL) {
+                *findGroup(coordinator, old[i], strlen(old[i])) = old[i];
+            }
+        }
+        releaseMemory(coordinator->allocator, old, oldCapacity * sizeof(char*));
+    }
+    char* copy = allocStringN(coordinator->allocator, name, length);
+    if (copy == NULL) {
+        return false;
+    }
+    *findGroup(coordinator, name, length) = copy;
+    coordinator->groupCount++;
+    return true;
+}
+
+static void stopShard(Shard* shard) {
+    // The worker has stopped reading (it reports why); the others carry on
+    fclose(shard->input);
+    shard->input = NULL;
+}
+
+// Note that the shard's text from here on comes from fileOffset in the input
+static void recordSegment(Coordinator* coordinator, Shard* shard, size_t fileOffset) {
+    if (shard->segmentCount > 0) {
+        const ShardSegment* last = &shard->segments[shard->segmentCount - 1];
+        if (fileOffset - last->fileOffset == shard->written - last->shardOffset) {
+            return;
+        }
+    }
+    if (shard->segmentCount == shard->segmentCapacity) {
+        int newCapacity = (shard->segmentCapacity == 0) ? 64 : shard->segmentCapacity * 2;
+        ShardSegment* segments = reallocMemory(coordinator->allocator, shard->segments,
+                                               shard->segmentCapacity * sizeof(ShardSegment),
+                                               newCapacity * sizeof(ShardSegment));
+        if (segments == NULL) {
+            coordinator->failed = true;
+            return;
+        }
+        shard->segments = segments;
+        shard->segmentCapacity = newCapacity;
+    }
+    shard->segments[shard->segmentCount].shardOffset = shard->written;
+    shard->segments[shard->segmentCount].fileOffset = fileOffset;
+    shard->segmentCount++;
+}
+
+// Copy a statement's text from the input, as one line
+static void sendText(Coordinator* coordinator, int index, const char* text, size_t length) {
+    Shard* shard = &coordinator->shards[index];
+    if (shard->input == NULL) {
+        return;
+    }
+    recordSegment(coordinator, shard, (size_t)(text - coordinator->text));
+    if (fwrite(text, 1, length, shard->input) != length || fputc('\n', shard->input) == EOF) {
+        stopShard(shard);
+    }
+    shard->written += length + 1;
+}
+
+// Write the statement back out as text. Tokens are separated by spaces and
+// string literals quoted again, which the lexer reads back unchanged. Token
+// offsets are from text, where the statement begins in the input.
+static void sendStatement(Coordinator* coordinator, int index, const char* text, Token** tokens, int count) {
+    Shard* shard = &coordinator->shards[index];
+    if (shard->input == NULL) {
+        return;
+    }
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        recordSegment(coordinator, shard, (size_t)(text - coordinator->text) + tokens[i]->offset);
+        if (tokens[i]->type == TOKEN_STRING_LITERAL) {
+            int written = fprintf(shard->input, "\"%s\" ", tokens[i]->value);
+            ok = written >= 0;
+            shard->written += ok ? (size_t)written : 0;
+        } else {
+            ok = fputs(tokens[i]->value, shard->input) >= 0 && fputc(' ', shard->input) != EOF;
+            shard->written += strlen(tokens[i]->value) + 1;
+        }
+    }
+    ok = ok && fputc('\n', shard->input) != EOF;
+    shard->written++;
+    if (!ok) {
+        stopShard(shard);
+    }
+}
+
+// Send each shard the group with only the members it owns. The recognizer
+// has accepted it, so the tokens are: group name { member , ... } ;
+static void sendGroup(Coordinator* coordinator, const char* text, size_t length) {
+    Token** tokens = lexerRange(text, length, coordinator->allocator);
+    int count = 0;
+    while (tokens != NULL && tokens[count]->type != TOKEN_EOF) {
+        count++;
+    }
+    Token** kept = (tokens != NULL) ? allocMemory(coordinator->allocator, count * sizeof(Token*)) : NULL;
+    if (kept == NULL) {
+        freeTokens(tokens, coordinator->allocator);
+        coordinator->failed = true;
+        return;
+    }
+    for (int shard = 0; shard < coordinator->shardCount; shard++) {
+        int keptCount = 0;
+        for (int i = 0; i < 3; i++) {
+            kept[keptCount++] = tokens[i];
+        }
+        for (int i = 3; i < count - 2; i += 2) {
+            if (clientShard(coordinator, tokens[i]->value, strlen(tokens[i]->value)) == shard) {
+                if (keptCount > 3) {
+                    kept[keptCount++] = tokens[i - 1]; // A comma after the previous member kept
+                }
+                kept[keptCount++] = tokens[i];
+            }
+        }
+        kept[keptCount++] = tokens[count - 2];
+        kept[keptCount++] = tokens[count - 1];
+        sendStatement(coordinator, shard, text, kept, keptCount);
+    }
+    releaseMemory(coordinator->allocator, kept, count * sizeof(Token*));
+    freeTokens(tokens, coordinator->allocator);
+}
+
+// Route each statement as the recognizer finds it (a StatementVisitor)
+static int routeStatement(void* userData, const StatementSpan* statement) {
+    Coordinator* coordinator = userData;
+    const char* text = coordinator->text + statement->begin;
+    size_t length = statement->end - statement->begin;
+    const char* name = coordinator->text + statement->nameOffset;
+
+    int target = 0;
+    switch (statement->kind) {
+        case STATEMENT_CLIENT:
+        case STATEMENT_SHOW_PLANS:
+            target = clientShard(coordinator, name, statement->nameLength);
+            break;
+        case STATEMENT_ASSIGNMENT:
+            // Each shard assigns a group's plan to the members it owns
+            if (isGroup(coordinator, name, statement->nameLength)) {
+                target = -1;
+            } else {
+                target = clientShard(coordinator, name, statement->nameLength);
+            }
+            break;
+        case STATEMENT_PLAN:
+            target = -1;
+            break;
+        case STATEMENT_GROUP:
+            if (!addGroup(coordinator, name, statement->nameLength)) {
+                coordinator->failed = true;
+            }
+            sendGroup(coordinator, text, length);
+            return coordinator->failed ? -1 : 0;
+        default:
+            // Days outside a plan belong to no client, and imports fail the check
+            break;
+    }
+
+    if (target < 0) {
+        for (int i = 0; i < coordinator->shardCount; i++) {
+            sendText(coordinator, i, text, length);
+        }
+    } else {
+        sendText(coordinator, target, text, length);
+    }
+    if (statement->kind == STATEMENT_SHOW_PLANS && fputc(target, coordinator->order) == EOF) {
+        coordinator->failed = true;
+    }
+    return coordinator->failed ? -1 : 0;
+}
+
+/***
+ * Merging
+*/
+
+static bool readFully(FILE* file, void* data, size_t length) {
+    return fread(data, 1, length, file) == length;
+}
+
+// Copy the next record of a worker's output to the writer
+static int copyRecord(FILE* file, char* buffer, OutputWriter writer, void* writerData) {
+    uint32_t frame;
+    while (readFully(file, &frame, sizeof(frame))) {
+        if (frame == 0) {
+            return SHARD_OK;
+        }
+        while (frame > 0) {
+            size_t length = (frame > SHARD_COPY_SIZE) ? SHARD_COPY_SIZE : frame;
+            if (!readFully(file, buffer, length) || writer(writerData, buffer, length) != 0) {
+                return SHARD_ERROR_IO;
+            }
+            frame -= length;
+        }
+    }
+    return SHARD_ERROR_IO;
+}
+
+static int mergeOutput(Coordinator* coordinator, OutputWriter writer, void* writerData) {
+    char* buffer = allocMemory(coordinator->allocator, SHARD_COPY_SIZE);
+    if (buffer == NULL) {
+        return SHARD_ERROR_NO_MEMORY;
+    }
+    rewind(coordinator->order);
+    for (int i = 0; i < coordinator->shardCount; i++) {
+        rewind(coordinator->shards[i].output);
+    }
+
+    int result = SHARD_OK;
+    int target;
+    while (result == SHARD_OK && (target = fgetc(coordinator->order)) != EOF) {
+        result = copyRecord(coordinator->shards[target].output, buffer, writer, writerData);
+    }
+    releaseMemory(coordinator->allocator, buffer, SHARD_COPY_SIZE);
+    return result;
+}
+
+// Read a worker's diagnostics, each line NUL-terminated (NULL if there are
+// none or they cannot be read). The text takes length + 1 bytes.
+static char* readDiagnostics(Coordinator* coordinator, Shard* shard, size_t* length) {
+    if (fseek(shard->diagnostics, 0, SEEK_END) != 0) {
+        return NULL;
+    }
+    long size = ftell(shard->diagnostics);
+    if (size <= 0) {
+        return NULL;
+    }
+    rewind(shard->diagnostics);
+    char* text = allocMemory(coordinator->allocator, size + 1);
+    if (text != NULL && !readFully(shard->diagnostics, text, size)) {
+        releaseMemory(coordinator->allocator, text, size + 1);
+        return NULL;
+    }
+    if (text != NULL) {
+        text[size] = '\0';
+        for (long i = 0; i < size; i++) {
+            text[i] = (text[i] == '\n') ? '\0' : text[i];
+        }
+    }
+    *length = size;
+    return text;
+}
+
+// Locate a line the worker printed through its offset map in the input;
+// false if it is not located
+static bool locateDiagnostic(const Shard* shard, const char* line, size_t* offset, const char** message) {
+    size_t shardOffset;
+    if (!parseOffsetDiagnostic(line, &shardOffset, message)) {
+        return false;
+    }
+    if (shard->segmentCount == 0 || shardOffset < shard->segments[0].shardOffset) {
+        *offset = NO_SOURCE_OFFSET;
+        return true;
+    }
+
+    // Last segment starting at or before the offset
+    int low = 0;
+    int high = shard->segmentCount;
+    while (high - low > 1) {
+        int middle = low + (high - low) / 2;
+        if (shard->segments[middle].shardOffset <= shardOffset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    *offset = shard->segments[low].fileOffset + (shardOffset - shard->segments[low].shardOffset);
+    return true;
+}
+
+static bool sameDiagnostic(const Shard* shard, const char* line, const Shard* otherShard, const char* otherLine) {
+    size_t offset;
+    size_t otherOffset;
+    const char* message;
+    const char* otherMessage;
+    bool located = locateDiagnostic(shard, line, &offset, &message);
+    bool otherLocated = locateDiagnostic(otherShard, otherLine, &otherOffset, &otherMessage);
+    if (!located || !otherLocated) {
+        return !located && !otherLocated && strcmp(line, otherLine) == 0;
+    }
+    return offset == otherOffset && strcmp(message, otherMessage) == 0;
+}
+
+static bool printedBefore(const Coordinator* coordinator, char** printed, const size_t* lengths, const int* owners,
+                          int printedCount, const Shard* shard, const char* line) {
+    for (int i = 0; i < printedCount; i++) {
+        const Shard* owner = &coordinator->shards[owners[i]];
+        for (const char* other = printed[i]; other < printed[i] + lengths[i]; other += strlen(other) + 1) {
+            if (sameDiagnostic(shard, line, owner, other)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Print what the failed workers reported, located in the input at path. Plan
+// definitions are checked by every worker, so the same diagnostic can come
+// from several of them.
+static void reportWorkers(Coordinator* coordinator, const char* path) {
+    char** printed = allocMemory(coordinator->allocator, coordinator->shardCount * sizeof(char*));
+    size_t* lengths = allocMemory(coordinator->allocator, coordinator->shardCount * sizeof(size_t));
+    int* owners = allocMemory(coordinator->allocator, coordinator->shardCount * sizeof(int));
+    bool keep = printed != NULL && lengths != NULL && owners != NULL;
+    int printedCount = 0;
+    SourceMap* map = createSourceMap(path, coordinator->allocator);
+
+    for (int i = 0; i < coordinator->shardCount; i++) {
+        Shard* shard = &coordinator->shards[i];
+        if (WIFEXITED(shard->status) && WEXITSTATUS(shard->status) == EXIT_SUCCESS) {
+            continue;
+        }
+        if (WIFSIGNALED(shard->status)) {
+            fprintf(stderr, "Worker for shard %d stopped by signal %d.\n", i, WTERMSIG(shard->status));
+        }
+
+        size_t length = 0;
+        char* text = readDiagnostics(coordinator, shard, &length);
+        if (text == NULL) {
+            continue;
+        }
+        for (const char* line = text; line < text + length; line += strlen(line) + 1) {
+            size_t offset;
+            const char* message;
+            if (printedBefore(coordinator, printed, lengths, owners, printedCount, shard, line)) {
+                continue;
+            }
+            if (locateDiagnostic(shard, line, &offset, &message)) {
+                printDiagnostic(map, offset, "%s", message);
+            } else {
+                fprintf(stderr, "%s\n", line);
+            }
+        }
+        if (keep) {
+            printed[printedCount] = text;
+            lengths[printedCount] = length;
+            owners[printedCount++] = i;
+        } else {
+            releaseMemory(coordinator->allocator, text, length + 1);
+        }
+    }
+
+    freeSourceMap(map);
+    for (int i = 0; i < printedCount; i++) {
+        releaseMemory(coordinator->allocator, printed[i], lengths[i] + 1);
+    }
+    releaseMemory(coordinator->allocator, printed, coordinator->shardCount * sizeof(char*));
+    releaseMemory(coordinator->allocator, lengths, coordinator->shardCount * sizeof(size_t));
+    releaseMemory(coordinator->allocator, owners, coordinator->shardCount * sizeof(int));
+}
+
+/***
+ * Coordinator
+*/
+
+static void closeShards(Coordinator* coordinator) {
+    for (int i = 0; i < coordinator->shardCount; i++) {
+        Shard* shard = &coordinator->shards[i];
+        if (shard->input != NULL) {
+            fclose(shard->input);
+        }
+        if (shard->output != NULL) {
+            fclose(shard->output);
+        }
+        if (shard->diagnostics != NULL) {
+            fclose(shard->diagnostics);
+        }
+        releaseMemory(coordinator->allocator, shard->segments, shard->segmentCapacity * sizeof(ShardSegment));
+    }
+    if (coordinator->order != NULL) {
+        fclose(coordinator->order);
+    }
+    for (int i = 0; i < coordinator->groupCapacity; i++) {
+        releaseString(coordinator->allocator, coordinator->groups[i]);
+    }
+    releaseMemory(coordinator->allocator, coordinator->groups, coordinator->groupCapacity * sizeof(char*));
+    releaseMemory(coordinator->allocator, coordinator->shards, coordinator->shardCount * sizeof(Shard));
+}
+
+// Feed the input to the started workers, then wait for all of them
+static int feedShards(Coordinator* coordinator, const char* path, const Catalog* catalog, CheckResult* check) {
+    int result = SHARD_OK;
+    SourceText input;
+    int sourceResult = loadSourceText(path, coordinator->allocator, &input);
+    if (sourceResult != SOURCE_OK) {
+        check->status = CHECK_ERROR_SOURCE;
+        check->sourceResult = sourceResult;
+        result = SHARD_ERROR_CHECK;
+    } else {
+        coordinator->text = input.text;
+        int status = checkText(input.text, input.length, catalog, coordinator->allocator,
+                               routeStatement, coordinator, check);
+        releaseSourceText(&input, coordinator->allocator);
+        if (coordinator->failed || (status == CHECK_OK && fflush(coordinator->order) != 0)) {
+            result = SHARD_ERROR_NO_MEMORY;
+        } else if (status != CHECK_OK) {
+            result = SHARD_ERROR_CHECK;
+        }
+    }
+
+    // Closing the pipes ends each worker's input
+    for (int i = 0; i < coordinator->shardCount; i++) {
+        Shard* shard = &coordinator->shards[i];
+        if (shard->input != NULL) {
+            fclose(shard->input);
+            shard->input = NULL;
+        }
+    }
+    for (int i = 0; i < coordinator->shardCount; i++) {
+        if (waitpid(coordinator->shards[i].pid, &coordinator->shards[i].status, 0) < 0 && result == SHARD_OK) {
+            result = SHARD_ERROR_IO;
+        }
+    }
+    return result;
+}
+
+int runSharded(const char* path, int shardCount, const Catalog* catalog, Allocator* allocator,
+               ShardWorker worker, void* workerData, OutputWriter writer, void* writerData, CheckResult* check) {
+    memset(check, 0, sizeof(CheckResult));
+    check->errorOffset = NO_SOURCE_OFFSET;
+    if (shardCount < 1 || shardCount > SHARD_MAX_COUNT) {
+        return SHARD_ERROR_COUNT;
+    }
+
+    Coordinator coordinator;
+    memset(&coordinator, 0, sizeof(coordinator));
+    coordinator.allocator = allocator;
+    coordinator.shards = allocMemory(allocator, shardCount * sizeof(Shard));
+    if (coordinator.shards == NULL) {
+        return SHARD_ERROR_NO_MEMORY;
+    }
+    memset(coordinator.shards, 0, shardCount * sizeof(Shard));
+    coordinator.shardCount = shardCount;
+
+    // Files and pipes are all made before the first fork, so every worker
+    // can close the pipe ends that are not its own
+    int pipes[2 * SHARD_MAX_COUNT];
+    int pipeCount = 0;
+    bool ok = (coordinator.order = tmpfile()) != NULL;
+    for (int i = 0; i < shardCount && ok; i++) {
+        Shard* shard = &coordinator.shards[i];
+        ok = (shard->output = tmpfile()) != NULL && (shard->diagnostics = tmpfile()) != NULL &&
+            pipe(&pipes[2 * i]) == 0;
+        pipeCount += ok ? 1 : 0;
+    }
+    if (!ok) {
+        for (int i = 0; i < 2 * pipeCount; i++) {
+            close(pipes[i]);
+        }
+        closeShards(&coordinator);
+        return SHARD_ERROR_IO;
+    }
+
+    // Buffered output must not be written again by each child
+    fflush(NULL);
+    int started = 0;
+    for (; started < shardCount; started++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            runWorker(&coordinator, started, pipes, worker, workerData);
+        } else if (pid < 0) {
+            break;
+        }
+        coordinator.shards[started].pid = pid;
+    }
+
+    for (int i = 0; i < shardCount; i++) {
+        close(pipes[2 * i]);
+        coordinator.shards[i].input = (i < started) ? fdopen(pipes[2 * i + 1], "wb") : NULL;
+        if (coordinator.shards[i].input == NULL) {
+            close(pipes[2 * i + 1]);
+        }
+    }
+    if (started < shardCount) {
+        // Workers that did start see an empty input
+        for (int i = 0; i < started; i++) {
+            fclose(coordinator.shards[i].input);
+            coordinator.shards[i].input = NULL;
+            waitpid(coordinator.shards[i].pid, &coordinator.shards[i].status, 0);
+        }
+        closeShards(&coordinator);
+        return SHARD_ERROR_NO_MEMORY;
+    }
+
+    // A worker that stops early closes its pipe; that shows up as a failed write
+    void (*previousHandler)(int) = signal(SIGPIPE, SIG_IGN);
+    int result = feedShards(&coordinator, path, catalog, check);
+    signal(SIGPIPE, previousHandler);
+
+    bool workersOk = true;
+    for (int i = 0; i < shardCount; i++) {
+        int status = coordinator.shards[i].status;
+        workersOk = workersOk && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    }
+    if (result == SHARD_OK && !workersOk) {
+        // Workers only see a partial program when the coordinator failed, so
+        // their diagnostics are only worth reading when it did not
+        reportWorkers(&coordinator, path);
+        result = SHARD_ERROR_WORKER;
+    }
+    if (result == SHARD_OK) {
+        result = mergeOutput(&coordinator, writer, writerData);
+    }
+
+    closeShards(&coordinator);
+    return result;
+}
+
+const char* shardErrorString(int status) {
+    switch (status) {
+        case SHARD_OK:
+            return "success";
+        case SHARD_ERROR_IO:
+            return "unable to create or read a worker's files";
+        case SHARD_ERROR_NO_MEMORY:
+            return "out of memory";
+        case SHARD_ERROR_CHECK:
+            return "the input failed the check";
+        case SHARD_ERROR_WORKER:
+            return "a worker failed";
+        case SHARD_ERROR_COUNT:
+            return "shard count out of range";
+        default:
+            return "unknown error";
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "interpreter.h"
+#include "source.h"
+#include "recognizer.h"
+
+// Sharded compilation. The coordinator checks the input with the recognizer
+// (recognizer.h), which finds the top-level statements exactly as the parser
+// would, and sends each one to one of N worker processes as soon as it has
+// been recognized, chosen by hashing the client it is about (ClientProfile X,
+// assign ... to X, showPlans(X)). Plan definitions go to every worker; days
+// outside a plan go to the first. A group goes to every worker with only the
+// members that worker owns, and so do assignments to it. A client's
+// statements therefore all meet in one worker, which compiles and runs its
+// shard like a whole program.
+//
+// Workers are forked and read their shard from a pipe. They write their
+// output and diagnostics to unlinked temporary files, which the coordinator
+// merges once every worker has finished: output in program order, and each
+// distinct diagnostic once. Output is only written if every worker succeeded.
+// Workers locate their diagnostics with an offset map (sourcemap.h); the
+// coordinator keeps where each piece of a shard's text came from, and prints
+// them at the file, line and column of the input.
+
+#define SHARD_MAX_COUNT 64
+
+// Shard status codes
+#define SHARD_OK 0
+#define SHARD_ERROR_IO -1
+#define SHARD_ERROR_NO_MEMORY -2
+#define SHARD_ERROR_CHECK -3        // The input could not be read or failed the check (see check)
+#define SHARD_ERROR_WORKER -4       // A worker failed; its diagnostics have been printed
+#define SHARD_ERROR_COUNT -5        // Shard count out of range
+
+// Output of one worker: the text of each showPlans statement, in order
+typedef struct ShardOutput ShardOutput;
+
+// Runs in a worker process. Compiles and runs the shard read from source,
+// which it owns, writing output through writeShardOutput and ending each
+// showPlans statement's output with endShardRecord. Diagnostics go to stderr.
+// Returns 0 on success.
+typedef int (*ShardWorker)(void* userData, Source* source, ShardOutput* output);
+
+// Function prototypes for workers
+int writeShardOutput(void* userData, const char* text, size_t length); // An OutputWriter for a ShardOutput
+int endShardRecord(ShardOutput* output);
+
+// Compile path in shardCount workers and write the merged output to writer.
+// Why the input could not be read or failed the check is left in check.
+int runSharded(const char* path, int shardCount, const Catalog* catalog, Allocator* allocator,
+               ShardWorker worker, void* workerData, OutputWriter writer, void* writerData, CheckResult* check);
+const char* shardErrorString(int status);
+
+#endif // SHARD_H
@@ -0,0 +1,470 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "simulate.h"
+#include "calendar.h"
+
+#define DAY_MINUTES (24 * 60)
+#define WEEKDAY_ROWS (SIMULATE_SLOTS + 1)   // A weekday's slots and the row that ends presence at midnight
+#define COLUMN_ALIGNMENT 8                  // Columns are padded so a row is a whole number of vectors
+#define ARRIVAL_BITS 10
+#define ARRIVAL_TABLE_SIZE (1 << ARRIVAL_BITS)
+
+static const char* const weekdayNames[7] = {
+    "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"
+};
+
+// Relative arrivals per hour of the day: closed at night, busiest before and after work
+static const int arrivalProfile[24] = {
+    0, 0, 0, 0, 0, 0, 6, 9, 7, 4, 3, 3, 4, 3, 3, 4, 6, 9, 10, 8, 5, 3, 0, 0
+};
+
+// Session descriptors, as parallel arrays; a session's visits are consecutive
+typedef struct {
+    Allocator* allocator;
+    uint8_t* weekday;
+    uint16_t* minutes;          // Whole session, capped at a day
+    uint32_t* firstVisit;
+    uint16_t* sessionVisits;
+    int sessionCount;
+    int sessionCapacity;
+    uint32_t* station;
+    uint16_t* offset;           // From the arrival, capped at a day
+    uint16_t* length;
+    long visitCount;
+    long visitCapacity;
+    const char** stationNames;  // Point into the environment's trees
+    int stationCount;
+    int stationCapacity;
+    int* stationIndex;          // Open-addressed: station + 1, 0 for an empty slot
+    int stationIndexCapacity;
+} Sessions;
+
+typedef struct {
+    const Sessions* sessions;
+    const uint16_t* arrivals;   // Arrival minute for each value of the top ARRIVAL_BITS bits of a draw
+    uint64_t threshold;         // A session is attended if the low 32 bits of its draw are below this
+    uint64_t seed;
+    int columns;                // The whole location, then each station, padded
+    int firstScenario;
+    int endScenario;
+    int32_t* difference;        // [7 * WEEKDAY_ROWS][columns]
+    int32_t* running;           // [columns]
+    int64_t* sums;              // [7 * SIMULATE_SLOTS][columns]
+    int32_t* peaks;             // [7 * SIMULATE_SLOTS][columns]
+} Worker;
+
+/***
+ * Session extraction
+*/
+
+static unsigned long hashName(const char* name) {
+    unsigned long hash = 14695981039346656037UL;
+    for (const unsigned char* c = (const unsigned char*)name; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static bool growStationIndex(Sessions* sessions) {
+    int capacity = (sessions->stationIndexCapacity == 0) ? 64 : sessions->stationIndexCapacity * 2;
+    int* index = allocMemory(sessions->allocator, capacity * sizeof(int));
+    if (index == NULL) {
+        return false;
+    }
+    memset(index, 0, capacity * sizeof(int));
+    for (int i = 0; i < sessions->stationCount; i++) {
+        unsigned long slot = hashName(sessions->stationNames[i]) & (capacity - 1);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        index[slot] = i + 1;
+    }
+    releaseMemory(sessions->allocator, sessions->stationIndex, sessions->stationIndexCapacity * sizeof(int));
+    sessions->stationIndex = index;
+    sessions->stationIndexCapacity = capacity;
+    return true;
+}
+
+// Station of an exercise name, added on first use; -1 if out of memory
+static int internStation(Sessions* sessions, const char* name) {
+    if ((sessions->stationCount + 1) * 2 > sessions->stationIndexCapacity && !growStationIndex(sessions)) {
+        return -1;
+    }
+    int mask = sessions->stationIndexCapacity - 1;
+    unsigned long slot = hashName(name) & mask;
+    while (sessions->stationIndex[slot] != 0) {
+        int station = sessions->stationIndex[slot] - 1;
+        if (strcmp(sessions->stationNames[station], name) == 0) {
+            return station;
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (sessions->stationCount == sessions->stationCapacity) {
+        int capacity = (sessions->stationCapacity == 0) ? 16 : sessions->stationCapacity * 2;
+        const char** names = reallocMemory(sessions->allocator, sessions->stationNames,
+                                           sessions->stationCapacity * sizeof(const char*), capacity * sizeof(const char*));
+        if (names == NULL) {
+            return -1;
+        }
+        sessions->stationNames = names;
+        sessions->stationCapacity = capacity;
+    }
+    sessions->stationNames[sessions->stationCount] = name;
+    sessions->stationIndex[slot] = sessions->stationCount + 1;
+    return sessions->stationCount++;
+}
+
+// Grow field, one of a set of parallel arrays, from old to new elements; grown receives the new array
+#define GROW_ARRAY(sessions, field, old, new, grown) \
+    (((grown) = reallocMemory((sessions)->allocator, (field), (old) * sizeof(*(field)), (new) * sizeof(*(field)))) != NULL && \
+     ((field) = (grown)) != NULL)
+
+static bool addVisit(Sessions* sessions, int station, int offset, int length) {
+    if (sessions->visitCount == sessions->visitCapacity) {
+        long old = sessions->visitCapacity;
+        long capacity = (old == 0) ? 256 : old * 2;
+        void* grown;
+        if (!GROW_ARRAY(sessions, sessions->station, old, capacity, grown) ||
+            !GROW_ARRAY(sessions, sessions->offset, old, capacity, grown) ||
+            !GROW_ARRAY(sessions, sessions->length, old, capacity, grown)) {
+            return false;
+        }
+        sessions->visitCapacity = capacity;
+    }
+    sessions->station[sessions->visitCount] = (uint32_t)station;
+    sessions->offset[sessions->visitCount] = (uint16_t)offset;
+    sessions->length[sessions->visitCount] = (uint16_t)length;
+    sessions->visitCount++;
+    return true;
+}
+
+static bool addSession(Sessions* sessions, int weekday, int minutes, long firstVisit) {
+    if (sessions->sessionCount == sessions->sessionCapacity) {
+        int old = sessions->sessionCapacity;
+        int capacity = (old == 0) ? 64 : old * 2;
+        void* grown;
+        if (!GROW_ARRAY(sessions, sessions->weekday, old, capacity, grown) ||
+            !GROW_ARRAY(sessions, sessions->minutes, old, capacity, grown) ||
+            !GROW_ARRAY(sessions, sessions->firstVisit, old, capacity, grown) ||
+            !GROW_ARRAY(sessions, sessions->sessionVisits, old, capacity, grown)) {
+            return false;
+        }
+        sessions->sessionCapacity = capacity;
+    }
+    sessions->weekday[sessions->sessionCount] = (uint8_t)weekday;
+    sessions->minutes[sessions->sessionCount] = (uint16_t)minutes;
+    sessions->firstVisit[sessions->sessionCount] = (uint32_t)firstVisit;
+    sessions->sessionVisits[sessions->sessionCount] = (uint16_t)(sessions->visitCount - firstVisit);
+    sessions->sessionCount++;
+    return true;
+}
+
+// Add a client's session on weekday: the exercises of every plan's days named after it, in order
+static bool extractSession(Sessions* sessions, ASTNode** plans, int planCount, int weekday) {
+    long firstVisit = sessions->visitCount;
+    int minutes = 0;
+    for (int i = 0; i < planCount; i++) {
+        for (int j = 0; j < plans[i]->childrenCount; j++) {
+            ASTNode* day = plans[i]->children[j];
+            if (weekdayFromName(day->data.day.name) != weekday) {
+                continue;
+            }
+            for (int k = 0; k < day->childrenCount && minutes < DAY_MINUTES; k++) {
+                ASTNode* exercise = day->children[k];
+                long length = (long)exercise->data.exercise.sets * (SIMULATE_SET_MINUTES + exercise->data.exercise.rest);
+                if (length <= 0) {
+                    continue;
+                }
+                if (length > DAY_MINUTES - minutes) {
+                    length = DAY_MINUTES - minutes; // Nothing past midnight is counted
+                }
+                int station = internStation(sessions, exercise->data.exercise.name);
+                if (station < 0 || !addVisit(sessions, station, minutes, (int)length)) {
+                    return false;
+                }
+                minutes += (int)length;
+            }
+        }
+    }
+    return sessions->visitCount == firstVisit || addSession(sessions, weekday, minutes, firstVisit);
+}
+
+static bool extractSessions(const Environment* env, Sessions* sessions) {
+    for (int i = 0; i < env->clientCount; i++) {
+        ASTNode** plans;
+        int planCount;
+        if (listClientPlans(env, &env->clients[i], &plans, &planCount) != 0) {
+            return false;
+        }
+        bool ok = true;
+        for (int weekday = 0; weekday < 7 && ok; weekday++) {
+            ok = extractSession(sessions, plans, planCount, weekday);
+        }
+        releaseMemory(env->allocator, plans, planCount * sizeof(ASTNode*));
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void freeSessions(Sessions* sessions) {
+    Allocator* allocator = sessions->allocator;
+    releaseMemory(allocator, sessions->weekday, sessions->sessionCapacity * sizeof(uint8_t));
+    releaseMemory(allocator, sessions->minutes, sessions->sessionCapacity * sizeof(uint16_t));
+    releaseMemory(allocator, sessions->firstVisit, sessions->sessionCapacity * sizeof(uint32_t));
+    releaseMemory(allocator, sessions->sessionVisits, sessions->sessionCapacity * sizeof(uint16_t));
+    releaseMemory(allocator, sessions->station, sessions->visitCapacity * sizeof(uint32_t));
+    releaseMemory(allocator, sessions->offset, sessions->visitCapacity * sizeof(uint16_t));
+    releaseMemory(allocator, sessions->length, sessions->visitCapacity * sizeof(uint16_t));
+    releaseMemory(allocator, sessions->stationNames, sessions->stationCapacity * sizeof(const char*));
+    releaseMemory(allocator, sessions->stationIndex, sessions->stationIndexCapacity * sizeof(int));
+}
+
+/***
+ * Scenarios
+*/
+
+static uint64_t splitMix(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Invert the cumulative arrival profile, so a uniform index gives an arrival minute
+static void buildArrivals(uint16_t* arrivals) {
+    int total = 0;
+    for (int hour = 0; hour < 24; hour++) {
+        total += arrivalProfile[hour];
+    }
+    int hour = 0;
+    double before = 0; // Weight of the hours before hour
+    for (int i = 0; i < ARRIVAL_TABLE_SIZE; i++) {
+        double target = (i + 0.5) * total / ARRIVAL_TABLE_SIZE;
+        while (before + arrivalProfile[hour] <= target) {
+            before += arrivalProfile[hour++];
+        }
+        arrivals[i] = (uint16_t)(hour * 60 + (int)((target - before) * 60 / arrivalProfile[hour]));
+    }
+}
+
+// Add the presence from start to end (minutes, end exclusive) to a column of a weekday's rows
+static inline void addPresence(int32_t* weekdayRows, int columns, int column, int start, int end) {
+    if (end > DAY_MINUTES) {
+        end = DAY_MINUTES;
+    }
+    if (start < end) {
+        weekdayRows[(start / SIMULATE_SLOT_MINUTES) * columns + column]++;
+        weekdayRows[((end - 1) / SIMULATE_SLOT_MINUTES + 1) * columns + column]--;
+    }
+}
+
+static void runScenario(Worker* worker, int scenario) {
+    const Sessions* sessions = worker->sessions;
+    int columns = worker->columns;
+    uint64_t state = worker->seed ^ ((uint64_t)scenario * 0xD1B54A32D192ED03ULL);
+    splitMix(&state);
+
+    memset(worker->difference, 0, (size_t)7 * WEEKDAY_ROWS * columns * sizeof(int32_t));
+    for (int i = 0; i < sessions->sessionCount; i++) {
+        uint64_t draw = splitMix(&state);
+        if ((draw & 0xFFFFFFFFULL) >= worker->threshold) {
+            continue;
+        }
+        int arrival = worker->arrivals[draw >> (64 - ARRIVAL_BITS)];
+        int32_t* rows = worker->difference + (size_t)sessions->weekday[i] * WEEKDAY_ROWS * columns;
+        addPresence(rows, columns, 0, arrival, arrival + sessions->minutes[i]);
+        uint32_t end = sessions->firstVisit[i] + sessions->sessionVisits[i];
+        for (uint32_t v = sessions->firstVisit[i]; v < end; v++) {
+            int start = arrival + sessions->offset[v];
+            addPresence(rows, columns, (int)sessions->station[v] + 1, start, start + sessions->length[v]);
+        }
+    }
+
+    // Prefix sums along each weekday turn the differences into occupancy; each
+    // step is an element-wise pass over a row, which the compiler vectorizes
+    int32_t* restrict running = worker->running;
+    for (int weekday = 0; weekday < 7; weekday++) {
+        memset(running, 0, columns * sizeof(int32_t));
+        for (int slot = 0; slot < SIMULATE_SLOTS; slot++) {
+            const int32_t* restrict difference = worker->difference + ((size_t)weekday * WEEKDAY_ROWS + slot) * columns;
+            int64_t* restrict sums = worker->sums + ((size_t)weekday * SIMULATE_SLOTS + slot) * columns;
+            int32_t* restrict peaks = worker->peaks + ((size_t)weekday * SIMULATE_SLOTS + slot) * columns;
+            for (int c = 0; c < columns; c++) {
+                running[c] += difference[c];
+                sums[c] += running[c];
+                peaks[c] = (running[c] > peaks[c]) ? running[c] : peaks[c];
+            }
+        }
+    }
+}
+
+static void* runWorker(void* data) {
+    Worker* worker = data;
+    for (int scenario = worker->firstScenario; scenario < worker->endScenario; scenario++) {
+        runScenario(worker, scenario);
+    }
+    return NULL;
+}
+
+static void releaseWorker(Allocator* allocator, Worker* worker) {
+    size_t cells = (size_t)7 * SIMULATE_SLOTS * worker->columns;
+    releaseMemory(allocator, worker->difference, (size_t)7 * WEEKDAY_ROWS * worker->columns * sizeof(int32_t));
+    releaseMemory(allocator, worker->running, worker->columns * sizeof(int32_t));
+    releaseMemory(allocator, worker->sums, cells * sizeof(int64_t));
+    releaseMemory(allocator, worker->peaks, cells * sizeof(int32_t));
+}
+
+static bool allocateWorker(Allocator* allocator, Worker* worker) {
+    size_t cells = (size_t)7 * SIMULATE_SLOTS * worker->columns;
+    worker->difference = allocMemory(allocator, (size_t)7 * WEEKDAY_ROWS * worker->columns * sizeof(int32_t));
+    worker->running = allocMemory(allocator, worker->columns * sizeof(int32_t));
+    worker->sums = allocMemory(allocator, cells * sizeof(int64_t));
+    worker->peaks = allocMemory(allocator, cells * sizeof(int32_t));
+    if (worker->difference == NULL || worker->running == NULL || worker->sums == NULL || worker->peaks == NULL) {
+        return false;
+    }
+    memset(worker->sums, 0, cells * sizeof(int64_t));
+    memset(worker->peaks, 0, cells * sizeof(int32_t));
+    return true;
+}
+
+// Run every scenario; the totals are left in the first worker
+static void runWorkers(Worker* workers, int count) {
+    pthread_t threads[SIMULATE_MAX_THREADS];
+    bool started[SIMULATE_MAX_THREADS];
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, runWorker, &workers[i]) == 0;
+    }
+    runWorker(&workers[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            runWorker(&workers[i]); // No thread to be had: do it here
+        }
+    }
+
+    // Sums and maxima do not depend on the order they are taken in
+    size_t cells = (size_t)7 * SIMULATE_SLOTS * workers[0].columns;
+    for (int i = 1; i < count; i++) {
+        int64_t* restrict sums = workers[0].sums;
+        int32_t* restrict peaks = workers[0].peaks;
+        for (size_t c = 0; c < cells; c++) {
+            sums[c] += workers[i].sums[c];
+            peaks[c] = (workers[i].peaks[c] > peaks[c]) ? workers[i].peaks[c] : peaks[c];
+        }
+    }
+}
+
+/***
+ * Simulation
+*/
+
+static int writeHistogram(const Environment* env, const Worker* totals, int scenarios, int column,
+                          const char* station, OutputWriter writer, void* writerData) {
+    for (int weekday = 0; weekday < 7; weekday++) {
+        for (int slot = 0; slot < SIMULATE_SLOTS; slot++) {
+            size_t cell = ((size_t)weekday * SIMULATE_SLOTS + slot) * totals->columns + column;
+            if (totals->peaks[cell] == 0) {
+                continue;
+            }
+            int minute = slot * SIMULATE_SLOT_MINUTES;
+            if (writeFormatted(env->allocator, writer, writerData, "%s,%s,%02d:%02d,%.2f,%d\n",
+                    station, weekdayNames[weekday], minute / 60, minute % 60,
+                    (double)totals->sums[cell] / scenarios, totals->peaks[cell]) != 0) {
+                return SIMULATE_ERROR_OUTPUT;
+            }
+        }
+    }
+    return SIMULATE_OK;
+}
+
+static double elapsedMilliseconds(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int simulateOccupancy(const Environment* env, const SimulationOptions* options, Allocator* allocator,
+                      OutputWriter writer, void* writerData, SimulationStats* stats) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Sessions sessions;
+    memset(&sessions, 0, sizeof(sessions));
+    sessions.allocator = allocator;
+    if (!extractSessions(env, &sessions)) {
+        freeSessions(&sessions);
+        return SIMULATE_ERROR_NO_MEMORY;
+    }
+    double extractMilliseconds = elapsedMilliseconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int threads = options->threads;
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (online > 0) ? (int)online : 1;
+    }
+    if (threads > SIMULATE_MAX_THREADS) {
+        threads = SIMULATE_MAX_THREADS;
+    }
+    if (threads > options->scenarios) {
+        threads = options->scenarios;
+    }
+
+    uint16_t arrivals[ARRIVAL_TABLE_SIZE];
+    buildArrivals(arrivals);
+    int columns = (sessions.stationCount + 1 + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+    Worker workers[SIMULATE_MAX_THREADS];
+    memset(workers, 0, sizeof(workers));
+    int status = SIMULATE_OK;
+    for (int i = 0; i < threads; i++) {
+        workers[i].sessions = &sessions;
+        workers[i].arrivals = arrivals;
+        workers[i].threshold = ((uint64_t)options->attendance << 32) / 100;
+        workers[i].seed = options->seed;
+        workers[i].columns = columns;
+        workers[i].firstScenario = (int)((long)options->scenarios * i / threads);
+        workers[i].endScenario = (int)((long)options->scenarios * (i + 1) / threads);
+        if (!allocateWorker(allocator, &workers[i])) {
+            status = SIMULATE_ERROR_NO_MEMORY;
+        }
+    }
+    if (status == SIMULATE_OK) {
+        runWorkers(workers, threads);
+        double simulateMilliseconds = elapsedMilliseconds(&start);
+
+        status = writeHistogram(env, &workers[0], options->scenarios, 0, "*", writer, writerData);
+        for (int i = 0; i < sessions.stationCount && status == SIMULATE_OK; i++) {
+            status = writeHistogram(env, &workers[0], options->scenarios, i + 1, sessions.stationNames[i], writer, writerData);
+        }
+        if (stats != NULL) {
+            stats->sessions = sessions.sessionCount;
+            stats->visits = sessions.visitCount;
+            stats->stations = sessions.stationCount;
+            stats->threads = threads;
+            stats->extractMilliseconds = extractMilliseconds;
+            stats->simulateMilliseconds = simulateMilliseconds;
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        releaseWorker(allocator, &workers[i]);
+    }
+    freeSessions(&sessions);
+    return status;
+}
+
+const char* simulateErrorString(int status) {
+    switch (status) {
+        case SIMULATE_OK: return "no error";
+        case SIMULATE_ERROR_OUTPUT: return "unable to write the output";
+        case SIMULATE_ERROR_NO_MEMORY: return "out of memory";
+        default: return "unknown error";
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include <stdint.h>
+#include "interpreter.h"
+
+// Occupancy simulation: forecasts how busy the location and each exercise
+// station are over a typical week. After the program has run, every client's
+// weekly plans are reduced to compact session descriptors: one per client and
+// training weekday, with the exercises of that day as visits to stations (one
+// station per exercise name). A visit lasts sets * (SIMULATE_SET_MINUTES + rest)
+// minutes and the visits of a session follow each other.
+//
+// Each Monte Carlo scenario decides, for every session, whether the client
+// comes (with the attendance probability) and when they arrive (from a fixed
+// profile of arrivals over the opening hours, with morning and evening peaks).
+// Presence is added to difference arrays of SIMULATE_SLOT_MINUTES slots, one
+// column per station plus one for the whole location, which are then
+// prefix-summed into the scenario's occupancy; the sums and peaks over the
+// scenarios make the histograms.
+//
+// Scenarios are split over threads. Each scenario draws from its own
+// generator, seeded from the seed and the scenario's number, so the result
+// does not depend on the number of threads.
+
+#define SIMULATE_SLOT_MINUTES 15
+#define SIMULATE_SLOTS (24 * 60 / SIMULATE_SLOT_MINUTES)
+#define SIMULATE_SET_MINUTES 1      // Time to perform one set, rest excluded
+#define SIMULATE_MAX_THREADS 64
+
+// Simulation status codes
+#define SIMULATE_OK 0
+#define SIMULATE_ERROR_OUTPUT -1    // The writer failed
+#define SIMULATE_ERROR_NO_MEMORY -2
+
+typedef struct {
+    int scenarios;
+    int attendance;         // Percent chance that a client comes to a session (1-100)
+    uint64_t seed;
+    int threads;            // 0 for one per online processor
+} SimulationOptions;
+
+typedef struct {
+    int sessions;           // Session descriptors (client and weekday)
+    long visits;
+    int stations;
+    int threads;
+    double extractMilliseconds;
+    double simulateMilliseconds;
+} SimulationStats;
+
+// Simulate the clients of env and write the histograms as lines of
+// "station,weekday,HH:MM,mean,peak" for every slot anyone is in, the whole
+// location first with station "*"; stats may be NULL. Returns a status code.
+int simulateOccupancy(const Environment* env, const SimulationOptions* options, Allocator* allocator,
+                      OutputWriter writer, void* writerData, SimulationStats* stats);
+
+const char* simulateErrorString(int status);
+
+#endif // SIMULATE_H
@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef FITLANG_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "source.h"
+
+struct Source {
+    Allocator* allocator;
+    FILE* file;
+    SourceFormat format;
+    int status;                         // First error, SOURCE_OK if none
+
+    // Plain input is read on the caller's thread into one chunk
+    char* plainChunk;
+
+    // Compressed input: a ring of chunks filled by the helper thread. The
+    // chunk at head is held by the caller until its next request.
+    char* chunks[SOURCE_CHUNK_COUNT];
+    size_t lengths[SOURCE_CHUNK_COUNT];
+    int head;
+    int filled;                         // Chunks published and not yet handed back
+    bool holding;
+    bool finished;                      // Helper thread has published its last chunk
+    bool cancelled;
+    bool threadStarted;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned char* input;               // Compressed bytes (helper thread only)
+};
+
+/***
+ * Helper thread side
+*/
+
+// Wait for a free chunk to decompress into (NULL once the reader has gone away)
+static char* acquireChunk(Source* source) {
+    pthread_mutex_lock(&source->lock);
+    while (source->filled == SOURCE_CHUNK_COUNT && !source->cancelled) {
+        pthread_cond_wait(&source->changed, &source->lock);
+    }
+    char* chunk = source->cancelled ? NULL : source->chunks[(source->head + source->filled) % SOURCE_CHUNK_COUNT];
+    pthread_mutex_unlock(&source->lock);
+    return chunk;
+}
+
+static void publishChunk(Source* source, size_t length) {
+    pthread_mutex_lock(&source->lock);
+    source->lengths[(source->head + source->filled) % SOURCE_CHUNK_COUNT] = length;
+    source->filled++;
+    pthread_cond_broadcast(&source->changed);
+    pthread_mutex_unlock(&source->lock);
+}
+
+static void finishSource(Source* source, int status) {
+    pthread_mutex_lock(&source->lock);
+    if (source->status == SOURCE_OK) {
+        source->status = status;
+    }
+    source->finished = true;
+    pthread_cond_broadcast(&source->changed);
+    pthread_mutex_unlock(&source->lock);
+}
+
+// gzip, including files made of several concatenated gzip members
+static int decompressGzip(Source* source) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return SOURCE_ERROR_NO_MEMORY;
+    }
+
+    int status = SOURCE_OK;
+    bool memberOpen = false;
+    char* out = NULL;
+    while (status == SOURCE_OK) {
+        if (stream.avail_in == 0) {
+            size_t count = fread(source->input, 1, SOURCE_CHUNK_SIZE, source->file);
+            if (count == 0) {
+                if (ferror(source->file)) {
+                    status = SOURCE_ERROR_IO;
+                } else if (memberOpen) {
+                    status = SOURCE_ERROR_CORRUPT; // Truncated stream
+                }
+                break;
+            }
+            stream.next_in = source->input;
+            stream.avail_in = count;
+        }
+        if (out == NULL) {
+            out = acquireChunk(source);
+            if (out == NULL) {
+                break;
+            }
+            stream.next_out = (unsigned char*)out;
+            stream.avail_out = SOURCE_CHUNK_SIZE;
+        }
+
+        int result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_STREAM_END) {
+            memberOpen = false;
+            inflateReset(&stream);
+        } else if (result == Z_OK || result == Z_BUF_ERROR) {
+            memberOpen = true;
+        } else {
+            status = (result == Z_MEM_ERROR) ? SOURCE_ERROR_NO_MEMORY : SOURCE_ERROR_CORRUPT;
+        }
+
+        if (stream.avail_out == 0) {
+            publishChunk(source, SOURCE_CHUNK_SIZE);
+            out = NULL;
+        }
+    }
+
+    if (out != NULL && stream.avail_out < SOURCE_CHUNK_SIZE) {
+        publishChunk(source, SOURCE_CHUNK_SIZE - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return status;
+}
+
+#ifdef FITLANG_HAVE_ZSTD
+static int decompressZstd(Source* source) {
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    if (stream == NULL) {
+        return SOURCE_ERROR_NO_MEMORY;
+    }
+    ZSTD_initDStream(stream);
+
+    int status = SOURCE_OK;
+    size_t pending = 0;   // Non-zero while a frame is incomplete
+    ZSTD_inBuffer in = { source->input, 0, 0 };
+    ZSTD_outBuffer out = { NULL, SOURCE_CHUNK_SIZE, 0 };
+    while (status == SOURCE_OK) {
+        if (in.pos == in.size) {
+            size_t count = fread(source->input, 1, SOURCE_CHUNK_SIZE, source->file);
+            if (count == 0) {
+                if (ferror(source->file)) {
+                    status = SOURCE_ERROR_IO;
+                } else if (pending != 0) {
+                    status = SOURCE_ERROR_CORRUPT;
+                }
+                break;
+            }
+            in.size = count;
+            in.pos = 0;
+        }
+        if (out.dst == NULL) {
+            out.dst = acquireChunk(source);
+            if (out.dst == NULL) {
+                break;
+            }
+            out.pos = 0;
+        }
+
+        pending = ZSTD_decompressStream(stream, &out, &in);
+        if (ZSTD_isError(pending)) {
+            status = SOURCE_ERROR_CORRUPT;
+        }
+        if (out.pos == out.size) {
+            publishChunk(source, out.pos);
+            out.dst = NULL;
+        }
+    }
+
+    if (out.dst != NULL && out.pos > 0) {
+        publishChunk(source, out.pos);
+    }
+    ZSTD_freeDStream(stream);
+    return status;
+}
+#endif
+
+static void* decompressSource(void* argument) {
+    Source* source = argument;
+#ifdef FITLANG_HAVE_ZSTD
+    int status = (source->format == SOURCE_ZSTD) ? decompressZstd(source) : decompressGzip(source);
+#else
+    int status = decompressGzip(source);
+#endif
+    finishSource(source, status);
+    return NULL;
+}
+
+/***
+ * Source functions
+*/
+
+static SourceFormat detectFormat(const unsigned char* magic, size_t length) {
+    if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return SOURCE_GZIP;
+    }
+    if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        return SOURCE_ZSTD;
+    }
+    return SOURCE_PLAIN;
+}
+
+int openSource(const char* path, Allocator* allocator, Source** source) {
+    *source = NULL;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return SOURCE_ERROR_IO;
+    }
+
+    unsigned char magic[4];
+    size_t magicLength = fread(magic, 1, sizeof(magic), file);
+    SourceFormat format = detectFormat(magic, magicLength);
+    if (fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return SOURCE_ERROR_IO;
+    }
+    return openSourceStream(file, format, allocator, source);
+}
+
+int openSourceStream(FILE* file, SourceFormat format, Allocator* allocator, Source** source) {
+    *source = NULL;
+#ifndef FITLANG_HAVE_ZSTD
+    if (format == SOURCE_ZSTD) {
+        fclose(file);
+        return SOURCE_ERROR_UNSUPPORTED;
+    }
+#endif
+
+    Source* opened = allocMemory(allocator, sizeof(Source));
+    if (opened == NULL) {
+        fclose(file);
+        return SOURCE_ERROR_NO_MEMORY;
+    }
+    memset(opened, 0, sizeof(Source));
+    opened->allocator = allocator;
+    opened->file = file;
+    opened->format = format;
+
+    if (format == SOURCE_PLAIN) {
+        opened->plainChunk = allocMemory(allocator, SOURCE_CHUNK_SIZE);
+        if (opened->plainChunk == NULL) {
+            closeSource(opened);
+            return SOURCE_ERROR_NO_MEMORY;
+        }
+        *source = opened;
+        return SOURCE_OK;
+    }
+
+    opened->input = allocMemory(allocator, SOURCE_CHUNK_SIZE);
+    bool allocated = opened->input != NULL;
+    for (int i = 0; i < SOURCE_CHUNK_COUNT; i++) {
+        opened->chunks[i] = allocMemory(allocator, SOURCE_CHUNK_SIZE);
+        allocated = allocated && opened->chunks[i] != NULL;
+    }
+    if (!allocated) {
+        closeSource(opened);
+        return SOURCE_ERROR_NO_MEMORY;
+    }
+
+    pthread_mutex_init(&opened->lock, NULL);
+    pthread_cond_init(&opened->changed, NULL);
+    if (pthread_create(&opened->thread, NULL, decompressSource, opened) != 0) {
+        pthread_mutex_destroy(&opened->lock);
+        pthread_cond_destroy(&opened->changed);
+        closeSource(opened);
+        return SOURCE_ERROR_NO_MEMORY;
+    }
+    opened->threadStarted = true;
+    *source = opened;
+    return SOURCE_OK;
+}
+
+int nextSourceChunk(Source* source, const char** data, size_t* length) {
+    if (source->format == SOURCE_PLAIN) {
+        size_t count = fread(source->plainChunk, 1, SOURCE_CHUNK_SIZE, source->file);
+        if (count > 0) {
+            *data = source->plainChunk;
+            *length = count;
+            return 1;
+        }
+        if (ferror(source->file)) {
+            source->status = SOURCE_ERROR_IO;
+        }
+        return source->status;
+    }
+
+    pthread_mutex_lock(&source->lock);
+    if (source->holding) {
+        source->head = (source->head + 1) % SOURCE_CHUNK_COUNT;
+        source->filled--;
+        source->holding = false;
+        pthread_cond_broadcast(&source->changed);
+    }
+    while (source->filled == 0 && !source->finished) {
+        pthread_cond_wait(&source->changed, &source->lock);
+    }
+
+    int result = source->status;
+    if (source->filled > 0) {
+        *data = source->chunks[source->head];
+        *length = source->lengths[source->head];
+        source->holding = true;
+        result = 1;
+    }
+    pthread_mutex_unlock(&source->lock);
+    return result;
+}
+
+SourceFormat sourceFormat(const Source* source) {
+    return source->format;
+}
+
+int sourceStatus(Source* source) {
+    if (!source->threadStarted) {
+        return source->status;
+    }
+    pthread_mutex_lock(&source->lock);
+    int status = source->status;
+    pthread_mutex_unlock(&source->lock);
+    return status;
+}
+
+void closeSource(Source* source) {
+    if (source == NULL) {
+        return;
+    }
+    if (source->threadStarted) {
+        pthread_mutex_lock(&source->lock);
+        source->cancelled = true;
+        pthread_cond_broadcast(&source->changed);
+        pthread_mutex_unlock(&source->lock);
+        pthread_join(source->thread, NULL);
+        pthread_mutex_destroy(&source->lock);
+        pthread_cond_destroy(&source->changed);
+    }
+
+    Allocator* allocator = source->allocator;
+    releaseMemory(allocator, source->plainChunk, SOURCE_CHUNK_SIZE);
+    releaseMemory(allocator, source->input, SOURCE_CHUNK_SIZE);
+    for (int i = 0; i < SOURCE_CHUNK_COUNT; i++) {
+        releaseMemory(allocator, source->chunks[i], SOURCE_CHUNK_SIZE);
+    }
+    if (source->file != NULL) {
+        fclose(source->file);
+    }
+    releaseMemory(allocator, source, sizeof(Source));
+}
+
+/***
+ * Whole input
+*/
+
+int loadSourceText(const char* path, Allocator* allocator, SourceText* input) {
+    input->text = NULL;
+    input->length = 0;
+    input->mapped = 0;
+    Source* source;
+    int sourceResult = openSource(path, allocator, &source);
+    if (sourceResult == SOURCE_OK && sourceFormat(source) == SOURCE_PLAIN) {
+        closeSource(source);
+        int fd = open(path, O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            sourceResult = SOURCE_ERROR_IO;
+        } else if (info.st_size > 0) {
+            void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                sourceResult = SOURCE_ERROR_IO;
+            } else {
+                input->text = mapping;
+                input->length = (size_t)info.st_size;
+                input->mapped = 1;
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    } else if (sourceResult == SOURCE_OK) {
+        char* text = NULL;
+        size_t capacity = 0;
+        const char* chunk;
+        size_t chunkLength;
+        while ((sourceResult = nextSourceChunk(source, &chunk, &chunkLength)) > 0) {
+            if (input->length + chunkLength > capacity) {
+                size_t newCapacity = (capacity == 0) ? SOURCE_CHUNK_SIZE : capacity;
+                while (newCapacity < input->length + chunkLength) {
+                    newCapacity *= 2;
+                }
+                char* resized = reallocMemory(allocator, text, capacity, newCapacity);
+                if (resized == NULL) {
+                    sourceResult = SOURCE_ERROR_NO_MEMORY;
+                    break;
+                }
+                text = resized;
+                capacity = newCapacity;
+            }
+            memcpy(text + input->length, chunk, chunkLength);
+            input->length += chunkLength;
+        }
+        closeSource(source);
+        // Shrink to fit, so the text can be released knowing only its length
+        if (text != NULL && capacity != input->length) {
+            char* fitted = reallocMemory(allocator, text, capacity, input->length);
+            if (fitted != NULL || input->length == 0) {
+                text = fitted;
+            }
+        }
+        if (sourceResult < 0) {
+            releaseMemory(allocator, text, input->length);
+            input->length = 0;
+            return sourceResult;
+        }
+        input->text = text;
+    }
+
+    if (sourceResult < 0) {
+        return sourceResult;
+    }
+    if (input->text == NULL) {
+        input->text = "";
+    }
+    return SOURCE_OK;
+}
+
+void releaseSourceText(SourceText* input, Allocator* allocator) {
+    if (input->mapped) {
+        munmap((void*)input->text, input->length);
+    } else if (input->text != NULL && input->length > 0) {
+        releaseMemory(allocator, (void*)input->text, input->length);
+    }
+    input->text = NULL;
+    input->length = 0;
+    input->mapped = 0;
+}
+
+const char* sourceErrorString(int status) {
+    switch (status) {
+        case SOURCE_OK:
+            return "ok";
+        case SOURCE_ERROR_IO:
+            return "unable to read file";
+        case SOURCE_ERROR_NO_MEMORY:
+            return "out of memory";
+        case SOURCE_ERROR_CORRUPT:
+            return "compressed data is corrupt or truncated";
+        case SOURCE_ERROR_UNSUPPORTED:
+            return "zstd input needs a build with FITLANG_HAVE_ZSTD";
+        default:
+            return "unknown error";
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "alloc.h"
+
+// Program input read in chunks. Compressed files (gzip, and zstd when built
+// with -DFITLANG_HAVE_ZSTD) are recognized by their magic bytes and
+// decompressed on a helper thread while the caller consumes earlier chunks.
+
+#define SOURCE_CHUNK_SIZE (64 * 1024)
+#define SOURCE_CHUNK_COUNT 4
+
+// Source status codes
+#define SOURCE_OK 0
+#define SOURCE_ERROR_IO -1
+#define SOURCE_ERROR_NO_MEMORY -2
+#define SOURCE_ERROR_CORRUPT -3
+#define SOURCE_ERROR_UNSUPPORTED -4
+
+typedef enum {
+    SOURCE_PLAIN,
+    SOURCE_GZIP,
+    SOURCE_ZSTD
+} SourceFormat;
+
+typedef struct Source Source;
+
+// The whole input in memory: a mapping of an uncompressed file, or the
+// decompressed text of a compressed one
+typedef struct {
+    const char* text;
+    size_t length;
+    int mapped;                 // text is a mapping of the file rather than a copy
+} SourceText;
+
+// Function prototypes for reading a source
+int openSource(const char* path, Allocator* allocator, Source** source);
+// Read an open stream (e.g. a pipe) whose format is already known; the source
+// takes ownership of the stream and closes it, even on failure
+int openSourceStream(FILE* file, SourceFormat format, Allocator* allocator, Source** source);
+// Next chunk of plain text; the previous chunk is handed back to the reader.
+// Returns 1 with a chunk, 0 at the end of the input, or a negative status.
+int nextSourceChunk(Source* source, const char** data, size_t* length);
+SourceFormat sourceFormat(const Source* source);
+int sourceStatus(Source* source); // First error seen, SOURCE_OK if none
+void closeSource(Source* source);
+const char* sourceErrorString(int status);
+
+// Function prototypes for reading the whole input at once
+int loadSourceText(const char* path, Allocator* allocator, SourceText* input);
+void releaseSourceText(SourceText* input, Allocator* allocator);
+
+#endif // SOURCE_H
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "sourcemap.h"
+#include "source.h"
+
+#define INITIAL_LINE_CAPACITY 1024
+
+struct SourceMap {
+    Allocator* allocator;
+    char* name;              // Shown in diagnostics
+    char* path;              // File read again when needed (NULL for a buffer)
+    const char* text;        // Buffer input (NULL for a file)
+    size_t length;
+    size_t* lines;           // Offset where each line starts, ascending
+    size_t lineCount;
+    size_t lineCapacity;
+    bool indexed;            // lines is built (or failed to be)
+    bool readable;           // The input could be read
+    bool offsetsOnly;        // Diagnostics carry the raw offset, for another process to locate
+};
+
+/***
+ * Newline index
+*/
+
+static bool addLine(SourceMap* map, size_t offset) {
+    if (map->lineCount == map->lineCapacity) {
+        size_t newCapacity = map->lineCapacity * 2;
+        size_t* resized = reallocMemory(map->allocator, map->lines,
+            map->lineCapacity * sizeof(size_t), newCapacity * sizeof(size_t));
+        if (resized == NULL) {
+            return false;
+        }
+        map->lines = resized;
+        map->lineCapacity = newCapacity;
+    }
+    map->lines[map->lineCount++] = offset;
+    return true;
+}
+
+// Record a line start after every newline in data, which begins at offset base.
+// SSE2 compares 16 bytes at a time; most blocks have no newline at all.
+static bool indexNewlines(SourceMap* map, const char* data, size_t length, size_t base) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        while (mask != 0) {
+            if (!addLine(map, base + i + (size_t)__builtin_ctz(mask) + 1)) {
+                return false;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i < length) {
+        const char* found = memchr(data + i, '\n', length - i);
+        if (found == NULL) {
+            break;
+        }
+        i = (size_t)(found - data) + 1;
+        if (!addLine(map, base + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool indexFile(SourceMap* map) {
+    Source* source;
+    if (openSource(map->path, map->allocator, &source) != SOURCE_OK) {
+        return false;
+    }
+    const char* chunk;
+    size_t chunkLength;
+    int result;
+    bool ok = true;
+    map->length = 0;
+    while (ok && (result = nextSourceChunk(source, &chunk, &chunkLength)) > 0) {
+        ok = indexNewlines(map, chunk, chunkLength, map->length);
+        map->length += chunkLength;
+    }
+    closeSource(source);
+    return ok && result == 0;
+}
+
+// Build the index on first use
+static bool indexSource(SourceMap* map) {
+    if (map->indexed) {
+        return map->readable;
+    }
+    map->indexed = true;
+    map->lines = allocMemory(map->allocator, INITIAL_LINE_CAPACITY * sizeof(size_t));
+    if (map->lines == NULL) {
+        return false;
+    }
+    map->lineCapacity = INITIAL_LINE_CAPACITY;
+    map->lines[0] = 0;
+    map->lineCount = 1;
+    map->readable = (map->text != NULL) ? indexNewlines(map, map->text, map->length, 0) : indexFile(map);
+    return map->readable;
+}
+
+// Copy up to size - 1 bytes of a line (from 1), starting skip bytes in and
+// without its line break
+static size_t readLine(SourceMap* map, size_t line, size_t skip, char* buffer, size_t size) {
+    size_t start = map->lines[line - 1] + skip;
+    size_t end = (line < map->lineCount) ? map->lines[line] : map->length;
+    size_t length = 0;
+    if (start >= end) {
+        return 0;
+    }
+
+    if (map->text != NULL) {
+        length = (end - start < size - 1) ? end - start : size - 1;
+        memcpy(buffer, map->text + start, length);
+    } else {
+        Source* source;
+        if (openSource(map->path, map->allocator, &source) != SOURCE_OK) {
+            return 0;
+        }
+        const char* chunk;
+        size_t chunkLength;
+        size_t offset = 0;
+        while (offset < end && length < size - 1 && nextSourceChunk(source, &chunk, &chunkLength) > 0) {
+            // Part of [start, end) in this chunk
+            size_t from = (start > offset) ? start - offset : 0;
+            size_t to = (end - offset < chunkLength) ? end - offset : chunkLength;
+            if (from < to) {
+                size_t take = (to - from < size - 1 - length) ? to - from : size - 1 - length;
+                memcpy(buffer + length, chunk + from, take);
+                length += take;
+            }
+            offset += chunkLength;
+        }
+        closeSource(source);
+    }
+
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == '\r')) {
+        length--;
+    }
+    return length;
+}
+
+/***
+ * Source map functions
+*/
+
+static SourceMap* newSourceMap(const char* name, Allocator* allocator) {
+    SourceMap* map = allocMemory(allocator, sizeof(SourceMap));
+    if (map == NULL) {
+        return NULL;
+    }
+    memset(map, 0, sizeof(SourceMap));
+    map->allocator = allocator;
+    map->name = allocString(allocator, name);
+    if (map->name == NULL) {
+        releaseMemory(allocator, map, sizeof(SourceMap));
+        return NULL;
+    }
+    return map;
+}
+
+SourceMap* createSourceMap(const char* path, Allocator* allocator) {
+    SourceMap* map = newSourceMap(path, allocator);
+    if (map != NULL && (map->path = allocString(allocator, path)) == NULL) {
+        freeSourceMap(map);
+        return NULL;
+    }
+    return map;
+}
+
+SourceMap* createBufferSourceMap(const char* name, const char* text, size_t length, Allocator* allocator) {
+    SourceMap* map = newSourceMap(name, allocator);
+    if (map != NULL) {
+        map->text = text;
+        map->length = length;
+    }
+    return map;
+}
+
+SourceMap* createOffsetSourceMap(Allocator* allocator) {
+    SourceMap* map = newSourceMap("", allocator);
+    if (map != NULL) {
+        map->offsetsOnly = true;
+    }
+    return map;
+}
+
+void freeSourceMap(SourceMap* map) {
+    if (map == NULL) {
+        return;
+    }
+    releaseMemory(map->allocator, map->lines, map->lineCapacity * sizeof(size_t));
+    releaseString(map->allocator, map->path);
+    releaseString(map->allocator, map->name);
+    releaseMemory(map->allocator, map, sizeof(SourceMap));
+}
+
+bool findSourcePosition(SourceMap* map, size_t offset, size_t* line, size_t* column) {
+    if (!indexSource(map)) {
+        return false;
+    }
+
+    // Last line starting at or before offset
+    size_t low = 0;
+    size_t high = map->lineCount;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (map->lines[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    *line = low + 1;
+    *column = offset - map->lines[low] + 1;
+    return true;
+}
+
+void printDiagnostic(SourceMap* map, size_t offset, const char* format, ...) {
+    char message[2 * DIAGNOSTIC_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (map != NULL && map->offsetsOnly && offset != NO_SOURCE_OFFSET) {
+        fprintf(stderr, "@%zu %s\n", offset, message);
+        return;
+    }
+    size_t line;
+    size_t column;
+    if (map == NULL || offset == NO_SOURCE_OFFSET || !findSourcePosition(map, offset, &line, &column)) {
+        fprintf(stderr, "%s\n", message);
+        return;
+    }
+    fprintf(stderr, "%s:%zu:%zu: %s\n", map->name, line, column, message);
+
+    // The line, and a caret under the column (tabs kept so it lines up). Long
+    // lines are cut to a window around the column.
+    char excerpt[SOURCE_EXCERPT_SIZE];
+    size_t skip = (column > sizeof(excerpt) / 2) ? column - sizeof(excerpt) / 2 : 0;
+    size_t length = readLine(map, line, skip, excerpt, sizeof(excerpt));
+    fprintf(stderr, "    %.*s\n    ", (int)length, excerpt);
+    for (size_t i = 0; i + 1 < column - skip && i < length; i++) {
+        fputc(excerpt[i] == '\t' ? '\t' : ' ', stderr);
+    }
+    fputs("^\n", stderr);
+}
+
+bool parseOffsetDiagnostic(const char* line, size_t* offset, const char** message) {
+    if (line[0] != '@') {
+        return false;
+    }
+    char* end;
+    unsigned long long value = strtoull(line + 1, &end, 10);
+    if (end == line + 1 || *end != ' ') {
+        return false;
+    }
+    *offset = (size_t)value;
+    *message = end + 1;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef SOURCEMAP_H
+#define SOURCEMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "alloc.h"
+#include "context.h"
+
+// Line and column lookup for diagnostics. Tokens and nodes only record byte
+// offsets, so the error-free path never counts lines. The first lookup scans
+// the input for newlines (reading the file again if need be) and keeps the
+// offset of every line start; later lookups are a binary search over them.
+
+#define SOURCE_EXCERPT_SIZE 160 // Longest excerpt of a line printed under a diagnostic
+
+typedef struct SourceMap SourceMap;
+
+// Function prototypes for creating source maps (no input is read yet)
+SourceMap* createSourceMap(const char* path, Allocator* allocator);
+SourceMap* createBufferSourceMap(const char* name, const char* text, size_t length, Allocator* allocator); // text must outlive the map
+// For input that only another process can locate (a shard of a program):
+// printDiagnostic writes "@offset message" for it to read back
+SourceMap* createOffsetSourceMap(Allocator* allocator);
+void freeSourceMap(SourceMap* map);
+
+// Line and column (both from 1) of an input offset; false if the input cannot be read
+bool findSourcePosition(SourceMap* map, size_t offset, size_t* line, size_t* column);
+
+// Print "name:line:column: message" to stderr, then the line with a caret
+// under the column. Without a map or a known offset only the message is printed.
+void printDiagnostic(SourceMap* map, size_t offset, const char* format, ...);
+
+// Split a line printed through an offset map (NUL-terminated, without its
+// newline); false if it is not located
+bool parseOffsetDiagnostic(const char* line, size_t* offset, const char** message);
+
+#endif // SOURCEMAP_H
@@ -0,0 +1,1188 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "store.h"
+
+#define STORE_MAGIC "FLSTORE1"
+#define STORE_VERSION 1
+#define STORE_CACHE_LIMIT 256   // Clean pages kept between operations
+#define STORE_MAX_DEPTH 16
+
+#define WAL_PAGE_MAGIC 0x50574c46u   // "FLWP": a page image follows
+#define WAL_COMMIT_MAGIC 0x43574c46u // "FLWC": the preceding page images form a complete commit
+
+#define PAGE_LEAF 1
+#define PAGE_INTERNAL 2
+#define PAGE_DATA 3
+
+#define RECORD_PLAN 1
+
+// Page layouts. Integers are kept in host byte order: a store file is local
+// to the machine that wrote it.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t pageCount;   // Pages in the file, including this header page
+    uint32_t rootPage;    // Root of the client B-tree (0 while empty)
+    uint32_t dataPage;    // Data page that new records are appended to (0 before the first)
+    uint32_t clientCount;
+} StoreHeader;
+
+typedef struct {
+    uint8_t type;
+    uint8_t unused;
+    uint16_t count;  // Entries in tree pages, bytes used in data pages
+    uint32_t link;   // Next leaf, first child of an internal page, or next data page
+} PageHeader;
+
+// Records from every client share the data pages. Each one starts with this
+// header (never split across pages) and its body may run onto following pages.
+typedef struct {
+    uint64_t next;   // Address of the client's next record (0 for the last)
+    uint32_t length; // Body length in bytes
+} RecordHeader;
+
+typedef struct {
+    char key[STORE_MAX_NAME + 1];
+    uint64_t head;   // Addresses of the first and last record on the client's plan chain (0 if none)
+    uint64_t tail;
+} LeafEntry;
+
+typedef struct {
+    char key[STORE_MAX_NAME + 1]; // Smallest key stored under child
+    uint32_t child;
+} InternalEntry;
+
+#define LEAF_CAPACITY ((int)((STORE_PAGE_SIZE - sizeof(PageHeader)) / sizeof(LeafEntry)))
+#define INTERNAL_CAPACITY ((int)((STORE_PAGE_SIZE - sizeof(PageHeader)) / sizeof(InternalEntry)))
+#define DATA_CAPACITY (STORE_PAGE_SIZE - sizeof(PageHeader))
+
+#define PAGE_HEADER(page) ((PageHeader*)(page))
+#define LEAF_ENTRIES(page) ((LeafEntry*)((page) + sizeof(PageHeader)))
+#define INTERNAL_ENTRIES(page) ((InternalEntry*)((page) + sizeof(PageHeader)))
+#define PAGE_DATA_BYTES(page) ((page) + sizeof(PageHeader))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t page;      // Page number, or the number of page records for a commit record
+    uint32_t checksum;
+} WalRecord;
+
+typedef struct {
+    uint32_t number;
+    bool dirty;
+    unsigned char* data;
+} CachedPage;
+
+// Growable byte buffer for serialized plans
+typedef struct {
+    Allocator* allocator;
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    size_t position;
+} ByteReader;
+
+struct Store {
+    Allocator* allocator;
+    int fd;
+    int walFd;
+    StoreHeader header;     // Working copy of page 0
+    StoreHeader committed;  // Page 0 as of the last commit
+    CachedPage* pages;      // Pages read or written since they were last evicted
+    int cachedCount;
+    int cachedCapacity;
+    int* index;             // Open-addressed page number index into pages (entries are position + 1)
+    int indexCapacity;
+    long pageReads;
+    long pageWrites;
+    long commits;
+};
+
+/***
+ * File helpers
+*/
+
+static int readAt(int fd, void* buffer, size_t length, off_t offset) {
+    unsigned char* bytes = buffer;
+    while (length > 0) {
+        ssize_t count = pread(fd, bytes, length, offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return STORE_ERROR_IO;
+        }
+        bytes += count;
+        length -= count;
+        offset += count;
+    }
+    return STORE_OK;
+}
+
+static int writeAt(int fd, const void* buffer, size_t length, off_t offset) {
+    const unsigned char* bytes = buffer;
+    while (length > 0) {
+        ssize_t count = pwrite(fd, bytes, length, offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return STORE_ERROR_IO;
+        }
+        bytes += count;
+        length -= count;
+        offset += count;
+    }
+    return STORE_OK;
+}
+
+static uint32_t checksumPage(uint32_t number, const unsigned char* data) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 4; i++) {
+        hash ^= (number >> (i * 8)) & 0xff;
+        hash *= 16777619u;
+    }
+    for (size_t i = 0; i < STORE_PAGE_SIZE; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/***
+ * Page cache
+*/
+
+static int cacheSlot(uint32_t number, int capacity) {
+    return (int)((number * 2654435761u) & (uint32_t)(capacity - 1));
+}
+
+static CachedPage* findCached(const Store* store, uint32_t number) {
+    if (store->indexCapacity == 0) {
+        return NULL;
+    }
+    int slot = cacheSlot(number, store->indexCapacity);
+    while (store->index[slot] != 0) {
+        CachedPage* page = &store->pages[store->index[slot] - 1];
+        if (page->number == number) {
+            return page;
+        }
+        slot = (slot + 1) & (store->indexCapacity - 1);
+    }
+    return NULL;
+}
+
+static int rebuildCacheIndex(Store* store, int newCapacity) {
+    int* newIndex = allocMemory(store->allocator, newCapacity * sizeof(int));
+    if (newIndex == NULL) {
+        return STORE_ERROR_NO_MEMORY;
+    }
+    memset(newIndex, 0, newCapacity * sizeof(int));
+
+    for (int i = 0; i < store->cachedCount; i++) {
+        int slot = cacheSlot(store->pages[i].number, newCapacity);
+        while (newIndex[slot] != 0) {
+            slot = (slot + 1) & (newCapacity - 1);
+        }
+        newIndex[slot] = i + 1;
+    }
+
+    releaseMemory(store->allocator, store->index, store->indexCapacity * sizeof(int));
+    store->index = newIndex;
+    store->indexCapacity = newCapacity;
+    return STORE_OK;
+}
+
+// Add a page buffer to the cache; the cache takes ownership of data
+static int addCached(Store* store, uint32_t number, unsigned char* data, bool dirty) {
+    if (store->cachedCount == store->cachedCapacity) {
+        int newCapacity = (store->cachedCapacity == 0) ? 32 : store->cachedCapacity * 2;
+        CachedPage* resized = reallocMemory(store->allocator, store->pages,
+            store->cachedCapacity * sizeof(CachedPage), newCapacity * sizeof(CachedPage));
+        if (resized == NULL) {
+            return STORE_ERROR_NO_MEMORY;
+        }
+        store->pages = resized;
+        store->cachedCapacity = newCapacity;
+    }
+    // Keep the index at most half full
+    if ((store->cachedCount + 1) * 2 > store->indexCapacity &&
+        rebuildCacheIndex(store, store->indexCapacity == 0 ? 64 : store->indexCapacity * 2) != STORE_OK) {
+        return STORE_ERROR_NO_MEMORY;
+    }
+
+    CachedPage* page = &store->pages[store->cachedCount];
+    page->number = number;
+    page->dirty = dirty;
+    page->data = data;
+
+    int slot = cacheSlot(number, store->indexCapacity);
+    while (store->index[slot] != 0) {
+        slot = (slot + 1) & (store->indexCapacity - 1);
+    }
+    store->index[slot] = ++store->cachedCount;
+    return STORE_OK;
+}
+
+// Drop cached pages; dirty ones are only dropped when discarding changes
+static void dropCached(Store* store, bool includeDirty) {
+    int kept = 0;
+    for (int i = 0; i < store->cachedCount; i++) {
+        CachedPage* page = &store->pages[i];
+        if (page->dirty && !includeDirty) {
+            store->pages[kept++] = *page;
+        } else {
+            releaseMemory(store->allocator, page->data, STORE_PAGE_SIZE);
+        }
+    }
+    store->cachedCount = kept;
+    if (store->indexCapacity > 0) {
+        memset(store->index, 0, store->indexCapacity * sizeof(int));
+        for (int i = 0; i < kept; i++) {
+            int slot = cacheSlot(store->pages[i].number, store->indexCapacity);
+            while (store->index[slot] != 0) {
+                slot = (slot + 1) & (store->indexCapacity - 1);
+            }
+            store->index[slot] = i + 1;
+        }
+    }
+}
+
+// Called at the start of each operation, when no page pointers are held
+static void trimCache(Store* store) {
+    if (store->cachedCount > STORE_CACHE_LIMIT) {
+        dropCached(store, false);
+    }
+}
+
+// Get a page (never page 0), reading it from the file if it is not cached
+static int loadPage(Store* store, uint32_t number, bool forWrite, unsigned char** data) {
+    if (number == 0 || number >= store->header.pageCount) {
+        return STORE_ERROR_CORRUPT;
+    }
+
+    CachedPage* cached = findCached(store, number);
+    if (cached == NULL) {
+        unsigned char* buffer = allocMemory(store->allocator, STORE_PAGE_SIZE);
+        if (buffer == NULL) {
+            return STORE_ERROR_NO_MEMORY;
+        }
+        if (readAt(store->fd, buffer, STORE_PAGE_SIZE, (off_t)number * STORE_PAGE_SIZE) != STORE_OK) {
+            releaseMemory(store->allocator, buffer, STORE_PAGE_SIZE);
+            return STORE_ERROR_IO;
+        }
+        store->pageReads++;
+        if (addCached(store, number, buffer, false) != STORE_OK) {
+            releaseMemory(store->allocator, buffer, STORE_PAGE_SIZE);
+            return STORE_ERROR_NO_MEMORY;
+        }
+        cached = &store->pages[store->cachedCount - 1];
+    }
+
+    if (forWrite) {
+        cached->dirty = true;
+    }
+    *data = cached->data;
+    return STORE_OK;
+}
+
+// Allocate a fresh page at the end of the file
+static int newPage(Store* store, uint8_t type, uint32_t* number, unsigned char** data) {
+    unsigned char* buffer = allocMemory(store->allocator, STORE_PAGE_SIZE);
+    if (buffer == NULL) {
+        return STORE_ERROR_NO_MEMORY;
+    }
+    memset(buffer, 0, STORE_PAGE_SIZE);
+    PAGE_HEADER(buffer)->type = type;
+
+    if (addCached(store, store->header.pageCount, buffer, true) != STORE_OK) {
+        releaseMemory(store->allocator, buffer, STORE_PAGE_SIZE);
+        return STORE_ERROR_NO_MEMORY;
+    }
+    *number = store->header.pageCount++;
+    *data = buffer;
+    return STORE_OK;
+}
+
+/***
+ * B-tree on client name
+*/
+
+static bool validName(const char* name) {
+    return name != NULL && strlen(name) <= STORE_MAX_NAME;
+}
+
+// First position in a leaf whose key is not less than key
+static int leafPosition(unsigned char* leaf, const char* key) {
+    LeafEntry* entries = LEAF_ENTRIES(leaf);
+    int low = 0;
+    int high = PAGE_HEADER(leaf)->count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (strcmp(entries[middle].key, key) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// First position in an internal page whose key is greater than key
+static int internalPosition(unsigned char* page, const char* key) {
+    InternalEntry* entries = INTERNAL_ENTRIES(page);
+    int low = 0;
+    int high = PAGE_HEADER(page)->count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (strcmp(entries[middle].key, key) <= 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Descend to the leaf that holds (or would hold) key, recording the path from the root
+static int findLeaf(Store* store, const char* key, uint32_t* path, int* depth) {
+    uint32_t number = store->header.rootPage;
+    *depth = 0;
+    while (*depth < STORE_MAX_DEPTH) {
+        unsigned char* page;
+        int result = loadPage(store, number, false, &page);
+        if (result != STORE_OK) {
+            return result;
+        }
+        path[(*depth)++] = number;
+
+        PageHeader* header = PAGE_HEADER(page);
+        if (header->type == PAGE_LEAF) {
+            return STORE_OK;
+        }
+        if (header->type != PAGE_INTERNAL) {
+            return STORE_ERROR_CORRUPT;
+        }
+        int position = internalPosition(page, key);
+        number = (position == 0) ? header->link : INTERNAL_ENTRIES(page)[position - 1].child;
+    }
+    return STORE_ERROR_CORRUPT;
+}
+
+// Find a client's leaf entry; a write lookup marks the leaf dirty
+static int lookupEntry(Store* store, const char* key, bool forWrite, LeafEntry** entry) {
+    if (store->header.rootPage == 0) {
+        return STORE_ERROR_NOT_FOUND;
+    }
+
+    uint32_t path[STORE_MAX_DEPTH];
+    int depth;
+    int result = findLeaf(store, key, path, &depth);
+    if (result != STORE_OK) {
+        return result;
+    }
+
+    unsigned char* leaf;
+    result = loadPage(store, path[depth - 1], forWrite, &leaf);
+    if (result != STORE_OK) {
+        return result;
+    }
+    int position = leafPosition(leaf, key);
+    if (position == PAGE_HEADER(leaf)->count || strcmp(LEAF_ENTRIES(leaf)[position].key, key) != 0) {
+        return STORE_ERROR_NOT_FOUND;
+    }
+    *entry = &LEAF_ENTRIES(leaf)[position];
+    return STORE_OK;
+}
+
+// Insert a separator for a new right sibling into the internal pages above it
+static int insertSeparator(Store* store, uint32_t* path, int level, const char* separator, uint32_t child) {
+    char key[STORE_MAX_NAME + 1];
+    strcpy(key, separator);
+
+    for (; level >= 0; level--) {
+        unsigned char* page;
+        int result = loadPage(store, path[level], true, &page);
+        if (result != STORE_OK) {
+            return result;
+        }
+        PageHeader* header = PAGE_HEADER(page);
+        InternalEntry* entries = INTERNAL_ENTRIES(page);
+        int position = internalPosition(page, key);
+
+        if (header->count < INTERNAL_CAPACITY) {
+            memmove(&entries[position + 1], &entries[position], (header->count - position) * sizeof(InternalEntry));
+            strcpy(entries[position].key, key);
+            entries[position].child = child;
+            header->count++;
+            return STORE_OK;
+        }
+
+        // Split the full page; the middle key moves up a level
+        InternalEntry combined[INTERNAL_CAPACITY + 1];
+        memcpy(combined, entries, position * sizeof(InternalEntry));
+        strcpy(combined[position].key, key);
+        combined[position].child = child;
+        memcpy(&combined[position + 1], &entries[position], (header->count - position) * sizeof(InternalEntry));
+
+        int total = INTERNAL_CAPACITY + 1;
+        int middle = total / 2;
+        uint32_t rightNumber;
+        unsigned char* right;
+        result = newPage(store, PAGE_INTERNAL, &rightNumber, &right);
+        if (result != STORE_OK) {
+            return result;
+        }
+        memcpy(entries, combined, middle * sizeof(InternalEntry));
+        header->count = middle;
+        PAGE_HEADER(right)->link = combined[middle].child;
+        memcpy(INTERNAL_ENTRIES(right), &combined[middle + 1], (total - middle - 1) * sizeof(InternalEntry));
+        PAGE_HEADER(right)->count = total - middle - 1;
+
+        strcpy(key, combined[middle].key);
+        child = rightNumber;
+    }
+
+    // The root split: grow the tree by one level
+    uint32_t rootNumber;
+    unsigned char* root;
+    int result = newPage(store, PAGE_INTERNAL, &rootNumber, &root);
+    if (result != STORE_OK) {
+        return result;
+    }
+    PAGE_HEADER(root)->link = store->header.rootPage;
+    PAGE_HEADER(root)->count = 1;
+    strcpy(INTERNAL_ENTRIES(root)[0].key, key);
+    INTERNAL_ENTRIES(root)[0].child = child;
+    store->header.rootPage = rootNumber;
+    return STORE_OK;
+}
+
+// Insert a client that is not yet in the tree
+static int insertClient(Store* store, const char* key) {
+    if (store->header.rootPage == 0) {
+        uint32_t number;
+        unsigned char* leaf;
+        int result = newPage(store, PAGE_LEAF, &number, &leaf);
+        if (result != STORE_OK) {
+            return result;
+        }
+        store->header.rootPage = number;
+    }
+
+    uint32_t path[STORE_MAX_DEPTH];
+    int depth;
+    int result = findLeaf(store, key, path, &depth);
+    if (result != STORE_OK) {
+        return result;
+    }
+
+    unsigned char* leaf;
+    result = loadPage(store, path[depth - 1], true, &leaf);
+    if (result != STORE_OK) {
+        return result;
+    }
+    PageHeader* header = PAGE_HEADER(leaf);
+    LeafEntry* entries = LEAF_ENTRIES(leaf);
+    int position = leafPosition(leaf, key);
+
+    LeafEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    strcpy(entry.key, key);
+    store->header.clientCount++;
+
+    if (header->count < LEAF_CAPACITY) {
+        memmove(&entries[position + 1], &entries[position], (header->count - position) * sizeof(LeafEntry));
+        entries[position] = entry;
+        header->count++;
+        return STORE_OK;
+    }
+
+    // Split the full leaf and link the new right half into the leaf chain
+    LeafEntry combined[LEAF_CAPACITY + 1];
+    memcpy(combined, entries, position * sizeof(LeafEntry));
+    combined[position] = entry;
+    memcpy(&combined[position + 1], &entries[position], (header->count - position) * sizeof(LeafEntry));
+
+    int total = LEAF_CAPACITY + 1;
+    int middle = total / 2;
+    uint32_t rightNumber;
+    unsigned char* right;
+    result = newPage(store, PAGE_LEAF, &rightNumber, &right);
+    if (result != STORE_OK) {
+        return result;
+    }
+    memcpy(entries, combined, middle * sizeof(LeafEntry));
+    header->count = middle;
+    memcpy(LEAF_ENTRIES(right), &combined[middle], (total - middle) * sizeof(LeafEntry));
+    PAGE_HEADER(right)->count = total - middle;
+    PAGE_HEADER(right)->link = header->link;
+    header->link = rightNumber;
+
+    return insertSeparator(store, path, depth - 2, LEAF_ENTRIES(right)[0].key, rightNumber);
+}
+
+/***
+ * Plan records
+*/
+
+static bool putBytes(ByteBuffer* buffer, const void* bytes, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t newCapacity = (buffer->capacity == 0) ? 256 : buffer->capacity * 2;
+        while (newCapacity < buffer->length + length) {
+            newCapacity *= 2;
+        }
+        unsigned char* resized = reallocMemory(buffer->allocator, buffer->data, buffer->capacity, newCapacity);
+        if (resized == NULL) {
+            return false;
+        }
+        buffer->data = resized;
+        buffer->capacity = newCapacity;
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+    return true;
+}
+
+static bool putInt(ByteBuffer* buffer, int32_t value) {
+    return putBytes(buffer, &value, sizeof(value));
+}
+
+static bool putString(ByteBuffer* buffer, const char* value) {
+    uint32_t length = (uint32_t)strlen(value);
+    return putBytes(buffer, &length, sizeof(length)) && putBytes(buffer, value, length);
+}
+
+static void releaseBuffer(ByteBuffer* buffer) {
+    releaseMemory(buffer->allocator, buffer->data, buffer->capacity);
+}
+
+// Plan record: name, then each day with its exercises
+static bool serializePlan(ByteBuffer* buffer, const ASTNode* plan) {
+    uint8_t tag = RECORD_PLAN;
+    if (!putBytes(buffer, &tag, sizeof(tag)) || !putString(buffer, plan->data.plan.name) ||
+        !putInt(buffer, plan->childrenCount)) {
+        return false;
+    }
+    for (int i = 0; i < plan->childrenCount; i++) {
+        const ASTNode* day = plan->children[i];
+        if (!putString(buffer, day->data.day.name) || !putInt(buffer, day->childrenCount)) {
+            return false;
+        }
+        for (int j = 0; j < day->childrenCount; j++) {
+            const ASTNode* exercise = day->children[j];
+            if (!putString(buffer, exercise->data.exercise.name) ||
+                !putInt(buffer, exercise->data.exercise.sets) || !putInt(buffer, exercise->data.exercise.rest)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Address of a record: page number * STORE_PAGE_SIZE + offset within the page
+static uint64_t recordAddress(uint32_t page, size_t offset) {
+    return (uint64_t)page * STORE_PAGE_SIZE + offset;
+}
+
+// Start a new data page and link it after the current one
+static int nextDataPage(Store* store, unsigned char** page) {
+    uint32_t number;
+    int result = newPage(store, PAGE_DATA, &number, page);
+    if (result != STORE_OK) {
+        return result;
+    }
+    if (store->header.dataPage != 0) {
+        unsigned char* previous;
+        result = loadPage(store, store->header.dataPage, true, &previous);
+        if (result != STORE_OK) {
+            return result;
+        }
+        PAGE_HEADER(previous)->link = number;
+    }
+    store->header.dataPage = number;
+    return STORE_OK;
+}
+
+// Append a record to the shared data pages and link it onto the client's chain
+static int appendRecord(Store* store, LeafEntry* entry, const unsigned char* bytes, size_t length) {
+    unsigned char* page = NULL;
+    int result = STORE_OK;
+    if (store->header.dataPage != 0) {
+        result = loadPage(store, store->header.dataPage, true, &page);
+    }
+    // Record headers never straddle a page boundary
+    if (result == STORE_OK && (page == NULL || DATA_CAPACITY - PAGE_HEADER(page)->count < sizeof(RecordHeader))) {
+        result = nextDataPage(store, &page);
+    }
+    if (result != STORE_OK) {
+        return result;
+    }
+
+    uint64_t address = recordAddress(store->header.dataPage, sizeof(PageHeader) + PAGE_HEADER(page)->count);
+    RecordHeader record = { 0, (uint32_t)length };
+    memcpy(PAGE_DATA_BYTES(page) + PAGE_HEADER(page)->count, &record, sizeof(record));
+    PAGE_HEADER(page)->count += sizeof(record);
+
+    while (length > 0) {
+        size_t room = DATA_CAPACITY - PAGE_HEADER(page)->count;
+        if (room == 0) {
+            result = nextDataPage(store, &page);
+            if (result != STORE_OK) {
+                return result;
+            }
+            continue;
+        }
+        size_t chunk = (length < room) ? length : room;
+        memcpy(PAGE_DATA_BYTES(page) + PAGE_HEADER(page)->count, bytes, chunk);
+        PAGE_HEADER(page)->count += chunk;
+        bytes += chunk;
+        length -= chunk;
+    }
+
+    // Link the previous record of this client to the new one
+    if (entry->tail != 0) {
+        unsigned char* tailPage;
+        result = loadPage(store, (uint32_t)(entry->tail / STORE_PAGE_SIZE), true, &tailPage);
+        if (result != STORE_OK) {
+            return result;
+        }
+        memcpy(tailPage + entry->tail % STORE_PAGE_SIZE, &address, sizeof(address));
+    } else {
+        entry->head = address;
+    }
+    entry->tail = address;
+    return STORE_OK;
+}
+
+// Collect the bodies of every record on a client's chain
+static int readRecords(Store* store, uint64_t address, ByteBuffer* buffer) {
+    uint64_t visited = 0;
+    while (address != 0) {
+        uint32_t number = (uint32_t)(address / STORE_PAGE_SIZE);
+        size_t offset = address % STORE_PAGE_SIZE;
+        unsigned char* page;
+        int result = loadPage(store, number, false, &page);
+        if (result != STORE_OK) {
+            return result;
+        }
+        if (PAGE_HEADER(page)->type != PAGE_DATA || offset < sizeof(PageHeader) ||
+            offset + sizeof(RecordHeader) > STORE_PAGE_SIZE || ++visited > store->header.pageCount * (uint64_t)DATA_CAPACITY) {
+            return STORE_ERROR_CORRUPT;
+        }
+        RecordHeader record;
+        memcpy(&record, page + offset, sizeof(record));
+        offset += sizeof(record);
+
+        // The body may continue on the following data pages
+        size_t remaining = record.length;
+        while (remaining > 0) {
+            size_t end = sizeof(PageHeader) + PAGE_HEADER(page)->count;
+            if (end > STORE_PAGE_SIZE || offset > end) {
+                return STORE_ERROR_CORRUPT;
+            }
+            size_t chunk = (remaining < end - offset) ? remaining : end - offset;
+            if (!putBytes(buffer, page + offset, chunk)) {
+                return STORE_ERROR_NO_MEMORY;
+            }
+            remaining -= chunk;
+            if (remaining > 0) {
+                result = loadPage(store, PAGE_HEADER(page)->link, false, &page);
+                if (result != STORE_OK) {
+                    return result;
+                }
+                if (PAGE_HEADER(page)->type != PAGE_DATA) {
+                    return STORE_ERROR_CORRUPT;
+                }
+                offset = sizeof(PageHeader);
+            }
+        }
+        address = record.next;
+    }
+    return STORE_OK;
+}
+
+static bool readBytes(ByteReader* reader, void* bytes, size_t length) {
+    if (reader->length - reader->position < length) {
+        return false;
+    }
+    memcpy(bytes, reader->data + reader->position, length);
+    reader->position += length;
+    return true;
+}
+
+static bool readInt(ByteReader* reader, int32_t* value) {
+    return readBytes(reader, value, sizeof(*value));
+}
+
+// Create a node named by the next string in the record
+static ASTNode* readNamedNode(ByteReader* reader, Allocator* allocator, NodeType type) {
+    uint32_t length;
+    if (!readBytes(reader, &length, sizeof(length)) || reader->length - reader->position < length) {
+        return NULL;
+    }
+    char* name = allocStringN(allocator, (const char*)reader->data + reader->position, length);
+    if (name == NULL) {
+        return NULL;
+    }
+    reader->position += length;
+    ASTNode* node = createASTNodeWithAllocator(allocator, type, name, 0);
+    releaseString(allocator, name);
+    return node;
+}
+
+static ASTNode* readPlan(ByteReader* reader, Allocator* allocator) {
+    uint8_t tag;
+    int32_t dayCount;
+    if (!readBytes(reader, &tag, sizeof(tag)) || tag != RECORD_PLAN) {
+        return NULL;
+    }
+    ASTNode* plan = readNamedNode(reader, allocator, NODE_PLAN);
+    if (plan == NULL || !readInt(reader, &dayCount)) {
+        freeAST(plan);
+        return NULL;
+    }
+
+    for (int32_t i = 0; i < dayCount; i++) {
+        int32_t exerciseCount;
+        ASTNode* day = readNamedNode(reader, allocator, NODE_DAY);
+        if (day == NULL || !addASTChildNode(plan, day)) {
+            freeAST(day);
+            freeAST(plan);
+            return NULL;
+        }
+        if (!readInt(reader, &exerciseCount)) {
+            freeAST(plan);
+            return NULL;
+        }
+        for (int32_t j = 0; j < exerciseCount; j++) {
+            int32_t sets, rest;
+            ASTNode* exercise = readNamedNode(reader, allocator, NODE_EXERCISE);
+            if (exercise == NULL || !readInt(reader, &sets) || !readInt(reader, &rest) ||
+                !addASTChildNode(day, exercise)) {
+                freeAST(exercise);
+                freeAST(plan);
+                return NULL;
+            }
+            exercise->data.exercise.sets = sets;
+            exercise->data.exercise.rest = rest;
+        }
+    }
+    return plan;
+}
+
+/***
+ * Write-ahead log
+*/
+
+// Apply the logged commit if it is complete, then empty the log
+static int replayLog(Store* store) {
+    struct stat status;
+    if (fstat(store->walFd, &status) != 0) {
+        return STORE_ERROR_IO;
+    }
+    if (status.st_size == 0) {
+        return STORE_OK;
+    }
+
+    unsigned char* page = allocMemory(store->allocator, STORE_PAGE_SIZE);
+    if (page == NULL) {
+        return STORE_ERROR_NO_MEMORY;
+    }
+
+    // First pass: check that every page image arrived intact and a commit record follows
+    off_t offset = 0;
+    uint32_t pageRecords = 0;
+    bool complete = false;
+    WalRecord record;
+    while (offset + (off_t)sizeof(record) <= status.st_size &&
+           readAt(store->walFd, &record, sizeof(record), offset) == STORE_OK) {
+        offset += sizeof(record);
+        if (record.magic == WAL_COMMIT_MAGIC) {
+            complete = (record.page == pageRecords);
+            break;
+        }
+        if (record.magic != WAL_PAGE_MAGIC || offset + STORE_PAGE_SIZE > status.st_size ||
+            readAt(store->walFd, page, STORE_PAGE_SIZE, offset) != STORE_OK ||
+            checksumPage(record.page, page) != record.checksum) {
+            break;
+        }
+        offset += STORE_PAGE_SIZE;
+        pageRecords++;
+    }
+
+    // Second pass: copy the page images into the store. A torn log never
+    // reached the store file, so it is simply dropped.
+    int result = STORE_OK;
+    if (complete) {
+        offset = 0;
+        for (uint32_t i = 0; i < pageRecords && result == STORE_OK; i++) {
+            result = readAt(store->walFd, &record, sizeof(record), offset);
+            if (result == STORE_OK) {
+                result = readAt(store->walFd, page, STORE_PAGE_SIZE, offset + sizeof(record));
+            }
+            if (result == STORE_OK) {
+                result = writeAt(store->fd, page, STORE_PAGE_SIZE, (off_t)record.page * STORE_PAGE_SIZE);
+            }
+            offset += sizeof(record) + STORE_PAGE_SIZE;
+        }
+        if (result == STORE_OK && fsync(store->fd) != 0) {
+            result = STORE_ERROR_IO;
+        }
+    }
+    releaseMemory(store->allocator, page, STORE_PAGE_SIZE);
+
+    if (result == STORE_OK && (ftruncate(store->walFd, 0) != 0 || fsync(store->walFd) != 0)) {
+        result = STORE_ERROR_IO;
+    }
+    return result;
+}
+
+static int logPage(Store* store, off_t* offset, uint32_t number, const unsigned char* data) {
+    WalRecord record = { WAL_PAGE_MAGIC, number, checksumPage(number, data) };
+    int result = writeAt(store->walFd, &record, sizeof(record), *offset);
+    if (result == STORE_OK) {
+        result = writeAt(store->walFd, data, STORE_PAGE_SIZE, *offset + sizeof(record));
+    }
+    *offset += sizeof(record) + STORE_PAGE_SIZE;
+    return result;
+}
+
+/***
+ * Store functions
+*/
+
+int storeOpen(const char* path, Allocator* allocator, Store** store) {
+    *store = NULL;
+    Store* opened = allocMemory(allocator, sizeof(Store));
+    if (opened == NULL) {
+        return STORE_ERROR_NO_MEMORY;
+    }
+    memset(opened, 0, sizeof(Store));
+    opened->allocator = allocator;
+
+    size_t pathLength = strlen(path);
+    size_t walPathSize = pathLength + sizeof("-wal");
+    char* walPath = allocMemory(allocator, walPathSize);
+    if (walPath == NULL) {
+        releaseMemory(allocator, opened, sizeof(Store));
+        return STORE_ERROR_NO_MEMORY;
+    }
+    memcpy(walPath, path, pathLength);
+    memcpy(walPath + pathLength, "-wal", sizeof("-wal"));
+    opened->fd = open(path, O_RDWR | O_CREAT, 0644);
+    opened->walFd = open(walPath, O_RDWR | O_CREAT, 0644);
+    releaseMemory(allocator, walPath, walPathSize);
+
+    int result = (opened->fd < 0 || opened->walFd < 0) ? STORE_ERROR_IO : replayLog(opened);
+    struct stat status;
+    if (result == STORE_OK && fstat(opened->fd, &status) != 0) {
+        result = STORE_ERROR_IO;
+    }
+
+    if (result == STORE_OK && status.st_size == 0) {
+        // New store: just the header page, written by the first commit
+        memcpy(opened->header.magic, STORE_MAGIC, sizeof(opened->header.magic));
+        opened->header.version = STORE_VERSION;
+        opened->header.pageCount = 1;
+        result = storeCommit(opened);
+    } else if (result == STORE_OK) {
+        result = readAt(opened->fd, &opened->header, sizeof(StoreHeader), 0);
+        if (result == STORE_OK &&
+            (memcmp(opened->header.magic, STORE_MAGIC, sizeof(opened->header.magic)) != 0 ||
+             opened->header.version != STORE_VERSION ||
+             (off_t)opened->header.pageCount * STORE_PAGE_SIZE > status.st_size)) {
+            result = STORE_ERROR_CORRUPT;
+        }
+        opened->committed = opened->header;
+    }
+
+    if (result != STORE_OK) {
+        storeClose(opened);
+        return result;
+    }
+    *store = opened;
+    return STORE_OK;
+}
+
+void storeClose(Store* store) {
+    if (store == NULL) {
+        return;
+    }
+    dropCached(store, true);
+    releaseMemory(store->allocator, store->pages, store->cachedCapacity * sizeof(CachedPage));
+    releaseMemory(store->allocator, store->index, store->indexCapacity * sizeof(int));
+    if (store->fd >= 0) {
+        close(store->fd);
+    }
+    if (store->walFd >= 0) {
+        close(store->walFd);
+    }
+    releaseMemory(store->allocator, store, sizeof(Store));
+}
+
+// Add a client; adding one that is already stored does nothing
+int storePutClient(Store* store, const char* name) {
+    if (!validName(name)) {
+        return STORE_ERROR_NAME_TOO_LONG;
+    }
+    trimCache(store);
+
+    LeafEntry* entry;
+    int result = lookupEntry(store, name, false, &entry);
+    if (result == STORE_ERROR_NOT_FOUND) {
+        return insertClient(store, name);
+    }
+    return result;
+}
+
+// Append a plan to a client's chain, adding the client if needed
+int storeAppendPlan(Store* store, const char* name, const ASTNode* plan) {
+    int result = storePutClient(store, name);
+    if (result != STORE_OK) {
+        return result;
+    }
+
+    ByteBuffer buffer = { store->allocator, NULL, 0, 0 };
+    if (!serializePlan(&buffer, plan)) {
+        releaseBuffer(&buffer);
+        return STORE_ERROR_NO_MEMORY;
+    }
+
+    LeafEntry* entry;
+    result = lookupEntry(store, name, true, &entry);
+    if (result == STORE_OK) {
+        result = appendRecord(store, entry, buffer.data, buffer.length);
+    }
+    releaseBuffer(&buffer);
+    return result;
+}
+
+// Make every change since the last commit durable
+int storeCommit(Store* store) {
+    bool headerChanged = memcmp(&store->header, &store->committed, sizeof(StoreHeader)) != 0;
+    uint32_t dirtyCount = 0;
+    for (int i = 0; i < store->cachedCount; i++) {
+        dirtyCount += store->pages[i].dirty ? 1 : 0;
+    }
+    if (dirtyCount == 0 && !headerChanged) {
+        return STORE_OK;
+    }
+
+    unsigned char* headerPage = allocMemory(store->allocator, STORE_PAGE_SIZE);
+    if (headerPage == NULL) {
+        return STORE_ERROR_NO_MEMORY;
+    }
+    memset(headerPage, 0, STORE_PAGE_SIZE);
+    memcpy(headerPage, &store->header, sizeof(StoreHeader));
+
+    // 1. Log every changed page followed by a commit record, and sync the log
+    off_t offset = 0;
+    int result = (ftruncate(store->walFd, 0) == 0) ? STORE_OK : STORE_ERROR_IO;
+    for (int i = 0; i < store->cachedCount && result == STORE_OK; i++) {
+        if (store->pages[i].dirty) {
+            result = logPage(store, &offset, store->pages[i].number, store->pages[i].data);
+        }
+    }
+    if (result == STORE_OK) {
+        result = logPage(store, &offset, 0, headerPage);
+    }
+    if (result == STORE_OK) {
+        WalRecord commit = { WAL_COMMIT_MAGIC, dirtyCount + 1, 0 };
+        result = writeAt(store->walFd, &commit, sizeof(commit), offset);
+    }
+    if (result == STORE_OK && fsync(store->walFd) != 0) {
+        result = STORE_ERROR_IO;
+    }
+
+    // 2. Write the pages in place; a crash from here on is repaired by replaying the log
+    for (int i = 0; i < store->cachedCount && result == STORE_OK; i++) {
+        if (store->pages[i].dirty) {
+            result = writeAt(store->fd, store->pages[i].data, STORE_PAGE_SIZE, (off_t)store->pages[i].number * STORE_PAGE_SIZE);
+        }
+    }
+    if (result == STORE_OK) {
+        result = writeAt(store->fd, headerPage, STORE_PAGE_SIZE, 0);
+    }
+    if (result == STORE_OK && fsync(store->fd) != 0) {
+        result = STORE_ERROR_IO;
+    }
+    releaseMemory(store->allocator, headerPage, STORE_PAGE_SIZE);
+
+    // 3. The store is up to date; empty the log
+    if (result == STORE_OK && ftruncate(store->walFd, 0) != 0) {
+        result = STORE_ERROR_IO;
+    }
+    if (result != STORE_OK) {
+        return result;
+    }
+
+    for (int i = 0; i < store->cachedCount; i++) {
+        store->pages[i].dirty = false;
+    }
+    store->committed = store->header;
+    store->pageWrites += dirtyCount + 1;
+    store->commits++;
+    return STORE_OK;
+}
+
+// Discard every change since the last commit
+void storeRollback(Store* store) {
+    dropCached(store, true);
+    store->header = store->committed;
+}
+
+bool storeHasClient(Store* store, const char* name) {
+    LeafEntry* entry;
+    trimCache(store);
+    return validName(name) && lookupEntry(store, name, false, &entry) == STORE_OK;
+}
+
+// Rebuild a client's plans; release them with storeFreePlans
+int storeLoadPlans(Store* store, const char* name, Allocator* allocator, ASTNode*** plans, int* planCount) {
+    *plans = NULL;
+    *planCount = 0;
+    if (!validName(name)) {
+        return STORE_ERROR_NAME_TOO_LONG;
+    }
+    trimCache(store);
+
+    LeafEntry* entry;
+    int result = lookupEntry(store, name, false, &entry);
+    if (result != STORE_OK) {
+        return result;
+    }
+    ByteBuffer buffer = { store->allocator, NULL, 0, 0 };
+    result = readRecords(store, entry->head, &buffer);
+
+    ByteReader reader = { buffer.data, buffer.length, 0 };
+    int capacity = 0;
+    while (result == STORE_OK && reader.position < reader.length) {
+        ASTNode* plan = readPlan(&reader, allocator);
+        if (plan == NULL) {
+            result = STORE_ERROR_CORRUPT;
+            break;
+        }
+        if (*planCount == capacity) {
+            int newCapacity = (capacity == 0) ? 4 : capacity * 2;
+            ASTNode** resized = reallocMemory(allocator, *plans, capacity * sizeof(ASTNode*), newCapacity * sizeof(ASTNode*));
+            if (resized == NULL) {
+                freeAST(plan);
+                result = STORE_ERROR_NO_MEMORY;
+                break;
+            }
+            *plans = resized;
+            capacity = newCapacity;
+        }
+        (*plans)[(*planCount)++] = plan;
+    }
+    releaseBuffer(&buffer);
+
+    // Trim the array so storeFreePlans can release it by count
+    if (result == STORE_OK && *planCount < capacity) {
+        ASTNode** trimmed = (*planCount == 0) ? NULL :
+            reallocMemory(allocator, *plans, capacity * sizeof(ASTNode*), *planCount * sizeof(ASTNode*));
+        if (*planCount == 0) {
+            releaseMemory(allocator, *plans, capacity * sizeof(ASTNode*));
+        } else if (trimmed == NULL) {
+            result = STORE_ERROR_NO_MEMORY;
+        }
+        if (result == STORE_OK) {
+            *plans = trimmed;
+            capacity = *planCount;
+        }
+    }
+    if (result != STORE_OK) {
+        for (int i = 0; i < *planCount; i++) {
+            freeAST((*plans)[i]);
+        }
+        releaseMemory(allocator, *plans, capacity * sizeof(ASTNode*));
+        *plans = NULL;
+        *planCount = 0;
+    }
+    return result;
+}
+
+void storeFreePlans(Allocator* allocator, ASTNode** plans, int planCount) {
+    for (int i = 0; i < planCount; i++) {
+        freeAST(plans[i]);
+    }
+    releaseMemory(allocator, plans, planCount * sizeof(ASTNode*));
+}
+
+// Walk the leaves left to right
+int storeForEachClient(Store* store, StoreClientVisitor visit, void* userData) {
+    trimCache(store);
+    uint32_t number = store->header.rootPage;
+    int depth = 0;
+    unsigned char* page;
+
+    // Leftmost leaf
+    while (number != 0) {
+        int result = loadPage(store, number, false, &page);
+        if (result != STORE_OK) {
+            return result;
+        }
+        if (PAGE_HEADER(page)->type == PAGE_LEAF) {
+            break;
+        }
+        if (PAGE_HEADER(page)->type != PAGE_INTERNAL || ++depth > STORE_MAX_DEPTH) {
+            return STORE_ERROR_CORRUPT;
+        }
+        number = PAGE_HEADER(page)->link;
+    }
+
+    uint32_t visited = 0;
+    while (number != 0) {
+        int result = loadPage(store, number, false, &page);
+        if (result != STORE_OK) {
+            return result;
+        }
+        if (PAGE_HEADER(page)->type != PAGE_LEAF || ++visited > store->header.pageCount) {
+            return STORE_ERROR_CORRUPT;
+        }
+        for (int i = 0; i < PAGE_HEADER(page)->count; i++) {
+            int stop = visit(userData, LEAF_ENTRIES(page)[i].key);
+            if (stop != 0) {
+                return stop;
+            }
+        }
+        number = PAGE_HEADER(page)->link;
+    }
+    return STORE_OK;
+}
+
+const char* storeErrorString(int status) {
+    switch (status) {
+        case STORE_OK:
+            return "ok";
+        case STORE_ERROR_IO:
+            return "I/O error";
+        case STORE_ERROR_CORRUPT:
+            return "store file is corrupt";
+        case STORE_ERROR_NO_MEMORY:
+            return "out of memory";
+        case STORE_ERROR_NOT_FOUND:
+            return "client not found";
+        case STORE_ERROR_NAME_TOO_LONG:
+            return "client name too long";
+        default:
+            return "unknown error";
+    }
+}
+
+void printStoreStats(const Store* store) {
+    printf("Store: %u pages, %u clients, %ld page reads, %ld page writes, %ld commits\n",
+        store->header.pageCount, store->header.clientCount, store->pageReads, store->pageWrites, store->commits);
+}
@@ -0,0 +1,48 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include "parser.h"
+#include "alloc.h"
+
+// Persistent client/plan store: a file of fixed-size pages holding a B-tree
+// keyed on client name, whose entries point at a chain of records with the
+// client's serialized plans. Changes are buffered in memory and made durable
+// by storeCommit through a write-ahead log ("<path>-wal") that is replayed
+// when the store is next opened.
+
+#define STORE_PAGE_SIZE 4096
+#define STORE_MAX_NAME 63
+
+// Store status codes
+#define STORE_OK 0
+#define STORE_ERROR_IO -1
+#define STORE_ERROR_CORRUPT -2
+#define STORE_ERROR_NO_MEMORY -3
+#define STORE_ERROR_NOT_FOUND -4
+#define STORE_ERROR_NAME_TOO_LONG -5
+
+typedef struct Store Store;
+
+// Called once per stored client, in name order; a non-zero return stops the walk
+// and is returned by storeForEachClient
+typedef int (*StoreClientVisitor)(void* userData, const char* name);
+
+// Function prototypes for opening and closing a store
+int storeOpen(const char* path, Allocator* allocator, Store** store);
+void storeClose(Store* store); // Uncommitted changes are discarded
+
+// Function prototypes for changing the store (visible to reads at once, durable after storeCommit)
+int storePutClient(Store* store, const char* name);
+int storeAppendPlan(Store* store, const char* name, const ASTNode* plan);
+int storeCommit(Store* store);
+void storeRollback(Store* store);
+
+// Function prototypes for reading the store
+bool storeHasClient(Store* store, const char* name);
+int storeLoadPlans(Store* store, const char* name, Allocator* allocator, ASTNode*** plans, int* planCount);
+void storeFreePlans(Allocator* allocator, ASTNode** plans, int planCount);
+int storeForEachClient(Store* store, StoreClientVisitor visit, void* userData);
+const char* storeErrorString(int status);
+void printStoreStats(const Store* store);
+
+#endif // STORE_H
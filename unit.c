@@ -0,0 +1,1165 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "unit.h"
+#include "hashcons.h"
+#include "source.h"
+#include "sourcemap.h"
+
+#define OBJECT_MAGIC 0x324f4c46u    // "FLO2"; the number changes with the layout
+#define OBJECT_HEADER_SIZE 8        // Magic and checksum
+#define OBJECT_SUFFIX ".flo"
+
+// How an assignment's client or plan is written in an object
+#define PART_NAME 0         // By name: a client, or a plan or group of another unit
+#define PART_STATEMENT 1    // A group or plan defined earlier in the unit, by statement index
+#define PART_BODY 2         // An inline plan body
+
+typedef struct Unit {
+    char* path;                 // As opened: relative paths are from the importing file's directory
+    char* realPath;             // Tells files apart
+    ASTNode* root;
+    struct SymbolTable* table;
+    int firstExport;            // Table symbols from here on are declared by the unit
+    int* exportStatements;      // Statement declaring each of them (-1 if not found)
+    int exportStatementCount;
+    struct Unit** imports;
+    int importCount;
+    int position;               // Place in link order, -1 while the unit's imports are followed
+    bool loaded;                // From an object file rather than compiled
+    size_t base;                // Offset of the unit's assignments in the linked program
+    size_t span;                // One past the unit's last assignment offset
+} Unit;
+
+struct Program {
+    Allocator* allocator;
+    Unit** units;               // In the order they were found, then in link order
+    int count;
+    int capacity;
+    int linked;                 // Units whose imports have all been followed
+    ASTNode* root;
+    int loadedCount;
+    bool objects;               // Units were looked for in object files
+    double linkMilliseconds;
+};
+
+// Growable byte buffer for an object being written
+typedef struct {
+    Allocator* allocator;
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+typedef struct {
+    const unsigned char* data;
+    size_t length;
+    size_t position;
+} ByteReader;
+
+// Where a group or plan definition is among a unit's statements
+typedef struct {
+    const ASTNode* node;
+    int statement;
+} Definition;
+
+// A name declared somewhere in the program, while linking
+typedef struct {
+    const char* name;           // NULL for an empty slot
+    unsigned long hash;
+    int type;
+    int position;               // Link position of the declaring unit, -1 for a predeclared name
+    ASTNode* node;              // Definition of a plan or group
+} LinkSymbol;
+
+typedef struct {
+    LinkSymbol* slots;
+    int capacity;               // A power of two, at least twice the number of names
+    unsigned char* visible;     // Per unit, a bit for each unit it imports directly or not
+    size_t rowBytes;
+} LinkTable;
+
+/***
+ * Helper functions
+*/
+
+static unsigned long hashBytes(unsigned long hash, const void* bytes, size_t length) {
+    const unsigned char* c = bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= c[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static double elapsedMilliseconds(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Print a diagnostic located in a unit's file
+static void reportAt(const Program* program, const Unit* unit, size_t offset, const char* format, ...) {
+    char message[DIAGNOSTIC_MESSAGE_SIZE + PATH_MAX];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+    SourceMap* map = createSourceMap(unit->path, program->allocator);
+    printDiagnostic(map, offset, "%s", message);
+    freeSourceMap(map);
+}
+
+// Path of a file named by an import: relative names are taken from the importing file's directory
+static char* importedPath(Allocator* allocator, const char* importer, const char* name) {
+    const char* slash = strrchr(importer, '/');
+    if (name[0] == '/' || slash == NULL) {
+        return allocString(allocator, name);
+    }
+    size_t directory = (size_t)(slash - importer) + 1;
+    size_t length = strlen(name);
+    char* path = allocMemory(allocator, directory + length + 1);
+    if (path != NULL) {
+        memcpy(path, importer, directory);
+        memcpy(path + directory, name, length + 1);
+    }
+    return path;
+}
+
+// Object file of a unit: named by a hash of its real path
+static bool objectPathFor(const char* directory, const char* realPath, char* path, size_t size) {
+    unsigned long hash = hashBytes(1469598103934665603UL, realPath, strlen(realPath));
+    int length = snprintf(path, size, "%s/%016lx%s", directory, hash, OBJECT_SUFFIX);
+    return length > 0 && (size_t)length < size;
+}
+
+// Name a top-level statement declares (NULL if it declares none)
+static const char* declaredName(const ASTNode* statement) {
+    switch (statement->type) {
+        case NODE_CLIENT_PROFILE:
+            return statement->data.clientProfile.name;
+        case NODE_PLAN:
+            return statement->data.plan.name;
+        case NODE_GROUP:
+            return statement->data.group.name;
+        default:
+            return NULL;
+    }
+}
+
+static int leadingImports(const ASTNode* root) {
+    int count = 0;
+    while (count < root->childrenCount && root->children[count]->type == NODE_IMPORT) {
+        count++;
+    }
+    return count;
+}
+
+// Assignments are the only statements whose offsets matter once linked
+static size_t assignmentSpan(const ASTNode* root) {
+    size_t span = 0;
+    for (int i = 0; i < root->childrenCount; i++) {
+        const ASTNode* statement = root->children[i];
+        if (statement->type == NODE_ASSIGNMENT && statement->offset != NO_SOURCE_OFFSET && statement->offset + 1 > span) {
+            span = statement->offset + 1;
+        }
+    }
+    return span;
+}
+
+static int exportCount(const Unit* unit) {
+    return (unit->table != NULL) ? unit->table->size - unit->firstExport : 0;
+}
+
+static size_t exportOffset(const Unit* unit, int index) {
+    int statement = unit->exportStatements[index];
+    return (statement >= 0) ? unit->root->children[statement]->offset : NO_SOURCE_OFFSET;
+}
+
+// Pair the symbols a compiled unit declared with the statements declaring them (both are in program order)
+static bool findExportStatements(Allocator* allocator, Unit* unit) {
+    int count = exportCount(unit);
+    if (count == 0) {
+        return true;
+    }
+    unit->exportStatements = allocMemory(allocator, count * sizeof(int));
+    if (unit->exportStatements == NULL) {
+        return false;
+    }
+    unit->exportStatementCount = count;
+    int cursor = 0;
+    for (int i = 0; i < count; i++) {
+        const char* name = unit->table->symbols[unit->firstExport + i].name;
+        int start = cursor;
+        while (cursor < unit->root->childrenCount) {
+            const char* declared = declaredName(unit->root->children[cursor]);
+            if (declared != NULL && strcmp(declared, name) == 0) {
+                break;
+            }
+            cursor++;
+        }
+        if (cursor < unit->root->childrenCount) {
+            unit->exportStatements[i] = cursor++;
+        } else {
+            unit->exportStatements[i] = -1;
+            cursor = start;
+        }
+    }
+    return true;
+}
+
+unsigned long hashFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned char chunk[65536];
+    unsigned long hash = 1469598103934665603UL;
+    size_t length;
+    while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        hash = hashBytes(hash, chunk, length);
+    }
+    bool failed = ferror(file);
+    fclose(file);
+    return failed ? 0 : hash;
+}
+
+/***
+ * Object files
+*/
+
+static bool putBytes(ByteBuffer* buffer, const void* bytes, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        size_t newCapacity = (buffer->capacity == 0) ? 4096 : buffer->capacity * 2;
+        while (newCapacity < buffer->length + length) {
+            newCapacity *= 2;
+        }
+        unsigned char* resized = reallocMemory(buffer->allocator, buffer->data, buffer->capacity, newCapacity);
+        if (resized == NULL) {
+            return false;
+        }
+        buffer->data = resized;
+        buffer->capacity = newCapacity;
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+    return true;
+}
+
+static bool putByte(ByteBuffer* buffer, uint8_t value) {
+    return putBytes(buffer, &value, sizeof(value));
+}
+
+static bool putInt(ByteBuffer* buffer, int32_t value) {
+    return putBytes(buffer, &value, sizeof(value));
+}
+
+static bool putOffset(ByteBuffer* buffer, size_t offset) {
+    uint64_t value = (uint64_t)offset;
+    return putBytes(buffer, &value, sizeof(value));
+}
+
+// Strings keep their terminator, so a loaded object's names are used where they lie
+static bool putString(ByteBuffer* buffer, const char* value) {
+    uint32_t length = (uint32_t)strlen(value);
+    return putBytes(buffer, &length, sizeof(length)) && putBytes(buffer, value, length + 1);
+}
+
+// A node written by name: the name, then its offset
+static bool putNamed(ByteBuffer* buffer, const char* name, size_t offset) {
+    return putString(buffer, name) && putOffset(buffer, offset);
+}
+
+static bool writeDay(ByteBuffer* buffer, const ASTNode* day) {
+    if (!putNamed(buffer, day->data.day.name, day->offset) || !putInt(buffer, day->childrenCount)) {
+        return false;
+    }
+    for (int i = 0; i < day->childrenCount; i++) {
+        const ASTNode* exercise = day->children[i];
+        if (!putNamed(buffer, exercise->data.exercise.name, exercise->offset) ||
+            !putInt(buffer, exercise->data.exercise.sets) || !putInt(buffer, exercise->data.exercise.rest) ||
+            !putInt(buffer, exercise->data.exercise.catalogId)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writePlan(ByteBuffer* buffer, const ASTNode* plan) {
+    if (!putNamed(buffer, plan->data.plan.name, plan->offset) || !putInt(buffer, plan->childrenCount)) {
+        return false;
+    }
+    for (int i = 0; i < plan->childrenCount; i++) {
+        if (!writeDay(buffer, plan->children[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compareDefinitions(const void* a, const void* b) {
+    uintptr_t left = (uintptr_t)((const Definition*)a)->node;
+    uintptr_t right = (uintptr_t)((const Definition*)b)->node;
+    return (left > right) - (left < right);
+}
+
+// Statement defining node, if it comes before statement position (-1 otherwise)
+static int findDefinition(const Definition* definitions, int count, const ASTNode* node, int position) {
+    Definition key = { node, 0 };
+    const Definition* found = bsearch(&key, definitions, count, sizeof(Definition), compareDefinitions);
+    return (found != NULL && found->statement < position) ? found->statement : -1;
+}
+
+static bool writeAssignment(ByteBuffer* buffer, const ASTNode* assignment, int position,
+                            const Definition* definitions, int definitionCount) {
+    const ASTNode* client = assignment->data.assignment.client;
+    const ASTNode* plan = assignment->data.assignment.plan;
+    if (!putOffset(buffer, assignment->offset)) {
+        return false;
+    }
+
+    if (client->type == NODE_GROUP) {
+        int group = findDefinition(definitions, definitionCount, client, position);
+        if (group < 0 || !putByte(buffer, PART_STATEMENT) || !putInt(buffer, group)) {
+            return false;
+        }
+    } else if (!putByte(buffer, PART_NAME) || !putNamed(buffer, client->data.clientProfile.name, client->offset)) {
+        return false;
+    }
+
+    if (plan->type == NODE_IDENTIFIER) {
+        return putByte(buffer, PART_NAME) && putNamed(buffer, plan->data.identifier.name, plan->offset);
+    }
+    int definition = findDefinition(definitions, definitionCount, plan, position);
+    if (definition >= 0) {
+        return putByte(buffer, PART_STATEMENT) && putInt(buffer, definition);
+    }
+    return putByte(buffer, PART_BODY) && writePlan(buffer, plan);
+}
+
+static bool writeStatement(ByteBuffer* buffer, const ASTNode* statement, int position,
+                           const Definition* definitions, int definitionCount) {
+    if (!putByte(buffer, (uint8_t)statement->type)) {
+        return false;
+    }
+    switch (statement->type) {
+        case NODE_IMPORT:
+            return putNamed(buffer, statement->data.import.path, statement->offset);
+        case NODE_CLIENT_PROFILE:
+            return putNamed(buffer, statement->data.clientProfile.name, statement->offset);
+        case NODE_SHOW_PLANS:
+            return putNamed(buffer, statement->data.showPlans.clientName, statement->offset);
+        case NODE_PLAN:
+            return writePlan(buffer, statement);
+        case NODE_DAY:
+            return writeDay(buffer, statement);
+        case NODE_GROUP:
+            if (!putNamed(buffer, statement->data.group.name, statement->offset) || !putInt(buffer, statement->childrenCount)) {
+                return false;
+            }
+            for (int i = 0; i < statement->childrenCount; i++) {
+                const ASTNode* member = statement->children[i];
+                if (!putNamed(buffer, member->data.identifier.name, member->offset)) {
+                    return false;
+                }
+            }
+            return true;
+        case NODE_ASSIGNMENT:
+            return writeAssignment(buffer, statement, position, definitions, definitionCount);
+        default:
+            return false;
+    }
+}
+
+// CRC-32 of everything in an object after its header
+static uint32_t objectChecksum(const unsigned char* data, size_t length) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (size_t done = OBJECT_HEADER_SIZE; done < length; ) {
+        uInt chunk = (length - done > UINT_MAX) ? UINT_MAX : (uInt)(length - done);
+        crc = crc32(crc, data + done, chunk);
+        done += chunk;
+    }
+    return (uint32_t)crc;
+}
+
+// Object layout: header (magic, checksum), source hash, catalog stamp, real
+// path, the statements, the external references, the declared names with
+// their statements, and the assignment span
+static bool serializeUnit(ByteBuffer* buffer, const Unit* unit, unsigned long sourceHash, unsigned long catalogStamp) {
+    const ASTNode* root = unit->root;
+    int definitionCount = 0;
+    Definition* definitions = allocMemory(buffer->allocator, (root->childrenCount + 1) * sizeof(Definition));
+    if (definitions == NULL) {
+        return false;
+    }
+    for (int i = 0; i < root->childrenCount; i++) {
+        if (root->children[i]->type == NODE_PLAN || root->children[i]->type == NODE_GROUP) {
+            definitions[definitionCount].node = root->children[i];
+            definitions[definitionCount++].statement = i;
+        }
+    }
+    qsort(definitions, definitionCount, sizeof(Definition), compareDefinitions);
+
+    bool written = putInt(buffer, (int32_t)OBJECT_MAGIC) && putInt(buffer, 0) && putOffset(buffer, sourceHash) &&
+                   putOffset(buffer, catalogStamp) && putString(buffer, unit->realPath) && putInt(buffer, root->childrenCount);
+    for (int i = 0; i < root->childrenCount && written; i++) {
+        written = writeStatement(buffer, root->children[i], i, definitions, definitionCount);
+    }
+    releaseMemory(buffer->allocator, definitions, (root->childrenCount + 1) * sizeof(Definition));
+
+    const struct SymbolTable* table = unit->table;
+    written = written && putInt(buffer, table->externalCount);
+    for (int i = 0; i < table->externalCount && written; i++) {
+        const struct ExternalReference* external = &table->externals[i];
+        written = putNamed(buffer, external->name, external->offset) && putInt(buffer, external->type);
+    }
+    written = written && putInt(buffer, exportCount(unit));
+    for (int i = 0; i < exportCount(unit) && written; i++) {
+        const struct Symbol* symbol = &table->symbols[unit->firstExport + i];
+        written = unit->exportStatements[i] >= 0 && putString(buffer, symbol->name) &&
+                  putInt(buffer, symbol->type) && putInt(buffer, unit->exportStatements[i]);
+    }
+    if (!written || !putOffset(buffer, unit->span)) {
+        return false;
+    }
+    uint32_t checksum = objectChecksum(buffer->data, buffer->length);
+    memcpy(buffer->data + sizeof(int32_t), &checksum, sizeof(checksum));
+    return true;
+}
+
+// Save a compiled unit. The object is written beside its final name and
+// renamed, so a reader never sees half of one; failing to write it only
+// costs the next run a compile.
+static void saveObject(Allocator* allocator, const Unit* unit, const char* objectPath,
+                       unsigned long sourceHash, unsigned long catalogStamp) {
+    ByteBuffer buffer = { allocator, NULL, 0, 0 };
+    char temporaryPath[PATH_MAX];
+    bool saved = serializeUnit(&buffer, unit, sourceHash, catalogStamp) &&
+                 snprintf(temporaryPath, sizeof(temporaryPath), "%s.%ld", objectPath, (long)getpid()) < (int)sizeof(temporaryPath);
+    if (saved) {
+        FILE* file = fopen(temporaryPath, "wb");
+        saved = file != NULL && fwrite(buffer.data, 1, buffer.length, file) == buffer.length;
+        if (file != NULL && fclose(file) != 0) {
+            saved = false;
+        }
+        if (!saved || rename(temporaryPath, objectPath) != 0) {
+            remove(temporaryPath);
+            saved = false;
+        }
+    }
+    if (!saved) {
+        fprintf(stderr, "Unable to write object '%s' for '%s'\n", objectPath, unit->path);
+    }
+    releaseMemory(allocator, buffer.data, buffer.capacity);
+}
+
+static bool readBytes(ByteReader* reader, void* bytes, size_t length) {
+    if (reader->length - reader->position < length) {
+        return false;
+    }
+    memcpy(bytes, reader->data + reader->position, length);
+    reader->position += length;
+    return true;
+}
+
+static bool readInt(ByteReader* reader, int32_t* value) {
+    return readBytes(reader, value, sizeof(*value));
+}
+
+static bool readOffset(ByteReader* reader, size_t* offset) {
+    uint64_t value;
+    if (!readBytes(reader, &value, sizeof(value))) {
+        return false;
+    }
+    *offset = (size_t)value;
+    return true;
+}
+
+// A count of items that each take at least one byte of what is left
+static bool readCount(ByteReader* reader, int32_t* count) {
+    return readInt(reader, count) && *count >= 0 && (size_t)*count <= reader->length - reader->position;
+}
+
+// The string at the reader, in place (NULL if the object is damaged)
+static const char* readString(ByteReader* reader) {
+    uint32_t length;
+    if (!readBytes(reader, &length, sizeof(length)) || reader->length - reader->position <= length ||
+        reader->data[reader->position + length] != '\0') {
+        return NULL;
+    }
+    const char* value = (const char*)reader->data + reader->position;
+    reader->position += (size_t)length + 1;
+    return value;
+}
+
+static ASTNode* readNamed(ByteReader* reader, Allocator* allocator, NodeType type) {
+    const char* name = readString(reader);
+    ASTNode* node = (name != NULL) ? createASTNodeWithAllocator(allocator, type, name, 0) : NULL;
+    if (node != NULL && !readOffset(reader, &node->offset)) {
+        freeAST(node);
+        return NULL;
+    }
+    return node;
+}
+
+static ASTNode* readDay(ByteReader* reader, Allocator* allocator) {
+    int32_t count;
+    ASTNode* day = readNamed(reader, allocator, NODE_DAY);
+    if (day == NULL || !readCount(reader, &count)) {
+        freeAST(day);
+        return NULL;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        int32_t sets, rest, catalogId;
+        ASTNode* exercise = readNamed(reader, allocator, NODE_EXERCISE);
+        if (exercise == NULL || !readInt(reader, &sets) || !readInt(reader, &rest) || !readInt(reader, &catalogId) ||
+            !addASTChildNode(day, exercise)) {
+            freeAST(exercise);
+            freeAST(day);
+            return NULL;
+        }
+        exercise->data.exercise.sets = sets;
+        exercise->data.exercise.rest = rest;
+        exercise->data.exercise.catalogId = catalogId;
+    }
+    return day;
+}
+
+// A plan body, to be interned as the parser interns the plans it builds
+static ASTNode* readPlan(ByteReader* reader, Allocator* allocator) {
+    int32_t count;
+    ASTNode* plan = readNamed(reader, allocator, NODE_PLAN);
+    if (plan == NULL || !readCount(reader, &count)) {
+        freeAST(plan);
+        return NULL;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        ASTNode* day = readDay(reader, allocator);
+        if (day == NULL || !addASTChildNode(plan, day)) {
+            freeAST(day);
+            freeAST(plan);
+            return NULL;
+        }
+    }
+    return plan;
+}
+
+// An earlier statement of the unit being read, which must be of the given type
+static ASTNode* readStatementIndex(ByteReader* reader, const ASTNode* root, NodeType type) {
+    int32_t index;
+    if (!readInt(reader, &index) || index < 0 || index >= root->childrenCount || root->children[index]->type != type) {
+        return NULL;
+    }
+    return retainASTNode(root->children[index]);
+}
+
+static ASTNode* readAssignment(ByteReader* reader, Allocator* allocator, struct NodeTable* nodes, const ASTNode* root) {
+    size_t offset;
+    uint8_t part;
+    if (!readOffset(reader, &offset) || !readBytes(reader, &part, sizeof(part))) {
+        return NULL;
+    }
+    ASTNode* client = (part == PART_STATEMENT) ? readStatementIndex(reader, root, NODE_GROUP) :
+                      (part == PART_NAME) ? readNamed(reader, allocator, NODE_CLIENT_PROFILE) : NULL;
+    if (client == NULL || !readBytes(reader, &part, sizeof(part))) {
+        freeAST(client);
+        return NULL;
+    }
+    ASTNode* plan = (part == PART_STATEMENT) ? readStatementIndex(reader, root, NODE_PLAN) :
+                    (part == PART_NAME) ? readNamed(reader, allocator, NODE_IDENTIFIER) :
+                    (part == PART_BODY) ? internNode(nodes, readPlan(reader, allocator)) : NULL;
+    ASTNode* assignment = (plan != NULL) ? createASTNodeWithAllocator(allocator, NODE_ASSIGNMENT, NULL, 0) : NULL;
+    if (assignment == NULL) {
+        freeAST(plan);
+        freeAST(client);
+        return NULL;
+    }
+    assignment->offset = offset;
+    assignment->data.assignment.client = client;
+    assignment->data.assignment.plan = plan;
+    if (plan->type == NODE_PLAN) {
+        hashAssignment(assignment);
+    }
+    return assignment;
+}
+
+static ASTNode* readStatement(ByteReader* reader, Allocator* allocator, struct NodeTable* nodes, const ASTNode* root) {
+    uint8_t type;
+    if (!readBytes(reader, &type, sizeof(type))) {
+        return NULL;
+    }
+    switch (type) {
+        case NODE_IMPORT:
+        case NODE_CLIENT_PROFILE:
+        case NODE_SHOW_PLANS:
+            return readNamed(reader, allocator, (NodeType)type);
+        case NODE_PLAN: {
+            ASTNode* plan = readPlan(reader, allocator);
+            internDefinition(nodes, plan);
+            return plan;
+        }
+        case NODE_DAY:
+            return readDay(reader, allocator);
+        case NODE_GROUP: {
+            int32_t count;
+            ASTNode* group = readNamed(reader, allocator, NODE_GROUP);
+            if (group == NULL || !readCount(reader, &count)) {
+                freeAST(group);
+                return NULL;
+            }
+            for (int32_t i = 0; i < count; i++) {
+                ASTNode* member = readNamed(reader, allocator, NODE_IDENTIFIER);
+                if (member == NULL || !addASTChildNode(group, member)) {
+                    freeAST(member);
+                    freeAST(group);
+                    return NULL;
+                }
+            }
+            return group;
+        }
+        case NODE_ASSIGNMENT:
+            return readAssignment(reader, allocator, nodes, root);
+        default:
+            return NULL;
+    }
+}
+
+// Rebuild a unit's tree and table from an object
+static bool deserializeUnit(ByteReader* reader, const UnitOptions* options, Unit* unit,
+                            unsigned long sourceHash, bool imported) {
+    int32_t magic, count;
+    uint32_t checksum;
+    size_t hash, stamp;
+    const char* realPath;
+    // Nothing is read from a damaged object: the checksum covers all but the header
+    if (!readInt(reader, &magic) || (uint32_t)magic != OBJECT_MAGIC || !readBytes(reader, &checksum, sizeof(checksum)) ||
+        checksum != objectChecksum(reader->data, reader->length) || !readOffset(reader, &hash) ||
+        hash != sourceHash || !readOffset(reader, &stamp) || stamp != options->catalogStamp ||
+        (realPath = readString(reader)) == NULL ||
+        strcmp(realPath, unit->realPath) != 0 || !readCount(reader, &count)) {
+        return false;
+    }
+
+    unit->root = createASTNodeWithAllocator(options->nodeAllocator, NODE_MAIN, NULL, 0);
+    if (unit->root == NULL) {
+        return false;
+    }
+    for (int32_t i = 0; i < count; i++) {
+        ASTNode* statement = readStatement(reader, options->nodeAllocator, options->nodes, unit->root);
+        if (statement == NULL || !addASTChildNode(unit->root, statement)) {
+            freeAST(statement);
+            return false;
+        }
+    }
+    // External references go in first, while no name is declared to hide them
+    struct SymbolTable* table = createSymbolTableWithAllocator(options->allocator);
+    unit->table = table;
+    if (table == NULL || !readCount(reader, &count)) {
+        return false;
+    }
+    table->acceptImports = 1;
+    table->openUnit = 1;
+    for (int32_t i = 0; i < count; i++) {
+        size_t offset;
+        int32_t type;
+        const char* name = readString(reader);
+        if (name == NULL || !readOffset(reader, &offset) || !readInt(reader, &type) ||
+            referExternal(table, name, type, offset) != SEMANTIC_OK) {
+            return false;
+        }
+    }
+
+    // A unit compiled open is the same compiled closed unless it has external
+    // references: a main file without imports must report those as errors
+    table->openUnit = imported || leadingImports(unit->root) > 0;
+    if (count > 0 && !table->openUnit) {
+        return false;
+    }
+
+    unit->firstExport = 0;
+    if (!readCount(reader, &count)) {
+        return false;
+    }
+    if (count > 0 && (unit->exportStatements = allocMemory(options->allocator, count * sizeof(int))) == NULL) {
+        return false;
+    }
+    unit->exportStatementCount = count;
+    for (int32_t i = 0; i < count; i++) {
+        int32_t type, statement;
+        const char* name = readString(reader);
+        if (name == NULL || !readInt(reader, &type) || !readInt(reader, &statement) || statement < 0 ||
+            statement >= unit->root->childrenCount || !addSymbol(table, name, type, 0)) {
+            return false;
+        }
+        unit->exportStatements[i] = statement;
+        ASTNode* definition = unit->root->children[statement];
+        if (type == TYPE_PLAN || type == TYPE_GROUP) {
+            if (definition->type != ((type == TYPE_PLAN) ? NODE_PLAN : NODE_GROUP)) {
+                return false;
+            }
+            table->symbols[table->size - 1].value.node = definition;
+        }
+    }
+    return readOffset(reader, &unit->span) && reader->position == reader->length;
+}
+
+// Drop whatever a failed load left in the unit
+static void clearUnit(Allocator* allocator, Unit* unit) {
+    if (unit->exportStatements != NULL) {
+        releaseMemory(allocator, unit->exportStatements, unit->exportStatementCount * sizeof(int));
+        unit->exportStatements = NULL;
+        unit->exportStatementCount = 0;
+    }
+    freeAST(unit->root);
+    freeSymbolTable(unit->table);
+    unit->root = NULL;
+    unit->table = NULL;
+}
+
+// Load a unit from its object, if there is one that matches the file; any
+// mismatch or damage means the file is compiled again
+static bool loadObject(const UnitOptions* options, Unit* unit, const char* objectPath,
+                       unsigned long sourceHash, bool imported) {
+    FILE* file = fopen(objectPath, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    struct stat status;
+    unsigned char* data = NULL;
+    size_t length = 0;
+    if (fstat(fileno(file), &status) == 0 && status.st_size > 0) {
+        length = (size_t)status.st_size;
+        data = allocMemory(options->allocator, length);
+    }
+    bool loaded = data != NULL && fread(data, 1, length, file) == length;
+    fclose(file);
+
+    if (loaded) {
+        ByteReader reader = { data, length, 0 };
+        loaded = deserializeUnit(&reader, options, unit, sourceHash, imported);
+    }
+    if (!loaded) {
+        clearUnit(options->allocator, unit);
+    }
+    releaseMemory(options->allocator, data, length);
+    return loaded;
+}
+
+/***
+ * Units
+*/
+
+static Unit* createUnit(Program* program, const char* path, const char* realPath) {
+    if (program->count == program->capacity) {
+        int newCapacity = (program->capacity == 0) ? 8 : program->capacity * 2;
+        Unit** resized = reallocMemory(program->allocator, program->units,
+            program->capacity * sizeof(Unit*), newCapacity * sizeof(Unit*));
+        if (resized == NULL) {
+            return NULL;
+        }
+        program->units = resized;
+        program->capacity = newCapacity;
+    }
+    Unit* unit = allocMemory(program->allocator, sizeof(Unit));
+    if (unit == NULL) {
+        return NULL;
+    }
+    memset(unit, 0, sizeof(Unit));
+    unit->position = -1;
+    unit->path = allocString(program->allocator, path);
+    unit->realPath = allocString(program->allocator, realPath);
+    program->units[program->count++] = unit;
+    return (unit->path != NULL && unit->realPath != NULL) ? unit : NULL;
+}
+
+static void freeUnit(Allocator* allocator, Unit* unit) {
+    clearUnit(allocator, unit);
+    releaseMemory(allocator, unit->imports, unit->importCount * sizeof(Unit*));
+    releaseString(allocator, unit->path);
+    releaseString(allocator, unit->realPath);
+    releaseMemory(allocator, unit, sizeof(Unit));
+}
+
+// Load the unit from its object, or compile it (and save its object)
+static int compileUnit(Program* program, const UnitOptions* options, Unit* unit, bool imported) {
+    // The main file's table starts with the predeclared names, which an object would not have
+    const struct SymbolTable* predeclared = imported ? NULL : options->predeclared;
+    bool useObjects = options->objectDirectory != NULL && (predeclared == NULL || predeclared->size == 0);
+    char objectPath[PATH_MAX];
+    unsigned long sourceHash = 0;
+    if (useObjects && objectPathFor(options->objectDirectory, unit->realPath, objectPath, sizeof(objectPath))) {
+        sourceHash = hashFile(unit->path);
+    }
+    if (sourceHash != 0 && loadObject(options, unit, objectPath, sourceHash, imported)) {
+        unit->loaded = true;
+        program->loadedCount++;
+        return UNIT_OK;
+    }
+
+    struct SymbolTable* table = createSymbolTableWithAllocator(options->allocator);
+    unit->table = table;
+    if (table == NULL) {
+        return UNIT_ERROR_NO_MEMORY;
+    }
+    table->acceptImports = 1;
+    table->openUnit = imported;
+    for (int i = 0; predeclared != NULL && i < predeclared->size; i++) {
+        if (!addSymbol(table, predeclared->symbols[i].name, predeclared->symbols[i].type, 0)) {
+            return UNIT_ERROR_NO_MEMORY;
+        }
+    }
+    unit->firstExport = table->size;
+
+    unit->root = options->compile(options->compilerData, unit->path, table);
+    if (unit->root == NULL) {
+        return UNIT_ERROR_FAILED;
+    }
+    if (!findExportStatements(options->allocator, unit)) {
+        return UNIT_ERROR_NO_MEMORY;
+    }
+    unit->span = assignmentSpan(unit->root);
+    if (sourceHash != 0) {
+        saveObject(options->allocator, unit, objectPath, sourceHash, options->catalogStamp);
+    }
+    return UNIT_OK;
+}
+
+// Compile the unit at path and, depth first, the units it imports. importer
+// and importOffset locate the import that named it (NULL for the main file).
+static int visitUnit(Program* program, const UnitOptions* options, const char* path,
+                     const Unit* importer, size_t importOffset, Unit** result) {
+    char* realPath = realpath(path, NULL);
+    if (realPath == NULL && importer != NULL) {
+        reportAt(program, importer, importOffset, "Unable to read '%s': %s", path, sourceErrorString(SOURCE_ERROR_IO));
+        return UNIT_ERROR_FAILED;
+    }
+
+    // The main file is never found again here, so an unresolved path is only reported by its compile
+    const char* key = (realPath != NULL) ? realPath : path;
+    for (int i = 0; i < program->count; i++) {
+        Unit* seen = program->units[i];
+        if (strcmp(seen->realPath, key) == 0) {
+            free(realPath);
+            if (seen->position < 0) {
+                reportAt(program, importer, importOffset, "Semantic analysis failed: %s", semanticErrorString(CYCLIC_DEPENDENCY));
+                return UNIT_ERROR_FAILED;
+            }
+            *result = seen;
+            return UNIT_OK;
+        }
+    }
+
+    Unit* unit = createUnit(program, path, key);
+    free(realPath);
+    if (unit == NULL) {
+        return UNIT_ERROR_NO_MEMORY;
+    }
+    int status = compileUnit(program, options, unit, importer != NULL);
+    if (status != UNIT_OK) {
+        return status;
+    }
+
+    int count = leadingImports(unit->root);
+    if (count > 0) {
+        unit->imports = allocMemory(program->allocator, count * sizeof(Unit*));
+        if (unit->imports == NULL) {
+            return UNIT_ERROR_NO_MEMORY;
+        }
+        memset(unit->imports, 0, count * sizeof(Unit*));
+        unit->importCount = count;
+    }
+    for (int i = 0; i < count; i++) {
+        const ASTNode* import = unit->root->children[i];
+        char* importPath = importedPath(program->allocator, unit->path, import->data.import.path);
+        if (importPath == NULL) {
+            return UNIT_ERROR_NO_MEMORY;
+        }
+        status = visitUnit(program, options, importPath, unit, import->offset, &unit->imports[i]);
+        releaseString(program->allocator, importPath);
+        if (status != UNIT_OK) {
+            return status;
+        }
+    }
+    unit->position = program->linked++;
+    *result = unit;
+    return UNIT_OK;
+}
+
+/***
+ * Link step
+*/
+
+static LinkSymbol* findLinkSymbol(const LinkTable* table, const char* name, unsigned long hash) {
+    int slot = (int)(hash & (unsigned long)(table->capacity - 1));
+    while (table->slots[slot].name != NULL &&
+           (table->slots[slot].hash != hash || strcmp(table->slots[slot].name, name) != 0)) {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return &table->slots[slot];
+}
+
+static LinkSymbol* lookupLinkSymbol(const LinkTable* table, const char* name) {
+    LinkSymbol* symbol = findLinkSymbol(table, name, hashBytes(1469598103934665603UL, name, strlen(name)));
+    return (symbol->name != NULL) ? symbol : NULL;
+}
+
+static bool sees(const LinkTable* table, int position, int other) {
+    return (table->visible[position * table->rowBytes + other / 8] >> (other % 8)) & 1;
+}
+
+// A unit may use the names of every unit it imports, directly or not
+static void findVisibleUnits(const Program* program, LinkTable* table) {
+    for (int p = 0; p < program->count; p++) {
+        const Unit* unit = program->units[p];
+        unsigned char* row = &table->visible[p * table->rowBytes];
+        for (int i = 0; i < unit->importCount; i++) {
+            int imported = unit->imports[i]->position;
+            const unsigned char* importedRow = &table->visible[imported * table->rowBytes];
+            row[imported / 8] |= (unsigned char)(1 << (imported % 8));
+            for (size_t b = 0; b < table->rowBytes; b++) {
+                row[b] |= importedRow[b];
+            }
+        }
+    }
+}
+
+// Whether a name declared with the given type satisfies an external reference
+// (TYPE_IDENTIFIER is a client or a group, as in checkAssignmentTarget)
+static bool externalMatches(int expected, int declared) {
+    if (expected == TYPE_IDENTIFIER) {
+        return declared == TYPE_CLIENT || declared == TYPE_GROUP;
+    }
+    return expected == declared;
+}
+
+// Resolve a unit's external references and add the names it declares,
+// in program order so the first error is the one reported
+static int linkUnit(const Program* program, LinkTable* table, const Unit* unit) {
+    const struct SymbolTable* symbols = unit->table;
+    int exports = exportCount(unit);
+    int e = 0;
+    int x = 0;
+    while (e < symbols->externalCount || x < exports) {
+        if (x < exports && (e == symbols->externalCount || exportOffset(unit, x) <= symbols->externals[e].offset)) {
+            const struct Symbol* symbol = &symbols->symbols[unit->firstExport + x];
+            unsigned long hash = hashBytes(1469598103934665603UL, symbol->name, strlen(symbol->name));
+            LinkSymbol* slot = findLinkSymbol(table, symbol->name, hash);
+            if (slot->name != NULL) {
+                reportAt(program, unit, exportOffset(unit, x), "Semantic analysis failed: %s", semanticErrorString(REDECLARATION_OF_SYMBOL));
+                return UNIT_ERROR_FAILED;
+            }
+            slot->name = symbol->name;
+            slot->hash = hash;
+            slot->type = symbol->type;
+            slot->position = unit->position;
+            slot->node = (symbol->type == TYPE_PLAN || symbol->type == TYPE_GROUP) ? symbol->value.node : NULL;
+            x++;
+        } else {
+            const struct ExternalReference* external = &symbols->externals[e];
+            const LinkSymbol* symbol = lookupLinkSymbol(table, external->name);
+            if (symbol == NULL || symbol->position == unit->position ||
+                (symbol->position >= 0 && !sees(table, unit->position, symbol->position)) ||
+                !externalMatches(external->type, symbol->type)) {
+                reportAt(program, unit, external->offset, "Semantic analysis failed: %s", semanticErrorString(UNDEFINED_IDENTIFIER));
+                return UNIT_ERROR_FAILED;
+            }
+            e++;
+        }
+    }
+    return UNIT_OK;
+}
+
+// Point a unit's assignments at the plans and groups of other units, and
+// move them past the assignments of the units before it
+static void relocateUnit(const LinkTable* table, Unit* unit, bool groups) {
+    for (int i = 0; i < unit->root->childrenCount; i++) {
+        ASTNode* statement = unit->root->children[i];
+        if (statement->type != NODE_ASSIGNMENT) {
+            continue;
+        }
+        statement->offset += unit->base;
+        if (unit->table->externalCount == 0) {
+            continue;
+        }
+        ASTNode* plan = statement->data.assignment.plan;
+        if (plan->type == NODE_IDENTIFIER) {
+            const LinkSymbol* symbol = lookupLinkSymbol(table, plan->data.identifier.name);
+            if (symbol != NULL && symbol->node != NULL) {
+                statement->data.assignment.plan = retainASTNode(symbol->node);
+                freeAST(plan);
+                hashAssignment(statement);
+            }
+        }
+        ASTNode* client = statement->data.assignment.client;
+        if (groups && client->type == NODE_CLIENT_PROFILE) {
+            const LinkSymbol* symbol = lookupLinkSymbol(table, client->data.clientProfile.name);
+            if (symbol != NULL && symbol->type == TYPE_GROUP && symbol->position != unit->position) {
+                statement->data.assignment.client = retainASTNode(symbol->node);
+                freeAST(client);
+            }
+        }
+    }
+}
+
+// Link the units, which are in link order, into one program
+static int linkProgram(Program* program, const UnitOptions* options) {
+    int names = (options->predeclared != NULL) ? options->predeclared->size : 0;
+    int statements = 0;
+    for (int p = 0; p < program->count; p++) {
+        names += exportCount(program->units[p]);
+        statements += program->units[p]->root->childrenCount - program->units[p]->importCount;
+    }
+    LinkTable table;
+    table.capacity = 64;
+    while (table.capacity < names * 2) {
+        table.capacity *= 2;
+    }
+    table.rowBytes = (size_t)(program->count + 7) / 8;
+    table.slots = allocMemory(program->allocator, table.capacity * sizeof(LinkSymbol));
+    table.visible = allocMemory(program->allocator, program->count * table.rowBytes);
+    int status = (table.slots != NULL && table.visible != NULL) ? UNIT_OK : UNIT_ERROR_NO_MEMORY;
+
+    if (status == UNIT_OK) {
+        memset(table.slots, 0, table.capacity * sizeof(LinkSymbol));
+        memset(table.visible, 0, program->count * table.rowBytes);
+        findVisibleUnits(program, &table);
+        for (int i = 0; options->predeclared != NULL && i < options->predeclared->size; i++) {
+            const struct Symbol* symbol = &options->predeclared->symbols[i];
+            unsigned long hash = hashBytes(1469598103934665603UL, symbol->name, strlen(symbol->name));
+            LinkSymbol* slot = findLinkSymbol(&table, symbol->name, hash);
+            *slot = (LinkSymbol){ symbol->name, hash, symbol->type, -1, NULL };
+        }
+    }
+    bool groups = false;
+    for (int p = 0; p < program->count && status == UNIT_OK; p++) {
+        status = linkUnit(program, &table, program->units[p]);
+        groups = groups || program->units[p]->table->groupCount > 0;
+    }
+
+    // Every statement but the imports, in link order
+    if (status == UNIT_OK) {
+        program->root = createASTNodeWithAllocator(options->nodeAllocator, NODE_MAIN, NULL, 0);
+        if (program->root != NULL && statements > 0) {
+            program->root->children = allocMemory(options->nodeAllocator, statements * sizeof(ASTNode*));
+        }
+        if (program->root == NULL || (statements > 0 && program->root->children == NULL)) {
+            status = UNIT_ERROR_NO_MEMORY;
+        }
+    }
+    size_t base = 0;
+    for (int p = 0; p < program->count && status == UNIT_OK; p++) {
+        Unit* unit = program->units[p];
+        unit->base = base;
+        base += unit->span;
+        relocateUnit(&table, unit, groups);
+        for (int i = unit->importCount; i < unit->root->childrenCount; i++) {
+            program->root->children[program->root->childrenCount++] = retainASTNode(unit->root->children[i]);
+        }
+    }
+
+    releaseMemory(program->allocator, table.slots, table.capacity * sizeof(LinkSymbol));
+    releaseMemory(program->allocator, table.visible, program->count * table.rowBytes);
+    return status;
+}
+
+/***
+ * Programs
+*/
+
+int buildProgram(const char* path, const UnitOptions* options, Program** result) {
+    *result = NULL;
+    Program* program = allocMemory(options->allocator, sizeof(Program));
+    if (program == NULL) {
+        return UNIT_ERROR_NO_MEMORY;
+    }
+    memset(program, 0, sizeof(Program));
+    program->allocator = options->allocator;
+    program->objects = options->objectDirectory != NULL;
+
+    int status = UNIT_OK;
+    if (options->objectDirectory != NULL && mkdir(options->objectDirectory, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create object directory '%s': %s\n", options->objectDirectory, strerror(errno));
+        status = UNIT_ERROR_FAILED;
+    }
+    Unit* mainUnit = NULL;
+    if (status == UNIT_OK) {
+        status = visitUnit(program, options, path, NULL, NO_SOURCE_OFFSET, &mainUnit);
+    }
+
+    // Units were found depth first; put them in link order
+    Unit** ordered = NULL;
+    if (status == UNIT_OK && (ordered = allocMemory(program->allocator, program->capacity * sizeof(Unit*))) == NULL) {
+        status = UNIT_ERROR_NO_MEMORY;
+    }
+    if (status == UNIT_OK) {
+        for (int i = 0; i < program->count; i++) {
+            ordered[program->units[i]->position] = program->units[i];
+        }
+        releaseMemory(program->allocator, program->units, program->capacity * sizeof(Unit*));
+        program->units = ordered;
+    }
+
+    // A program of one file needs no link
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (status == UNIT_OK && program->count == 1) {
+        program->root = retainASTNode(mainUnit->root);
+    } else if (status == UNIT_OK) {
+        status = linkProgram(program, options);
+    }
+    program->linkMilliseconds = elapsedMilliseconds(&start);
+
+    if (status != UNIT_OK) {
+        freeProgram(program);
+        return status;
+    }
+    *result = program;
+    return UNIT_OK;
+}
+
+void freeProgram(Program* program) {
+    if (program == NULL) {
+        return;
+    }
+    freeAST(program->root);
+    for (int i = 0; i < program->count; i++) {
+        freeUnit(program->allocator, program->units[i]);
+    }
+    releaseMemory(program->allocator, program->units, program->capacity * sizeof(Unit*));
+    releaseMemory(program->allocator, program, sizeof(Program));
+}
+
+ASTNode* programRoot(const Program* program) {
+    return program->root;
+}
+
+const char* locateProgramOffset(const Program* program, size_t offset, size_t* fileOffset) {
+    if (program->count == 1) {
+        *fileOffset = offset;
+        return program->units[0]->path;
+    }
+    for (int p = 0; p < program->count && offset != NO_SOURCE_OFFSET; p++) {
+        const Unit* unit = program->units[p];
+        if (offset >= unit->base && offset - unit->base < unit->span) {
+            *fileOffset = offset - unit->base;
+            return unit->path;
+        }
+    }
+    return NULL;
+}
+
+void printProgramStats(const Program* program) {
+    if (program->count == 1 && !program->objects) {
+        return; // Compiled as a program on its own
+    }
+    printf("Units: %d (%d compiled, %d loaded from objects), linked in %.2f ms\n",
+           program->count, program->count - program->loadedCount, program->loadedCount, program->linkMilliseconds);
+}
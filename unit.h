@@ -0,0 +1,70 @@
+#ifndef UNIT_H
+#define UNIT_H
+
+#include "parser.h"
+#include "semantic.h"
+
+// Separate compilation. A program may be split over several files: a file
+// names the files it uses with import statements, which come before its
+// other statements. Each file is a unit, compiled on its own into a tree and
+// a symbol table. A name a unit uses but does not declare is left as an
+// external reference (semantic.h) instead of being an error.
+//
+// buildProgram follows the imports from the main file, depth first, so every
+// unit comes after the units it imports (files are told apart by their real
+// path; a file that imports itself, directly or not, is an error). The link
+// step then resolves each unit's external references against the names
+// declared by the units it imports, directly or through other imports, and
+// checks that no name is declared twice in the whole program. The linked
+// program is one tree: the units' statements in that order, with references
+// to plans and groups of other units pointing at their definitions, and each
+// unit's assignments moved past those of the units before it so that plan
+// order still follows the program.
+//
+// With an object directory, each unit's checked tree and table are also
+// saved to an object file named after the unit's path, and loaded instead of
+// compiling the file while its text, the catalog and the compiler's format
+// are the same. Only the units that changed are compiled again; linking is
+// always done.
+//
+// A main file without imports is compiled exactly as a program on its own.
+
+#define UNIT_OK 0
+#define UNIT_ERROR_FAILED -1     // A unit failed to compile or link; the diagnostic has been printed
+#define UNIT_ERROR_NO_MEMORY -2
+
+typedef struct Program Program;
+
+// Compile the file at path with table (which says whether the unit is open);
+// returns the checked tree, or NULL after reporting why there is none
+typedef ASTNode* (*UnitCompiler)(void* userData, const char* path, struct SymbolTable* table);
+
+typedef struct {
+    UnitCompiler compile;
+    void* compilerData;
+    Allocator* allocator;                   // Units, symbol tables and the link step
+    Allocator* nodeAllocator;               // Trees loaded from object files and the linked program
+    struct NodeTable* nodes;                // Loaded plans are interned here, as compiled ones are
+    const char* objectDirectory;            // Where object files go (NULL for none)
+    unsigned long catalogStamp;             // Hash of the catalog the units are checked against (0 for none)
+    const struct SymbolTable* predeclared;  // Names every unit may use (NULL for none)
+} UnitOptions;
+
+// Compile, or load, the main file at path and every file it imports, and link them
+int buildProgram(const char* path, const UnitOptions* options, Program** program);
+void freeProgram(Program* program);
+
+// The linked program (owned by the program)
+ASTNode* programRoot(const Program* program);
+
+// File an offset in the linked program comes from, and the offset in that
+// file (NULL if no unit holds it)
+const char* locateProgramOffset(const Program* program, size_t offset, size_t* fileOffset);
+
+// Units compiled and loaded, and the link time (nothing for one file compiled without objects)
+void printProgramStats(const Program* program);
+
+// FNV-1a hash of a file's bytes (0 if it cannot be read)
+unsigned long hashFile(const char* path);
+
+#endif // UNIT_H